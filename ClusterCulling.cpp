@@ -0,0 +1,103 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+CullingView ClusterCulling::ExtractView(const float* objectToClip, const float* eye)
+{
+	CullingView view = {};
+
+	float rows[4][4];
+
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		for (uint32_t column = 0; column < 4; column++)
+		{
+			rows[i][column] = objectToClip[column * 4 + i];
+		}
+	}
+
+	// Left, right, bottom, top, near and far. Vulkan clips depth to 0 <= z <= w, so the near plane is row 2 alone.
+	for (uint32_t column = 0; column < 4; column++)
+	{
+		view.planes[0][column] = rows[3][column] + rows[0][column];
+		view.planes[1][column] = rows[3][column] - rows[0][column];
+		view.planes[2][column] = rows[3][column] + rows[1][column];
+		view.planes[3][column] = rows[3][column] - rows[1][column];
+		view.planes[4][column] = rows[2][column];
+		view.planes[5][column] = rows[3][column] - rows[2][column];
+	}
+
+	for (uint32_t plane = 0; plane < 6; plane++)
+	{
+		float length = std::sqrt(view.planes[plane][0] * view.planes[plane][0] + view.planes[plane][1] * view.planes[plane][1] + view.planes[plane][2] * view.planes[plane][2]);
+
+		if (length > 0.0f)
+		{
+			for (uint32_t k = 0; k < 4; k++)
+			{
+				view.planes[plane][k] /= length;
+			}
+		}
+	}
+
+	memcpy(view.eye, eye, sizeof(view.eye));
+
+	return view;
+}
+
+bool ClusterCulling::IsSphereVisible(const CullingView& view, const float* center, float radius)
+{
+	for (const float* plane : view.planes)
+	{
+		if (plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3] < -radius)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ClusterCulling::IsMeshletVisible(const CullingView& view, const MeshFileMeshlet& meshlet)
+{
+	if (!IsSphereVisible(view, meshlet.center, meshlet.radius))
+	{
+		return false;
+	}
+
+	float direction[3] = { meshlet.center[0] - view.eye[0], meshlet.center[1] - view.eye[1], meshlet.center[2] - view.eye[2] };
+
+	float distance = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+
+	// Every triangle faces away from the eye
+	float dot = direction[0] * meshlet.coneAxis[0] + direction[1] * meshlet.coneAxis[1] + direction[2] * meshlet.coneAxis[2];
+
+	return dot < meshlet.coneCutoff * distance + meshlet.radius;
+}
+
+uint32_t ClusterCulling::CullMeshlets(const CullingView& view, std::span<const MeshFileMeshlet> meshlets, std::vector<IndexRange>& ranges)
+{
+	uint32_t visibleCount = 0;
+
+	for (const MeshFileMeshlet& meshlet : meshlets)
+	{
+		if (!IsMeshletVisible(view, meshlet))
+		{
+			continue;
+		}
+
+		visibleCount++;
+
+		if (!ranges.empty() && ranges.back().firstIndex + ranges.back().indexCount == meshlet.firstIndex)
+		{
+			ranges.back().indexCount += meshlet.indexCount;
+		}
+		else
+		{
+			ranges.push_back({ meshlet.firstIndex, meshlet.indexCount });
+		}
+	}
+
+	return visibleCount;
+}
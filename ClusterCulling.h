@@ -0,0 +1,32 @@
+#pragma once
+
+// Frustum and eye position in the object space of one instance, so meshlet bounds are tested without transforming them
+struct CullingView
+{
+	// Normalized planes, a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all six
+	float planes[6][4];
+
+	float eye[3];
+};
+
+// A contiguous run of visible indices
+struct IndexRange
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+};
+
+// CPU side meshlet culling. Back facing assumes counter-clockwise front faces in object space, as written by the cooker.
+class ClusterCulling
+{
+public:
+	// objectToClip is a column-major model-view-projection matrix with Vulkan's 0 to 1 depth range
+	static CullingView ExtractView(const float* objectToClip, const float* eye);
+
+	static bool IsSphereVisible(const CullingView& view, const float* center, float radius);
+
+	static bool IsMeshletVisible(const CullingView& view, const MeshFileMeshlet& meshlet);
+
+	// Appends the index ranges of visible meshlets, merging neighbours that stay contiguous. Returns the visible count.
+	static uint32_t CullMeshlets(const CullingView& view, std::span<const MeshFileMeshlet> meshlets, std::vector<IndexRange>& ranges);
+};
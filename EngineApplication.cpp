@@ -3,52 +3,245 @@
 
 #include "core.h"
 
-EngineApplication::EngineApplication()
+EngineApplication::EngineApplication(bool headless) : m_headless(headless)
 {
+	if (m_headless)
+	{
+		m_renderer = new EngineRenderer(1280u, 720u);
+		m_eventManager = new EventManager(new HeadlessEventSource());
+
+		return;
+	}
+
+#ifdef _WIN32
 	m_window = new EngineWindow(L"CARDINAL_WINDOW", 1280, 720);
 	m_renderer = new EngineRenderer(m_window);
+	m_eventManager = new EventManager(new Win32EventSource());
+#else
+	throw std::runtime_error("WINDOWED MODE IS ONLY SUPPORTED ON WIN32, RUN WITH --headless");
+#endif // _WIN32
 }
 
 EngineApplication::~EngineApplication() 
 {
+#ifdef _WIN32
 	delete m_window;
+#endif // _WIN32
 	delete m_renderer;
+	delete m_eventManager;
 }
 
 void EngineApplication::Init()
 {
+	m_jobSystem.Init();
+
+	m_renderer->SetJobSystem(&m_jobSystem);
+	m_renderer->SetTransformHierarchy(&m_transforms);
+
 	m_renderer->Init();
 
+	CreateScene();
+
+	m_eventManager->Subscribe(EventType::Quit, [this](const Event&) { this->m_isApplicationRunning = false; });
+
 	this->m_isApplicationRunning = true;
 }
 
+void EngineApplication::CreateScene()
+{
+	if (!m_renderer->IsGpuSceneAvailable())
+	{
+		return;
+	}
+
+	GpuScene& scene = m_renderer->GetGpuScene();
+
+	CookedMesh cookedMesh;
+
+	if (!cookedMesh.Open(SCENE_MESH_PATH))
+	{
+		return;
+	}
+
+	// The copies are staged before AddMesh returns, the file can be closed right away
+	uint32_t mesh = scene.AddMesh(cookedMesh);
+
+	cookedMesh.Close();
+
+	if (mesh == INVALID_GPU_SCENE_INDEX)
+	{
+		return;
+	}
+
+	GraphicsPipelineDesc desc;
+	desc.vertexShader = GpuScene::VERTEX_SHADER_PATH;
+	desc.fragmentShader = "shaders/fragment_shader.spv";
+	desc.layout = scene.GetDrawPipelineLayout();
+	desc.depthTest = true;
+	desc.depthWrite = true;
+
+	// Cooked meshes wind counter-clockwise, which the Y flip of Mat4::Perspective keeps on screen
+	desc.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+	scene.FillVertexInput(desc);
+
+	m_renderer->SetGpuScenePipeline(m_renderer->RegisterPipeline(desc));
+
+	m_sceneRoot = m_transforms.CreateNode();
+
+	float gridOffset = (SCENE_GRID_SIZE - 1) * SCENE_GRID_SPACING * 0.5f;
+
+	for (uint32_t z = 0; z < SCENE_GRID_SIZE; z++)
+	{
+		for (uint32_t x = 0; x < SCENE_GRID_SIZE; x++)
+		{
+			uint32_t node = m_transforms.CreateNode(m_sceneRoot);
+
+			m_transforms.SetLocalPosition(node, Vec3(x * SCENE_GRID_SPACING - gridOffset, 0.0f, z * SCENE_GRID_SPACING - gridOffset));
+
+			scene.AddNodeInstance(mesh, node);
+		}
+	}
+
+	Logger::Info("GPU SCENE CREATED WITH %u INSTANCES OF %s", scene.GetInstanceCount(), SCENE_MESH_PATH);
+}
+
 void EngineApplication::Shutdown()
 {
+	if (m_headless && !m_capturePath.empty())
+	{
+		std::vector<uint8_t> pixels;
+		uint32_t width, height;
+
+		if (m_renderer->CaptureFrame(pixels, &width, &height))
+		{
+			std::ofstream file(m_capturePath, std::ios::binary);
+
+			file << "P6\n" << width << " " << height << "\n255\n";
+
+			for (size_t i = 0; i < pixels.size(); i += 4)
+			{
+				file.write(reinterpret_cast<const char*>(&pixels[i]), 3);
+			}
+
+			Logger::Info("CAPTURED FRAME TO %s", m_capturePath.c_str());
+		}
+	}
+
 	vkDeviceWaitIdle(m_renderer->GetVkDevice());
 
 	m_renderer->Destroy();
+
+	m_jobSystem.Destroy();
 }
 
-void EngineApplication::Update()
+void EngineApplication::Run()
 {
-	PollEvents();
+	using Clock = std::chrono::steady_clock;
 
-	m_renderer->DrawFrame();
-}
+	Clock::time_point previousTime = Clock::now();
+	Clock::time_point reportTime = previousTime;
 
-void EngineApplication::PollEvents()
-{
-	if(GetMessage(&m_MSG, m_window->GetWindow(), 0, 0) > 0)
+	double accumulator = 0.0;
+	double cpuTimeSum = 0.0;
+	uint32_t reportFrames = 0;
+
+	while (m_isApplicationRunning)
 	{
-		if (m_MSG.message == WM_QUIT)
+		Clock::time_point frameStart = Clock::now();
+
+		// Clamp long stalls (debugger, window drag) so the simulation does not try to catch up for seconds
+		double elapsed = (std::min)(std::chrono::duration<double>(frameStart - previousTime).count(), FIXED_TIMESTEP * MAX_FIXED_STEPS_PER_FRAME);
+		previousTime = frameStart;
+
+		accumulator += elapsed;
+
+		PollEvents();
+
+		while (accumulator >= FIXED_TIMESTEP)
 		{
-			this->m_isApplicationRunning = false;
-			PostQuitMessage(0);
+			FixedUpdate(FIXED_TIMESTEP);
+
+			accumulator -= FIXED_TIMESTEP;
+		}
+
+		Render(accumulator / FIXED_TIMESTEP);
+
+		cpuTimeSum += std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+		reportFrames++;
+
+		if (frameStart - reportTime >= std::chrono::seconds(1))
+		{
+			m_cpuFrameTime = cpuTimeSum / reportFrames;
+
+			Logger::Info("CPU FRAME TIME %.3f MS (%u FRAMES)", m_cpuFrameTime, reportFrames);
+
+			if (m_renderer->IsGpuSceneAvailable() && !m_renderer->GetGpuScene().IsEmpty())
+			{
+				GpuCullingStats stats = m_renderer->GetGpuCullingStats();
+
+				Logger::Info("GPU CULLING: %u INSTANCES, %u DRAWN, %u FRUSTUM REJECTED, %u OCCLUSION REJECTED", stats.instances, stats.drawn, stats.frustumRejected, stats.occlusionRejected);
+			}
+
+			cpuTimeSum = 0.0;
+			reportFrames = 0;
+			reportTime = frameStart;
 		}
-		else
+
+		m_frameCount++;
+
+		if (m_frameLimit != 0 && m_frameCount >= m_frameLimit)
 		{
-			TranslateMessage(&m_MSG);
-			DispatchMessage(&m_MSG);
+			this->m_isApplicationRunning = false;
 		}
 	}
 }
+
+void EngineApplication::PollEvents()
+{
+	m_eventManager->PumpEvents();
+}
+
+void EngineApplication::FixedUpdate(double deltaTime)
+{
+	// Simulation systems advance here in steps of exactly deltaTime
+	m_systems.Run(m_world, m_jobSystem, static_cast<float>(deltaTime));
+
+	m_previousSceneAngle = m_sceneAngle;
+	m_sceneAngle += SCENE_SPIN_SPEED * deltaTime;
+}
+
+void EngineApplication::Render(double alpha)
+{
+	// alpha is the fraction of a fixed step accumulated since the last FixedUpdate, so the grid moves smoothly at any frame rate
+	if (m_sceneRoot != INVALID_TRANSFORM_NODE)
+	{
+		double angle = m_previousSceneAngle + (m_sceneAngle - m_previousSceneAngle) * alpha;
+
+		m_transforms.SetLocalRotation(m_sceneRoot, Quat::FromAxisAngle(Vec3(0.0f, 1.0f, 0.0f), static_cast<float>(angle)));
+
+		VkExtent2D extent = m_renderer->GetSwapChainExtent();
+
+		float fovY = 1.0f;
+		float aspect = static_cast<float>(extent.width) / static_cast<float>((std::max)(extent.height, 1u));
+
+		Vec3 eye(0.0f, 20.0f, 40.0f);
+
+		Mat4 viewProjection = Mat4::Perspective(fovY, aspect, 0.1f, 500.0f) * Mat4::LookAt(eye, Vec3(0.0f, 0.0f, 0.0f), Vec3(0.0f, 1.0f, 0.0f));
+
+		m_renderer->SetGpuSceneView(viewProjection.Data(), &eye.x, extent.height / (2.0f * std::tan(fovY * 0.5f)));
+	}
+	else
+	{
+		DrawCommand triangle;
+		triangle.pipeline = m_renderer->GetDefaultPipeline();
+		triangle.vertexCount = 3;
+
+		m_renderer->SubmitDraw(triangle);
+	}
+
+	// Only changed subtrees are recomputed, a still scene costs one flag check per level
+	m_transforms.Update(&m_jobSystem);
+
+	m_renderer->DrawFrame();
+}
@@ -3,26 +3,88 @@
 class EngineApplication
 {
 public:
-	EngineApplication();
+	EngineApplication(bool headless = false);
 	~EngineApplication();
 
+public:
+	static constexpr double FIXED_TIMESTEP = 1.0 / 60.0;
+	static constexpr uint32_t MAX_FIXED_STEPS_PER_FRAME = 5;
+
+	// Cooked by the build from primitives/Cube.fbx, drawn as a grid of instances through the GPU scene
+	static constexpr const char* SCENE_MESH_PATH = "primitives/Cube.cmesh";
+	static constexpr uint32_t SCENE_GRID_SIZE = 16;
+	static constexpr float SCENE_GRID_SPACING = 3.0f;
+
+	// Radians per second the grid turns about the Y axis
+	static constexpr double SCENE_SPIN_SPEED = 0.25;
+
 public:
 	void Init();
 	void Shutdown();
-	void Update();
+
+	// Runs the main loop until the application quits: fixed timestep simulation, one render per iteration
+	void Run();
 
 	bool IsApplicationRunning() { return this->m_isApplicationRunning; }
 
+	// Average CPU time of one loop iteration over the last report interval, in milliseconds
+	double GetCpuFrameTime() { return this->m_cpuFrameTime; }
+
+	// Stops the application after the given number of frames, 0 runs until the window is closed
+	void SetFrameLimit(uint64_t frameLimit) { this->m_frameLimit = frameLimit; }
+
+	// Headless only: the last frame is written to this path as a binary PPM on shutdown
+	void SetCapturePath(const std::string& capturePath) { this->m_capturePath = capturePath; }
+
+	JobSystem& GetJobSystem() { return this->m_jobSystem; }
+
+	// Scene data, simulated by the systems on every fixed step
+	EntityWorld& GetWorld() { return this->m_world; }
+	SystemScheduler& GetSystems() { return this->m_systems; }
+
+	// Scene graph, updated once per rendered frame and drawn through the GPU scene's node instances
+	TransformHierarchy& GetTransforms() { return this->m_transforms; }
+
 private:
 
 	bool m_isApplicationRunning = false;
+	bool m_headless = false;
+
+	uint64_t m_frameCount = 0;
+	uint64_t m_frameLimit = 0;
+
+	double m_cpuFrameTime = 0.0;
+
+	std::string m_capturePath;
+
+	// Started first and stopped last, every other system may hand work to it
+	JobSystem m_jobSystem;
 
 	EngineWindow* m_window = nullptr;
 	EngineRenderer* m_renderer = nullptr;
 
-	MSG m_MSG = {};
+	EventManager* m_eventManager = nullptr;
+
+	EntityWorld m_world;
+	SystemScheduler m_systems;
+
+	TransformHierarchy m_transforms;
+
+	// Parent of every scene instance's node, INVALID_TRANSFORM_NODE when the GPU scene could not be set up
+	uint32_t m_sceneRoot = INVALID_TRANSFORM_NODE;
+
+	// Grid rotation before and after the last fixed step, rendered in between
+	double m_previousSceneAngle = 0.0;
+	double m_sceneAngle = 0.0;
 
 private:
+	// Falls back to the built-in triangle when the device has no GPU scene or the mesh cannot be loaded
+	void CreateScene();
+
 	void PollEvents();
+
+	void FixedUpdate(double deltaTime);
+
+	void Render(double alpha);
 };
 
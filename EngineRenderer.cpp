@@ -2,14 +2,42 @@
 #include "cardinal.h"
 #include "core.h"
 
-EngineRenderer::EngineRenderer(EngineWindow* window) 
+uint32_t GpuMesh::SelectLod(float distance, float pixelsPerUnit, float maxPixelError) const
+{
+	if (lodCount == 0)
+	{
+		return 0;
+	}
+
+	// Inside the bounds every LOD error is visible, stay on full detail
+	if (distance <= 0.0f)
+	{
+		return 0;
+	}
+
+	uint32_t selected = 0;
+
+	// LOD errors only grow along the chain
+	for (uint32_t lod = 1; lod < lodCount; lod++)
+	{
+		if (lods[lod].error * pixelsPerUnit / distance > maxPixelError)
+		{
+			break;
+		}
+
+		selected = lod;
+	}
+
+	return selected;
+}
+
+EngineRenderer::EngineRenderer(EngineWindow* window, uint32_t framesInFlight) 
 {
 	this->m_window = window;
 
-	this->m_imageAvailableSemaphore = {};
-	this->m_renderFinishedSemaphore = {};
+	this->m_framesInFlight = (std::max)(framesInFlight, 1u);
+
 	this->m_swapChainExtent = {};
-	this->m_inFlightFence = {};
 
 	this->m_device = VK_NULL_HANDLE;
 
@@ -24,11 +52,6 @@ EngineRenderer::EngineRenderer(EngineWindow* window)
 
 	this->m_swapChain = VK_NULL_HANDLE;
 
-	this->m_commandPool = VK_NULL_HANDLE;
-	this->m_commandBuffer = VK_NULL_HANDLE;
-
-	this->m_graphicsPipeline = VK_NULL_HANDLE;
-
 	this->m_swapChainImageFormat = VK_FORMAT_UNDEFINED;
 
 	this->m_pipelineLayout = VK_NULL_HANDLE;
@@ -38,6 +61,13 @@ EngineRenderer::EngineRenderer(EngineWindow* window)
 	this->m_physicalDevice = VK_NULL_HANDLE;
 }
 
+EngineRenderer::EngineRenderer(uint32_t width, uint32_t height, uint32_t framesInFlight) : EngineRenderer(nullptr, framesInFlight)
+{
+	this->m_headless = true;
+
+	this->m_swapChainExtent = { width, height };
+}
+
 EngineRenderer::~EngineRenderer() { }
 
 bool EngineRenderer::Init()
@@ -51,53 +81,134 @@ bool EngineRenderer::Init()
 
 	CreateInstance();
 	SetupDebugMessenger();
-	CreateSurface();
+
+	if (!m_headless)
+	{
+		CreateSurface();
+	}
+
 	PickPhysicalDevice();
 	CreateLogicalDevice();
-	CreateSwapChain();
+
+	m_allocator = new MemoryAllocator(m_physicalDevice, m_device);
+
+	VkResult result = m_pipelineCache.Init(m_physicalDevice, m_device, PIPELINE_CACHE_PATH);
+
+	// Not fatal, pipelines are then compiled without a cache on every run
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE PIPELINE CACHE");
+		Logger::Error("%s", string_VkResult(result));
+	}
+
+	if (m_headless)
+	{
+		CreateOffscreenTargets();
+	}
+	else
+	{
+		CreateSwapChain();
+	}
+
 	CreateImageViews();
+
+	m_depthFormat = FindDepthFormat();
+
+	VkFormatProperties depthProperties;
+	vkGetPhysicalDeviceFormatProperties(m_physicalDevice, m_depthFormat, &depthProperties);
+
+	m_depthSampleable = (depthProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+
 	CreateRenderPass();
 	CreateGraphicsPipeline();
-	CreateFrameBuffers();
-	CreateCommandPool();
-	CreateCommandBuffer();
-	CreateSyncObjects();
+	CreateFrameResources();
+
+	if (!m_frameArena.Init(m_allocator, FRAME_ARENA_SIZE, m_framesInFlight, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT))
+	{
+		return false;
+	}
+
+	QueueFamilyIndices indicies = FindQueueFamilies(m_physicalDevice);
+
+	bool sharedTransferQueue = m_transferQueue == m_graphicsQueue || m_transferQueue == m_presentQueue;
+
+	if (!m_uploadManager.Init(m_allocator, m_transferQueue, indicies.transferFamily.value_or(indicies.graphicsFamily.value()), indicies.graphicsFamily.value(), sharedTransferQueue ? &m_queueMutex : nullptr))
+	{
+		return false;
+	}
+
+	// Not fatal, draws submitted through SubmitDraw keep working without it
+	m_gpuSceneAvailable = m_gpuScene.Init(m_device, m_allocator, &m_uploadManager, &m_pipelineCache, m_frameArena, m_gpuSceneFeatures, m_framesInFlight, [this](std::function<void()> release) { DeferRelease(std::move(release)); });
+
+	if (!m_gpuSceneAvailable)
+	{
+		Logger::Warn("GPU SCENE UNAVAILABLE");
+	}
+
+	// Built once the GPU scene is known, its occlusion passes depend on it
+	m_renderGraph.Init(m_device, m_allocator, [this](std::function<void()> release) { DeferRelease(std::move(release)); });
+
+	BuildRenderGraph();
+
+	m_pipelineCache.LogStats();
 
-	Logger::Info("ENGINE RENDERER INITIALIZED");
+	Logger::Info("ENGINE RENDERER INITIALIZED WITH %u FRAMES IN FLIGHT%s", m_framesInFlight, m_headless ? " (HEADLESS)" : "");
 
 	return true;
 }
 
 bool EngineRenderer::Destroy()
 {
-	vkDestroySemaphore(m_device, m_renderFinishedSemaphore, nullptr);
-	vkDestroySemaphore(m_device, m_imageAvailableSemaphore, nullptr);
-	vkDestroyFence(m_device, m_inFlightFence, nullptr);
+	DestroyFrameResources();
 
-	vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+	m_renderGraph.Destroy();
 
-	for (auto framebuffer : m_swapChainFrameBuffers) 
-	{
-		vkDestroyFramebuffer(m_device, framebuffer, nullptr);
-	}
+	m_gpuScene.Destroy();
 
-	vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
+	m_uploadManager.Destroy();
+	m_frameArena.Destroy();
+
+	m_pipelineRegistry.Destroy();
 	vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
 	vkDestroyRenderPass(m_device, m_renderPass, nullptr);
+	vkDestroyRenderPass(m_device, m_depthRenderPass, nullptr);
 
 	for (auto imageView : m_swapChainImageViews) 
 	{
 		vkDestroyImageView(m_device, imageView, nullptr);
 	}
 
-	vkDestroySwapchainKHR(m_device, m_swapChain, nullptr);
+	if (m_headless)
+	{
+		DestroyOffscreenTargets();
+	}
+	else
+	{
+		for (VkSemaphore semaphore : m_renderFinishedSemaphores)
+		{
+			vkDestroySemaphore(m_device, semaphore, nullptr);
+		}
+
+		vkDestroySwapchainKHR(m_device, m_swapChain, nullptr);
+	}
+
+	m_allocator->LogStats();
+
+	delete m_allocator;
+
+	m_pipelineCache.Destroy();
+
 	vkDestroyDevice(m_device, nullptr);
 
 	if (ENABLE_VALIDATION_LAYERS) {
 		DestroyDebugUtilsMessengerEXT(m_instance, m_debugMessenger, nullptr);
 	}
 
-	vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+	if (!m_headless)
+	{
+		vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+	}
+
 	vkDestroyInstance(m_instance, nullptr);
 
 	return true;
@@ -109,59 +220,173 @@ void EngineRenderer::DrawFrame()
 
 	uint32_t imageIndex;
 
-	result = vkWaitForFences(m_device, 1, &m_inFlightFence, VK_TRUE, UINT64_MAX);
+	FrameResources& frame = m_frames[m_currentFrame];
+
+	// Scene draws inside the frustum join the ones submitted for this frame
+	if (!m_repeatingDraws)
+	{
+		m_visibleSceneDraws.clear();
+
+		if (m_gpuSceneViewSet)
+		{
+			m_sceneTree.QueryFrustum(m_gpuSceneView, m_visibleSceneDraws);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < m_sceneDraws.size(); i++)
+			{
+				if (m_sceneDraws[i].proxy != INVALID_SPATIAL_PROXY)
+				{
+					m_visibleSceneDraws.push_back(i);
+				}
+			}
+		}
+
+		for (uint32_t sceneDraw : m_visibleSceneDraws)
+		{
+			m_drawCommands.push_back(m_sceneDraws[sceneDraw].command);
+		}
+	}
+
+	// Swapping keeps the capacity of both lists, and draws of a skipped frame do not pile up
+	m_frameDrawCommands.swap(m_drawCommands);
+	m_drawCommands.clear();
+
+	// Only wait for the frame that last used this slot, the frames in the other slots keep running on the GPU
+	result = vkWaitForFences(m_device, 1, &frame.inFlightFence, VK_TRUE, UINT64_MAX);
 
 	if (result != VK_SUCCESS)
 	{
 		Logger::Error("WAIT FOR FENCES TIMED OUT");
 		Logger::Error("%s", string_VkResult(result));
 	}
-	
-	result = vkResetFences(m_device, 1, &m_inFlightFence);
 
-	if (result != VK_SUCCESS)
+	FlushReleaseQueue(false);
+
+	// The slot's previous frame has retired, so its transient data can be overwritten
+	m_frameArena.BeginFrame(m_currentFrame);
+
+	// Uploads staged since the last frame go out in one submission and overlap with this frame's rendering
+	m_uploadManager.Flush();
+	m_uploadManager.Update();
+
+#ifdef _WIN32
+	if (!m_headless && m_window->ConsumeResize())
 	{
-		Logger::Error("FAILED TO RESET FENCES");
-		Logger::Error("%s", string_VkResult(result));
+		m_swapChainOutOfDate = true;
+	}
+#endif // _WIN32
+
+	// A minimized window has no drawable area, keep the old swap chain and skip the frame until it is restored
+	if (m_swapChainOutOfDate && !RecreateSwapChain())
+	{
+		return;
+	}
+
+	if (m_headless)
+	{
+		// Each frame slot owns its own offscreen target, so the slot's fence already guards it
+		imageIndex = m_currentFrame;
+	}
+	else
+	{
+		result = vkAcquireNextImageKHR(m_device, m_swapChain, UINT64_MAX, frame.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+
+		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			// Nothing was signaled, so the slot can be reused as is once the swap chain has been recreated
+			m_swapChainOutOfDate = true;
+
+			return;
+		}
+		else if (result == VK_SUBOPTIMAL_KHR)
+		{
+			// The image is still presentable, finish this frame and recreate at the start of the next one
+			m_swapChainOutOfDate = true;
+		}
+		else if (result != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO ACQUIRE THE NEXT IMAGE");
+			Logger::Error("%s", string_VkResult(result));
+
+			return;
+		}
+	}
+
+	// The swap chain may hand back an image that an older frame slot is still rendering into
+	if (m_imagesInFlight[imageIndex] != VK_NULL_HANDLE && m_imagesInFlight[imageIndex] != frame.inFlightFence)
+	{
+		result = vkWaitForFences(m_device, 1, &m_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+
+		if (result != VK_SUCCESS)
+		{
+			Logger::Error("WAIT FOR SWAP CHAIN IMAGE FENCE TIMED OUT");
+			Logger::Error("%s", string_VkResult(result));
+		}
+	}
+
+	m_imagesInFlight[imageIndex] = frame.inFlightFence;
+
+	// Straight into the slot's mapped transforms, nothing is staged or copied on the GPU. Only once the frame is sure to be
+	// submitted: a write counts against the slot, and a skipped frame would leave the other slots without the change.
+	if (m_transforms != nullptr && m_gpuSceneAvailable)
+	{
+		m_transforms->WriteGpuTransforms(m_jobSystem, m_gpuScene.GetTransformBuffer(m_currentFrame), m_gpuScene.GetMaxTransforms(), m_framesInFlight);
 	}
 
-	result = vkAcquireNextImageKHR(m_device, m_swapChain, UINT64_MAX, m_imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+	// Reset only once we know work will be submitted, otherwise an early return would leave the fence unsignaled forever
+	result = vkResetFences(m_device, 1, &frame.inFlightFence);
 
 	if (result != VK_SUCCESS)
 	{
-		Logger::Error("FAILED TO ACQUIRE THE NEXT IMAGE");
+		Logger::Error("FAILED TO RESET FENCES");
 		Logger::Error("%s", string_VkResult(result));
-
-		return;
 	}
 
-	result = vkResetCommandBuffer(m_commandBuffer, /*VkCommandBufferResetFlagBits*/ 0);
+	result = vkResetCommandPool(m_device, frame.commandPool, 0);
 
 	if (result != VK_SUCCESS)
 	{
-		Logger::Error("FAILED TO RESET COMMAND BUFFER");
+		Logger::Error("FAILED TO RESET COMMAND POOL");
 		Logger::Error("%s", string_VkResult(result));
 	}
 
-	RecordCommandBuffer(m_commandBuffer, imageIndex);
+	for (ThreadCommandPool& threadPool : frame.threadPools)
+	{
+		result = vkResetCommandPool(m_device, threadPool.commandPool, 0);
+
+		if (result != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO RESET THREAD COMMAND POOL");
+			Logger::Error("%s", string_VkResult(result));
+		}
+
+		threadPool.usedBuffers = 0;
+	}
+
+	RecordCommandBuffer(frame.commandBuffer, imageIndex);
 
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-	VkSemaphore waitSemaphores[] = { m_imageAvailableSemaphore };
+	VkSemaphore waitSemaphores[] = { frame.imageAvailableSemaphore };
 	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.waitSemaphoreCount = m_headless ? 0 : 1;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &m_commandBuffer;
+	submitInfo.pCommandBuffers = &frame.commandBuffer;
 
-	VkSemaphore signalSemaphores[] = { m_renderFinishedSemaphore };
-	submitInfo.signalSemaphoreCount = 1;
+	VkSemaphore signalSemaphores[] = { m_headless ? VK_NULL_HANDLE : m_renderFinishedSemaphores[imageIndex] };
+	submitInfo.signalSemaphoreCount = m_headless ? 0 : 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	result = vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_inFlightFence);
+	{
+		std::lock_guard<std::mutex> queueLock(m_queueMutex);
+
+		result = vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, frame.inFlightFence);
+	}
 
 	if (result != VK_SUCCESS) 
 	{
@@ -169,6 +394,15 @@ void EngineRenderer::DrawFrame()
 		Logger::Error("%s", string_VkResult(result));
 	}
 
+	m_frameNumber++;
+
+	if (m_headless)
+	{
+		m_currentFrame = (m_currentFrame + 1) % m_framesInFlight;
+
+		return;
+	}
+
 	VkPresentInfoKHR presentInfo{};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
@@ -181,17 +415,86 @@ void EngineRenderer::DrawFrame()
 
 	presentInfo.pImageIndices = &imageIndex;
 
-	result = vkQueuePresentKHR(m_presentQueue, &presentInfo);
+	{
+		std::lock_guard<std::mutex> queueLock(m_queueMutex);
 
-	if (result != VK_SUCCESS)
+		result = vkQueuePresentKHR(m_presentQueue, &presentInfo);
+	}
+
+	m_currentFrame = (m_currentFrame + 1) % m_framesInFlight;
+
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+	{
+		m_swapChainOutOfDate = true;
+	}
+	else if (result != VK_SUCCESS)
 	{
 		Logger::Error("FAILED TO PRESENT QUEUE");
 		Logger::Error("%s", string_VkResult(result));
 
 		return;
 	}
+}
+
+void EngineRenderer::DeferRelease(std::function<void()> release)
+{
+	m_releaseQueue.push_back({ m_frameNumber, std::move(release) });
+}
+
+void EngineRenderer::FlushReleaseQueue(bool releaseAll)
+{
+	// Called right after waiting on the current slot's fence, which retires every frame up to m_frameNumber - m_framesInFlight
+	while (!m_releaseQueue.empty() && (releaseAll || m_releaseQueue.front().frameNumber + m_framesInFlight <= m_frameNumber))
+	{
+		m_releaseQueue.front().release();
+		m_releaseQueue.pop_front();
+	}
+}
+
+bool EngineRenderer::CaptureFrame(std::vector<uint8_t>& pixels, uint32_t* width, uint32_t* height)
+{
+	if (!m_headless)
+	{
+		Logger::Error("FRAME CAPTURE IS ONLY SUPPORTED BY THE HEADLESS RENDERER");
+
+		return false;
+	}
+
+	uint32_t captureFrame = m_currentFrame;
+
+	m_captureRequested = true;
+
+	// Nothing new was submitted since the last frame, so the capture repeats its draws, the visible scene draws included
+	if (m_drawCommands.empty())
+	{
+		m_drawCommands = m_frameDrawCommands;
+		m_repeatingDraws = true;
+	}
+
+	DrawFrame();
+
+	m_captureRequested = false;
+	m_repeatingDraws = false;
+
+	VkResult result = vkWaitForFences(m_device, 1, &m_frames[captureFrame].inFlightFence, VK_TRUE, UINT64_MAX);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("WAIT FOR CAPTURED FRAME TIMED OUT");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	size_t frameSize = static_cast<size_t>(m_swapChainExtent.width) * m_swapChainExtent.height * 4;
+
+	pixels.resize(frameSize);
+	memcpy(pixels.data(), m_readbackAllocation.mapped, frameSize);
 
-	Logger::Trace("DRAWING FRAME");
+	*width = m_swapChainExtent.width;
+	*height = m_swapChainExtent.height;
+
+	return true;
 }
 
 void EngineRenderer::CreateInstance()
@@ -242,15 +545,13 @@ void EngineRenderer::CreateInstance()
 
 void EngineRenderer::CreateSurface()
 {
-	VkResult result;
 #ifdef _WIN32
-
 	VkWin32SurfaceCreateInfoKHR createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
 	createInfo.hwnd = m_window->GetWindow();
 	createInfo.hinstance = GetModuleHandle(nullptr);
 
-	result = vkCreateWin32SurfaceKHR(m_instance, &createInfo, nullptr, &m_surface);
+	VkResult result = vkCreateWin32SurfaceKHR(m_instance, &createInfo, nullptr, &m_surface);
 
 	if (result != VK_SUCCESS)
 	{
@@ -272,6 +573,16 @@ void EngineRenderer::CreateLogicalDevice()
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos{};
 	std::set<uint32_t> uniqueQueueFamilies = { indicies.graphicsFamily.value(), indicies.presentFamily.value() };
 
+	if (indicies.transferFamily.has_value())
+	{
+		uniqueQueueFamilies.insert(indicies.transferFamily.value());
+	}
+
+	if (indicies.computeFamily.has_value())
+	{
+		uniqueQueueFamilies.insert(indicies.computeFamily.value());
+	}
+
 	float queuePriority = 1.0f;
 
 	for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -284,15 +595,37 @@ void EngineRenderer::CreateLogicalDevice()
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
+	VkPhysicalDeviceFeatures supportedFeatures{};
+	vkGetPhysicalDeviceFeatures(m_physicalDevice, &supportedFeatures);
+
+	// Indirect draws of the GPU scene carry the instance index in firstInstance and come many per call
 	VkPhysicalDeviceFeatures deviceFeatures{};
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
 
 	VkDeviceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.pEnabledFeatures = &deviceFeatures;
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(m_deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = m_deviceExtensions.data();
+	std::vector<const char*> deviceExtensions = GetRequiredDeviceExtensions();
+
+	std::set<std::string> enabledOptionalExtensions;
+
+	for (const VkExtensionProperties& extension : GetAvailableDeviceExtensions(m_physicalDevice))
+	{
+		for (const char* optionalExtension : m_optionalDeviceExtensions)
+		{
+			if (strcmp(extension.extensionName, optionalExtension) == 0)
+			{
+				deviceExtensions.push_back(optionalExtension);
+				enabledOptionalExtensions.insert(optionalExtension);
+			}
+		}
+	}
+
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
 	if (ENABLE_VALIDATION_LAYERS) 
 	{
@@ -314,10 +647,41 @@ void EngineRenderer::CreateLogicalDevice()
 	vkGetDeviceQueue(m_device, indicies.presentFamily.value(), 0, &m_presentQueue);
 	vkGetDeviceQueue(m_device, indicies.graphicsFamily.value(), 0, &m_graphicsQueue);
 
+	// Without dedicated families, transfers and compute share the graphics queue
+	m_transferQueue = m_graphicsQueue;
+	m_computeQueue = m_graphicsQueue;
+
+	if (indicies.transferFamily.has_value())
+	{
+		vkGetDeviceQueue(m_device, indicies.transferFamily.value(), 0, &m_transferQueue);
+	}
+
+	if (indicies.computeFamily.has_value())
+	{
+		vkGetDeviceQueue(m_device, indicies.computeFamily.value(), 0, &m_computeQueue);
+	}
+
+	Logger::Info("DEDICATED TRANSFER QUEUE: %s, ASYNC COMPUTE QUEUE: %s", indicies.transferFamily.has_value() ? "YES" : "NO", indicies.computeFamily.has_value() ? "YES" : "NO");
+
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+
+	m_gpuSceneFeatures.multiDrawIndirect = deviceFeatures.multiDrawIndirect == VK_TRUE;
+	m_gpuSceneFeatures.drawIndirectFirstInstance = deviceFeatures.drawIndirectFirstInstance == VK_TRUE;
+	m_gpuSceneFeatures.maxDrawIndirectCount = properties.limits.maxDrawIndirectCount;
+
+	// Core only from Vulkan 1.2 on, on 1.0 the extension entry point has to be loaded by hand
+	if (enabledOptionalExtensions.count(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) != 0)
+	{
+		m_gpuSceneFeatures.drawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(m_device, "vkCmdDrawIndexedIndirectCountKHR"));
+	}
+
+	Logger::Info("MULTI DRAW INDIRECT: %s, DRAW INDIRECT COUNT: %s", m_gpuSceneFeatures.multiDrawIndirect ? "YES" : "NO", m_gpuSceneFeatures.drawIndexedIndirectCount != nullptr ? "YES" : "NO");
+
 	Logger::Info( "LOGICAL DEVICES CREATED SUCCESSFULLY");
 }
 
-void EngineRenderer::CreateSwapChain()
+void EngineRenderer::CreateSwapChain(VkSwapchainKHR oldSwapChain)
 {
 	VkResult result;
 
@@ -365,7 +729,7 @@ void EngineRenderer::CreateSwapChain()
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE;
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	createInfo.oldSwapchain = oldSwapChain;
 
 	result = vkCreateSwapchainKHR(m_device, &createInfo, nullptr, &m_swapChain);
 
@@ -375,381 +739,1038 @@ void EngineRenderer::CreateSwapChain()
 		Logger::Error("%s", string_VkResult(result));
 	}
 
-	result = vkGetSwapchainImagesKHR(m_device, m_swapChain, &imageCount, nullptr);
+	result = vkGetSwapchainImagesKHR(m_device, m_swapChain, &imageCount, nullptr);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO INITIALIZE SWAP CHAIN IMAGES");
+		Logger::Error("%s", string_VkResult(result));
+	}
+
+	m_swapChainImages.resize(imageCount);
+
+	result = vkGetSwapchainImagesKHR(m_device, m_swapChain, &imageCount, m_swapChainImages.data());
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO GET SWAP CHAIN IMAGES");
+		Logger::Error("%s", string_VkResult(result));
+	}
+
+	m_swapChainImageFormat = surfaceFormat.format;
+	m_swapChainExtent = extent;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	m_renderFinishedSemaphores.resize(imageCount);
+
+	for (VkSemaphore& semaphore : m_renderFinishedSemaphores)
+	{
+		result = vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &semaphore);
+
+		if (result != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO CREATE RENDER FINISHED SEMAPHORE");
+			Logger::Error("%s", string_VkResult(result));
+		}
+	}
+}
+
+bool EngineRenderer::RecreateSwapChain()
+{
+	SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(m_physicalDevice);
+	VkExtent2D extent = ChooseSwapExtent(swapChainSupport.capabilities);
+
+	if (extent.width == 0 || extent.height == 0)
+	{
+		return false;
+	}
+
+	VkSwapchainKHR oldSwapChain = m_swapChain;
+
+	std::vector<VkImageView> oldImageViews = std::move(m_swapChainImageViews);
+	std::vector<VkSemaphore> oldRenderFinishedSemaphores = std::move(m_renderFinishedSemaphores);
+
+	m_swapChainImageViews.clear();
+	m_renderFinishedSemaphores.clear();
+
+	// Passing the old swap chain lets the driver hand over its images without draining the queue
+	CreateSwapChain(oldSwapChain);
+	CreateImageViews();
+
+	// The graph's framebuffers and size dependent images are released along with the old swap chain
+	BuildRenderGraph();
+
+	m_imagesInFlight.assign(m_swapChainImages.size(), VK_NULL_HANDLE);
+
+	// Frames still in flight keep rendering into and presenting the old images, so they are only destroyed once those frames retire
+	VkDevice device = m_device;
+
+	DeferRelease([device, oldSwapChain, oldImageViews, oldRenderFinishedSemaphores]()
+	{
+		for (VkImageView imageView : oldImageViews)
+		{
+			vkDestroyImageView(device, imageView, nullptr);
+		}
+
+		for (VkSemaphore semaphore : oldRenderFinishedSemaphores)
+		{
+			vkDestroySemaphore(device, semaphore, nullptr);
+		}
+
+		vkDestroySwapchainKHR(device, oldSwapChain, nullptr);
+	});
+
+	m_swapChainOutOfDate = false;
+
+	Logger::Info("SWAP CHAIN RECREATED <%ux%u>", m_swapChainExtent.width, m_swapChainExtent.height);
+
+	return true;
+}
+
+void EngineRenderer::CreateOffscreenTargets()
+{
+	// RGBA8 UNORM is a mandatory color attachment and transfer source format, so software ICDs such as lavapipe support it
+	m_swapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+	m_swapChainImages.resize(m_framesInFlight);
+	m_offscreenImageAllocations.resize(m_framesInFlight);
+
+	for (uint32_t i = 0; i < m_framesInFlight; i++)
+	{
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = m_swapChainImageFormat;
+		imageInfo.extent = { m_swapChainExtent.width, m_swapChainExtent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (!m_allocator->CreateImage(imageInfo, MemoryUsage::GpuOnly, &m_swapChainImages[i], &m_offscreenImageAllocations[i]))
+		{
+			Logger::Error("FAILED TO CREATE OFFSCREEN IMAGE");
+
+			throw std::runtime_error("FAILED TO CREATE OFFSCREEN IMAGE");
+		}
+	}
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = static_cast<VkDeviceSize>(m_swapChainExtent.width) * m_swapChainExtent.height * 4;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (!m_allocator->CreateBuffer(bufferInfo, MemoryUsage::GpuToCpu, &m_readbackBuffer, &m_readbackAllocation))
+	{
+		Logger::Error("FAILED TO CREATE READBACK BUFFER");
+
+		throw std::runtime_error("FAILED TO CREATE READBACK BUFFER");
+	}
+
+	Logger::Info("OFFSCREEN TARGETS CREATED SUCCESSFULLY <%ux%u>", m_swapChainExtent.width, m_swapChainExtent.height);
+}
+
+void EngineRenderer::DestroyOffscreenTargets()
+{
+	m_allocator->DestroyBuffer(m_readbackBuffer, m_readbackAllocation);
+
+	for (size_t i = 0; i < m_swapChainImages.size(); i++)
+	{
+		m_allocator->DestroyImage(m_swapChainImages[i], m_offscreenImageAllocations[i]);
+	}
+
+	m_swapChainImages.clear();
+	m_offscreenImageAllocations.clear();
+}
+
+void EngineRenderer::CreateImageViews()
+{
+	VkResult result;
+
+	m_swapChainImageViews.resize(m_swapChainImages.size());
+
+	for (size_t i = 0; i < m_swapChainImages.size(); i++)
+	{
+		VkImageViewCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		createInfo.image = m_swapChainImages[i];
+		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		createInfo.format = m_swapChainImageFormat;
+
+		createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+		createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+		createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+		createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+
+		createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		createInfo.subresourceRange.baseMipLevel = 0;
+		createInfo.subresourceRange.levelCount = 1;
+		createInfo.subresourceRange.baseArrayLayer = 0;
+		createInfo.subresourceRange.layerCount = 1;
+
+		result = vkCreateImageView(m_device, &createInfo, nullptr, &m_swapChainImageViews[i]);
+
+		if (result !=  VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO CREATE IMAGE VIEWS");
+			Logger::Error("%s", string_VkResult(result));
+		}
+	}
+}
+
+void EngineRenderer::CreateRenderPass()
+{
+	VkResult result;
+
+	// Pipelines are created against these passes. The frame itself runs in the render graph's passes, which are compatible
+	// with them as long as the attachment formats match, so they never need load ops, layouts or dependencies of their own.
+	VkAttachmentDescription colorAttachment{};
+	colorAttachment.format = m_swapChainImageFormat;
+	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentDescription depthAttachment{};
+	depthAttachment.format = m_depthFormat;
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference colorAttachmentRef{};
+	colorAttachmentRef.attachment = 0;
+	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference depthAttachmentRef{};
+	depthAttachmentRef.attachment = 1;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorAttachmentRef;
+	subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+	VkAttachmentDescription attachments[] = { colorAttachment, depthAttachment };
+
+	VkRenderPassCreateInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = 2;
+	renderPassInfo.pAttachments = attachments;
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+
+	result = vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_renderPass);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE RENDER PASS");
+		Logger::Error("%s", string_VkResult(result));
+	}
+
+	// Depth only, for the pre-pass variants
+	depthAttachmentRef.attachment = 0;
+
+	VkSubpassDescription depthSubpass{};
+	depthSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	depthSubpass.colorAttachmentCount = 0;
+	depthSubpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+	renderPassInfo.attachmentCount = 1;
+	renderPassInfo.pAttachments = &depthAttachment;
+	renderPassInfo.pSubpasses = &depthSubpass;
+
+	result = vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_depthRenderPass);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE DEPTH RENDER PASS");
+		Logger::Error("%s", string_VkResult(result));
+	}
+}
+
+void EngineRenderer::CreateGraphicsPipeline()
+{
+	VkResult result;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 0;
+	pipelineLayoutInfo.pSetLayouts = nullptr;
+	pipelineLayoutInfo.pushConstantRangeCount = 0;
+	pipelineLayoutInfo.pPushConstantRanges = nullptr;
+
+	result = vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error( "FAILED TO CREATE PIPELINE LAYOUT");
+		Logger::Error("%s", string_VkResult(result));
+	}
+
+	m_pipelineRegistry.Init(m_device, &m_pipelineCache);
+
+	GraphicsPipelineDesc desc;
+	desc.vertexShader = "shaders/vertex_shader.spv";
+	desc.fragmentShader = "shaders/fragment_shader.spv";
+
+	m_defaultPipeline = RegisterPipeline(desc);
+
+	// Compiled up front so startup reports the cold or warm cost of the built-in pipeline
+	m_pipelineRegistry.Prewarm(m_defaultPipeline);
+}
+
+PipelineKey EngineRenderer::RegisterPipeline(GraphicsPipelineDesc desc)
+{
+	if (desc.layout == VK_NULL_HANDLE)
+	{
+		desc.layout = m_pipelineLayout;
+	}
+
+	if (desc.renderPass == VK_NULL_HANDLE)
+	{
+		desc.renderPass = m_renderPass;
+	}
+
+	PipelineKey key = m_pipelineRegistry.Register(desc);
+
+	// Pipelines that write depth take part in the pre-pass: a depth-only copy fills the depth buffer and an equal-test
+	// copy without depth writes shades. Both share the vertex shader, which must declare gl_Position invariant.
+	if (desc.depthWrite && desc.renderPass == m_renderPass && m_depthVariants.find(key) == m_depthVariants.end())
+	{
+		GraphicsPipelineDesc depthDesc = desc;
+		depthDesc.fragmentShader.clear();
+		depthDesc.colorAttachmentCount = 0;
+		depthDesc.blendEnable = false;
+		depthDesc.renderPass = m_depthRenderPass;
+
+		GraphicsPipelineDesc equalDesc = desc;
+		equalDesc.depthWrite = false;
+		equalDesc.depthCompareOp = VK_COMPARE_OP_EQUAL;
+
+		m_depthVariants[key] = { m_pipelineRegistry.Register(depthDesc), m_pipelineRegistry.Register(equalDesc) };
+	}
+
+	return key;
+}
+
+void EngineRenderer::SetDepthPrepass(bool enabled)
+{
+	if (enabled == m_depthPrepass)
+	{
+		return;
+	}
+
+	m_depthPrepass = enabled;
+
+	// Before Init the graph is built with the setting anyway
+	if (m_device != VK_NULL_HANDLE)
+	{
+		BuildRenderGraph();
+	}
+}
+
+void EngineRenderer::SetOcclusionCulling(bool enabled)
+{
+	if (enabled == m_occlusionCulling)
+	{
+		return;
+	}
+
+	m_occlusionCulling = enabled;
+
+	if (m_device != VK_NULL_HANDLE)
+	{
+		BuildRenderGraph();
+	}
+}
+
+bool EngineRenderer::CreateMesh(const CookedMesh& mesh, GpuMesh* gpuMesh)
+{
+	const MeshFileHeader& header = mesh.GetHeader();
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	bufferInfo.size = header.vertexBytes;
+	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	if (!m_allocator->CreateBuffer(bufferInfo, MemoryUsage::GpuOnly, &gpuMesh->vertexBuffer, &gpuMesh->vertexAllocation))
+	{
+		Logger::Error("FAILED TO CREATE MESH VERTEX BUFFER");
+
+		return false;
+	}
+
+	bufferInfo.size = header.indexBytes;
+	bufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	if (!m_allocator->CreateBuffer(bufferInfo, MemoryUsage::GpuOnly, &gpuMesh->indexBuffer, &gpuMesh->indexAllocation))
+	{
+		Logger::Error("FAILED TO CREATE MESH INDEX BUFFER");
+
+		m_allocator->DestroyBuffer(gpuMesh->vertexBuffer, gpuMesh->vertexAllocation);
+		gpuMesh->vertexBuffer = VK_NULL_HANDLE;
+
+		return false;
+	}
+
+	std::span<const uint8_t> vertexData = mesh.GetVertexData();
+	std::span<const uint8_t> indexData = mesh.GetIndexData();
+
+	// Batches complete in order, so the index copy's batch also covers the vertex copy
+	uint64_t vertexBatch = m_uploadManager.UploadBuffer(gpuMesh->vertexBuffer, 0, vertexData.data(), vertexData.size());
+	uint64_t indexBatch = vertexBatch != 0 ? m_uploadManager.UploadBuffer(gpuMesh->indexBuffer, 0, indexData.data(), indexData.size()) : 0;
+
+	if (indexBatch == 0)
+	{
+		Logger::Error("FAILED TO STAGE MESH UPLOAD");
+
+		// A staged vertex copy still targets the buffer and may hand it over to the graphics queue in the next frame,
+		// so the buffers go through the deferred release once the copy has landed
+		if (vertexBatch != 0)
+		{
+			m_uploadManager.WaitForBatch(vertexBatch);
+		}
+
+		DestroyMesh(*gpuMesh);
+
+		return false;
+	}
+
+	gpuMesh->uploadBatch = indexBatch;
+
+	gpuMesh->indexType = mesh.GetIndexType();
+	gpuMesh->indexCount = header.indexCount;
+	gpuMesh->lodCount = header.lodCount;
+
+	memcpy(gpuMesh->lods, header.lods, sizeof(header.lods));
+
+	std::span<const MeshFileMeshlet> meshlets = mesh.GetMeshlets();
+
+	gpuMesh->meshlets.assign(meshlets.begin(), meshlets.end());
+
+	return true;
+}
+
+void EngineRenderer::DestroyMesh(GpuMesh& gpuMesh)
+{
+	VkBuffer vertexBuffer = gpuMesh.vertexBuffer;
+	VkBuffer indexBuffer = gpuMesh.indexBuffer;
+	MemoryAllocation vertexAllocation = gpuMesh.vertexAllocation;
+	MemoryAllocation indexAllocation = gpuMesh.indexAllocation;
+
+	DeferRelease([this, vertexBuffer, indexBuffer, vertexAllocation, indexAllocation]() mutable
+	{
+		if (vertexBuffer != VK_NULL_HANDLE)
+		{
+			m_allocator->DestroyBuffer(vertexBuffer, vertexAllocation);
+		}
+
+		if (indexBuffer != VK_NULL_HANDLE)
+		{
+			m_allocator->DestroyBuffer(indexBuffer, indexAllocation);
+		}
+	});
+
+	gpuMesh = GpuMesh();
+}
+
+void EngineRenderer::SubmitDraw(const DrawCommand& drawCommand)
+{
+	m_drawCommands.push_back(drawCommand);
+}
+
+uint32_t EngineRenderer::AddSceneDraw(const DrawCommand& drawCommand, const Aabb& bounds)
+{
+	uint32_t sceneDraw = static_cast<uint32_t>(m_sceneDraws.size());
+
+	if (!m_freeSceneDraws.empty())
+	{
+		sceneDraw = m_freeSceneDraws.back();
+		m_freeSceneDraws.pop_back();
+	}
+	else
+	{
+		m_sceneDraws.emplace_back();
+	}
+
+	m_sceneDraws[sceneDraw].command = drawCommand;
+	m_sceneDraws[sceneDraw].proxy = m_sceneTree.CreateProxy(bounds, sceneDraw);
+
+	return sceneDraw;
+}
+
+void EngineRenderer::MoveSceneDraw(uint32_t sceneDraw, const Aabb& bounds)
+{
+	if (sceneDraw >= m_sceneDraws.size() || m_sceneDraws[sceneDraw].proxy == INVALID_SPATIAL_PROXY)
+	{
+		return;
+	}
+
+	m_sceneTree.MoveProxy(m_sceneDraws[sceneDraw].proxy, bounds);
+}
+
+void EngineRenderer::RemoveSceneDraw(uint32_t sceneDraw)
+{
+	// Removing twice would also put the id on the free list twice and hand it out to two draws
+	if (sceneDraw >= m_sceneDraws.size() || m_sceneDraws[sceneDraw].proxy == INVALID_SPATIAL_PROXY)
+	{
+		return;
+	}
+
+	m_sceneTree.DestroyProxy(m_sceneDraws[sceneDraw].proxy);
+
+	m_sceneDraws[sceneDraw] = SceneDraw();
+	m_freeSceneDraws.push_back(sceneDraw);
+}
+
+void EngineRenderer::SetGpuSceneView(const float* viewProjection, const float* eye, float pixelsPerUnit)
+{
+	// Planes extracted from the view projection matrix alone are in world space
+	m_gpuSceneView = ClusterCulling::ExtractView(viewProjection, eye);
+
+	memcpy(m_gpuSceneViewProjection, viewProjection, sizeof(m_gpuSceneViewProjection));
+
+	m_gpuScenePixelsPerUnit = pixelsPerUnit;
+	m_gpuSceneViewSet = true;
+}
+
+void EngineRenderer::BuildRenderGraph()
+{
+	m_renderGraph.Reset();
+
+	// Presented images are handed over by the acquire semaphore, which the submit waits on at the color output stage
+	VkImageLayout finalLayout = m_headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	m_backBuffer = m_renderGraph.ImportImage("BackBuffer", m_swapChainImageFormat, m_swapChainExtent, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, finalLayout);
+
+	RenderGraphImageDesc depthDesc;
+	depthDesc.format = m_depthFormat;
+	depthDesc.extent = m_swapChainExtent;
+	depthDesc.aspect = GetDepthAspect(m_depthFormat);
+
+	m_depthBuffer = m_renderGraph.CreateImage("Depth", depthDesc);
+
+	VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
+
+	// Writes the indirect draws of the GPU scene. Buffers are not tracked by the graph, the scene records its own barriers.
+	m_gpuCullingPass = m_renderGraph.AddPass("GpuCulling", [this](const RenderGraphPassContext& context)
+	{
+		if (m_gpuSceneDrawing)
+		{
+			m_gpuScene.RecordEarlyCulling(context.commandBuffer, m_frameArena);
+		}
+	});
+
+	m_renderGraph.SetSideEffects(m_gpuCullingPass);
+
+	VkClearValue clearDepth{};
+	clearDepth.depthStencil = { 1.0f, 0 };
+
+	// The pyramid is built from the pre-pass depth, without the pre-pass there is no depth before shading
+	m_occlusionPasses = m_gpuSceneAvailable && m_depthPrepass && m_occlusionCulling && m_depthSampleable;
+
+	// The pre-pass lays down the nearest depth of every pixel, the main pass then tests for equality and shades each pixel once
+	if (m_depthPrepass)
+	{
+		m_prepassPass = m_renderGraph.AddPass("DepthPrepass", [this](const RenderGraphPassContext& context) { RecordDrawPass(context, m_depthPipelines, m_gpuSceneDepthPipeline, GPU_CULL_PHASE_EARLY, m_prepassCommandBuffers); });
+		m_renderGraph.UseImage(m_prepassPass, m_depthBuffer, RenderGraphAccess::DepthAttachment, VK_ATTACHMENT_LOAD_OP_CLEAR, clearDepth);
+	}
+
+	// Instances hidden last frame are tested against the early depth, those that show up again add their depth before shading
+	if (m_occlusionPasses)
+	{
+		uint32_t occlusionPass = m_renderGraph.AddPass("OcclusionCulling", [this](const RenderGraphPassContext& context)
+		{
+			if (m_gpuSceneDrawing)
+			{
+				m_gpuScene.RecordDepthPyramid(context.commandBuffer);
+				m_gpuScene.RecordLateCulling(context.commandBuffer);
+			}
+		});
+
+		m_renderGraph.UseImage(occlusionPass, m_depthBuffer, RenderGraphAccess::Sampled);
+		m_renderGraph.SetSideEffects(occlusionPass);
+
+		uint32_t latePrepass = m_renderGraph.AddPass("DepthPrepassLate", [this](const RenderGraphPassContext& context)
+		{
+			if (m_gpuSceneDrawing)
+			{
+				SetViewportAndScissor(context.commandBuffer);
+
+				m_gpuScene.RecordDraw(context.commandBuffer, m_gpuSceneDepthPipeline, GPU_CULL_PHASE_LATE);
+			}
+		});
+
+		m_renderGraph.UseImage(latePrepass, m_depthBuffer, RenderGraphAccess::DepthAttachment, VK_ATTACHMENT_LOAD_OP_LOAD);
+	}
+
+	m_mainPass = m_renderGraph.AddPass("Main", [this](const RenderGraphPassContext& context) { RecordDrawPass(context, m_drawPipelines, m_gpuSceneShadePipeline, GPU_CULL_PHASE_EARLY | GPU_CULL_PHASE_LATE, m_chunkCommandBuffers); });
+	m_renderGraph.UseImage(m_mainPass, m_backBuffer, RenderGraphAccess::ColorAttachment, VK_ATTACHMENT_LOAD_OP_CLEAR, clearColor);
+
+	if (m_depthPrepass)
+	{
+		m_renderGraph.UseImage(m_mainPass, m_depthBuffer, RenderGraphAccess::DepthRead);
+	}
+	else
+	{
+		m_renderGraph.UseImage(m_mainPass, m_depthBuffer, RenderGraphAccess::DepthAttachment, VK_ATTACHMENT_LOAD_OP_CLEAR, clearDepth);
+	}
+
+	if (m_headless)
+	{
+		uint32_t readbackPass = m_renderGraph.AddPass("Readback", [this](const RenderGraphPassContext& context)
+		{
+			if (m_captureRequested)
+			{
+				RecordReadback(context.commandBuffer, m_currentImageIndex);
+			}
+		});
+
+		m_renderGraph.UseImage(readbackPass, m_backBuffer, RenderGraphAccess::TransferSrc);
+		m_renderGraph.SetSideEffects(readbackPass);
+	}
+
+	if (!m_renderGraph.Compile())
+	{
+		Logger::Error("FAILED TO COMPILE RENDER GRAPH");
+
+		throw std::runtime_error("FAILED TO COMPILE RENDER GRAPH");
+	}
+
+	// The depth buffer is recreated with the graph, so is the pyramid built from it
+	if (m_gpuSceneAvailable && !m_gpuScene.SetDepthSource(m_occlusionPasses ? m_renderGraph.GetSampledView(m_depthBuffer) : VK_NULL_HANDLE, m_swapChainExtent))
+	{
+		Logger::Warn("OCCLUSION CULLING DISABLED, NO DEPTH PYRAMID");
+	}
+}
+
+void EngineRenderer::CreateFrameResources()
+{
+	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_physicalDevice);
+
+	m_frames.resize(m_framesInFlight);
+	m_imagesInFlight.assign(m_swapChainImages.size(), VK_NULL_HANDLE);
+
+	// Without a job system everything is recorded on the calling thread, which still needs a pool for its scratch
+	uint32_t threadCount = m_jobSystem != nullptr ? m_jobSystem->GetThreadCount() : 1;
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (FrameResources& frame : m_frames)
+	{
+		// One pool per frame lets the whole frame be recycled with a single vkResetCommandPool
+		if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &frame.commandPool) != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO CREATE COMMAND POOL");
+
+			throw std::runtime_error("FAILED TO CREATE COMMAND POOL");
+		}
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = frame.commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(m_device, &allocInfo, &frame.commandBuffer) != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO ALLOCATE COMMAND BUFFERS");
+
+			throw std::runtime_error("FAILED TO ALLOCATE COMMAND BUFFERS");
+		}
+
+		frame.threadPools.resize(threadCount);
+
+		for (ThreadCommandPool& threadPool : frame.threadPools)
+		{
+			if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &threadPool.commandPool) != VK_SUCCESS)
+			{
+				Logger::Error("FAILED TO CREATE THREAD COMMAND POOL");
+
+				throw std::runtime_error("FAILED TO CREATE THREAD COMMAND POOL");
+			}
+		}
+
+		VkResult result_imageAvailableSemaphore = vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &frame.imageAvailableSemaphore);
+
+		if (result_imageAvailableSemaphore != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO CREATE IMAGE AVAILABLE SEMAPHORE");
+			Logger::Error("%s", string_VkResult(result_imageAvailableSemaphore));
+		}
+
+		VkResult result_inFlightFence = vkCreateFence(m_device, &fenceInfo, nullptr, &frame.inFlightFence);
+
+		if (result_inFlightFence != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO CREATE IN FLIGHT FENCE");
+			Logger::Error("%s", string_VkResult(result_inFlightFence));
+		}
+
+		if (result_imageAvailableSemaphore != VK_SUCCESS || result_inFlightFence != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO CREATE SYNC OBJECTS");
+		}
+	}
+
+	Logger::Info("FRAME RESOURCES CREATED SUCCESSFULLY");
+}
+
+void EngineRenderer::DestroyFrameResources()
+{
+	FlushReleaseQueue(true);
+
+	for (FrameResources& frame : m_frames)
+	{
+		vkDestroySemaphore(m_device, frame.imageAvailableSemaphore, nullptr);
+		vkDestroyFence(m_device, frame.inFlightFence, nullptr);
+
+		vkDestroyCommandPool(m_device, frame.commandPool, nullptr);
+
+		// Frees the secondary buffers along with the pools
+		for (ThreadCommandPool& threadPool : frame.threadPools)
+		{
+			vkDestroyCommandPool(m_device, threadPool.commandPool, nullptr);
+		}
+	}
+
+	m_frames.clear();
+	m_imagesInFlight.clear();
+}
+
+void EngineRenderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	VkResult result;
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+	result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
 
 	if (result != VK_SUCCESS)
 	{
-		Logger::Error("FAILED TO INITIALIZE SWAP CHAIN IMAGES");
+		Logger::Error("FAILED TO BEGIN RECORDING COMMAND BUFFER");
 		Logger::Error("%s", string_VkResult(result));
 	}
 
-	m_swapChainImages.resize(imageCount);
+	// Takes ownership of resources whose uploads finished on the transfer queue before anything reads them
+	m_uploadManager.RecordAcquireBarriers(commandBuffer);
 
-	result = vkGetSwapchainImagesKHR(m_device, m_swapChain, &imageCount, m_swapChainImages.data());
+	// Grouping by pipeline key means each distinct pipeline is bound once per command buffer
+	std::stable_sort(m_frameDrawCommands.begin(), m_frameDrawCommands.end(), [](const DrawCommand& a, const DrawCommand& b) { return a.pipeline < b.pipeline; });
 
-	if (result != VK_SUCCESS)
+	uint32_t drawCount = static_cast<uint32_t>(m_frameDrawCommands.size());
+
+	m_drawPipelines.resize(drawCount);
+	m_depthPipelines.resize(drawCount);
+
+	for (uint32_t i = 0; i < drawCount; i++)
 	{
-		Logger::Error("FAILED TO GET SWAP CHAIN IMAGES");
-		Logger::Error("%s", string_VkResult(result));
+		if (i > 0 && m_frameDrawCommands[i].pipeline == m_frameDrawCommands[i - 1].pipeline)
+		{
+			m_drawPipelines[i] = m_drawPipelines[i - 1];
+			m_depthPipelines[i] = m_depthPipelines[i - 1];
+		}
+		else
+		{
+			ResolveDrawPipelines(m_frameDrawCommands[i].pipeline, &m_drawPipelines[i], &m_depthPipelines[i]);
+		}
 	}
 
-	m_swapChainImageFormat = surfaceFormat.format;
-	m_swapChainExtent = extent;
-}
+	m_gpuSceneDrawing = false;
+	m_gpuSceneShadePipeline = VK_NULL_HANDLE;
+	m_gpuSceneDepthPipeline = VK_NULL_HANDLE;
 
-void EngineRenderer::CreateImageViews()
-{
-	VkResult result;
+	if (m_gpuSceneAvailable && m_gpuSceneViewSet && m_gpuScenePipeline != 0 && !m_gpuScene.IsEmpty())
+	{
+		ResolveDrawPipelines(m_gpuScenePipeline, &m_gpuSceneShadePipeline, &m_gpuSceneDepthPipeline);
 
-	m_swapChainImageViews.resize(m_swapChainImages.size());
+		m_gpuSceneDrawing = m_gpuSceneShadePipeline != VK_NULL_HANDLE;
+	}
 
-	for (size_t i = 0; i < m_swapChainImages.size(); i++)
+	if (m_gpuSceneDrawing)
 	{
-		VkImageViewCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		createInfo.image = m_swapChainImages[i];
-		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		createInfo.format = m_swapChainImageFormat;
+		m_gpuScene.BeginFrame(m_currentFrame, m_frameArena, m_gpuSceneView, m_gpuSceneViewProjection, m_gpuScenePixelsPerUnit, m_occlusionPasses);
+	}
 
-		createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-		createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-		createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-		createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	m_currentImageIndex = imageIndex;
 
-		createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		createInfo.subresourceRange.baseMipLevel = 0;
-		createInfo.subresourceRange.levelCount = 1;
-		createInfo.subresourceRange.baseArrayLayer = 0;
-		createInfo.subresourceRange.layerCount = 1;
+	m_renderGraph.SetImportedImage(m_backBuffer, m_swapChainImages[imageIndex], m_swapChainImageViews[imageIndex]);
 
-		result = vkCreateImageView(m_device, &createInfo, nullptr, &m_swapChainImageViews[i]);
+	FrameResources& frame = m_frames[m_currentFrame];
 
-		if (result !=  VK_SUCCESS)
+	// Jobs only run on threads with a pool, a thread outside the job system would pick them up while waiting
+	m_parallelRecording = m_jobSystem != nullptr && JobSystem::GetThreadIndex() < frame.threadPools.size() && drawCount >= 2 * MIN_DRAWS_PER_SECONDARY;
+
+	if (m_parallelRecording)
+	{
+		if (m_depthPrepass)
 		{
-			Logger::Error("FAILED TO CREATE IMAGE VIEWS");
-			Logger::Error("%s", string_VkResult(result));
+			RecordPassInParallel(frame, m_prepassPass, m_depthPipelines, m_gpuSceneDepthPipeline, GPU_CULL_PHASE_EARLY, m_prepassCommandBuffers);
 		}
+
+		RecordPassInParallel(frame, m_mainPass, m_drawPipelines, m_gpuSceneShadePipeline, GPU_CULL_PHASE_EARLY | GPU_CULL_PHASE_LATE, m_chunkCommandBuffers);
 	}
-}
 
-void EngineRenderer::CreateRenderPass()
-{
-	VkResult result;
+	// Barriers, layout transitions and the render passes themselves come from the graph
+	m_renderGraph.Execute(commandBuffer);
 
-	VkAttachmentDescription colorAttachment{};
-	colorAttachment.format = m_swapChainImageFormat;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	result = vkEndCommandBuffer(commandBuffer);
 
-	VkAttachmentReference colorAttachmentRef{};
-	colorAttachmentRef.attachment = 0;
-	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO RECORD COMMAND BUFFER");
+		Logger::Error("%s", string_VkResult(result));
+	}
+}
 
-	VkSubpassDescription subpass{};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorAttachmentRef;
+void EngineRenderer::ResolveDrawPipelines(PipelineKey key, VkPipeline* shadePipeline, VkPipeline* depthPipeline)
+{
+	auto it = m_depthPrepass ? m_depthVariants.find(key) : m_depthVariants.end();
 
-	VkSubpassDependency dependency{};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	if (it == m_depthVariants.end())
+	{
+		*shadePipeline = m_pipelineRegistry.GetPipeline(key);
+		*depthPipeline = VK_NULL_HANDLE;
 
-	VkRenderPassCreateInfo renderPassInfo{};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassInfo.attachmentCount = 1;
-	renderPassInfo.pAttachments = &colorAttachment;
-	renderPassInfo.subpassCount = 1;
-	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+		return;
+	}
 
-	result = vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_renderPass);
+	*depthPipeline = m_pipelineRegistry.GetPipeline(it->second.depthOnly);
+	*shadePipeline = m_pipelineRegistry.GetPipeline(it->second.depthEqual);
 
-	if (result != VK_SUCCESS)
+	// Equal testing only finds the depth the pre-pass laid down, so the draw waits until both variants are ready
+	if (*depthPipeline == VK_NULL_HANDLE || *shadePipeline == VK_NULL_HANDLE)
 	{
-		Logger::Error("FAILED TO CREATE RENDER PASS");
-		Logger::Error("%s", string_VkResult(result));
+		*depthPipeline = VK_NULL_HANDLE;
+		*shadePipeline = VK_NULL_HANDLE;
 	}
 }
 
-void EngineRenderer::CreateGraphicsPipeline()
+void EngineRenderer::RecordPassInParallel(FrameResources& frame, uint32_t pass, const std::vector<VkPipeline>& pipelines, VkPipeline gpuScenePipeline, uint32_t gpuScenePhases, std::vector<VkCommandBuffer>& commandBuffers)
 {
-	VkResult result;
+	VkRenderPass renderPass = m_renderGraph.GetRenderPass(pass);
+	VkFramebuffer framebuffer = m_renderGraph.GetFramebuffer(pass);
 
-	std::vector<char> vertexShaderCode = Directory::ReadFile("shaders/vertex_shader.spv");
-	std::vector<char> fragmentShaderCode = Directory::ReadFile("shaders/fragment_shader.spv");
-
-	VkShaderModule vertexShaderModule = CreateShaderModule(vertexShaderCode);
-	VkShaderModule fragmentShaderModule = CreateShaderModule(fragmentShaderCode);
-
-	VkPipelineShaderStageCreateInfo vertexShaderStageInfo{};
-	vertexShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertexShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertexShaderStageInfo.module = vertexShaderModule;
-	vertexShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo fragmentShaderStageInfo{};
-	fragmentShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragmentShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragmentShaderStageInfo.module = fragmentShaderModule;
-	fragmentShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderStageInfo, fragmentShaderStageInfo };
-
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 0;
-	vertexInputInfo.pVertexBindingDescriptions = nullptr;
-	vertexInputInfo.vertexAttributeDescriptionCount = 0;
-	vertexInputInfo.pVertexAttributeDescriptions = nullptr;
-
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-	VkPipelineViewportStateCreateInfo viewportState{};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.scissorCount = 1;
-
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-	rasterizer.depthBiasEnable = VK_FALSE;
-	rasterizer.depthBiasConstantFactor = 0.0f;
-	rasterizer.depthBiasClamp = 0.0f;
-	rasterizer.depthBiasSlopeFactor = 0.0f;
-
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-	multisampling.minSampleShading = 1.0f;
-	multisampling.pSampleMask = nullptr;
-	multisampling.alphaToCoverageEnable = VK_FALSE;
-	multisampling.alphaToOneEnable = VK_FALSE;
-
-	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_FALSE;
-	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-	VkPipelineColorBlendStateCreateInfo colorBlending{};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable = VK_FALSE;
-	colorBlending.logicOp = VK_LOGIC_OP_COPY;
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-	colorBlending.blendConstants[0] = 0.0f;
-	colorBlending.blendConstants[1] = 0.0f;
-	colorBlending.blendConstants[2] = 0.0f;
-	colorBlending.blendConstants[3] = 0.0f;
-
-	std::vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-	dynamicState.pDynamicStates = dynamicStates.data();
+	uint32_t drawCount = static_cast<uint32_t>(m_frameDrawCommands.size());
+	uint32_t chunkCount = m_jobSystem->GetThreadCount() * SECONDARIES_PER_THREAD;
+	uint32_t drawsPerChunk = (std::max)((drawCount + chunkCount - 1) / chunkCount, MIN_DRAWS_PER_SECONDARY);
 
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 0;
-	pipelineLayoutInfo.pSetLayouts = nullptr;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = nullptr;
+	chunkCount = (drawCount + drawsPerChunk - 1) / drawsPerChunk;
 
-	result = vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout);
+	commandBuffers.assign(chunkCount, VK_NULL_HANDLE);
 
-	if (result != VK_SUCCESS)
+	// Whichever thread records a chunk, its buffer lands in the chunk's slot, so the order matches the sorted draws
+	m_jobSystem->ParallelFor(chunkCount, 1, [&](uint32_t firstChunk, uint32_t lastChunk)
 	{
-		Logger::Error( "FAILED TO CREATE PIPELINE LAYOUT");
-		Logger::Error("%s", string_VkResult(result));
+		for (uint32_t chunk = firstChunk; chunk < lastChunk; chunk++)
+		{
+			uint32_t first = chunk * drawsPerChunk;
+			uint32_t last = (std::min)(first + drawsPerChunk, drawCount);
+
+			commandBuffers[chunk] = RecordSecondary(frame, renderPass, framebuffer, [&](VkCommandBuffer commandBuffer, std::vector<IndexRange>& visibleRanges)
+			{
+				RecordDraws(commandBuffer, pipelines, first, last, visibleRanges);
+			});
+		}
+	});
+
+	// A pass with secondary contents takes no inline commands, so the indirect draw gets a secondary of its own
+	if (m_gpuSceneDrawing && gpuScenePipeline != VK_NULL_HANDLE)
+	{
+		commandBuffers.push_back(RecordSecondary(frame, renderPass, framebuffer, [&](VkCommandBuffer commandBuffer, std::vector<IndexRange>&)
+		{
+			m_gpuScene.RecordDraw(commandBuffer, gpuScenePipeline, gpuScenePhases);
+		}));
 	}
 
-	VkGraphicsPipelineCreateInfo pipelineInfo{};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount = 2;
-	pipelineInfo.pStages = shaderStages;
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pRasterizationState = &rasterizer;
-	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = &dynamicState;
-	pipelineInfo.layout = m_pipelineLayout;
-	pipelineInfo.renderPass = m_renderPass;
-	pipelineInfo.subpass = 0;
-	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-
-	result = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicsPipeline);
+	commandBuffers.erase(std::remove(commandBuffers.begin(), commandBuffers.end(), VK_NULL_HANDLE), commandBuffers.end());
 
-	if (result != VK_SUCCESS)
+	m_renderGraph.SetSubpassContents(pass, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+}
+
+void EngineRenderer::RecordDrawPass(const RenderGraphPassContext& context, const std::vector<VkPipeline>& pipelines, VkPipeline gpuScenePipeline, uint32_t gpuScenePhases, const std::vector<VkCommandBuffer>& commandBuffers)
+{
+	if (m_parallelRecording)
 	{
-		Logger::Error( "FAILED TO CREATE GRAPHICS PIPELINE");
-		Logger::Error("%s", string_VkResult(result));
+		if (!commandBuffers.empty())
+		{
+			vkCmdExecuteCommands(context.commandBuffer, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+		}
+
+		return;
 	}
 
-	vkDestroyShaderModule(m_device, fragmentShaderModule, nullptr);
-	vkDestroyShaderModule(m_device, vertexShaderModule, nullptr);
+	SetViewportAndScissor(context.commandBuffer);
+
+	RecordDraws(context.commandBuffer, pipelines, 0, static_cast<uint32_t>(m_frameDrawCommands.size()), m_frames[m_currentFrame].threadPools[0].visibleRanges);
 
-	Logger::Info( "GRAPHICS PIPELINE CREATED SUCCESSFULLY");
+	if (m_gpuSceneDrawing)
+	{
+		m_gpuScene.RecordDraw(context.commandBuffer, gpuScenePipeline, gpuScenePhases);
+	}
 }
 
-void EngineRenderer::CreateFrameBuffers()
+void EngineRenderer::RecordDraws(VkCommandBuffer commandBuffer, const std::vector<VkPipeline>& pipelines, uint32_t first, uint32_t last, std::vector<IndexRange>& visibleRanges)
 {
-	m_swapChainFrameBuffers.resize(m_swapChainImageViews.size());
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
 
-	for (size_t i = 0; i < m_swapChainImageViews.size(); i++)
+	for (uint32_t i = first; i < last; i++)
 	{
-		VkImageView attachments[] = { m_swapChainImageViews[i] };
+		const DrawCommand& draw = m_frameDrawCommands[i];
 
-		VkFramebufferCreateInfo frameBufferInfo{};
-		frameBufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		frameBufferInfo.renderPass = m_renderPass;
-		frameBufferInfo.attachmentCount = 1;
-		frameBufferInfo.pAttachments = attachments;
-		frameBufferInfo.width = m_swapChainExtent.width;
-		frameBufferInfo.height = m_swapChainExtent.height;
-		frameBufferInfo.layers = 1;
+		// Still compiling in the background, or not part of this pass, e.g. draws without depth writes in the pre-pass
+		if (pipelines[i] == VK_NULL_HANDLE)
+		{
+			continue;
+		}
 
-		if (vkCreateFramebuffer(m_device, &frameBufferInfo, nullptr, &m_swapChainFrameBuffers[i]) != VK_SUCCESS)
+		if (pipelines[i] != boundPipeline)
 		{
-			Logger::Error("FAILED TO CREATE FRAME BUFFER");
+			boundPipeline = pipelines[i];
 
-			throw std::runtime_error("[VK] : FAILED TO CREATE FRAME BUFFER");
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, boundPipeline);
 		}
-	}
 
-	Logger::Info("FRAME BUFFER CREATED SUCCESSFULLY");
-}
+		if (draw.mesh != nullptr)
+		{
+			const GpuMesh& mesh = *draw.mesh;
 
-void EngineRenderer::CreateCommandPool()
-{
-	QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(m_physicalDevice);
+			// Same for meshes whose upload has not landed yet
+			if (!m_uploadManager.IsBatchComplete(mesh.uploadBatch) || draw.lod >= mesh.lodCount)
+			{
+				continue;
+			}
 
-	VkCommandPoolCreateInfo poolInfo{};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+			VkDeviceSize offset = 0;
 
-	if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS)
-	{
-		Logger::Error("FAILED TO CREATE COMMAND POOL");
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh.vertexBuffer, &offset);
+			vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer, 0, mesh.indexType);
 
-		throw std::runtime_error("FAILED TO CREATE COMMAND POOL");
-	}
+			// The culling view is in the object space of one instance, other instances of the draw sit elsewhere
+			if (draw.cullMeshlets && draw.instanceCount == 1 && draw.lod == 0 && !mesh.meshlets.empty())
+			{
+				visibleRanges.clear();
 
-	Logger::Info("COMMAND POOL CREATED SUCCESSFULLY");
-}
+				ClusterCulling::CullMeshlets(draw.cullingView, mesh.meshlets, visibleRanges);
 
-void EngineRenderer::CreateCommandBuffer()
-{
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = m_commandPool;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = 1;
+				for (const IndexRange& range : visibleRanges)
+				{
+					vkCmdDrawIndexed(commandBuffer, range.indexCount, draw.instanceCount, range.firstIndex, 0, draw.firstInstance);
+				}
 
-	if (vkAllocateCommandBuffers(m_device, &allocInfo, &m_commandBuffer) != VK_SUCCESS)
-	{
-		Logger::Error("FAILED TO ALLOCATE COMMAND BUFFERS");
+				continue;
+			}
 
-		throw std::runtime_error("FAILED TO ALLOCATE COMMAND BUFFERS");
-	}
+			vkCmdDrawIndexed(commandBuffer, mesh.lods[draw.lod].indexCount, draw.instanceCount, mesh.lods[draw.lod].firstIndex, 0, draw.firstInstance);
 
-	Logger::Info("COMMAND BUFFERS CREATED SUCCESSFULLY");
+			continue;
+		}
+
+		vkCmdDraw(commandBuffer, draw.vertexCount, draw.instanceCount, draw.firstVertex, draw.firstInstance);
+	}
 }
 
-void EngineRenderer::CreateSyncObjects()
+VkCommandBuffer EngineRenderer::RecordSecondary(FrameResources& frame, VkRenderPass renderPass, VkFramebuffer framebuffer, const std::function<void(VkCommandBuffer, std::vector<IndexRange>&)>& record)
 {
-	VkSemaphoreCreateInfo semaphoreInfo{};
-	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	VkResult result;
 
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	ThreadCommandPool& threadPool = frame.threadPools[JobSystem::GetThreadIndex()];
 
-	VkResult result_imageAvailableSemaphore = vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_imageAvailableSemaphore);
-	
-	if (result_imageAvailableSemaphore != VK_SUCCESS)
+	if (threadPool.usedBuffers == threadPool.secondaryBuffers.size())
 	{
-		Logger::Error("FAILED TO CREATE IMAGE AVAILABLE SEMAPHORE");
-		Logger::Error("%s", string_VkResult(result_imageAvailableSemaphore));
-	}
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = threadPool.commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
 
-	VkResult result_renderFinishedSemaphore = vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_renderFinishedSemaphore);
+		VkCommandBuffer secondaryBuffer = VK_NULL_HANDLE;
 
-	if (result_renderFinishedSemaphore != VK_SUCCESS)
-	{
-		Logger::Error("FAILED TO CREATE IMAGE AVAILABLE SEMAPHORE");
-		Logger::Error("%s", string_VkResult(result_renderFinishedSemaphore));
-	}
+		result = vkAllocateCommandBuffers(m_device, &allocInfo, &secondaryBuffer);
 
-	VkResult result_inFlightFence = vkCreateFence(m_device, &fenceInfo, nullptr, &m_inFlightFence);
+		if (result != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO ALLOCATE SECONDARY COMMAND BUFFER");
+			Logger::Error("%s", string_VkResult(result));
 
-	if (result_inFlightFence != VK_SUCCESS)
-	{
-		Logger::Error("FAILED TO CREATE IN FLIGHT FENCE");
-		Logger::Error("%s", string_VkResult(result_inFlightFence));
-	}
+			// Throwing would take down the worker thread, the chunk's draws are dropped for this frame instead
+			return VK_NULL_HANDLE;
+		}
 
-	if (result_imageAvailableSemaphore != VK_SUCCESS || result_renderFinishedSemaphore != VK_SUCCESS || result_inFlightFence != VK_SUCCESS)
-	{
-		Logger::Error("FAILED TO CREATE SYNC OBJECTS");
+		threadPool.secondaryBuffers.push_back(secondaryBuffer);
 	}
-}
 
-void EngineRenderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
-{
-	VkResult result;
+	VkCommandBuffer commandBuffer = threadPool.secondaryBuffers[threadPool.usedBuffers++];
+
+	VkCommandBufferInheritanceInfo inheritanceInfo{};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = framebuffer;
 
 	VkCommandBufferBeginInfo beginInfo{};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
 
 	result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
 
 	if (result != VK_SUCCESS)
 	{
-		Logger::Error("FAILED TO BEGIN RECORDING COMMAND BUFFER");
+		Logger::Error("FAILED TO BEGIN RECORDING SECONDARY COMMAND BUFFER");
 		Logger::Error("%s", string_VkResult(result));
+
+		// The buffer is not recording, executing it would be invalid. It stays taken until the pool is reset.
+		return VK_NULL_HANDLE;
 	}
 
-	VkRenderPassBeginInfo renderPassInfo{};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassInfo.renderPass = m_renderPass;
-	renderPassInfo.framebuffer = m_swapChainFrameBuffers[imageIndex];
-	renderPassInfo.renderArea.offset = { 0, 0 };
-	renderPassInfo.renderArea.extent = m_swapChainExtent;
+	// Dynamic state is not inherited from the primary buffer
+	SetViewportAndScissor(commandBuffer);
 
-	VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
-	renderPassInfo.clearValueCount = 1;
-	renderPassInfo.pClearValues = &clearColor;
+	record(commandBuffer, threadPool.visibleRanges);
+
+	result = vkEndCommandBuffer(commandBuffer);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO RECORD SECONDARY COMMAND BUFFER");
+		Logger::Error("%s", string_VkResult(result));
 
-	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		return VK_NULL_HANDLE;
+	}
 
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+	return commandBuffer;
+}
 
+void EngineRenderer::SetViewportAndScissor(VkCommandBuffer commandBuffer)
+{
 	VkViewport viewport{};
 	viewport.x = 0.0f;
 	viewport.y = 0.0f;
@@ -763,18 +1784,34 @@ void EngineRenderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t
 	scissor.offset = { 0, 0 };
 	scissor.extent = m_swapChainExtent;
 	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
 
-	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
-
-	vkCmdEndRenderPass(commandBuffer);
-
-	result = vkEndCommandBuffer(commandBuffer);
-
-	if (result != VK_SUCCESS)
-	{
-		Logger::Error("FAILED TO RECORD COMMAND BUFFER");
-		Logger::Error("%s", string_VkResult(result));
-	}
+void EngineRenderer::RecordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	VkBufferImageCopy region{};
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { m_swapChainExtent.width, m_swapChainExtent.height, 1 };
+
+	vkCmdCopyImageToBuffer(commandBuffer, m_swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_readbackBuffer, 1, &region);
+
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = m_readbackBuffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
 }
 
 void EngineRenderer::PickPhysicalDevice()
@@ -818,6 +1855,8 @@ void EngineRenderer::PickPhysicalDevice()
 	if (m_physicalDevice == VK_NULL_HANDLE) 
 	{
 		Logger::Error("FAILED TO FIND A SUITABLE GPU");
+
+		throw std::runtime_error("FAILED TO FIND A SUITABLE GPU");
 	}
 
 	VkPhysicalDeviceProperties m_physicalDeviceProperties;
@@ -869,23 +1908,6 @@ void EngineRenderer::DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugU
 	}
 }
 
-VkShaderModule EngineRenderer::CreateShaderModule(const std::vector<char>& code)
-{
-	VkShaderModuleCreateInfo createInfo{};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-	VkShaderModule shaderModule;
-
-	if (vkCreateShaderModule(m_device, &createInfo, nullptr, &shaderModule))
-	{
-		Logger::Error("FAILED TO CREATE SHADER MODULE");
-	}
-
-	return shaderModule;
-}
-
 bool EngineRenderer::CheckValidationLayerSupport()
 {
 	VkResult result;
@@ -914,7 +1936,7 @@ bool EngineRenderer::CheckValidationLayerSupport()
 	{
 		bool layerFound = false;
 
-		Logger::Trace("LOCATING LAYER: %s", layerName);
+		CDNL_LOG_TRACE("LOCATING LAYER: %s", layerName);
 
 		for (const VkLayerProperties& layer : availableLayers) 
 		{
@@ -945,9 +1967,10 @@ bool EngineRenderer::IsDeviceSuitable(VkPhysicalDevice device)
 
 	bool extensionsSupported = CheckDeviceExtensionsSupport(device);
 
-	bool swapChainAdequate = false;
+	// Without a surface there is no swap chain to validate
+	bool swapChainAdequate = m_headless;
 
-	if (extensionsSupported)
+	if (extensionsSupported && !m_headless)
 	{
 		SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(device);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
@@ -957,10 +1980,28 @@ bool EngineRenderer::IsDeviceSuitable(VkPhysicalDevice device)
 }
 
 bool EngineRenderer::CheckDeviceExtensionsSupport(VkPhysicalDevice device)
+{
+	std::vector<VkExtensionProperties> availableExtensions = GetAvailableDeviceExtensions(device);
+
+	std::vector<const char*> deviceExtensions = GetRequiredDeviceExtensions();
+
+	std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+
+	for (const VkExtensionProperties& extension : availableExtensions) 
+	{
+		requiredExtensions.erase(extension.extensionName);
+
+		Logger::Info("%s SUPPORTED", extension.extensionName);
+	}
+	
+	return requiredExtensions.empty();																		
+}
+
+std::vector<VkExtensionProperties> EngineRenderer::GetAvailableDeviceExtensions(VkPhysicalDevice device)
 {
 	VkResult result;
 
-	uint32_t extensionCount;
+	uint32_t extensionCount = 0;
 
 	result = vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
 
@@ -980,26 +2021,23 @@ bool EngineRenderer::CheckDeviceExtensionsSupport(VkPhysicalDevice device)
 		Logger::Error("%s", string_VkResult(result));
 	}
 
-	std::set<std::string> requiredExtensions(m_deviceExtensions.begin(), m_deviceExtensions.end());
-
-	for (const VkExtensionProperties& extension : availableExtensions) 
-	{
-		requiredExtensions.erase(extension.extensionName);
-
-		Logger::Info("%s SUPPORTED", extension.extensionName);
-	}
-	
-	return requiredExtensions.empty();																		
+	return availableExtensions;
 }
 
 std::vector<const char*> EngineRenderer::GetRequiredExtensions() {
 
-	std::vector<const char*> enabledExtensions = { VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_DEBUG_UTILS_EXTENSION_NAME };
+	std::vector<const char*> enabledExtensions;
 
 	if (ENABLE_VALIDATION_LAYERS) {
 		enabledExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 	}
 
+	if (m_headless) {
+		return enabledExtensions;
+	}
+
+	enabledExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+
 #ifdef _WIN32
 	enabledExtensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 #endif // _WIN32
@@ -1011,6 +2049,16 @@ std::vector<const char*> EngineRenderer::GetRequiredExtensions() {
 	return enabledExtensions;
 }
 
+std::vector<const char*> EngineRenderer::GetRequiredDeviceExtensions()
+{
+	if (m_headless)
+	{
+		return {};
+	}
+
+	return m_deviceExtensions;
+}
+
 QueueFamilyIndices EngineRenderer::FindQueueFamilies(VkPhysicalDevice device)
 {
 	QueueFamilyIndices indicies;
@@ -1021,28 +2069,41 @@ QueueFamilyIndices EngineRenderer::FindQueueFamilies(VkPhysicalDevice device)
 	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
 	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
-	int i = 0;
+	for (uint32_t i = 0; i < queueFamilyCount; i++) {
 
-	for (const auto& queueFamily : queueFamilies) {
-		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+		VkQueueFlags flags = queueFamilies[i].queueFlags;
+
+		if ((flags & VK_QUEUE_GRAPHICS_BIT) && !indicies.graphicsFamily.has_value()) {
 			indicies.graphicsFamily = i;
 		}
 
+		// Families without graphics or compute map to the copy engines, uploads there run alongside rendering
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && !indicies.transferFamily.has_value()) {
+			indicies.transferFamily = i;
+		}
+
+		if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && !indicies.computeFamily.has_value()) {
+			indicies.computeFamily = i;
+		}
+
+		if (m_headless) {
+			continue;
+		}
+
 		VkBool32 presentSupport = false;
 
 		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &presentSupport);
 
-		if (presentSupport) {
+		// Prefer presenting from the graphics family so no ownership transfer is needed before present
+		if (presentSupport && (!indicies.presentFamily.has_value() || indicies.graphicsFamily == i)) {
 
 			indicies.presentFamily = i;
 		}
+	}
 
-		if (indicies.isComplete()) {
-
-			break;
-		}
-
-		i++;
+	// Nothing is presented in headless mode, the graphics queue stands in for the present queue
+	if (m_headless) {
+		indicies.presentFamily = indicies.graphicsFamily;
 	}
 
 	return indicies;
@@ -1078,6 +2139,39 @@ SwapChainSupportDetails EngineRenderer::QuerySwapChainSupport(VkPhysicalDevice d
 	return details;
 }
 
+VkFormat EngineRenderer::FindDepthFormat()
+{
+	// D32 keeps the most precision, the packed formats cover devices that only support depth together with stencil
+	const VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
+
+	for (VkFormat format : candidates)
+	{
+		VkFormatProperties properties;
+
+		vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &properties);
+
+		if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+		{
+			return format;
+		}
+	}
+
+	Logger::Error("FAILED TO FIND A SUPPORTED DEPTH FORMAT");
+
+	throw std::runtime_error("FAILED TO FIND A SUPPORTED DEPTH FORMAT");
+}
+
+VkImageAspectFlags EngineRenderer::GetDepthAspect(VkFormat format)
+{
+	// Barriers on combined formats have to cover both aspects
+	if (format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT)
+	{
+		return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+
+	return VK_IMAGE_ASPECT_DEPTH_BIT;
+}
+
 VkSurfaceFormatKHR EngineRenderer::ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
 {
 	for (const VkSurfaceFormatKHR& availableFormat : availableFormats)
@@ -1113,9 +2207,11 @@ VkExtent2D EngineRenderer::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capa
 	}
 	else
 	{
-		UINT width, height;
+		uint32_t width = 0, height = 0;
 
+#ifdef _WIN32
 		m_window->GetWindowDimensions(&width, &height);
+#endif // _WIN32
 
 		VkExtent2D actualExtent = {
 			static_cast<uint32_t>(width),
@@ -1,9 +1,15 @@
 #pragma once
 
+class EngineWindow;
+
 struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
 
+	// Only set when the device exposes a family dedicated to transfers / compute without graphics
+	std::optional<uint32_t> transferFamily;
+	std::optional<uint32_t> computeFamily;
+
 	bool isComplete()
 	{
 		return graphicsFamily.has_value() && presentFamily.has_value();
@@ -17,40 +23,335 @@ struct SwapChainSupportDetails
 	std::vector<VkPresentModeKHR> presentModes;
 };
 
+// Secondary command buffers one job system thread records into during a frame.
+// Command pools are externally synchronized, so every thread gets its own and never touches another thread's.
+struct ThreadCommandPool
+{
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+
+	// Allocated on demand and kept across frames, vkResetCommandPool returns them to the initial state
+	std::vector<VkCommandBuffer> secondaryBuffers;
+	uint32_t usedBuffers = 0;
+
+	// Scratch for the index ranges of visible meshlets
+	std::vector<IndexRange> visibleRanges;
+};
+
+// Everything a single frame touches while it is being recorded or executed.
+// One set exists per frame in flight so the CPU can record frame N+1 while the GPU is still working on frame N.
+struct FrameResources
+{
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+
+	// Indexed by JobSystem::GetThreadIndex
+	std::vector<ThreadCommandPool> threadPools;
+
+	VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
+
+	VkFence inFlightFence = VK_NULL_HANDLE;
+};
+
+// A resource that may still be referenced by frames in flight, released once the tagged frame has retired.
+struct PendingRelease
+{
+	uint64_t frameNumber = 0;
+
+	std::function<void()> release;
+};
+
+struct GpuMesh
+{
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+
+	MemoryAllocation vertexAllocation;
+	MemoryAllocation indexAllocation;
+
+	VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+	uint32_t indexCount = 0;
+
+	uint32_t lodCount = 0;
+	MeshFileLod lods[MESH_FILE_MAX_LODS] = {};
+
+	// CPU copy of the LOD 0 clusters for culling
+	std::vector<MeshFileMeshlet> meshlets;
+
+	// The buffers may be used once this upload batch has completed
+	uint64_t uploadBatch = 0;
+
+	// Coarsest LOD whose error stays below maxPixelError on screen. pixelsPerUnit is the projected size of one
+	// object space unit at distance 1, viewport height / (2 tan(fovY / 2)) times the instance scale.
+	uint32_t SelectLod(float distance, float pixelsPerUnit, float maxPixelError = 1.0f) const;
+};
+
+struct DrawCommand
+{
+	PipelineKey pipeline = 0;
+
+	// Indexed draw of one LOD when set, vertexCount and firstVertex are ignored then
+	const GpuMesh* mesh = nullptr;
+	uint32_t lod = 0;
+
+	// Draws only the LOD 0 meshlets inside the frustum and not facing away from the eye. cullingView is in the object
+	// space of the drawn instance, so draws of more than one instance ignore it and draw LOD 0 whole.
+	bool cullMeshlets = false;
+	CullingView cullingView = {};
+
+	uint32_t vertexCount = 0;
+	uint32_t instanceCount = 1;
+	uint32_t firstVertex = 0;
+	uint32_t firstInstance = 0;
+};
+
 class EngineRenderer
 {
 public:
-	EngineRenderer(EngineWindow* window);
+	static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+	static constexpr VkDeviceSize FRAME_ARENA_SIZE = 4 << 20;
+
+	static constexpr const char* PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+
+	// Frames with fewer draws are recorded inline, below this the job round trips cost more than they save
+	static constexpr uint32_t MIN_DRAWS_PER_SECONDARY = 128;
+
+	// Splitting finer than the thread count keeps the threads busy when some chunks cull more than others
+	static constexpr uint32_t SECONDARIES_PER_THREAD = 4;
+
+	EngineRenderer(EngineWindow* window, uint32_t framesInFlight = MAX_FRAMES_IN_FLIGHT);
+
+	// Headless renderer: draws into offscreen images without a surface or swap chain.
+	EngineRenderer(uint32_t width, uint32_t height, uint32_t framesInFlight = MAX_FRAMES_IN_FLIGHT);
+
 	~EngineRenderer();
 
 public:
+	// Draws are recorded in parallel on the job system's threads when set. Must be called before Init.
+	void SetJobSystem(JobSystem* jobSystem) { this->m_jobSystem = jobSystem; }
+
 	bool Init();
 	bool Destroy();
 
 	void DrawFrame();
 
+	// Queues a release callback that runs once the frame currently being recorded has retired on the GPU.
+	void DeferRelease(std::function<void()> release);
+
+	// Headless only: renders one frame and copies it into pixels as tightly packed RGBA8, blocking until the GPU is done.
+	bool CaptureFrame(std::vector<uint8_t>& pixels, uint32_t* width, uint32_t* height);
+
 	VkDevice GetVkDevice() { return m_device; }
+
+	VkExtent2D GetSwapChainExtent() { return m_swapChainExtent; }
+
+	MemoryAllocator* GetAllocator() { return m_allocator; }
+
+	FrameArena& GetFrameArena() { return m_frameArena; }
+	UploadManager& GetUploadManager() { return m_uploadManager; }
+
+	PipelineRegistry& GetPipelineRegistry() { return m_pipelineRegistry; }
+
+	// Registers a pipeline for the main render pass, the renderer fills in layout and render pass when left empty
+	PipelineKey RegisterPipeline(GraphicsPipelineDesc desc);
+
+	// Pipeline of the built-in triangle shaders
+	PipelineKey GetDefaultPipeline() { return m_defaultPipeline; }
+
+	// Draws with depth-writing pipelines first fill the depth buffer in a pre-pass, then shade with an equal depth test.
+	// Rebuilds the render graph, so it must not be called while a frame is being recorded.
+	void SetDepthPrepass(bool enabled);
+
+	bool IsDepthPrepassEnabled() { return m_depthPrepass; }
+
+	VkFormat GetDepthFormat() { return m_depthFormat; }
+
+	// Creates device local buffers for a cooked mesh and queues the copies straight from the mapped file
+	bool CreateMesh(const CookedMesh& mesh, GpuMesh* gpuMesh);
+
+	// The buffers are released once the frames that may still reference them have retired
+	void DestroyMesh(GpuMesh& gpuMesh);
+
+	// Queues a draw for the next DrawFrame. Draws are recorded grouped by pipeline, in submission order within a pipeline.
+	void SubmitDraw(const DrawCommand& drawCommand);
+
+	// Keeps a draw across frames, drawn whenever its world space bounds intersect the scene view's frustum. The draws
+	// live in a bounding volume tree, so culling tests the nodes the frustum reaches instead of every draw. Without a
+	// scene view every draw is drawn.
+	uint32_t AddSceneDraw(const DrawCommand& drawCommand, const Aabb& bounds);
+	void MoveSceneDraw(uint32_t sceneDraw, const Aabb& bounds);
+	void RemoveSceneDraw(uint32_t sceneDraw);
+
+	// Scene draws the last DrawFrame found inside the frustum
+	uint32_t GetVisibleSceneDrawCount() { return static_cast<uint32_t>(m_visibleSceneDraws.size()); }
+
+	// False when the device lacks what GPU driven drawing needs, the scene then stays empty
+	bool IsGpuSceneAvailable() { return m_gpuSceneAvailable; }
+
+	// Instances added here are culled and drawn on the GPU every frame without per-object CPU work
+	GpuScene& GetGpuScene() { return m_gpuScene; }
+
+	// Pipeline the GPU scene is drawn with, registered with the scene's vertex input and draw pipeline layout
+	void SetGpuScenePipeline(PipelineKey pipeline) { m_gpuScenePipeline = pipeline; }
+
+	// Camera the GPU scene and the scene draws are culled and drawn with from the next DrawFrame on. viewProjection is column-major with
+	// Vulkan's 0 to 1 depth range, pixelsPerUnit is viewport height / (2 tan(fovY / 2)) for LOD selection.
+	void SetGpuSceneView(const float* viewProjection, const float* eye, float pixelsPerUnit);
+
+	// Tests the GPU scene against a depth pyramid of the previous and the current frame's pre-pass depth. Needs the
+	// depth pre-pass, rebuilds the render graph, so it must not be called while a frame is being recorded.
+	void SetOcclusionCulling(bool enabled);
+
+	bool IsOcclusionCullingEnabled() { return m_occlusionCulling; }
+
+	// Counts of a frame that retired up to GetFramesInFlight() frames ago
+	GpuCullingStats GetGpuCullingStats() { return m_gpuScene.GetCullingStats(); }
+
+	// World matrices of the hierarchy's nodes are written into the GPU scene's transform buffer at the start of every
+	// frame, for the instances added with GpuScene::AddNodeInstance. The hierarchy must be updated before DrawFrame.
+	void SetTransformHierarchy(TransformHierarchy* transforms) { m_transforms = transforms; }
+
+	bool IsHeadless() { return m_headless; }
+
+	uint32_t GetFramesInFlight() { return m_framesInFlight; }
+	uint32_t GetCurrentFrameIndex() { return m_currentFrame; }
 	
 private:
 	EngineWindow* m_window;
 
+	JobSystem* m_jobSystem = nullptr;
+
 private:
+	bool m_headless = false;
+
+	// In headless mode these hold the offscreen render targets instead of swap chain images
 	std::vector<VkImage> m_swapChainImages;
 	std::vector<VkImageView> m_swapChainImageViews;
 
+	// Indexed by swap chain image. Presentation may still wait on an image's semaphore when the frame slot that
+	// signaled it comes around again, so they follow the images rather than the frame slots.
+	std::vector<VkSemaphore> m_renderFinishedSemaphores;
+
 	const std::vector<const char*> m_validationLayers = { "VK_LAYER_KHRONOS_validation" };
 	const std::vector<const char*> m_deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
-	std::vector<VkFramebuffer> m_swapChainFrameBuffers;
+	// Enabled when the device has them, features built on top check for them at runtime
+	const std::vector<const char*> m_optionalDeviceExtensions = { VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME };
 
-	const int MAX_FRAMES_IN_FLIGHT = 2;
+	std::vector<FrameResources> m_frames;
 
-private:
+	// Fence of the frame that last rendered into each swap chain image, VK_NULL_HANDLE if the image is idle.
+	std::vector<VkFence> m_imagesInFlight;
+
+	uint32_t m_framesInFlight = MAX_FRAMES_IN_FLIGHT;
+	uint32_t m_currentFrame = 0;
+
+	// Number of frames submitted so far, used to tell when deferred releases are safe
+	uint64_t m_frameNumber = 0;
+
+	std::deque<PendingRelease> m_releaseQueue;
+
+	bool m_swapChainOutOfDate = false;
+
+	MemoryAllocator* m_allocator = nullptr;
+
+	// Transient per-frame data (uniforms, dynamic vertices), one segment per frame in flight
+	FrameArena m_frameArena;
+
+	UploadManager m_uploadManager;
+
+	PipelineCache m_pipelineCache;
+
+	PipelineRegistry m_pipelineRegistry;
+
+	PipelineKey m_defaultPipeline = 0;
+
+	// Rebuilt with the swap chain, the back buffer is swapped in per frame
+	RenderGraph m_renderGraph;
+	RenderGraphResource m_backBuffer = INVALID_RENDER_GRAPH_RESOURCE;
+	RenderGraphResource m_depthBuffer = INVALID_RENDER_GRAPH_RESOURCE;
+	uint32_t m_prepassPass = 0;
+	uint32_t m_mainPass = 0;
+
+	bool m_depthPrepass = true;
+	bool m_occlusionCulling = true;
+
+	VkFormat m_depthFormat = VK_FORMAT_UNDEFINED;
+
+	// The depth pyramid samples the depth buffer, which not every depth format supports
+	bool m_depthSampleable = false;
+
+	struct DepthPipelineVariants
+	{
+		PipelineKey depthOnly = 0;
+		PipelineKey depthEqual = 0;
+	};
+
+	// Pre-pass variants of every registered pipeline that writes depth
+	std::unordered_map<PipelineKey, DepthPipelineVariants> m_depthVariants;
+
+	// Swap chain image of the frame being recorded
+	uint32_t m_currentImageIndex = 0;
+
+	// Draws submitted for the next frame, and the ones being recorded for the current frame
+	std::vector<DrawCommand> m_drawCommands;
+	std::vector<DrawCommand> m_frameDrawCommands;
+
+	struct SceneDraw
+	{
+		DrawCommand command;
+
+		// INVALID_SPATIAL_PROXY for removed draws
+		uint32_t proxy = INVALID_SPATIAL_PROXY;
+	};
+
+	// Indexed by scene draw id, the tree's proxies carry the id as user data
+	std::vector<SceneDraw> m_sceneDraws;
+	std::vector<uint32_t> m_freeSceneDraws;
+	DynamicAabbTree m_sceneTree;
+	std::vector<uint32_t> m_visibleSceneDraws;
+
+	// Set while a capture redraws the last frame's list, which already holds its visible scene draws
+	bool m_repeatingDraws = false;
 
-	VkSemaphore m_imageAvailableSemaphore;
-	VkSemaphore m_renderFinishedSemaphore;
+	// Pipelines of each frame draw in the main pass and the pre-pass, resolved before recording so the recording threads never compile
+	std::vector<VkPipeline> m_drawPipelines;
+	std::vector<VkPipeline> m_depthPipelines;
 
-	VkFence m_inFlightFence;
+	// Secondary command buffer of each draw chunk, executed in chunk order
+	std::vector<VkCommandBuffer> m_chunkCommandBuffers;
+	std::vector<VkCommandBuffer> m_prepassCommandBuffers;
+	bool m_parallelRecording = false;
+
+	std::vector<MemoryAllocation> m_offscreenImageAllocations;
+
+	VkBuffer m_readbackBuffer = VK_NULL_HANDLE;
+	MemoryAllocation m_readbackAllocation;
+
+	bool m_captureRequested = false;
+
+	GpuScene m_gpuScene;
+	GpuSceneFeatures m_gpuSceneFeatures;
+	bool m_gpuSceneAvailable = false;
+
+	PipelineKey m_gpuScenePipeline = 0;
+	uint32_t m_gpuCullingPass = 0;
+
+	TransformHierarchy* m_transforms = nullptr;
+
+	// Whether the graph holds the pyramid, the late culling and the late pre-pass
+	bool m_occlusionPasses = false;
+
+	CullingView m_gpuSceneView = {};
+	float m_gpuSceneViewProjection[16] = {};
+	float m_gpuScenePixelsPerUnit = 0.0f;
+	bool m_gpuSceneViewSet = false;
+
+	// Resolved per frame like m_drawPipelines, the scene is skipped when it has nothing to draw
+	bool m_gpuSceneDrawing = false;
+	VkPipeline m_gpuSceneShadePipeline = VK_NULL_HANDLE;
+	VkPipeline m_gpuSceneDepthPipeline = VK_NULL_HANDLE;
+
+private:
 
 	VkDevice m_device;
 
@@ -60,18 +361,20 @@ private:
 
 	VkQueue m_presentQueue;
 	VkQueue m_graphicsQueue;
+	VkQueue m_transferQueue = VK_NULL_HANDLE;
+	VkQueue m_computeQueue = VK_NULL_HANDLE;
+
+	// Held around submissions and presents, the upload manager submits to the graphics queue from loading threads
+	// when the device has no transfer queue
+	std::mutex m_queueMutex;
 
 	VkRenderPass m_renderPass;
+	VkRenderPass m_depthRenderPass = VK_NULL_HANDLE;
 
 	VkSwapchainKHR m_swapChain;
 
-	VkCommandPool m_commandPool;
-	VkCommandBuffer m_commandBuffer;
-
 	VkExtent2D m_swapChainExtent;
 
-	VkPipeline m_graphicsPipeline;
-
 	VkFormat m_swapChainImageFormat;
 
 	VkPipelineLayout m_pipelineLayout;
@@ -91,7 +394,13 @@ private:
 
 	void CreateLogicalDevice();
 
-	void CreateSwapChain();
+	void CreateSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
+
+	bool RecreateSwapChain();
+
+	void CreateOffscreenTargets();
+
+	void DestroyOffscreenTargets();
 
 	void CreateImageViews();
 
@@ -99,13 +408,13 @@ private:
 
 	void CreateGraphicsPipeline();
 
-	void CreateFrameBuffers();
+	void BuildRenderGraph();
 
-	void CreateCommandPool();
+	void CreateFrameResources();
 
-	void CreateCommandBuffer();
+	void DestroyFrameResources();
 
-	void CreateSyncObjects();
+	void FlushReleaseQueue(bool releaseAll);
 
 private:
 
@@ -115,29 +424,57 @@ private:
 
 	bool CheckDeviceExtensionsSupport(VkPhysicalDevice device);
 
+	std::vector<VkExtensionProperties> GetAvailableDeviceExtensions(VkPhysicalDevice device);
+
 	void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
 
+	// Shading and pre-pass pipeline of a draw, VK_NULL_HANDLE where the draw is skipped
+	void ResolveDrawPipelines(PipelineKey key, VkPipeline* shadePipeline, VkPipeline* depthPipeline);
+
+	// Splits the frame's draws into chunks that are recorded into secondary command buffers on the job system.
+	// The GPU scene's indirect draw goes into one more secondary after them.
+	void RecordPassInParallel(FrameResources& frame, uint32_t pass, const std::vector<VkPipeline>& pipelines, VkPipeline gpuScenePipeline, uint32_t gpuScenePhases, std::vector<VkCommandBuffer>& commandBuffers);
+
+	// Render graph callback of the pre-pass and the main pass, executes the secondaries or records inline
+	void RecordDrawPass(const RenderGraphPassContext& context, const std::vector<VkPipeline>& pipelines, VkPipeline gpuScenePipeline, uint32_t gpuScenePhases, const std::vector<VkCommandBuffer>& commandBuffers);
+
+	// Records m_frameDrawCommands[first, last) with pipelines[i] into a command buffer inside a render pass, skipping draws without a pipeline
+	void RecordDraws(VkCommandBuffer commandBuffer, const std::vector<VkPipeline>& pipelines, uint32_t first, uint32_t last, std::vector<IndexRange>& visibleRanges);
+
+	// Records into a secondary command buffer taken from the calling thread's pool, record gets the thread's culling scratch.
+	// Returns VK_NULL_HANDLE when the buffer cannot be allocated or recorded, the caller drops it from the executed buffers.
+	VkCommandBuffer RecordSecondary(FrameResources& frame, VkRenderPass renderPass, VkFramebuffer framebuffer, const std::function<void(VkCommandBuffer, std::vector<IndexRange>&)>& record);
+
+	void SetViewportAndScissor(VkCommandBuffer commandBuffer);
+
+	void RecordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
 	void PopulateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
 
 private:
 	std::vector<const char*> GetRequiredExtensions();
 
+	std::vector<const char*> GetRequiredDeviceExtensions();
+
 private:
 	QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device);
 
 	SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device);
 
+	VkFormat FindDepthFormat();
+
+	static VkImageAspectFlags GetDepthAspect(VkFormat format);
+
 	VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
 
 	VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes);
 
 	VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 
+
 	VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger);
 
 	void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator);
-	
-	VkShaderModule CreateShaderModule(const std::vector<char>& code);
 
 private:
 	static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* userData);
@@ -3,6 +3,8 @@
 
 #include "core.h"
 
+#ifdef _WIN32
+
 EngineWindow::EngineWindow(LPCWSTR windowName, UINT width, UINT height): m_windowName(windowName), m_width(width), m_height(height)
 {
 	m_appInstance = GetModuleHandle(NULL);
@@ -30,6 +32,8 @@ EngineWindow::EngineWindow(LPCWSTR windowName, UINT width, UINT height): m_windo
 		throw std::runtime_error("FAILED TO CREATE ENGINE WINDOW");
 	}
 
+	SetWindowLongPtr(m_window, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
+
 	ShowWindow(m_window, SW_SHOWDEFAULT);
 }
 
@@ -46,24 +50,48 @@ void EngineWindow::GetWindowDimensions(UINT* width, UINT* height)
 	*height = m_height;
 }
 
+bool EngineWindow::ConsumeResize()
+{
+	bool resized = m_resized;
+
+	m_resized = false;
+
+	return resized;
+}
+
 LRESULT CALLBACK EngineWindow::WindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
 	switch (uMsg)
 	{
-	case WM_QUIT:
+	case WM_CLOSE:
+		// The application owns the window, ask it to shut down instead of destroying the window under the renderer
 		PostQuitMessage(0);
 
-		break;
+		return 0;
 	case WM_DESTROY:
 		DestroyWindow(hWnd);
 
 		break;
 
 	case WM_SIZE:
+	{
+		EngineWindow* window = reinterpret_cast<EngineWindow*>(GetWindowLongPtr(hWnd, GWLP_USERDATA));
+
+		if (window != nullptr)
+		{
+			window->m_width = LOWORD(lParam);
+			window->m_height = HIWORD(lParam);
+			window->m_resized = true;
+		}
+
+		break;
+	}
 	default:
 
 		break;
 	}
 
 	return DefWindowProc(hWnd, uMsg, wParam, lParam);
-}
\ No newline at end of file
+}
+
+#endif // _WIN32
\ No newline at end of file
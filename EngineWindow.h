@@ -1,5 +1,7 @@
 #pragma once
 
+#ifdef _WIN32
+
 class EngineWindow
 {
 
@@ -17,6 +19,8 @@ private:
 	UINT m_width = 1280;
 	UINT m_height = 720;
 
+	bool m_resized = false;
+
 public:
 
 	HWND GetWindow() { return m_window; }
@@ -24,8 +28,12 @@ public:
 
 	void GetWindowDimensions(UINT* width, UINT* height);
 
+	// Returns true once after the client area changed size
+	bool ConsumeResize();
+
 private:
 
 	static LRESULT CALLBACK WindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 };
 
+#endif // _WIN32
@@ -0,0 +1,563 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+static std::mutex s_componentMutex;
+static ComponentInfo s_componentInfos[MAX_COMPONENT_TYPES];
+static std::atomic<uint32_t> s_componentCount = 0;
+
+static uint32_t AlignUp(uint32_t value, uint32_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+ComponentType ComponentRegistry::Register(uint32_t size, uint32_t alignment)
+{
+	std::lock_guard<std::mutex> lock(s_componentMutex);
+
+	uint32_t type = s_componentCount.load(std::memory_order_relaxed);
+
+	if (type >= MAX_COMPONENT_TYPES)
+	{
+		Logger::Error("TOO MANY COMPONENT TYPES, THE LIMIT IS %u", MAX_COMPONENT_TYPES);
+
+		throw std::runtime_error("TOO MANY COMPONENT TYPES");
+	}
+
+	s_componentInfos[type] = { size, alignment };
+	s_componentCount.store(type + 1, std::memory_order_release);
+
+	return type;
+}
+
+const ComponentInfo& ComponentRegistry::GetInfo(ComponentType type)
+{
+	return s_componentInfos[type];
+}
+
+uint32_t ComponentRegistry::GetCount()
+{
+	return s_componentCount.load(std::memory_order_acquire);
+}
+
+Entity EntityCommandBuffer::CreateEntity()
+{
+	Entity entity = { PENDING_ENTITY_BIT | m_createdEntities++, 0 };
+
+	m_commands.push_back({ CommandType::CreateEntity, 0, entity, 0 });
+
+	return entity;
+}
+
+void EntityCommandBuffer::DestroyEntity(Entity entity)
+{
+	Record(CommandType::DestroyEntity, entity, 0, nullptr);
+}
+
+void EntityCommandBuffer::Clear()
+{
+	m_commands.clear();
+	m_data.clear();
+
+	m_createdEntities = 0;
+}
+
+void EntityCommandBuffer::Record(CommandType type, Entity entity, ComponentType component, const void* data)
+{
+	Command command = { type, component, entity, 0 };
+
+	// Values are copied back with memcpy on playback, so the byte stream needs no alignment
+	if (data != nullptr)
+	{
+		uint32_t size = ComponentRegistry::GetInfo(component).size;
+
+		command.dataOffset = static_cast<uint32_t>(m_data.size());
+
+		m_data.insert(m_data.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+	}
+
+	m_commands.push_back(command);
+}
+
+EntityWorld::EntityWorld()
+{
+	// Archetype 0 holds entities without components
+	GetOrCreateArchetype(0);
+}
+
+EntityWorld::~EntityWorld()
+{
+	Clear();
+
+	for (uint8_t* data : m_freeChunks)
+	{
+		::operator delete(data, std::align_val_t(ENTITY_COLUMN_ALIGNMENT));
+	}
+
+	m_freeChunks.clear();
+}
+
+void EntityWorld::Clear()
+{
+	for (std::unique_ptr<Archetype>& archetype : m_archetypes)
+	{
+		for (EntityChunk& chunk : archetype->chunks)
+		{
+			m_freeChunks.push_back(chunk.data);
+		}
+
+		archetype->chunks.clear();
+	}
+
+	// Generations keep counting so handles from before the clear stay invalid
+	m_freeEntities.clear();
+
+	for (uint32_t index = static_cast<uint32_t>(m_entities.size()); index-- > 0;)
+	{
+		if (m_entities[index].archetype != NO_ARCHETYPE)
+		{
+			m_entities[index].archetype = NO_ARCHETYPE;
+			m_entities[index].generation++;
+		}
+
+		m_freeEntities.push_back(index);
+	}
+
+	m_entityCount = 0;
+}
+
+Entity EntityWorld::CreateEntity()
+{
+	return CreateEntity(0);
+}
+
+Entity EntityWorld::CreateEntity(ComponentMask mask)
+{
+	if (!IsStructuralChangeAllowed())
+	{
+		return INVALID_ENTITY;
+	}
+
+	uint32_t index;
+
+	if (!m_freeEntities.empty())
+	{
+		index = m_freeEntities.back();
+
+		m_freeEntities.pop_back();
+	}
+	else
+	{
+		index = static_cast<uint32_t>(m_entities.size());
+
+		m_entities.emplace_back();
+	}
+
+	uint32_t archetypeIndex = GetOrCreateArchetype(mask);
+	Archetype& archetype = *m_archetypes[archetypeIndex];
+
+	EntityRecord& record = m_entities[index];
+	record.archetype = archetypeIndex;
+
+	AllocateRow(archetype, &record.chunk, &record.row);
+
+	Entity entity = { index, record.generation };
+
+	EntityChunk& chunk = archetype.chunks[record.chunk];
+
+	reinterpret_cast<Entity*>(chunk.data)[record.row] = entity;
+
+	for (uint32_t column = 0; column < archetype.types.size(); column++)
+	{
+		uint32_t size = ComponentRegistry::GetInfo(archetype.types[column]).size;
+
+		memset(chunk.data + archetype.offsets[column] + static_cast<size_t>(record.row) * size, 0, size);
+	}
+
+	m_entityCount++;
+
+	return entity;
+}
+
+void EntityWorld::DestroyEntity(Entity entity)
+{
+	if (!IsAlive(entity) || !IsStructuralChangeAllowed())
+	{
+		return;
+	}
+
+	EntityRecord& record = m_entities[entity.index];
+
+	RemoveRow(*m_archetypes[record.archetype], record.chunk, record.row);
+
+	record.archetype = NO_ARCHETYPE;
+	record.generation++;
+
+	m_freeEntities.push_back(entity.index);
+	m_entityCount--;
+}
+
+bool EntityWorld::IsAlive(Entity entity)
+{
+	return entity.index < m_entities.size() && m_entities[entity.index].generation == entity.generation && m_entities[entity.index].archetype != NO_ARCHETYPE;
+}
+
+void* EntityWorld::AddComponent(Entity entity, ComponentType type)
+{
+	if (!IsAlive(entity))
+	{
+		return nullptr;
+	}
+
+	EntityRecord& record = m_entities[entity.index];
+
+	if ((m_archetypes[record.archetype]->mask & (ComponentMask(1) << type)) == 0)
+	{
+		if (!IsStructuralChangeAllowed())
+		{
+			return nullptr;
+		}
+
+		MoveEntity(entity, GetNeighbourArchetype(record.archetype, type, true));
+	}
+
+	return GetComponent(entity, type);
+}
+
+void EntityWorld::RemoveComponent(Entity entity, ComponentType type)
+{
+	if (!IsAlive(entity))
+	{
+		return;
+	}
+
+	EntityRecord& record = m_entities[entity.index];
+
+	if ((m_archetypes[record.archetype]->mask & (ComponentMask(1) << type)) == 0 || !IsStructuralChangeAllowed())
+	{
+		return;
+	}
+
+	MoveEntity(entity, GetNeighbourArchetype(record.archetype, type, false));
+}
+
+void* EntityWorld::GetComponent(Entity entity, ComponentType type)
+{
+	if (!IsAlive(entity))
+	{
+		return nullptr;
+	}
+
+	const EntityRecord& record = m_entities[entity.index];
+	const Archetype& archetype = *m_archetypes[record.archetype];
+
+	uint8_t column = archetype.columns[type];
+
+	if (column == NO_COLUMN)
+	{
+		return nullptr;
+	}
+
+	return archetype.chunks[record.chunk].data + archetype.offsets[column] + static_cast<size_t>(record.row) * ComponentRegistry::GetInfo(type).size;
+}
+
+bool EntityWorld::HasComponent(Entity entity, ComponentType type)
+{
+	return IsAlive(entity) && (m_archetypes[m_entities[entity.index].archetype]->mask & (ComponentMask(1) << type)) != 0;
+}
+
+void EntityWorld::Playback(EntityCommandBuffer& commands)
+{
+	m_playbackEntities.assign(commands.m_createdEntities, INVALID_ENTITY);
+
+	for (const EntityCommandBuffer::Command& command : commands.m_commands)
+	{
+		Entity entity = command.entity;
+
+		if (command.type == EntityCommandBuffer::CommandType::CreateEntity)
+		{
+			m_playbackEntities[entity.index & ~EntityCommandBuffer::PENDING_ENTITY_BIT] = CreateEntity();
+
+			continue;
+		}
+
+		// Placeholders resolve to the entity their CreateEntity command made
+		if (entity.index != UINT32_MAX && (entity.index & EntityCommandBuffer::PENDING_ENTITY_BIT) != 0)
+		{
+			entity = m_playbackEntities[entity.index & ~EntityCommandBuffer::PENDING_ENTITY_BIT];
+		}
+
+		switch (command.type)
+		{
+		case EntityCommandBuffer::CommandType::DestroyEntity:
+			DestroyEntity(entity);
+			break;
+		case EntityCommandBuffer::CommandType::AddComponent:
+			{
+				void* data = AddComponent(entity, command.component);
+
+				if (data != nullptr)
+				{
+					memcpy(data, commands.m_data.data() + command.dataOffset, ComponentRegistry::GetInfo(command.component).size);
+				}
+			}
+			break;
+		case EntityCommandBuffer::CommandType::RemoveComponent:
+			RemoveComponent(entity, command.component);
+			break;
+		default:
+			break;
+		}
+	}
+
+	commands.Clear();
+}
+
+uint32_t EntityWorld::CountEntities(EntityQuery& query)
+{
+	UpdateQuery(query);
+
+	uint32_t count = 0;
+
+	for (uint32_t archetypeIndex : query.m_archetypes)
+	{
+		for (const EntityChunk& chunk : m_archetypes[archetypeIndex]->chunks)
+		{
+			count += chunk.count;
+		}
+	}
+
+	return count;
+}
+
+uint32_t EntityWorld::GetChunkCount()
+{
+	uint32_t count = 0;
+
+	for (const std::unique_ptr<Archetype>& archetype : m_archetypes)
+	{
+		count += static_cast<uint32_t>(archetype->chunks.size());
+	}
+
+	return count;
+}
+
+uint32_t EntityWorld::GetOrCreateArchetype(ComponentMask mask)
+{
+	auto it = m_archetypeLookup.find(mask);
+
+	if (it != m_archetypeLookup.end())
+	{
+		return it->second;
+	}
+
+	std::unique_ptr<Archetype> archetype = std::make_unique<Archetype>();
+	archetype->mask = mask;
+
+	memset(archetype->columns, NO_COLUMN, sizeof(archetype->columns));
+
+	uint32_t rowSize = sizeof(Entity);
+
+	for (ComponentType type = 0; type < MAX_COMPONENT_TYPES; type++)
+	{
+		if ((mask & (ComponentMask(1) << type)) != 0)
+		{
+			archetype->columns[type] = static_cast<uint8_t>(archetype->types.size());
+			archetype->types.push_back(type);
+
+			rowSize += ComponentRegistry::GetInfo(type).size;
+		}
+	}
+
+	archetype->offsets.resize(archetype->types.size());
+
+	// Start from the capacity the row size allows and shrink until the aligned arrays fit
+	for (uint32_t capacity = ENTITY_CHUNK_SIZE / rowSize; capacity > 0; capacity--)
+	{
+		uint32_t offset = capacity * sizeof(Entity);
+
+		for (uint32_t column = 0; column < archetype->types.size(); column++)
+		{
+			const ComponentInfo& info = ComponentRegistry::GetInfo(archetype->types[column]);
+
+			offset = AlignUp(offset, (std::max)(info.alignment, ENTITY_COLUMN_ALIGNMENT));
+
+			archetype->offsets[column] = info.size == 0 ? 0 : offset;
+
+			offset += capacity * info.size;
+		}
+
+		if (offset <= ENTITY_CHUNK_SIZE)
+		{
+			archetype->capacity = capacity;
+
+			break;
+		}
+	}
+
+	if (archetype->capacity == 0)
+	{
+		Logger::Error("ARCHETYPE ROW OF %u BYTES DOES NOT FIT A %u BYTE CHUNK", rowSize, ENTITY_CHUNK_SIZE);
+
+		throw std::runtime_error("ARCHETYPE DOES NOT FIT A CHUNK");
+	}
+
+	uint32_t index = static_cast<uint32_t>(m_archetypes.size());
+
+	m_archetypes.push_back(std::move(archetype));
+	m_archetypeLookup[mask] = index;
+
+	return index;
+}
+
+uint32_t EntityWorld::GetNeighbourArchetype(uint32_t archetype, ComponentType type, bool add)
+{
+	std::vector<std::pair<ComponentType, uint32_t>>& edges = add ? m_archetypes[archetype]->addEdges : m_archetypes[archetype]->removeEdges;
+
+	for (const std::pair<ComponentType, uint32_t>& edge : edges)
+	{
+		if (edge.first == type)
+		{
+			return edge.second;
+		}
+	}
+
+	ComponentMask bit = ComponentMask(1) << type;
+	ComponentMask mask = add ? (m_archetypes[archetype]->mask | bit) : (m_archetypes[archetype]->mask & ~bit);
+
+	uint32_t neighbour = GetOrCreateArchetype(mask);
+
+	// The archetypes live behind pointers, creating one above did not move this one
+	(add ? m_archetypes[archetype]->addEdges : m_archetypes[archetype]->removeEdges).emplace_back(type, neighbour);
+
+	return neighbour;
+}
+
+void EntityWorld::UpdateQuery(EntityQuery& query)
+{
+	uint32_t archetypeCount = static_cast<uint32_t>(m_archetypes.size());
+
+	for (uint32_t archetype = query.m_testedArchetypes; archetype < archetypeCount; archetype++)
+	{
+		ComponentMask mask = m_archetypes[archetype]->mask;
+
+		if ((mask & query.m_required) == query.m_required && (mask & query.m_excluded) == 0)
+		{
+			query.m_archetypes.push_back(archetype);
+		}
+	}
+
+	query.m_testedArchetypes = archetypeCount;
+}
+
+uint8_t* EntityWorld::AllocateChunk()
+{
+	if (!m_freeChunks.empty())
+	{
+		uint8_t* data = m_freeChunks.back();
+
+		m_freeChunks.pop_back();
+
+		return data;
+	}
+
+	return static_cast<uint8_t*>(::operator new(ENTITY_CHUNK_SIZE, std::align_val_t(ENTITY_COLUMN_ALIGNMENT)));
+}
+
+void EntityWorld::AllocateRow(Archetype& archetype, uint32_t* chunk, uint32_t* row)
+{
+	if (archetype.chunks.empty() || archetype.chunks.back().count == archetype.capacity)
+	{
+		archetype.chunks.push_back({ AllocateChunk(), 0 });
+	}
+
+	*chunk = static_cast<uint32_t>(archetype.chunks.size() - 1);
+	*row = archetype.chunks.back().count++;
+}
+
+void EntityWorld::RemoveRow(Archetype& archetype, uint32_t chunk, uint32_t row)
+{
+	uint32_t lastChunk = static_cast<uint32_t>(archetype.chunks.size() - 1);
+	uint32_t lastRow = archetype.chunks[lastChunk].count - 1;
+
+	if (chunk != lastChunk || row != lastRow)
+	{
+		EntityChunk& destination = archetype.chunks[chunk];
+		EntityChunk& source = archetype.chunks[lastChunk];
+
+		Entity moved = reinterpret_cast<Entity*>(source.data)[lastRow];
+
+		reinterpret_cast<Entity*>(destination.data)[row] = moved;
+
+		for (uint32_t column = 0; column < archetype.types.size(); column++)
+		{
+			uint32_t size = ComponentRegistry::GetInfo(archetype.types[column]).size;
+
+			memcpy(destination.data + archetype.offsets[column] + static_cast<size_t>(row) * size, source.data + archetype.offsets[column] + static_cast<size_t>(lastRow) * size, size);
+		}
+
+		m_entities[moved.index].chunk = chunk;
+		m_entities[moved.index].row = row;
+	}
+
+	if (--archetype.chunks[lastChunk].count == 0)
+	{
+		m_freeChunks.push_back(archetype.chunks[lastChunk].data);
+
+		archetype.chunks.pop_back();
+	}
+}
+
+void EntityWorld::MoveEntity(Entity entity, uint32_t destination)
+{
+	EntityRecord& record = m_entities[entity.index];
+
+	Archetype& source = *m_archetypes[record.archetype];
+	Archetype& target = *m_archetypes[destination];
+
+	uint32_t chunk, row;
+
+	AllocateRow(target, &chunk, &row);
+
+	EntityChunk& sourceChunk = source.chunks[record.chunk];
+	EntityChunk& targetChunk = target.chunks[chunk];
+
+	reinterpret_cast<Entity*>(targetChunk.data)[row] = entity;
+
+	// Shared components are copied, the added one starts zeroed
+	for (uint32_t column = 0; column < target.types.size(); column++)
+	{
+		ComponentType type = target.types[column];
+		uint32_t size = ComponentRegistry::GetInfo(type).size;
+
+		uint8_t* destinationData = targetChunk.data + target.offsets[column] + static_cast<size_t>(row) * size;
+
+		if (source.columns[type] != NO_COLUMN)
+		{
+			memcpy(destinationData, sourceChunk.data + source.offsets[source.columns[type]] + static_cast<size_t>(record.row) * size, size);
+		}
+		else
+		{
+			memset(destinationData, 0, size);
+		}
+	}
+
+	RemoveRow(source, record.chunk, record.row);
+
+	record.archetype = destination;
+	record.chunk = chunk;
+	record.row = row;
+}
+
+bool EntityWorld::IsStructuralChangeAllowed()
+{
+	if (m_iterationDepth.load(std::memory_order_relaxed) != 0)
+	{
+		Logger::Error("STRUCTURAL CHANGE WHILE THE ENTITY WORLD IS ITERATED, RECORD IT IN AN ENTITY COMMAND BUFFER");
+
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,411 @@
+#pragma once
+
+// Index into the world's entity table plus the generation of the slot, so handles to destroyed entities are detected
+struct Entity
+{
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+
+	bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+static constexpr Entity INVALID_ENTITY = {};
+
+typedef uint32_t ComponentType;
+
+// One bit per component type, an archetype is identified by the mask of its components
+typedef uint64_t ComponentMask;
+
+static constexpr uint32_t MAX_COMPONENT_TYPES = 64;
+
+// Every archetype stores its entities in chunks of this size, one array per component (structure of arrays)
+static constexpr uint32_t ENTITY_CHUNK_SIZE = 16 * 1024;
+
+// Component arrays start on a cache line so neighbouring arrays never share one and SIMD loads stay aligned
+static constexpr uint32_t ENTITY_COLUMN_ALIGNMENT = 64;
+
+struct ComponentInfo
+{
+	// 0 for tag components, which only take part in the archetype mask
+	uint32_t size = 0;
+	uint32_t alignment = 1;
+};
+
+// Component types are numbered on first use, in whatever order the program touches them
+class ComponentRegistry
+{
+public:
+	static ComponentType Register(uint32_t size, uint32_t alignment);
+
+	static const ComponentInfo& GetInfo(ComponentType type);
+
+	static uint32_t GetCount();
+};
+
+// Components are plain data, chunks move them with memcpy and never run constructors or destructors
+// const qualified types share the id of the plain type, queries use them to mark read only access.
+template<typename T>
+ComponentType GetComponentType()
+{
+	if constexpr (!std::is_same_v<T, std::remove_cv_t<T>>)
+	{
+		return GetComponentType<std::remove_cv_t<T>>();
+	}
+	else
+	{
+		static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>, "Components must be trivially copyable and destructible");
+
+		static const ComponentType type = ComponentRegistry::Register(std::is_empty_v<T> ? 0 : sizeof(T), alignof(T));
+
+		return type;
+	}
+}
+
+template<typename... Components>
+ComponentMask GetComponentMask()
+{
+	return (ComponentMask(0) | ... | (ComponentMask(1) << GetComponentType<Components>()));
+}
+
+// Archetypes holding all of the required and none of the excluded components. The matches are cached, each use only
+// tests the archetypes created since the previous one.
+class EntityQuery
+{
+public:
+	EntityQuery() = default;
+	EntityQuery(ComponentMask required, ComponentMask excluded = 0) : m_required(required), m_excluded(excluded) {}
+
+	template<typename... Components>
+	static EntityQuery Create(ComponentMask excluded = 0) { return EntityQuery(GetComponentMask<Components...>(), excluded); }
+
+	ComponentMask GetRequired() const { return m_required; }
+	ComponentMask GetExcluded() const { return m_excluded; }
+
+private:
+	friend class EntityWorld;
+
+	ComponentMask m_required = 0;
+	ComponentMask m_excluded = 0;
+
+	std::vector<uint32_t> m_archetypes;
+	uint32_t m_testedArchetypes = 0;
+};
+
+// Structural changes recorded while the world is being iterated, applied in recording order by EntityWorld::Playback.
+// Entities created through the buffer are placeholders until then and may only be used within the same buffer.
+class EntityCommandBuffer
+{
+public:
+	Entity CreateEntity();
+	void DestroyEntity(Entity entity);
+
+	template<typename T>
+	void AddComponent(Entity entity, const T& component)
+	{
+		Record(CommandType::AddComponent, entity, GetComponentType<T>(), &component);
+	}
+
+	template<typename T>
+	void RemoveComponent(Entity entity)
+	{
+		Record(CommandType::RemoveComponent, entity, GetComponentType<T>(), nullptr);
+	}
+
+	bool IsEmpty() { return m_commands.empty(); }
+
+	void Clear();
+
+private:
+	friend class EntityWorld;
+
+	// Marks the index of a placeholder entity, the rest is its position among the buffer's created entities
+	static constexpr uint32_t PENDING_ENTITY_BIT = 0x80000000u;
+
+	enum class CommandType : uint32_t
+	{
+		CreateEntity,
+		DestroyEntity,
+		AddComponent,
+		RemoveComponent
+	};
+
+	struct Command
+	{
+		CommandType type = CommandType::CreateEntity;
+		ComponentType component = 0;
+		Entity entity;
+
+		// Component value in m_data, only for AddComponent
+		uint32_t dataOffset = 0;
+	};
+
+private:
+	std::vector<Command> m_commands;
+	std::vector<uint8_t> m_data;
+
+	uint32_t m_createdEntities = 0;
+
+private:
+	void Record(CommandType type, Entity entity, ComponentType component, const void* data);
+};
+
+// Archetype based entity storage. Entities with the same set of components share an archetype, whose chunks keep each
+// component in its own tightly packed array, so a query walks memory linearly instead of chasing pointers.
+// Chunks stay densely filled: removing an entity moves the archetype's last entity into the hole.
+//
+// Structural changes (creating and destroying entities, adding and removing components) move entities between chunks
+// and are refused while the world is being iterated, record them in an EntityCommandBuffer instead.
+// Iterating and reading or writing components of existing entities is safe from several threads at once.
+class EntityWorld
+{
+public:
+	EntityWorld();
+	~EntityWorld();
+
+	EntityWorld(const EntityWorld&) = delete;
+	EntityWorld& operator=(const EntityWorld&) = delete;
+
+	// Destroys every entity and returns the chunk memory
+	void Clear();
+
+	Entity CreateEntity();
+
+	template<typename... Components>
+	Entity CreateEntity(const Components&... components)
+	{
+		Entity entity = CreateEntity(GetComponentMask<Components...>());
+
+		if (entity != INVALID_ENTITY)
+		{
+			(memcpy(GetComponent(entity, GetComponentType<Components>()), &components, ComponentRegistry::GetInfo(GetComponentType<Components>()).size), ...);
+		}
+
+		return entity;
+	}
+
+	// New components of the archetype start zeroed
+	Entity CreateEntity(ComponentMask mask);
+
+	void DestroyEntity(Entity entity);
+
+	bool IsAlive(Entity entity);
+
+	template<typename T>
+	void AddComponent(Entity entity, const T& component)
+	{
+		void* data = AddComponent(entity, GetComponentType<T>());
+
+		if (data != nullptr)
+		{
+			memcpy(data, &component, ComponentRegistry::GetInfo(GetComponentType<T>()).size);
+		}
+	}
+
+	template<typename T>
+	void RemoveComponent(Entity entity) { RemoveComponent(entity, GetComponentType<T>()); }
+
+	template<typename T>
+	T* GetComponent(Entity entity) { return static_cast<T*>(GetComponent(entity, GetComponentType<T>())); }
+
+	template<typename T>
+	bool HasComponent(Entity entity) { return HasComponent(entity, GetComponentType<T>()); }
+
+	// Returns the zeroed storage of the added component, or the existing one if the entity already has it
+	void* AddComponent(Entity entity, ComponentType type);
+	void RemoveComponent(Entity entity, ComponentType type);
+
+	// nullptr if the entity is dead or lacks the component. Tag components return a non-null pointer that must not be dereferenced.
+	void* GetComponent(Entity entity, ComponentType type);
+	bool HasComponent(Entity entity, ComponentType type);
+
+	// Applies the recorded changes in order and clears the buffer
+	void Playback(EntityCommandBuffer& commands);
+
+	// Structural changes are refused between these, like inside ForEachChunk. Calls nest, and may come from any thread.
+	void BeginIteration() { m_iterationDepth.fetch_add(1, std::memory_order_relaxed); }
+	void EndIteration() { m_iterationDepth.fetch_sub(1, std::memory_order_relaxed); }
+
+	// Calls function(count, entities, arrays...) once per chunk of every archetype the query matches. Each array holds
+	// count components of the type given in Components, which the query must require. const types document read only access.
+	template<typename... Components, typename Function>
+	void ForEachChunk(EntityQuery& query, Function&& function)
+	{
+		UpdateQuery(query);
+
+		ComponentType types[] = { GetComponentType<Components>()..., 0 };
+
+		m_iterationDepth.fetch_add(1, std::memory_order_relaxed);
+
+		for (uint32_t archetypeIndex : query.m_archetypes)
+		{
+			Archetype& archetype = *m_archetypes[archetypeIndex];
+
+			for (EntityChunk& chunk : archetype.chunks)
+			{
+				const uint8_t* columns[sizeof...(Components) + 1] = {};
+
+				for (uint32_t i = 0; i < sizeof...(Components); i++)
+				{
+					columns[i] = GetColumn(archetype, chunk, types[i]);
+				}
+
+				CallWithColumns<Components...>(function, chunk, columns, std::index_sequence_for<Components...>{});
+			}
+		}
+
+		m_iterationDepth.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	// Calls function(entity, components&...) for every matching entity
+	template<typename... Components, typename Function>
+	void ForEach(EntityQuery& query, Function&& function)
+	{
+		ForEachChunk<Components...>(query, [&function](uint32_t count, const Entity* entities, Components*... arrays)
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				function(entities[i], arrays[i]...);
+			}
+		});
+	}
+
+	// Same as ForEachChunk with the chunks spread over the job system, the function is called from several threads at once
+	template<typename... Components, typename Function>
+	void ParallelForEachChunk(JobSystem& jobSystem, EntityQuery& query, Function&& function)
+	{
+		UpdateQuery(query);
+
+		std::vector<std::pair<Archetype*, uint32_t>> chunks;
+
+		for (uint32_t archetypeIndex : query.m_archetypes)
+		{
+			Archetype& archetype = *m_archetypes[archetypeIndex];
+
+			for (uint32_t chunk = 0; chunk < archetype.chunks.size(); chunk++)
+			{
+				chunks.emplace_back(&archetype, chunk);
+			}
+		}
+
+		ComponentType types[] = { GetComponentType<Components>()..., 0 };
+
+		m_iterationDepth.fetch_add(1, std::memory_order_relaxed);
+
+		jobSystem.ParallelFor(static_cast<uint32_t>(chunks.size()), 1, [&](uint32_t first, uint32_t last)
+		{
+			for (uint32_t i = first; i < last; i++)
+			{
+				Archetype& archetype = *chunks[i].first;
+				EntityChunk& chunk = archetype.chunks[chunks[i].second];
+
+				const uint8_t* columns[sizeof...(Components) + 1] = {};
+
+				for (uint32_t column = 0; column < sizeof...(Components); column++)
+				{
+					columns[column] = GetColumn(archetype, chunk, types[column]);
+				}
+
+				CallWithColumns<Components...>(function, chunk, columns, std::index_sequence_for<Components...>{});
+			}
+		});
+
+		m_iterationDepth.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	// Entities the query currently matches
+	uint32_t CountEntities(EntityQuery& query);
+
+	uint32_t GetEntityCount() { return m_entityCount; }
+	uint32_t GetArchetypeCount() { return static_cast<uint32_t>(m_archetypes.size()); }
+	uint32_t GetChunkCount();
+
+private:
+	static constexpr uint8_t NO_COLUMN = 0xFF;
+	static constexpr uint32_t NO_ARCHETYPE = UINT32_MAX;
+
+	struct EntityChunk
+	{
+		// ENTITY_CHUNK_SIZE bytes: the Entity array first, then one array per component
+		uint8_t* data = nullptr;
+		uint32_t count = 0;
+	};
+
+	struct Archetype
+	{
+		ComponentMask mask = 0;
+
+		// Ascending component types, and the byte offset of each one's array within a chunk
+		std::vector<ComponentType> types;
+		std::vector<uint32_t> offsets;
+
+		// Column of each component type in types, NO_COLUMN if the archetype lacks it
+		uint8_t columns[MAX_COMPONENT_TYPES];
+
+		// Entities per chunk
+		uint32_t capacity = 0;
+
+		// Every chunk but the last is full
+		std::vector<EntityChunk> chunks;
+
+		// Archetype reached by adding or removing one component, filled in on first use
+		std::vector<std::pair<ComponentType, uint32_t>> addEdges;
+		std::vector<std::pair<ComponentType, uint32_t>> removeEdges;
+	};
+
+	struct EntityRecord
+	{
+		uint32_t archetype = NO_ARCHETYPE;
+		uint32_t chunk = 0;
+		uint32_t row = 0;
+
+		uint32_t generation = 0;
+	};
+
+private:
+	std::vector<std::unique_ptr<Archetype>> m_archetypes;
+	std::unordered_map<ComponentMask, uint32_t> m_archetypeLookup;
+
+	std::vector<EntityRecord> m_entities;
+	std::vector<uint32_t> m_freeEntities;
+	uint32_t m_entityCount = 0;
+
+	// Chunks of emptied archetypes, reused before new memory is allocated
+	std::vector<uint8_t*> m_freeChunks;
+
+	// Scratch mapping the placeholder entities of a command buffer to the ones created on playback
+	std::vector<Entity> m_playbackEntities;
+
+	std::atomic<uint32_t> m_iterationDepth = 0;
+
+private:
+	uint32_t GetOrCreateArchetype(ComponentMask mask);
+	uint32_t GetNeighbourArchetype(uint32_t archetype, ComponentType type, bool add);
+
+	void UpdateQuery(EntityQuery& query);
+
+	uint8_t* AllocateChunk();
+
+	// Appends a row to the archetype, its components are left for the caller to fill
+	void AllocateRow(Archetype& archetype, uint32_t* chunk, uint32_t* row);
+
+	// Fills the hole with the archetype's last entity
+	void RemoveRow(Archetype& archetype, uint32_t chunk, uint32_t row);
+
+	void MoveEntity(Entity entity, uint32_t destination);
+
+	bool IsStructuralChangeAllowed();
+
+	static const uint8_t* GetColumn(const Archetype& archetype, const EntityChunk& chunk, ComponentType type)
+	{
+		uint8_t column = archetype.columns[type];
+
+		return column == NO_COLUMN ? nullptr : chunk.data + archetype.offsets[column];
+	}
+
+	template<typename... Components, typename Function, size_t... Indices>
+	static void CallWithColumns(Function& function, const EntityChunk& chunk, const uint8_t* const* columns, std::index_sequence<Indices...>)
+	{
+		function(chunk.count, reinterpret_cast<const Entity*>(chunk.data), reinterpret_cast<Components*>(const_cast<uint8_t*>(columns[Indices]))...);
+	}
+};
@@ -3,20 +3,85 @@
 
 #include "core.h"
 
-int main() {
+int main(int argc, char** argv) {
 
-	EngineApplication* engine = new EngineApplication();
+	// Messages are written on the logger's own thread from here on
+	Logger::Init();
 
-	engine->Init();
-	
-	while (engine->IsApplicationRunning())
+	bool headless = false;
+	uint64_t frameLimit = 0;
+	std::string capturePath;
+	bool benchmarkSpatialIndex = false;
+	bool benchmarkAllocator = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (argument == "--headless")
+		{
+			headless = true;
+		}
+		else if (argument == "--frames" && i + 1 < argc)
+		{
+			frameLimit = std::stoull(argv[++i]);
+		}
+		else if (argument == "--capture" && i + 1 < argc)
+		{
+			capturePath = argv[++i];
+		}
+		else if (argument == "--bench-spatial")
+		{
+			benchmarkSpatialIndex = true;
+		}
+		else if (argument == "--bench-allocator")
+		{
+			benchmarkAllocator = true;
+		}
+	}
+
+	// Runs without a window or device and exits
+	if (benchmarkSpatialIndex)
 	{
-		engine->Update();
+		JobSystem jobSystem;
+
+		if (!jobSystem.Init())
+		{
+			return EXIT_FAILURE;
+		}
+
+		SpatialIndexBenchmark::Run(&jobSystem);
+
+		jobSystem.Destroy();
+
+		Logger::Shutdown();
+
+		return EXIT_SUCCESS;
 	}
 
+	if (benchmarkAllocator)
+	{
+		MemoryAllocatorBenchmark::Run();
+
+		Logger::Shutdown();
+
+		return EXIT_SUCCESS;
+	}
+
+	EngineApplication* engine = new EngineApplication(headless);
+
+	engine->SetFrameLimit(frameLimit);
+	engine->SetCapturePath(capturePath);
+
+	engine->Init();
+	
+	engine->Run();
+
 	engine->Shutdown();
 
 	delete engine;
 
+	Logger::Shutdown();
+
 	return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -1,3 +1,137 @@
 #include "cardinal_pch.h"
 
 #include "core.h"
+
+#ifdef _WIN32
+
+bool Win32EventSource::PollEvent(Event& event)
+{
+	MSG message = {};
+
+	// PeekMessage returns immediately, so the loop only runs as long as messages are queued
+	while (PeekMessage(&message, NULL, 0, 0, PM_REMOVE))
+	{
+		if (message.message == WM_QUIT)
+		{
+			event = {};
+			event.type = EventType::Quit;
+
+			return true;
+		}
+
+		TranslateMessage(&message);
+		DispatchMessage(&message);
+
+		if (TranslateEvent(message, event))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool Win32EventSource::TranslateEvent(const MSG& message, Event& event)
+{
+	event = {};
+
+	switch (message.message)
+	{
+	case WM_KEYDOWN:
+	case WM_SYSKEYDOWN:
+		event.type = EventType::KeyDown;
+		event.code = static_cast<uint32_t>(message.wParam);
+
+		return true;
+	case WM_KEYUP:
+	case WM_SYSKEYUP:
+		event.type = EventType::KeyUp;
+		event.code = static_cast<uint32_t>(message.wParam);
+
+		return true;
+	case WM_MOUSEMOVE:
+		event.type = EventType::MouseMove;
+		event.x = static_cast<int16_t>(LOWORD(message.lParam));
+		event.y = static_cast<int16_t>(HIWORD(message.lParam));
+
+		return true;
+	case WM_LBUTTONDOWN:
+	case WM_RBUTTONDOWN:
+	case WM_MBUTTONDOWN:
+		event.type = EventType::MouseButtonDown;
+		event.code = message.message == WM_LBUTTONDOWN ? 0 : message.message == WM_RBUTTONDOWN ? 1 : 2;
+		event.x = static_cast<int16_t>(LOWORD(message.lParam));
+		event.y = static_cast<int16_t>(HIWORD(message.lParam));
+
+		return true;
+	case WM_LBUTTONUP:
+	case WM_RBUTTONUP:
+	case WM_MBUTTONUP:
+		event.type = EventType::MouseButtonUp;
+		event.code = message.message == WM_LBUTTONUP ? 0 : message.message == WM_RBUTTONUP ? 1 : 2;
+		event.x = static_cast<int16_t>(LOWORD(message.lParam));
+		event.y = static_cast<int16_t>(HIWORD(message.lParam));
+
+		return true;
+	default:
+
+		return false;
+	}
+}
+
+#endif // _WIN32
+
+void HeadlessEventSource::PushEvent(const Event& event)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_events.push_back(event);
+}
+
+bool HeadlessEventSource::PollEvent(Event& event)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_events.empty())
+	{
+		return false;
+	}
+
+	event = m_events.front();
+	m_events.pop_front();
+
+	return true;
+}
+
+EventManager::EventManager(PlatformEventSource* source) : m_source(source) { }
+
+EventManager::~EventManager()
+{
+	delete m_source;
+}
+
+void EventManager::Subscribe(EventType type, std::function<void(const Event&)> listener)
+{
+	m_listeners.emplace(type, std::move(listener));
+}
+
+uint32_t EventManager::PumpEvents()
+{
+	uint32_t eventCount = 0;
+
+	Event event;
+
+	while (m_source->PollEvent(event))
+	{
+		auto range = m_listeners.equal_range(event.type);
+
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			it->second(event);
+		}
+
+		eventCount++;
+	}
+
+	return eventCount;
+}
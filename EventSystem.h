@@ -1,9 +1,74 @@
 #pragma once
-class EventManager
+
+enum class EventType
+{
+	None, Quit, KeyDown, KeyUp, MouseMove, MouseButtonDown, MouseButtonUp
+};
+
+struct Event
+{
+	EventType type = EventType::None;
+
+	// Cursor position for mouse events
+	int32_t x = 0;
+	int32_t y = 0;
+
+	// Virtual key code or mouse button index
+	uint32_t code = 0;
+};
+
+// Platform specific producer of events. PollEvent must never block, it returns false once nothing is pending.
+class PlatformEventSource
 {
 public:
+	virtual ~PlatformEventSource() = default;
+
+	virtual bool PollEvent(Event& event) = 0;
+};
+
+#ifdef _WIN32
 
-	virtual void onClose();
+class Win32EventSource : public PlatformEventSource
+{
+public:
+	bool PollEvent(Event& event) override;
 
+private:
+	bool TranslateEvent(const MSG& message, Event& event);
 };
 
+#endif // _WIN32
+
+// Event source without a window, events are injected by the application or a test harness.
+class HeadlessEventSource : public PlatformEventSource
+{
+public:
+	void PushEvent(const Event& event);
+
+	bool PollEvent(Event& event) override;
+
+private:
+	std::mutex m_mutex;
+
+	std::deque<Event> m_events;
+};
+
+class EventManager
+{
+public:
+	EventManager(PlatformEventSource* source);
+	~EventManager();
+
+public:
+	void Subscribe(EventType type, std::function<void(const Event&)> listener);
+
+	// Drains every pending event and dispatches it, returns the number of events handled
+	uint32_t PumpEvents();
+
+	PlatformEventSource* GetSource() { return m_source; }
+
+private:
+	PlatformEventSource* m_source = nullptr;
+
+	std::multimap<EventType, std::function<void(const Event&)>> m_listeners;
+};
@@ -1,2 +1,1020 @@
 #include "cardinal_pch.h"
-#include "FBXLoader.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+static constexpr char FBX_MAGIC[] = "Kaydara FBX Binary  ";
+static constexpr size_t FBX_HEADER_SIZE = 27;
+
+// Node records switched from 32 to 64 bit offsets with version 7500
+static constexpr uint32_t FBX_LARGE_OFFSETS_VERSION = 7500;
+
+template<typename T>
+static T ReadValue(const uint8_t* data)
+{
+	T value;
+
+	memcpy(&value, data, sizeof(T));
+
+	return value;
+}
+
+// Minimal zlib (RFC 1950) / DEFLATE (RFC 1951) decoder for compressed array properties.
+// The decompressed size is always known up front from the array header, so the output is a fixed buffer.
+namespace
+{
+	struct Huffman
+	{
+		uint16_t counts[16];
+		uint16_t symbols[288];
+	};
+
+	struct InflateState
+	{
+		const uint8_t* in;
+		size_t inSize;
+		size_t inPos;
+
+		uint32_t bitBuffer;
+		uint32_t bitCount;
+
+		uint8_t* out;
+		size_t outSize;
+		size_t outPos;
+
+		bool error;
+	};
+
+	const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const uint16_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const uint16_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	uint32_t InflateBits(InflateState& state, uint32_t count)
+	{
+		uint32_t buffer = state.bitBuffer;
+
+		while (state.bitCount < count)
+		{
+			if (state.inPos >= state.inSize)
+			{
+				state.error = true;
+
+				return 0;
+			}
+
+			buffer |= static_cast<uint32_t>(state.in[state.inPos++]) << state.bitCount;
+			state.bitCount += 8;
+		}
+
+		state.bitBuffer = count < 32 ? buffer >> count : 0;
+		state.bitCount -= count;
+
+		return buffer & ((1u << count) - 1);
+	}
+
+	// Canonical Huffman table from code lengths, returns false for over-subscribed sets
+	bool BuildHuffman(Huffman& huffman, const uint8_t* lengths, uint32_t count)
+	{
+		uint16_t offsets[16];
+
+		memset(huffman.counts, 0, sizeof(huffman.counts));
+
+		for (uint32_t symbol = 0; symbol < count; symbol++)
+		{
+			huffman.counts[lengths[symbol]]++;
+		}
+
+		huffman.counts[0] = 0;
+
+		int32_t left = 1;
+
+		for (uint32_t length = 1; length < 16; length++)
+		{
+			left <<= 1;
+			left -= huffman.counts[length];
+
+			if (left < 0)
+			{
+				return false;
+			}
+		}
+
+		offsets[1] = 0;
+
+		for (uint32_t length = 1; length < 15; length++)
+		{
+			offsets[length + 1] = offsets[length] + huffman.counts[length];
+		}
+
+		for (uint32_t symbol = 0; symbol < count; symbol++)
+		{
+			if (lengths[symbol] != 0)
+			{
+				huffman.symbols[offsets[lengths[symbol]]++] = static_cast<uint16_t>(symbol);
+			}
+		}
+
+		return true;
+	}
+
+	int32_t DecodeSymbol(InflateState& state, const Huffman& huffman)
+	{
+		int32_t code = 0;
+		int32_t first = 0;
+		int32_t index = 0;
+
+		for (uint32_t length = 1; length < 16; length++)
+		{
+			code |= static_cast<int32_t>(InflateBits(state, 1));
+
+			int32_t count = huffman.counts[length];
+
+			if (code - count < first)
+			{
+				return huffman.symbols[index + (code - first)];
+			}
+
+			index += count;
+			first += count;
+			first <<= 1;
+			code <<= 1;
+		}
+
+		state.error = true;
+
+		return -1;
+	}
+
+	bool InflateCodes(InflateState& state, const Huffman& lengthCodes, const Huffman& distanceCodes)
+	{
+		while (!state.error)
+		{
+			int32_t symbol = DecodeSymbol(state, lengthCodes);
+
+			if (symbol < 0)
+			{
+				return false;
+			}
+
+			if (symbol < 256)
+			{
+				if (state.outPos >= state.outSize)
+				{
+					return false;
+				}
+
+				state.out[state.outPos++] = static_cast<uint8_t>(symbol);
+
+				continue;
+			}
+
+			if (symbol == 256)
+			{
+				return true;
+			}
+
+			symbol -= 257;
+
+			if (symbol >= 29)
+			{
+				return false;
+			}
+
+			size_t length = LENGTH_BASE[symbol] + InflateBits(state, LENGTH_EXTRA[symbol]);
+
+			int32_t distanceSymbol = DecodeSymbol(state, distanceCodes);
+
+			if (distanceSymbol < 0 || distanceSymbol >= 30)
+			{
+				return false;
+			}
+
+			size_t distance = DISTANCE_BASE[distanceSymbol] + InflateBits(state, DISTANCE_EXTRA[distanceSymbol]);
+
+			if (distance > state.outPos || length > state.outSize - state.outPos)
+			{
+				return false;
+			}
+
+			// Byte by byte, the source may overlap the bytes being written
+			for (size_t i = 0; i < length; i++, state.outPos++)
+			{
+				state.out[state.outPos] = state.out[state.outPos - distance];
+			}
+		}
+
+		return false;
+	}
+
+	bool InflateStored(InflateState& state)
+	{
+		// Stored blocks start on a byte boundary
+		state.bitBuffer = 0;
+		state.bitCount = 0;
+
+		if (state.inSize - state.inPos < 4)
+		{
+			return false;
+		}
+
+		uint32_t length = state.in[state.inPos] | (state.in[state.inPos + 1] << 8);
+		uint32_t complement = state.in[state.inPos + 2] | (state.in[state.inPos + 3] << 8);
+
+		state.inPos += 4;
+
+		if (length != (~complement & 0xffff) || length > state.inSize - state.inPos || length > state.outSize - state.outPos)
+		{
+			return false;
+		}
+
+		memcpy(state.out + state.outPos, state.in + state.inPos, length);
+
+		state.inPos += length;
+		state.outPos += length;
+
+		return true;
+	}
+
+	bool InflateFixed(InflateState& state)
+	{
+		static Huffman lengthCodes;
+		static Huffman distanceCodes;
+
+		static const bool built = []()
+		{
+			uint8_t lengths[288];
+
+			memset(lengths, 8, 144);
+			memset(lengths + 144, 9, 112);
+			memset(lengths + 256, 7, 24);
+			memset(lengths + 280, 8, 8);
+
+			BuildHuffman(lengthCodes, lengths, 288);
+
+			memset(lengths, 5, 30);
+
+			BuildHuffman(distanceCodes, lengths, 30);
+
+			return true;
+		}();
+
+		return built && InflateCodes(state, lengthCodes, distanceCodes);
+	}
+
+	bool InflateDynamic(InflateState& state)
+	{
+		static const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+		uint8_t lengths[288 + 30];
+
+		uint32_t lengthCount = InflateBits(state, 5) + 257;
+		uint32_t distanceCount = InflateBits(state, 5) + 1;
+		uint32_t codeLengthCount = InflateBits(state, 4) + 4;
+
+		if (state.error || lengthCount > 286 || distanceCount > 30)
+		{
+			return false;
+		}
+
+		memset(lengths, 0, 19);
+
+		for (uint32_t i = 0; i < codeLengthCount; i++)
+		{
+			lengths[CODE_LENGTH_ORDER[i]] = static_cast<uint8_t>(InflateBits(state, 3));
+		}
+
+		Huffman codeLengthCodes;
+
+		if (!BuildHuffman(codeLengthCodes, lengths, 19))
+		{
+			return false;
+		}
+
+		uint32_t index = 0;
+
+		while (index < lengthCount + distanceCount)
+		{
+			int32_t symbol = DecodeSymbol(state, codeLengthCodes);
+
+			if (symbol < 0 || state.error)
+			{
+				return false;
+			}
+
+			if (symbol < 16)
+			{
+				lengths[index++] = static_cast<uint8_t>(symbol);
+
+				continue;
+			}
+
+			uint8_t repeated = 0;
+			uint32_t repeat;
+
+			if (symbol == 16)
+			{
+				if (index == 0)
+				{
+					return false;
+				}
+
+				repeated = lengths[index - 1];
+				repeat = 3 + InflateBits(state, 2);
+			}
+			else if (symbol == 17)
+			{
+				repeat = 3 + InflateBits(state, 3);
+			}
+			else
+			{
+				repeat = 11 + InflateBits(state, 7);
+			}
+
+			if (index + repeat > lengthCount + distanceCount)
+			{
+				return false;
+			}
+
+			memset(lengths + index, repeated, repeat);
+
+			index += repeat;
+		}
+
+		// A block without an end of block code could never terminate
+		if (lengths[256] == 0)
+		{
+			return false;
+		}
+
+		Huffman lengthCodes;
+		Huffman distanceCodes;
+
+		if (!BuildHuffman(lengthCodes, lengths, lengthCount) || !BuildHuffman(distanceCodes, lengths + lengthCount, distanceCount))
+		{
+			return false;
+		}
+
+		return InflateCodes(state, lengthCodes, distanceCodes);
+	}
+
+	bool ZlibInflate(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize)
+	{
+		if (inSize < 6)
+		{
+			return false;
+		}
+
+		uint32_t cmf = in[0];
+		uint32_t flg = in[1];
+
+		// Deflate only, no preset dictionary
+		if ((cmf & 0x0f) != 8 || ((cmf << 8) | flg) % 31 != 0 || (flg & 0x20) != 0)
+		{
+			return false;
+		}
+
+		InflateState state = { in, inSize - 4, 2, 0, 0, out, outSize, 0, false };
+
+		uint32_t last;
+
+		do
+		{
+			last = InflateBits(state, 1);
+
+			uint32_t type = InflateBits(state, 2);
+
+			bool ok = false;
+
+			switch (type)
+			{
+			case 0:
+				ok = InflateStored(state);
+				break;
+			case 1:
+				ok = InflateFixed(state);
+				break;
+			case 2:
+				ok = InflateDynamic(state);
+				break;
+			default:
+				break;
+			}
+
+			if (!ok || state.error)
+			{
+				return false;
+			}
+		} while (!last);
+
+		if (state.outPos != outSize)
+		{
+			return false;
+		}
+
+		uint32_t a = 1;
+		uint32_t b = 0;
+
+		for (size_t i = 0; i < outSize; i++)
+		{
+			a = (a + out[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+
+		const uint8_t* trailer = in + inSize - 4;
+
+		uint32_t adler = (uint32_t(trailer[0]) << 24) | (uint32_t(trailer[1]) << 16) | (uint32_t(trailer[2]) << 8) | trailer[3];
+
+		return adler == ((b << 16) | a);
+	}
+
+	struct CornerKey
+	{
+		uint32_t controlPoint;
+		int64_t normal;
+		int64_t uv;
+
+		bool operator==(const CornerKey& other) const { return controlPoint == other.controlPoint && normal == other.normal && uv == other.uv; }
+	};
+
+	struct CornerKeyHash
+	{
+		size_t operator()(const CornerKey& key) const
+		{
+			uint64_t hash = key.controlPoint * 0x9E3779B97F4A7C15ull;
+
+			hash ^= static_cast<uint64_t>(key.normal) + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+			hash ^= static_cast<uint64_t>(key.uv) + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+
+			return static_cast<size_t>(hash);
+		}
+	};
+}
+
+int64_t FBXProperty::AsInt() const
+{
+	switch (type)
+	{
+	case 'Y': return ReadValue<int16_t>(data);
+	case 'C': return data[0];
+	case 'I': return ReadValue<int32_t>(data);
+	case 'L': return ReadValue<int64_t>(data);
+	case 'F': return static_cast<int64_t>(ReadValue<float>(data));
+	case 'D': return static_cast<int64_t>(ReadValue<double>(data));
+	default: return 0;
+	}
+}
+
+double FBXProperty::AsDouble() const
+{
+	switch (type)
+	{
+	case 'F': return ReadValue<float>(data);
+	case 'D': return ReadValue<double>(data);
+	case 'Y':
+	case 'C':
+	case 'I':
+	case 'L': return static_cast<double>(AsInt());
+	default: return 0.0;
+	}
+}
+
+std::string_view FBXProperty::AsString() const
+{
+	if (type != 'S' && type != 'R')
+	{
+		return {};
+	}
+
+	return { reinterpret_cast<const char*>(data), size };
+}
+
+bool FBXLoader::Load(const std::string& path)
+{
+	MappedFile file;
+
+	if (!file.Open(path))
+	{
+		return false;
+	}
+
+	bool result = Parse(file.GetData());
+
+	// The views point into the mapping, which goes away with the file
+	m_data = {};
+
+	if (result)
+	{
+		Logger::Info("LOADED %u MESHES FROM %s (FBX %u)", static_cast<uint32_t>(m_meshes.size()), path.c_str(), m_version);
+	}
+	else
+	{
+		Logger::Error("FAILED TO PARSE FBX FILE %s", path.c_str());
+	}
+
+	return result;
+}
+
+bool FBXLoader::Parse(std::span<const uint8_t> data)
+{
+	m_meshes.clear();
+
+	if (data.size() < FBX_HEADER_SIZE || memcmp(data.data(), FBX_MAGIC, sizeof(FBX_MAGIC)) != 0)
+	{
+		Logger::Error("NOT AN FBX BINARY FILE");
+
+		return false;
+	}
+
+	m_data = data;
+	m_version = ReadValue<uint32_t>(data.data() + 23);
+
+	FBXNode root;
+	root.children = data.data() + FBX_HEADER_SIZE;
+	root.end = data.data() + data.size();
+
+	FBXNode objects;
+
+	if (!FindChild(root, "Objects", &objects))
+	{
+		Logger::Error("FBX FILE HAS NO OBJECTS");
+
+		return false;
+	}
+
+	FBXNode node;
+
+	for (bool valid = FirstChild(objects, &node); valid; valid = NextSibling(objects, &node))
+	{
+		if (node.name == "Geometry" && !ReadGeometry(node))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool FBXLoader::ReadNode(const uint8_t* at, const uint8_t* limit, FBXNode* node)
+{
+	const uint8_t* base = m_data.data();
+
+	bool largeOffsets = m_version >= FBX_LARGE_OFFSETS_VERSION;
+
+	size_t headerSize = largeOffsets ? 25 : 13;
+
+	if (at < base || limit < at || static_cast<size_t>(limit - at) < headerSize)
+	{
+		return false;
+	}
+
+	uint64_t endOffset = largeOffsets ? ReadValue<uint64_t>(at) : ReadValue<uint32_t>(at);
+	uint64_t propertyCount = largeOffsets ? ReadValue<uint64_t>(at + 8) : ReadValue<uint32_t>(at + 4);
+	uint64_t propertyListLength = largeOffsets ? ReadValue<uint64_t>(at + 16) : ReadValue<uint32_t>(at + 8);
+	uint8_t nameLength = at[headerSize - 1];
+
+	// The null record terminating every node list
+	if (endOffset == 0)
+	{
+		return false;
+	}
+
+	const uint8_t* end = base + endOffset;
+	const uint8_t* name = at + headerSize;
+
+	if (endOffset > m_data.size() || end > limit || end < name || static_cast<size_t>(end - name) < nameLength || static_cast<uint64_t>(end - name - nameLength) < propertyListLength)
+	{
+		Logger::Error("MALFORMED FBX NODE AT OFFSET %llu", (unsigned long long)(at - base));
+
+		return false;
+	}
+
+	node->name = std::string_view(reinterpret_cast<const char*>(name), nameLength);
+	node->propertyCount = propertyCount;
+	node->properties = name + nameLength;
+	node->children = node->properties + propertyListLength;
+	node->end = end;
+
+	return true;
+}
+
+bool FBXLoader::FirstChild(const FBXNode& parent, FBXNode* child)
+{
+	return ReadNode(parent.children, parent.end, child);
+}
+
+bool FBXLoader::NextSibling(const FBXNode& parent, FBXNode* node)
+{
+	return ReadNode(node->end, parent.end, node);
+}
+
+bool FBXLoader::FindChild(const FBXNode& parent, std::string_view name, FBXNode* child)
+{
+	for (bool valid = FirstChild(parent, child); valid; valid = NextSibling(parent, child))
+	{
+		if (child->name == name)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool FBXLoader::GetProperty(const FBXNode& node, uint64_t index, FBXProperty* property)
+{
+	const uint8_t* at = node.properties;
+	const uint8_t* limit = node.children;
+
+	for (uint64_t i = 0; i < node.propertyCount; i++)
+	{
+		if (at >= limit)
+		{
+			return false;
+		}
+
+		FBXProperty current;
+		current.type = static_cast<char>(*at++);
+
+		size_t available = static_cast<size_t>(limit - at);
+		size_t headerSize = 0;
+
+		switch (current.type)
+		{
+		case 'C':
+			current.size = 1;
+			break;
+		case 'Y':
+			current.size = 2;
+			break;
+		case 'I':
+		case 'F':
+			current.size = 4;
+			break;
+		case 'L':
+		case 'D':
+			current.size = 8;
+			break;
+		case 'S':
+		case 'R':
+			headerSize = 4;
+
+			if (available < headerSize)
+			{
+				return false;
+			}
+
+			current.size = ReadValue<uint32_t>(at);
+			break;
+		case 'f':
+		case 'd':
+		case 'l':
+		case 'i':
+		case 'b':
+			headerSize = 12;
+
+			if (available < headerSize)
+			{
+				return false;
+			}
+
+			current.arrayLength = ReadValue<uint32_t>(at);
+			current.encoding = ReadValue<uint32_t>(at + 4);
+			current.size = ReadValue<uint32_t>(at + 8);
+			break;
+		default:
+			Logger::Error("UNKNOWN FBX PROPERTY TYPE '%c'", current.type);
+
+			return false;
+		}
+
+		if (available - headerSize < current.size)
+		{
+			return false;
+		}
+
+		current.data = at + headerSize;
+
+		if (i == index)
+		{
+			*property = current;
+
+			return true;
+		}
+
+		at = current.data + current.size;
+	}
+
+	return false;
+}
+
+const uint8_t* FBXLoader::DecodeArray(const FBXProperty& property, uint32_t elementSize)
+{
+	size_t decodedSize = static_cast<size_t>(property.arrayLength) * elementSize;
+
+	if (property.encoding == 0)
+	{
+		return property.size == decodedSize ? property.data : nullptr;
+	}
+
+	if (property.encoding != 1)
+	{
+		return nullptr;
+	}
+
+	m_scratch.resize(decodedSize);
+
+	if (!ZlibInflate(property.data, property.size, m_scratch.data(), decodedSize))
+	{
+		Logger::Error("FAILED TO INFLATE FBX ARRAY (%u BYTES)", property.size);
+
+		return nullptr;
+	}
+
+	return m_scratch.data();
+}
+
+bool FBXLoader::ReadArray(const FBXProperty& property, std::vector<double>& values)
+{
+	uint32_t elementSize = (property.type == 'd' || property.type == 'l') ? 8 : 4;
+
+	if (property.type != 'd' && property.type != 'f' && property.type != 'i' && property.type != 'l')
+	{
+		return false;
+	}
+
+	const uint8_t* data = DecodeArray(property, elementSize);
+
+	if (data == nullptr)
+	{
+		return false;
+	}
+
+	values.resize(property.arrayLength);
+
+	for (uint32_t i = 0; i < property.arrayLength; i++)
+	{
+		const uint8_t* element = data + static_cast<size_t>(i) * elementSize;
+
+		switch (property.type)
+		{
+		case 'd': values[i] = ReadValue<double>(element); break;
+		case 'f': values[i] = ReadValue<float>(element); break;
+		case 'i': values[i] = ReadValue<int32_t>(element); break;
+		case 'l': values[i] = static_cast<double>(ReadValue<int64_t>(element)); break;
+		}
+	}
+
+	return true;
+}
+
+bool FBXLoader::ReadArray(const FBXProperty& property, std::vector<int32_t>& values)
+{
+	if (property.type != 'i' && property.type != 'l')
+	{
+		return false;
+	}
+
+	uint32_t elementSize = property.type == 'l' ? 8 : 4;
+
+	const uint8_t* data = DecodeArray(property, elementSize);
+
+	if (data == nullptr)
+	{
+		return false;
+	}
+
+	values.resize(property.arrayLength);
+
+	if (property.type == 'i')
+	{
+		memcpy(values.data(), data, static_cast<size_t>(property.arrayLength) * sizeof(int32_t));
+
+		return true;
+	}
+
+	for (uint32_t i = 0; i < property.arrayLength; i++)
+	{
+		values[i] = static_cast<int32_t>(ReadValue<int64_t>(data + static_cast<size_t>(i) * 8));
+	}
+
+	return true;
+}
+
+bool FBXLoader::ReadLayerElement(const FBXNode& geometry, std::string_view elementName, std::string_view valuesName, std::string_view indicesName, LayerElement* element)
+{
+	element->present = false;
+	element->byPolygonVertex = false;
+	element->byPolygon = false;
+	element->allSame = false;
+	element->indexed = false;
+
+	FBXNode layer;
+
+	// Only the first layer is used, further UV sets and normal layers are ignored
+	if (!FindChild(geometry, elementName, &layer))
+	{
+		return true;
+	}
+
+	FBXNode child;
+	FBXProperty property;
+
+	if (FindChild(layer, "MappingInformationType", &child) && GetProperty(child, 0, &property))
+	{
+		std::string_view mapping = property.AsString();
+
+		element->byPolygonVertex = mapping == "ByPolygonVertex";
+		element->byPolygon = mapping == "ByPolygon";
+		element->allSame = mapping == "AllSame";
+	}
+
+	if (FindChild(layer, "ReferenceInformationType", &child) && GetProperty(child, 0, &property))
+	{
+		std::string_view reference = property.AsString();
+
+		element->indexed = reference == "IndexToDirect" || reference == "Index";
+	}
+
+	if (!FindChild(layer, valuesName, &child) || !GetProperty(child, 0, &property) || !ReadArray(property, element->values))
+	{
+		return false;
+	}
+
+	if (element->indexed && (!FindChild(layer, indicesName, &child) || !GetProperty(child, 0, &property) || !ReadArray(property, element->indices)))
+	{
+		return false;
+	}
+
+	element->present = true;
+
+	return true;
+}
+
+int64_t FBXLoader::ResolveLayerIndex(const LayerElement& element, uint32_t corner, uint32_t controlPoint, uint32_t polygon)
+{
+	uint32_t index = element.byPolygonVertex ? corner : element.byPolygon ? polygon : element.allSame ? 0 : controlPoint;
+
+	if (!element.indexed)
+	{
+		return index;
+	}
+
+	if (index >= element.indices.size())
+	{
+		return -1;
+	}
+
+	return element.indices[index];
+}
+
+bool FBXLoader::ReadGeometry(const FBXNode& geometry)
+{
+	FBXNode vertices;
+	FBXNode polygonVertexIndex;
+	FBXProperty property;
+
+	// Shapes and curves are Geometry nodes too, only polygon meshes have a PolygonVertexIndex
+	if (!FindChild(geometry, "Vertices", &vertices) || !FindChild(geometry, "PolygonVertexIndex", &polygonVertexIndex))
+	{
+		return true;
+	}
+
+	if (!GetProperty(vertices, 0, &property) || !ReadArray(property, m_positions) ||
+		!GetProperty(polygonVertexIndex, 0, &property) || !ReadArray(property, m_polygonIndices) ||
+		!ReadLayerElement(geometry, "LayerElementNormal", "Normals", "NormalsIndex", &m_normals) ||
+		!ReadLayerElement(geometry, "LayerElementUV", "UV", "UVIndex", &m_uvs))
+	{
+		Logger::Error("MALFORMED FBX GEOMETRY");
+
+		return false;
+	}
+
+	FBXMesh& mesh = m_meshes.emplace_back();
+
+	// Object names are stored as "Name\x00\x01Class"
+	if (GetProperty(geometry, 1, &property))
+	{
+		std::string_view name = property.AsString();
+
+		mesh.name = name.substr(0, name.find('\0'));
+	}
+
+	mesh.hasNormals = m_normals.present;
+	mesh.hasUVs = m_uvs.present;
+
+	uint32_t controlPointCount = static_cast<uint32_t>(m_positions.size() / 3);
+
+	std::unordered_map<CornerKey, uint32_t, CornerKeyHash> welded;
+
+	welded.reserve(m_polygonIndices.size());
+
+	mesh.vertices.reserve(m_polygonIndices.size());
+	mesh.indices.reserve(m_polygonIndices.size() * 2);
+
+	uint32_t polygon = 0;
+
+	m_polygon.clear();
+
+	for (uint32_t corner = 0; corner < m_polygonIndices.size(); corner++)
+	{
+		int32_t rawIndex = m_polygonIndices[corner];
+
+		// The last corner of each polygon is stored as ~index
+		bool lastCorner = rawIndex < 0;
+		uint32_t controlPoint = static_cast<uint32_t>(lastCorner ? ~rawIndex : rawIndex);
+
+		if (controlPoint >= controlPointCount)
+		{
+			Logger::Error("FBX POLYGON INDEX %u OUT OF RANGE", controlPoint);
+
+			m_meshes.pop_back();
+
+			return false;
+		}
+
+		CornerKey key = { controlPoint, -1, -1 };
+
+		if (m_normals.present)
+		{
+			key.normal = ResolveLayerIndex(m_normals, corner, controlPoint, polygon);
+
+			if (key.normal < 0 || static_cast<size_t>(key.normal) * 3 + 2 >= m_normals.values.size())
+			{
+				key.normal = -1;
+			}
+		}
+
+		if (m_uvs.present)
+		{
+			key.uv = ResolveLayerIndex(m_uvs, corner, controlPoint, polygon);
+
+			if (key.uv < 0 || static_cast<size_t>(key.uv) * 2 + 1 >= m_uvs.values.size())
+			{
+				key.uv = -1;
+			}
+		}
+
+		auto [it, inserted] = welded.try_emplace(key, static_cast<uint32_t>(mesh.vertices.size()));
+
+		if (inserted)
+		{
+			FBXVertex vertex = {};
+
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				vertex.position[axis] = static_cast<float>(m_positions[controlPoint * 3 + axis]);
+			}
+
+			if (key.normal >= 0)
+			{
+				for (uint32_t axis = 0; axis < 3; axis++)
+				{
+					vertex.normal[axis] = static_cast<float>(m_normals.values[key.normal * 3 + axis]);
+				}
+			}
+
+			if (key.uv >= 0)
+			{
+				// FBX puts the UV origin at the bottom left, Vulkan samples from the top left
+				vertex.uv[0] = static_cast<float>(m_uvs.values[key.uv * 2]);
+				vertex.uv[1] = 1.0f - static_cast<float>(m_uvs.values[key.uv * 2 + 1]);
+			}
+
+			mesh.vertices.push_back(vertex);
+		}
+
+		m_polygon.push_back(it->second);
+
+		if (lastCorner)
+		{
+			for (size_t i = 1; i + 1 < m_polygon.size(); i++)
+			{
+				mesh.indices.push_back(m_polygon[0]);
+				mesh.indices.push_back(m_polygon[i]);
+				mesh.indices.push_back(m_polygon[i + 1]);
+			}
+
+			m_polygon.clear();
+
+			polygon++;
+		}
+	}
+
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		mesh.boundsMin[axis] = mesh.vertices.empty() ? 0.0f : FLT_MAX;
+		mesh.boundsMax[axis] = mesh.vertices.empty() ? 0.0f : -FLT_MAX;
+	}
+
+	for (const FBXVertex& vertex : mesh.vertices)
+	{
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			mesh.boundsMin[axis] = (std::min)(mesh.boundsMin[axis], vertex.position[axis]);
+			mesh.boundsMax[axis] = (std::max)(mesh.boundsMax[axis], vertex.position[axis]);
+		}
+	}
+
+	return true;
+}
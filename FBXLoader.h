@@ -1,6 +1,123 @@
 #pragma once
-class FBXLoader
+
+struct FBXVertex
+{
+	float position[3];
+	float normal[3];
+	float uv[2];
+};
+
+struct FBXMesh
+{
+	std::string name;
+
+	std::vector<FBXVertex> vertices;
+	std::vector<uint32_t> indices;
+
+	float boundsMin[3];
+	float boundsMax[3];
+
+	bool hasNormals = false;
+	bool hasUVs = false;
+};
+
+// One property record, pointing into the file. Array payloads may still be zlib compressed (encoding 1).
+struct FBXProperty
 {
+	char type = 0;
 
+	const uint8_t* data = nullptr;
+	uint32_t size = 0;
+
+	uint32_t arrayLength = 0;
+	uint32_t encoding = 0;
+
+	bool IsArray() const { return type == 'f' || type == 'd' || type == 'l' || type == 'i' || type == 'b'; }
+
+	int64_t AsInt() const;
+	double AsDouble() const;
+	std::string_view AsString() const;
 };
 
+// One node record, pointing into the file. Nodes are plain views, walking the tree never allocates.
+struct FBXNode
+{
+	std::string_view name;
+
+	uint64_t propertyCount = 0;
+
+	const uint8_t* properties = nullptr;
+	const uint8_t* children = nullptr;
+	const uint8_t* end = nullptr;
+};
+
+// Parses "Kaydara FBX Binary" files (versions 7100 to 7700) without the Autodesk SDK.
+// Polygons are triangulated as fans and corners sharing position, normal and UV are welded into one vertex.
+class FBXLoader
+{
+public:
+	// Maps the file and parses it, the mapping is released before returning
+	bool Load(const std::string& path);
+
+	bool Parse(std::span<const uint8_t> data);
+
+	const std::vector<FBXMesh>& GetMeshes() const { return m_meshes; }
+
+	uint32_t GetVersion() const { return m_version; }
+
+public:
+	// Low level access for tools that need more than geometry. Return false at the end of a node list or on malformed data.
+	bool ReadNode(const uint8_t* at, const uint8_t* limit, FBXNode* node);
+
+	bool FirstChild(const FBXNode& parent, FBXNode* child);
+	bool NextSibling(const FBXNode& parent, FBXNode* node);
+
+	bool FindChild(const FBXNode& parent, std::string_view name, FBXNode* child);
+
+	bool GetProperty(const FBXNode& node, uint64_t index, FBXProperty* property);
+
+	// Decodes and converts numeric arrays ('d', 'f', 'i', 'l'), decompressing into a reused scratch buffer
+	bool ReadArray(const FBXProperty& property, std::vector<double>& values);
+	bool ReadArray(const FBXProperty& property, std::vector<int32_t>& values);
+
+private:
+	struct LayerElement
+	{
+		bool present = false;
+		bool byPolygonVertex = false;
+		bool byPolygon = false;
+		bool allSame = false;
+		bool indexed = false;
+
+		std::vector<double> values;
+		std::vector<int32_t> indices;
+	};
+
+private:
+	std::span<const uint8_t> m_data;
+
+	uint32_t m_version = 0;
+
+	std::vector<FBXMesh> m_meshes;
+
+	// Reused between arrays and geometries so steady state parsing does not allocate
+	std::vector<uint8_t> m_scratch;
+
+	std::vector<double> m_positions;
+	std::vector<int32_t> m_polygonIndices;
+
+	LayerElement m_normals;
+	LayerElement m_uvs;
+
+	std::vector<uint32_t> m_polygon;
+
+private:
+	const uint8_t* DecodeArray(const FBXProperty& property, uint32_t elementSize);
+
+	bool ReadLayerElement(const FBXNode& geometry, std::string_view elementName, std::string_view valuesName, std::string_view indicesName, LayerElement* element);
+
+	bool ReadGeometry(const FBXNode& geometry);
+
+	// Index into a layer element's value array for one polygon corner
+	static int64_t ResolveLayerIndex(const LayerElement& element, uint32_t corner, uint32_t controlPoint, uint32_t polygon);
+};
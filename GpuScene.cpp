@@ -0,0 +1,1288 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+// Instances staged per frame arena allocation, larger dirty sets continue with another allocation
+static constexpr uint32_t INSTANCE_UPLOAD_BATCH = 4096;
+
+static float GetMaxAxisScale(const float* objectToWorld)
+{
+	float maxScaleSquared = 0.0f;
+
+	for (uint32_t column = 0; column < 3; column++)
+	{
+		float x = objectToWorld[column];
+		float y = objectToWorld[4 + column];
+		float z = objectToWorld[8 + column];
+
+		maxScaleSquared = (std::max)(maxScaleSquared, x * x + y * y + z * z);
+	}
+
+	return std::sqrt(maxScaleSquared);
+}
+
+bool GpuScene::Init(VkDevice device, MemoryAllocator* allocator, UploadManager* uploadManager, PipelineCache* pipelineCache, FrameArena& frameArena, const GpuSceneFeatures& features, uint32_t framesInFlight, std::function<void(std::function<void()>)> deferRelease, const GpuSceneLimits& limits)
+{
+	m_device = device;
+	m_allocator = allocator;
+	m_uploadManager = uploadManager;
+	m_features = features;
+	m_limits = limits;
+	m_deferRelease = std::move(deferRelease);
+
+	// gl_InstanceIndex is the only way the vertex shader finds its instance
+	if (!m_features.drawIndirectFirstInstance)
+	{
+		Logger::Error("GPU SCENE REQUIRES drawIndirectFirstInstance");
+
+		return false;
+	}
+
+	// A count buffer draw cannot be split, so the scene is capped to what one call may draw
+	if (m_features.drawIndexedIndirectCount != nullptr && m_limits.maxInstances > m_features.maxDrawIndirectCount)
+	{
+		Logger::Warn("GPU SCENE LIMITED TO %u INSTANCES BY maxDrawIndirectCount", m_features.maxDrawIndirectCount);
+
+		m_limits.maxInstances = m_features.maxDrawIndirectCount;
+	}
+
+	if (m_features.drawIndexedIndirectCount == nullptr && !m_features.multiDrawIndirect)
+	{
+		Logger::Warn("NO MULTI DRAW INDIRECT, GPU SCENE FALLS BACK TO ONE INDIRECT DRAW PER INSTANCE");
+	}
+
+	m_readbacks.assign(framesInFlight, {});
+
+	if (!CreateBuffers() || !CreateDescriptors(frameArena.GetBuffer()) || !CreateComputePipeline(pipelineCache, CULL_SHADER_PATH, m_cullPipelineLayout, &m_cullPipeline) || !CreateComputePipeline(pipelineCache, PYRAMID_SHADER_PATH, m_reducePipelineLayout, &m_reducePipeline) || !CreatePyramid(VK_NULL_HANDLE, {}))
+	{
+		Destroy();
+
+		return false;
+	}
+
+	m_instances.reserve(m_limits.maxInstances);
+
+	Logger::Info("GPU SCENE INITIALIZED FOR %u INSTANCES (%s)", m_limits.maxInstances, m_features.drawIndexedIndirectCount != nullptr ? "DRAW INDIRECT COUNT" : "DRAW INDIRECT");
+
+	return true;
+}
+
+void GpuScene::Destroy()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// The renderer has drained the device, nothing needs to wait for frames in flight
+	m_deferRelease = nullptr;
+
+	ReleasePyramid();
+
+	vkDestroySampler(m_device, m_pyramidSampler, nullptr);
+
+	vkDestroyPipeline(m_device, m_cullPipeline, nullptr);
+	vkDestroyPipeline(m_device, m_reducePipeline, nullptr);
+	vkDestroyPipelineLayout(m_device, m_cullPipelineLayout, nullptr);
+	vkDestroyPipelineLayout(m_device, m_reducePipelineLayout, nullptr);
+	vkDestroyPipelineLayout(m_device, m_drawPipelineLayout, nullptr);
+
+	vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(m_device, m_cullSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device, m_pyramidSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device, m_reduceSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device, m_drawSetLayout, nullptr);
+
+	m_pyramidSampler = VK_NULL_HANDLE;
+	m_cullPipeline = VK_NULL_HANDLE;
+	m_reducePipeline = VK_NULL_HANDLE;
+	m_cullPipelineLayout = VK_NULL_HANDLE;
+	m_reducePipelineLayout = VK_NULL_HANDLE;
+	m_drawPipelineLayout = VK_NULL_HANDLE;
+	m_descriptorPool = VK_NULL_HANDLE;
+	m_cullSetLayout = VK_NULL_HANDLE;
+	m_pyramidSetLayout = VK_NULL_HANDLE;
+	m_reduceSetLayout = VK_NULL_HANDLE;
+	m_drawSetLayout = VK_NULL_HANDLE;
+	m_cullSet = VK_NULL_HANDLE;
+	m_drawSet = VK_NULL_HANDLE;
+
+	std::pair<VkBuffer*, MemoryAllocation*> buffers[] = {
+		{ &m_vertexBuffer, &m_vertexAllocation },
+		{ &m_indexBuffer, &m_indexAllocation },
+		{ &m_meshBuffer, &m_meshAllocation },
+		{ &m_instanceBuffer, &m_instanceAllocation },
+		{ &m_drawBuffer, &m_drawAllocation },
+		{ &m_countBuffer, &m_countAllocation },
+		{ &m_visibilityBuffer, &m_visibilityAllocation },
+		{ &m_readbackBuffer, &m_readbackAllocation },
+		{ &m_transformBuffer, &m_transformAllocation },
+	};
+
+	for (auto& [buffer, allocation] : buffers)
+	{
+		if (*buffer != VK_NULL_HANDLE)
+		{
+			m_allocator->DestroyBuffer(*buffer, *allocation);
+
+			*buffer = VK_NULL_HANDLE;
+		}
+	}
+
+	m_meshes.clear();
+	m_instances.clear();
+	m_freeInstances.clear();
+	m_dirtyInstances.clear();
+	m_dirtyFlags.clear();
+	m_readbacks.clear();
+
+	m_stats = {};
+	m_framePhases = 0;
+	m_instanceCount = 0;
+	m_vertexCount = 0;
+	m_indexCount = 0;
+	m_vertexStride = 0;
+
+	m_device = VK_NULL_HANDLE;
+}
+
+uint32_t GpuScene::AddMesh(const CookedMesh& mesh)
+{
+	const MeshFileHeader& header = mesh.GetHeader();
+
+	GraphicsPipelineDesc vertexInput;
+	mesh.FillVertexInput(vertexInput);
+
+	// One vertex buffer binding serves every mesh, so they all need the same layout
+	if (m_vertexStride == 0)
+	{
+		m_vertexStride = header.vertexStride;
+		m_vertexBindings = vertexInput.vertexBindings;
+		m_vertexAttributes = vertexInput.vertexAttributes;
+	}
+	else if (header.vertexStride != m_vertexStride || vertexInput.vertexAttributes.size() != m_vertexAttributes.size() || !std::equal(m_vertexAttributes.begin(), m_vertexAttributes.end(), vertexInput.vertexAttributes.begin(), [](const VkVertexInputAttributeDescription& a, const VkVertexInputAttributeDescription& b) { return a.format == b.format && a.offset == b.offset; }))
+	{
+		Logger::Error("GPU SCENE MESH VERTEX LAYOUT DOES NOT MATCH THE SCENE");
+
+		return INVALID_GPU_SCENE_INDEX;
+	}
+
+	if (m_meshes.size() >= m_limits.maxMeshes || static_cast<VkDeviceSize>(m_vertexCount + header.vertexCount) * m_vertexStride > m_limits.vertexBytes || static_cast<uint64_t>(m_indexCount) + header.indexCount > m_limits.maxIndices)
+	{
+		Logger::Error("GPU SCENE IS FULL, MESH WITH %u VERTICES NOT ADDED", header.vertexCount);
+
+		return INVALID_GPU_SCENE_INDEX;
+	}
+
+	std::span<const uint8_t> vertexData = mesh.GetVertexData();
+	std::span<const uint8_t> indexData = mesh.GetIndexData();
+
+	uint64_t vertexBatch = m_uploadManager->UploadBuffer(m_vertexBuffer, static_cast<VkDeviceSize>(m_vertexCount) * m_vertexStride, vertexData.data(), vertexData.size());
+	uint64_t indexBatch = 0;
+
+	// The shared index buffer is 32 bit, 16 bit meshes are widened on the way in
+	if (mesh.GetIndexType() == VK_INDEX_TYPE_UINT32)
+	{
+		indexBatch = m_uploadManager->UploadBuffer(m_indexBuffer, static_cast<VkDeviceSize>(m_indexCount) * sizeof(uint32_t), indexData.data(), indexData.size());
+	}
+	else
+	{
+		std::vector<uint32_t> indices(header.indexCount);
+
+		const uint16_t* source = reinterpret_cast<const uint16_t*>(indexData.data());
+
+		for (uint32_t i = 0; i < header.indexCount; i++)
+		{
+			indices[i] = source[i];
+		}
+
+		indexBatch = m_uploadManager->UploadBuffer(m_indexBuffer, static_cast<VkDeviceSize>(m_indexCount) * sizeof(uint32_t), indices.data(), indices.size() * sizeof(uint32_t));
+	}
+
+	GpuMeshInfo info = {};
+	info.vertexOffset = static_cast<int32_t>(m_vertexCount);
+	info.lodCount = (std::min)(header.lodCount, MESH_FILE_MAX_LODS);
+
+	for (uint32_t lod = 0; lod < info.lodCount; lod++)
+	{
+		info.lods[lod] = header.lods[lod];
+		info.lods[lod].firstIndex += m_indexCount;
+	}
+
+	// Meshes cooked without a LOD chain draw everything as LOD 0
+	if (info.lodCount == 0)
+	{
+		info.lodCount = 1;
+		info.lods[0] = { m_indexCount, header.indexCount, 0.0f, 0 };
+	}
+
+	uint32_t meshIndex = static_cast<uint32_t>(m_meshes.size());
+
+	uint64_t infoBatch = m_uploadManager->UploadBuffer(m_meshBuffer, static_cast<VkDeviceSize>(meshIndex) * sizeof(GpuMeshInfo), &info, sizeof(info));
+
+	if (vertexBatch == 0 || indexBatch == 0 || infoBatch == 0)
+	{
+		Logger::Error("FAILED TO STAGE GPU SCENE MESH");
+
+		return INVALID_GPU_SCENE_INDEX;
+	}
+
+	MeshEntry entry;
+
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		entry.boundsCenter[axis] = (header.boundsMin[axis] + header.boundsMax[axis]) * 0.5f;
+	}
+
+	entry.boundsRadius = header.boundsRadius;
+	entry.uploadBatch = (std::max)({ vertexBatch, indexBatch, infoBatch });
+
+	m_meshes.push_back(entry);
+
+	m_vertexCount += header.vertexCount;
+	m_indexCount += header.indexCount;
+
+	return meshIndex;
+}
+
+uint32_t GpuScene::AddInstance(uint32_t mesh, const float* objectToWorld)
+{
+	if (mesh >= m_meshes.size())
+	{
+		Logger::Error("GPU SCENE INSTANCE OF UNKNOWN MESH %u", mesh);
+
+		return INVALID_GPU_SCENE_INDEX;
+	}
+
+	uint32_t instance;
+
+	if (!m_freeInstances.empty())
+	{
+		instance = m_freeInstances.back();
+
+		m_freeInstances.pop_back();
+	}
+	else if (m_instanceCount < m_limits.maxInstances)
+	{
+		instance = m_instanceCount++;
+
+		m_instances.emplace_back();
+		m_dirtyFlags.push_back(0);
+	}
+	else
+	{
+		Logger::Error("GPU SCENE IS FULL, INSTANCE NOT ADDED");
+
+		return INVALID_GPU_SCENE_INDEX;
+	}
+
+	GpuInstance& gpuInstance = m_instances[instance];
+	gpuInstance = {};
+
+	memcpy(gpuInstance.boundsCenter, m_meshes[mesh].boundsCenter, sizeof(gpuInstance.boundsCenter));
+
+	gpuInstance.boundsRadius = m_meshes[mesh].boundsRadius;
+	gpuInstance.mesh = mesh;
+
+	SetTransform(instance, objectToWorld);
+
+	return instance;
+}
+
+uint32_t GpuScene::AddNodeInstance(uint32_t mesh, uint32_t transformNode)
+{
+	if (transformNode >= m_limits.maxTransforms)
+	{
+		Logger::Error("TRANSFORM NODE %u IS OUTSIDE THE GPU SCENE'S %u TRANSFORMS", transformNode, m_limits.maxTransforms);
+
+		return INVALID_GPU_SCENE_INDEX;
+	}
+
+	static constexpr float IDENTITY_ROWS[12] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f };
+
+	uint32_t instance = AddInstance(mesh, IDENTITY_ROWS);
+
+	// Still dirty from AddInstance, this is the only copy the instance needs
+	if (instance != INVALID_GPU_SCENE_INDEX)
+	{
+		m_instances[instance].transform = transformNode;
+	}
+
+	return instance;
+}
+
+void GpuScene::SetTransform(uint32_t instance, const float* objectToWorld)
+{
+	GpuInstance& gpuInstance = m_instances[instance];
+
+	memcpy(gpuInstance.objectToWorld, objectToWorld, sizeof(gpuInstance.objectToWorld));
+
+	gpuInstance.scale = GetMaxAxisScale(objectToWorld);
+	gpuInstance.transform = INVALID_TRANSFORM_NODE;
+
+	MarkDirty(instance);
+}
+
+void GpuScene::RemoveInstance(uint32_t instance)
+{
+	if (instance >= m_instanceCount || m_instances[instance].mesh == INVALID_GPU_SCENE_INDEX)
+	{
+		return;
+	}
+
+	// The slot stays in the draw range as an empty draw until AddInstance reuses it
+	m_instances[instance].mesh = INVALID_GPU_SCENE_INDEX;
+	m_freeInstances.push_back(instance);
+
+	MarkDirty(instance);
+}
+
+void GpuScene::FillVertexInput(GraphicsPipelineDesc& desc) const
+{
+	desc.vertexBindings = m_vertexBindings;
+	desc.vertexAttributes = m_vertexAttributes;
+}
+
+bool GpuScene::SetDepthSource(VkImageView depthView, VkExtent2D extent)
+{
+	if (depthView == m_pyramid.sourceView && extent.width == m_pyramid.sourceExtent.width && extent.height == m_pyramid.sourceExtent.height)
+	{
+		return true;
+	}
+
+	ReleasePyramid();
+
+	if (CreatePyramid(depthView, extent))
+	{
+		return true;
+	}
+
+	// Set 1 of the culling layout must stay valid, the placeholder takes over and occlusion culling stays off
+	ReleasePyramid();
+	CreatePyramid(VK_NULL_HANDLE, {});
+
+	return false;
+}
+
+void GpuScene::BeginFrame(uint32_t frameIndex, FrameArena& frameArena, const CullingView& view, const float* viewProjection, float pixelsPerUnit, bool occlusion, float maxPixelError)
+{
+	m_frameIndex = frameIndex;
+	m_framePhases = 0;
+
+	memcpy(m_viewProjection, viewProjection, sizeof(m_viewProjection));
+
+	// The slot's previous frame has retired, its counts are in host visible memory
+	CountReadback& readback = m_readbacks[frameIndex];
+
+	if (readback.pending)
+	{
+		const uint32_t* counts = reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(m_readbackAllocation.mapped) + static_cast<VkDeviceSize>(frameIndex) * 4 * sizeof(uint32_t));
+
+		m_stats.instances = readback.instances;
+		m_stats.drawn = counts[0] + counts[1];
+		m_stats.frustumRejected = counts[2];
+		m_stats.occlusionRejected = counts[3];
+
+		readback.pending = false;
+	}
+
+	m_viewAllocation = {};
+
+	// The arena already warned, the scene is skipped this frame
+	if (m_instanceCount == 0 || !frameArena.Allocate(sizeof(GpuCullView), 256, &m_viewAllocation))
+	{
+		return;
+	}
+
+	// Decided up front, draws may be recorded into secondary command buffers before the culling is
+	m_framePhases = GPU_CULL_PHASE_EARLY;
+
+	if (occlusion && HasDepthPyramid())
+	{
+		m_framePhases |= GPU_CULL_PHASE_LATE;
+	}
+
+	GpuCullView* uniforms = static_cast<GpuCullView*>(m_viewAllocation.mapped);
+	*uniforms = {};
+
+	memcpy(uniforms->viewProjection, viewProjection, sizeof(uniforms->viewProjection));
+	memcpy(uniforms->planes, view.planes, sizeof(uniforms->planes));
+	memcpy(uniforms->eye, view.eye, sizeof(uniforms->eye));
+
+	uniforms->pixelsPerUnit = pixelsPerUnit;
+	uniforms->pyramidSize[0] = static_cast<float>(m_pyramid.extent.width);
+	uniforms->pyramidSize[1] = static_cast<float>(m_pyramid.extent.height);
+	uniforms->maxPixelError = maxPixelError;
+	uniforms->instanceCount = m_instanceCount;
+	uniforms->pyramidLevels = m_pyramid.levelCount;
+	uniforms->occlusion = (m_framePhases & GPU_CULL_PHASE_LATE) != 0 ? 1 : 0;
+	uniforms->compact = m_features.drawIndexedIndirectCount != nullptr ? 1 : 0;
+	uniforms->maxDraws = m_limits.maxInstances;
+}
+
+void GpuScene::RecordEarlyCulling(VkCommandBuffer commandBuffer, FrameArena& frameArena)
+{
+	if ((m_framePhases & GPU_CULL_PHASE_EARLY) == 0)
+	{
+		return;
+	}
+
+	// The previous frame's draws read the instances and the draws this frame overwrites, its readback copy the counts
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// A new pyramid leaves the undefined layout and starts with nothing visible, the first late phase then draws everything it finds
+	if (!m_pyramid.initialized)
+	{
+		VkImageMemoryBarrier imageBarrier{};
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier.srcAccessMask = 0;
+		imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = m_pyramid.image;
+		imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1 };
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+		vkCmdFillBuffer(commandBuffer, m_visibilityBuffer, 0, VK_WHOLE_SIZE, 0);
+
+		m_pyramid.initialized = true;
+	}
+
+	RecordInstanceUploads(commandBuffer, frameArena);
+
+	// Both draw counts and both rejection counts start at zero, the late count stays zero without occlusion culling
+	vkCmdFillBuffer(commandBuffer, m_countBuffer, 0, 4 * sizeof(uint32_t), 0);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	RecordCullingPass(commandBuffer, 0);
+
+	// Draws and count feed the indirect stage, the copied instances the vertex shader
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// Without a late phase the counts are complete now
+	if ((m_framePhases & GPU_CULL_PHASE_LATE) == 0)
+	{
+		RecordCountReadback(commandBuffer);
+	}
+}
+
+void GpuScene::RecordDepthPyramid(VkCommandBuffer commandBuffer)
+{
+	if ((m_framePhases & GPU_CULL_PHASE_LATE) == 0)
+	{
+		return;
+	}
+
+	// The previous frame's late phase read the pyramid this frame overwrites
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_reducePipeline);
+
+	int32_t sourceSize[2] = { static_cast<int32_t>(m_pyramid.sourceExtent.width), static_cast<int32_t>(m_pyramid.sourceExtent.height) };
+
+	for (uint32_t level = 0; level < m_pyramid.levelCount; level++)
+	{
+		int32_t constants[4] = { sourceSize[0], sourceSize[1], static_cast<int32_t>((std::max)(m_pyramid.extent.width >> level, 1u)), static_cast<int32_t>((std::max)(m_pyramid.extent.height >> level, 1u)) };
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_reducePipelineLayout, 0, 1, &m_pyramid.reduceSets[level], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, m_reducePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), constants);
+
+		vkCmdDispatch(commandBuffer, (constants[2] + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, (constants[3] + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+
+		// The next level reads this one, the late phase reads them all
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		sourceSize[0] = constants[2];
+		sourceSize[1] = constants[3];
+	}
+}
+
+void GpuScene::RecordLateCulling(VkCommandBuffer commandBuffer)
+{
+	if ((m_framePhases & GPU_CULL_PHASE_LATE) == 0)
+	{
+		return;
+	}
+
+	RecordCullingPass(commandBuffer, 1);
+
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	RecordCountReadback(commandBuffer);
+}
+
+void GpuScene::RecordDraw(VkCommandBuffer commandBuffer, VkPipeline pipeline, uint32_t phases)
+{
+	phases &= m_framePhases;
+
+	if (m_instanceCount == 0 || pipeline == VK_NULL_HANDLE || phases == 0)
+	{
+		return;
+	}
+
+	uint32_t transformOffset = static_cast<uint32_t>(m_frameIndex * m_transformSegmentSize);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_drawPipelineLayout, 0, 1, &m_drawSet, 1, &transformOffset);
+	vkCmdPushConstants(commandBuffer, m_drawPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(m_viewProjection), m_viewProjection);
+
+	VkDeviceSize offset = 0;
+
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_vertexBuffer, &offset);
+	vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+	uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	for (uint32_t phase = 0; phase < 2; phase++)
+	{
+		if ((phases & (1u << phase)) == 0)
+		{
+			continue;
+		}
+
+		VkDeviceSize region = static_cast<VkDeviceSize>(phase) * m_limits.maxInstances * stride;
+
+		if (m_features.drawIndexedIndirectCount != nullptr)
+		{
+			m_features.drawIndexedIndirectCount(commandBuffer, m_drawBuffer, region, m_countBuffer, phase * sizeof(uint32_t), m_instanceCount, stride);
+
+			continue;
+		}
+
+		// Without a count every slot is drawn, culled slots hold empty draws
+		uint32_t maxDrawsPerCall = m_features.multiDrawIndirect ? (std::max)(m_features.maxDrawIndirectCount, 1u) : 1;
+
+		for (uint32_t first = 0; first < m_instanceCount; first += maxDrawsPerCall)
+		{
+			uint32_t count = (std::min)(maxDrawsPerCall, m_instanceCount - first);
+
+			vkCmdDrawIndexedIndirect(commandBuffer, m_drawBuffer, region + static_cast<VkDeviceSize>(first) * stride, count, stride);
+		}
+	}
+}
+
+bool GpuScene::CreateBuffers()
+{
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	struct BufferDesc
+	{
+		VkDeviceSize size;
+		VkBufferUsageFlags usage;
+		VkBuffer* buffer;
+		MemoryAllocation* allocation;
+		const char* name;
+	};
+
+	BufferDesc buffers[] = {
+		{ m_limits.vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, &m_vertexBuffer, &m_vertexAllocation, "VERTEX" },
+		{ static_cast<VkDeviceSize>(m_limits.maxIndices) * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, &m_indexBuffer, &m_indexAllocation, "INDEX" },
+		{ static_cast<VkDeviceSize>(m_limits.maxMeshes) * sizeof(GpuMeshInfo), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, &m_meshBuffer, &m_meshAllocation, "MESH" },
+		{ static_cast<VkDeviceSize>(m_limits.maxInstances) * sizeof(GpuInstance), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, &m_instanceBuffer, &m_instanceAllocation, "INSTANCE" },
+		{ 2 * static_cast<VkDeviceSize>(m_limits.maxInstances) * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, &m_drawBuffer, &m_drawAllocation, "DRAW" },
+		{ 4 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, &m_countBuffer, &m_countAllocation, "COUNT" },
+		{ static_cast<VkDeviceSize>(m_limits.maxInstances) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, &m_visibilityBuffer, &m_visibilityAllocation, "VISIBILITY" },
+	};
+
+	for (const BufferDesc& desc : buffers)
+	{
+		bufferInfo.size = desc.size;
+		bufferInfo.usage = desc.usage;
+
+		if (!m_allocator->CreateBuffer(bufferInfo, MemoryUsage::GpuOnly, desc.buffer, desc.allocation))
+		{
+			Logger::Error("FAILED TO CREATE GPU SCENE %s BUFFER", desc.name);
+
+			return false;
+		}
+	}
+
+	// One slot of counts per frame in flight, read on the host once the frame has retired
+	bufferInfo.size = (std::max)(static_cast<VkDeviceSize>(m_readbacks.size()), VkDeviceSize(1)) * 4 * sizeof(uint32_t);
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	if (!m_allocator->CreateBuffer(bufferInfo, MemoryUsage::GpuToCpu, &m_readbackBuffer, &m_readbackAllocation) || m_readbackAllocation.mapped == nullptr)
+	{
+		Logger::Error("FAILED TO CREATE GPU SCENE READBACK BUFFER");
+
+		return false;
+	}
+
+	// Written by the host in place, 256 bytes covers every minStorageBufferOffsetAlignment the spec allows
+	m_transformSegmentSize = (static_cast<VkDeviceSize>((std::max)(m_limits.maxTransforms, 1u)) * sizeof(GpuTransform) + 255) & ~VkDeviceSize(255);
+
+	bufferInfo.size = (std::max)(static_cast<VkDeviceSize>(m_readbacks.size()), VkDeviceSize(1)) * m_transformSegmentSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+	if (!m_allocator->CreateBuffer(bufferInfo, MemoryUsage::CpuToGpu, &m_transformBuffer, &m_transformAllocation) || m_transformAllocation.mapped == nullptr)
+	{
+		Logger::Error("FAILED TO CREATE GPU SCENE TRANSFORM BUFFER");
+
+		return false;
+	}
+
+	// Nodes the hierarchy has not written yet read as a zero matrix rather than garbage
+	memset(m_transformAllocation.mapped, 0, bufferInfo.size);
+
+	return true;
+}
+
+bool GpuScene::CreateDescriptors(VkBuffer uniformBuffer)
+{
+	VkResult result;
+
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	result = vkCreateSampler(m_device, &samplerInfo, nullptr, &m_pyramidSampler);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE DEPTH PYRAMID SAMPLER");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	VkDescriptorSetLayoutBinding cullBindings[7] = {};
+
+	for (uint32_t binding = 0; binding < 7; binding++)
+	{
+		cullBindings[binding].binding = binding;
+		cullBindings[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		cullBindings[binding].descriptorCount = 1;
+		cullBindings[binding].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	cullBindings[5].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	cullBindings[6].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+	VkDescriptorSetLayoutBinding reduceBindings[2] = {};
+
+	for (uint32_t binding = 0; binding < 2; binding++)
+	{
+		reduceBindings[binding].binding = binding;
+		reduceBindings[binding].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		reduceBindings[binding].descriptorCount = 1;
+		reduceBindings[binding].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	reduceBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+	// Instances and transforms
+	VkDescriptorSetLayoutBinding drawBindings[2] = {};
+
+	for (uint32_t binding = 0; binding < 2; binding++)
+	{
+		drawBindings[binding].binding = binding;
+		drawBindings[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		drawBindings[binding].descriptorCount = 1;
+		drawBindings[binding].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	}
+
+	drawBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+	struct SetLayoutDesc
+	{
+		uint32_t bindingCount;
+		const VkDescriptorSetLayoutBinding* bindings;
+		VkDescriptorSetLayout* layout;
+		const char* name;
+	};
+
+	// The pyramid set is the sampler binding of the reduce set on its own
+	SetLayoutDesc setLayouts[] = {
+		{ 7, cullBindings, &m_cullSetLayout, "GPU CULLING" },
+		{ 1, reduceBindings, &m_pyramidSetLayout, "DEPTH PYRAMID" },
+		{ 2, reduceBindings, &m_reduceSetLayout, "DEPTH PYRAMID REDUCE" },
+		{ 2, drawBindings, &m_drawSetLayout, "GPU SCENE" },
+	};
+
+	for (const SetLayoutDesc& desc : setLayouts)
+	{
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = desc.bindingCount;
+		layoutInfo.pBindings = desc.bindings;
+
+		result = vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, desc.layout);
+
+		if (result != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO CREATE %s DESCRIPTOR SET LAYOUT", desc.name);
+			Logger::Error("%s", string_VkResult(result));
+
+			return false;
+		}
+	}
+
+	VkDescriptorPoolSize poolSizes[3] = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = 6;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[1].descriptorCount = 1;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	poolSizes[2].descriptorCount = 2;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 2;
+	poolInfo.poolSizeCount = 3;
+	poolInfo.pPoolSizes = poolSizes;
+
+	result = vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE GPU SCENE DESCRIPTOR POOL");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	VkDescriptorSetLayout layouts[] = { m_cullSetLayout, m_drawSetLayout };
+	VkDescriptorSet sets[2] = {};
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_descriptorPool;
+	allocInfo.descriptorSetCount = 2;
+	allocInfo.pSetLayouts = layouts;
+
+	result = vkAllocateDescriptorSets(m_device, &allocInfo, sets);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO ALLOCATE GPU SCENE DESCRIPTOR SETS");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	m_cullSet = sets[0];
+	m_drawSet = sets[1];
+
+	// The sets never change, every buffer is bound whole for the scene's lifetime. The uniforms and the frame's
+	// transform segment move by dynamic offset.
+	VkDescriptorBufferInfo bufferInfos[] = {
+		{ m_instanceBuffer, 0, VK_WHOLE_SIZE },
+		{ m_meshBuffer, 0, VK_WHOLE_SIZE },
+		{ m_drawBuffer, 0, VK_WHOLE_SIZE },
+		{ m_countBuffer, 0, VK_WHOLE_SIZE },
+		{ m_visibilityBuffer, 0, VK_WHOLE_SIZE },
+		{ uniformBuffer, 0, sizeof(GpuCullView) },
+		{ m_transformBuffer, 0, m_transformSegmentSize },
+	};
+
+	VkWriteDescriptorSet writes[9] = {};
+
+	for (uint32_t binding = 0; binding < 7; binding++)
+	{
+		writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[binding].dstSet = m_cullSet;
+		writes[binding].dstBinding = binding;
+		writes[binding].descriptorCount = 1;
+		writes[binding].descriptorType = cullBindings[binding].descriptorType;
+		writes[binding].pBufferInfo = &bufferInfos[binding];
+	}
+
+	writes[7] = writes[0];
+	writes[7].dstSet = m_drawSet;
+
+	writes[8] = writes[6];
+	writes[8].dstSet = m_drawSet;
+	writes[8].dstBinding = 1;
+
+	vkUpdateDescriptorSets(m_device, 9, writes, 0, nullptr);
+
+	// Culling phase
+	VkPushConstantRange cullRange{};
+	cullRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullRange.size = sizeof(uint32_t);
+
+	VkDescriptorSetLayout cullLayouts[] = { m_cullSetLayout, m_pyramidSetLayout };
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 2;
+	pipelineLayoutInfo.pSetLayouts = cullLayouts;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &cullRange;
+
+	result = vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_cullPipelineLayout);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE GPU CULLING PIPELINE LAYOUT");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	// Source and destination size of one pyramid level
+	VkPushConstantRange reduceRange{};
+	reduceRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	reduceRange.size = 4 * sizeof(int32_t);
+
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_reduceSetLayout;
+	pipelineLayoutInfo.pPushConstantRanges = &reduceRange;
+
+	result = vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_reducePipelineLayout);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE DEPTH PYRAMID PIPELINE LAYOUT");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	// Column-major view projection matrix
+	VkPushConstantRange drawRange{};
+	drawRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	drawRange.size = 16 * sizeof(float);
+
+	pipelineLayoutInfo.pSetLayouts = &m_drawSetLayout;
+	pipelineLayoutInfo.pPushConstantRanges = &drawRange;
+
+	result = vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_drawPipelineLayout);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE GPU SCENE PIPELINE LAYOUT");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	return true;
+}
+
+bool GpuScene::CreateComputePipeline(PipelineCache* pipelineCache, const char* path, VkPipelineLayout layout, VkPipeline* pipeline)
+{
+	MappedFile file;
+
+	if (!file.Open(path))
+	{
+		Logger::Error("FAILED TO LOAD SHADER %s", path);
+
+		return false;
+	}
+
+	std::span<const uint8_t> code = file.GetData();
+
+	if (code.empty() || code.size() % sizeof(uint32_t) != 0)
+	{
+		Logger::Error("INVALID SPIR-V CODE (%llu BYTES)", (unsigned long long)code.size());
+
+		return false;
+	}
+
+	VkShaderModuleCreateInfo moduleInfo{};
+	moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleInfo.codeSize = code.size();
+	moduleInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+
+	VkResult result = vkCreateShaderModule(m_device, &moduleInfo, nullptr, &shaderModule);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE SHADER MODULE");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = layout;
+
+	result = pipelineCache->CreateComputePipeline(pipelineInfo, pipeline);
+
+	vkDestroyShaderModule(m_device, shaderModule, nullptr);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE COMPUTE PIPELINE FOR %s", path);
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	return true;
+}
+
+bool GpuScene::CreatePyramid(VkImageView depthView, VkExtent2D extent)
+{
+	VkResult result;
+
+	m_pyramid = {};
+	m_pyramid.sourceExtent = extent;
+
+	// Level 0 is the depth size rounded down to a power of two, so every level halves exactly
+	if (depthView != VK_NULL_HANDLE && extent.width > 0 && extent.height > 0)
+	{
+		m_pyramid.extent.width = 1u << static_cast<uint32_t>(std::floor(std::log2(static_cast<float>(extent.width))));
+		m_pyramid.extent.height = 1u << static_cast<uint32_t>(std::floor(std::log2(static_cast<float>(extent.height))));
+		m_pyramid.levelCount = static_cast<uint32_t>(std::floor(std::log2(static_cast<float>((std::max)(m_pyramid.extent.width, m_pyramid.extent.height))))) + 1;
+	}
+	else
+	{
+		m_pyramid.extent = { 1, 1 };
+	}
+
+	uint32_t mipLevels = (std::max)(m_pyramid.levelCount, 1u);
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageInfo.extent = { m_pyramid.extent.width, m_pyramid.extent.height, 1 };
+	imageInfo.mipLevels = mipLevels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	if (!m_allocator->CreateImage(imageInfo, MemoryUsage::GpuOnly, &m_pyramid.image, &m_pyramid.allocation))
+	{
+		Logger::Error("FAILED TO CREATE DEPTH PYRAMID %ux%u", m_pyramid.extent.width, m_pyramid.extent.height);
+
+		return false;
+	}
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = m_pyramid.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = VK_FORMAT_R32_SFLOAT;
+	viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+
+	result = vkCreateImageView(m_device, &viewInfo, nullptr, &m_pyramid.view);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE DEPTH PYRAMID VIEW");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	// Each reduction samples the level above through its own view and writes the next one as a storage image
+	viewInfo.subresourceRange.levelCount = 1;
+
+	for (uint32_t level = 0; level < m_pyramid.levelCount; level++)
+	{
+		viewInfo.subresourceRange.baseMipLevel = level;
+
+		VkImageView levelView = VK_NULL_HANDLE;
+
+		result = vkCreateImageView(m_device, &viewInfo, nullptr, &levelView);
+
+		if (result != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO CREATE DEPTH PYRAMID LEVEL VIEW");
+			Logger::Error("%s", string_VkResult(result));
+
+			return false;
+		}
+
+		m_pyramid.levelViews.push_back(levelView);
+	}
+
+	VkDescriptorPoolSize poolSizes[2] = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = m_pyramid.levelCount + 1;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = (std::max)(m_pyramid.levelCount, 1u);
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = m_pyramid.levelCount + 1;
+	poolInfo.poolSizeCount = 2;
+	poolInfo.pPoolSizes = poolSizes;
+
+	result = vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_pyramid.descriptorPool);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE DEPTH PYRAMID DESCRIPTOR POOL");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(m_pyramid.levelCount, m_reduceSetLayout);
+	layouts.push_back(m_pyramidSetLayout);
+
+	std::vector<VkDescriptorSet> sets(layouts.size());
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_pyramid.descriptorPool;
+	allocInfo.descriptorSetCount = static_cast<uint32_t>(sets.size());
+	allocInfo.pSetLayouts = layouts.data();
+
+	result = vkAllocateDescriptorSets(m_device, &allocInfo, sets.data());
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO ALLOCATE DEPTH PYRAMID DESCRIPTOR SETS");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	m_pyramid.cullSet = sets.back();
+	m_pyramid.reduceSets.assign(sets.begin(), sets.end() - 1);
+
+	// The pyramid stays in the general layout, reductions write it and the culling samples it
+	std::vector<VkDescriptorImageInfo> imageInfos(2 * m_pyramid.levelCount + 1);
+	std::vector<VkWriteDescriptorSet> writes(2 * m_pyramid.levelCount + 1);
+
+	for (uint32_t level = 0; level < m_pyramid.levelCount; level++)
+	{
+		// Level 0 reads the depth buffer, which the render graph has moved to the shader read only layout
+		imageInfos[2 * level] = { m_pyramidSampler, level == 0 ? depthView : m_pyramid.levelViews[level - 1], level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL };
+		imageInfos[2 * level + 1] = { VK_NULL_HANDLE, m_pyramid.levelViews[level], VK_IMAGE_LAYOUT_GENERAL };
+
+		for (uint32_t binding = 0; binding < 2; binding++)
+		{
+			VkWriteDescriptorSet& write = writes[2 * level + binding];
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = m_pyramid.reduceSets[level];
+			write.dstBinding = binding;
+			write.descriptorCount = 1;
+			write.descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			write.pImageInfo = &imageInfos[2 * level + binding];
+		}
+	}
+
+	imageInfos.back() = { m_pyramidSampler, m_pyramid.view, VK_IMAGE_LAYOUT_GENERAL };
+
+	VkWriteDescriptorSet& cullWrite = writes.back();
+	cullWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	cullWrite.dstSet = m_pyramid.cullSet;
+	cullWrite.dstBinding = 0;
+	cullWrite.descriptorCount = 1;
+	cullWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	cullWrite.pImageInfo = &imageInfos.back();
+
+	vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+	m_pyramid.sourceView = depthView;
+
+	if (depthView != VK_NULL_HANDLE)
+	{
+		Logger::Info("DEPTH PYRAMID %ux%u, %u LEVELS", m_pyramid.extent.width, m_pyramid.extent.height, m_pyramid.levelCount);
+	}
+
+	return true;
+}
+
+void GpuScene::ReleasePyramid()
+{
+	DepthPyramid pyramid = std::move(m_pyramid);
+
+	m_pyramid = {};
+
+	// Frames in flight may still reduce into or sample the old pyramid
+	auto release = [device = m_device, allocator = m_allocator, pyramid]() mutable
+	{
+		for (VkImageView levelView : pyramid.levelViews)
+		{
+			vkDestroyImageView(device, levelView, nullptr);
+		}
+
+		vkDestroyImageView(device, pyramid.view, nullptr);
+		vkDestroyDescriptorPool(device, pyramid.descriptorPool, nullptr);
+
+		if (pyramid.image != VK_NULL_HANDLE)
+		{
+			allocator->DestroyImage(pyramid.image, pyramid.allocation);
+		}
+	};
+
+	if (m_deferRelease)
+	{
+		m_deferRelease(std::move(release));
+	}
+	else
+	{
+		release();
+	}
+}
+
+void GpuScene::RecordCullingPass(VkCommandBuffer commandBuffer, uint32_t phase)
+{
+	VkDescriptorSet sets[] = { m_cullSet, m_pyramid.cullSet };
+
+	// In binding order: the uniforms, then the frame's transforms
+	uint32_t dynamicOffsets[] = { static_cast<uint32_t>(m_viewAllocation.offset), static_cast<uint32_t>(m_frameIndex * m_transformSegmentSize) };
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipelineLayout, 0, 2, sets, 2, dynamicOffsets);
+	vkCmdPushConstants(commandBuffer, m_cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(phase), &phase);
+
+	vkCmdDispatch(commandBuffer, (m_instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+void GpuScene::RecordCountReadback(VkCommandBuffer commandBuffer)
+{
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	VkBufferCopy region{};
+	region.srcOffset = 0;
+	region.dstOffset = static_cast<VkDeviceSize>(m_frameIndex) * 4 * sizeof(uint32_t);
+	region.size = 4 * sizeof(uint32_t);
+
+	vkCmdCopyBuffer(commandBuffer, m_countBuffer, m_readbackBuffer, 1, &region);
+
+	// The frame's fence makes the copy visible to the host, the memory is coherent
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	m_readbacks[m_frameIndex].instances = m_instanceCount - static_cast<uint32_t>(m_freeInstances.size());
+	m_readbacks[m_frameIndex].pending = true;
+}
+
+void GpuScene::MarkDirty(uint32_t instance)
+{
+	if (m_dirtyFlags[instance] == 0)
+	{
+		m_dirtyFlags[instance] = 1;
+		m_dirtyInstances.push_back(instance);
+	}
+}
+
+void GpuScene::RecordInstanceUploads(VkCommandBuffer commandBuffer, FrameArena& frameArena)
+{
+	if (m_dirtyInstances.empty())
+	{
+		return;
+	}
+
+	// Ascending order lets neighbouring instances share one copy region
+	std::sort(m_dirtyInstances.begin(), m_dirtyInstances.end());
+
+	m_copyRegions.clear();
+
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+
+	size_t next = 0;
+	size_t kept = 0;
+
+	while (next < m_dirtyInstances.size())
+	{
+		uint32_t batchSize = static_cast<uint32_t>((std::min)(m_dirtyInstances.size() - next, static_cast<size_t>(INSTANCE_UPLOAD_BATCH)));
+
+		FrameArenaAllocation staging;
+
+		// The arena is full for this frame, the rest stays dirty for the next one
+		if (!frameArena.Allocate(batchSize * sizeof(GpuInstance), alignof(GpuInstance), &staging))
+		{
+			break;
+		}
+
+		stagingBuffer = staging.buffer;
+
+		GpuInstance* destination = static_cast<GpuInstance*>(staging.mapped);
+
+		for (uint32_t i = 0; i < batchSize; i++)
+		{
+			uint32_t instance = m_dirtyInstances[next + i];
+
+			destination[i] = m_instances[instance];
+
+			// Drawing before the mesh upload has landed would read garbage, the slot is copied again next frame
+			if (destination[i].mesh != INVALID_GPU_SCENE_INDEX && !m_uploadManager->IsBatchComplete(m_meshes[destination[i].mesh].uploadBatch))
+			{
+				destination[i].mesh = INVALID_GPU_SCENE_INDEX;
+
+				m_dirtyInstances[kept++] = instance;
+			}
+			else
+			{
+				m_dirtyFlags[instance] = 0;
+			}
+
+			VkDeviceSize srcOffset = staging.offset + i * sizeof(GpuInstance);
+			VkDeviceSize dstOffset = static_cast<VkDeviceSize>(instance) * sizeof(GpuInstance);
+
+			if (!m_copyRegions.empty() && m_copyRegions.back().srcOffset + m_copyRegions.back().size == srcOffset && m_copyRegions.back().dstOffset + m_copyRegions.back().size == dstOffset)
+			{
+				m_copyRegions.back().size += sizeof(GpuInstance);
+			}
+			else
+			{
+				m_copyRegions.push_back({ srcOffset, dstOffset, sizeof(GpuInstance) });
+			}
+		}
+
+		next += batchSize;
+	}
+
+	// Whatever did not fit moves down behind the pending instances
+	for (; next < m_dirtyInstances.size(); next++)
+	{
+		m_dirtyInstances[kept++] = m_dirtyInstances[next];
+	}
+
+	m_dirtyInstances.resize(kept);
+
+	if (!m_copyRegions.empty())
+	{
+		vkCmdCopyBuffer(commandBuffer, stagingBuffer, m_instanceBuffer, static_cast<uint32_t>(m_copyRegions.size()), m_copyRegions.data());
+	}
+}
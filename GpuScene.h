@@ -0,0 +1,323 @@
+#pragma once
+
+static constexpr uint32_t INVALID_GPU_SCENE_INDEX = UINT32_MAX;
+
+// Per instance record read by the culling shader and the vertex shader, std430 layout
+struct GpuInstance
+{
+	// Rows of the affine object to world matrix
+	float objectToWorld[12];
+
+	// Object space bounding sphere of the mesh
+	float boundsCenter[3];
+	float boundsRadius;
+
+	// INVALID_GPU_SCENE_INDEX for free slots, which the culling shader skips
+	uint32_t mesh;
+
+	// Largest axis scale of objectToWorld, grows the sphere and the LOD errors into world space
+	float scale;
+
+	// Node of the transform hierarchy whose world matrix replaces objectToWorld, INVALID_TRANSFORM_NODE for none.
+	// The shaders then read the matrix from the frame's transform buffer and derive the scale from it.
+	uint32_t transform;
+
+	uint32_t reserved;
+};
+
+static_assert(sizeof(GpuInstance) == 80, "GpuInstance must match the Instance struct of the shaders");
+
+struct GpuMeshInfo
+{
+	int32_t vertexOffset;
+	uint32_t lodCount;
+	uint32_t reserved[2];
+
+	// firstIndex already offset into the shared index buffer
+	MeshFileLod lods[MESH_FILE_MAX_LODS];
+};
+
+static_assert(sizeof(GpuMeshInfo) == 144, "GpuMeshInfo must match the Mesh struct of gpu_cull.comp");
+
+// Uniform block of gpu_cull.comp, std140 layout
+struct GpuCullView
+{
+	float viewProjection[16];
+
+	float planes[6][4];
+
+	float eye[3];
+	float pixelsPerUnit;
+
+	float pyramidSize[2];
+	float maxPixelError;
+	uint32_t instanceCount;
+
+	uint32_t pyramidLevels;
+	uint32_t occlusion;
+	uint32_t compact;
+	uint32_t maxDraws;
+};
+
+static_assert(sizeof(GpuCullView) == 208, "GpuCullView must match the View block of gpu_cull.comp");
+
+// Bit mask of the culling phases whose draws are recorded
+static constexpr uint32_t GPU_CULL_PHASE_EARLY = 1 << 0;
+static constexpr uint32_t GPU_CULL_PHASE_LATE = 1 << 1;
+
+// Instances rejected by one frame's culling, read back a few frames later
+struct GpuCullingStats
+{
+	uint32_t instances = 0;
+	uint32_t drawn = 0;
+	uint32_t frustumRejected = 0;
+	uint32_t occlusionRejected = 0;
+};
+
+struct GpuSceneLimits
+{
+	uint32_t maxInstances = 65536;
+	uint32_t maxMeshes = 1024;
+
+	// Transform hierarchy nodes the per-frame transform buffer holds
+	uint32_t maxTransforms = 65536;
+
+	VkDeviceSize vertexBytes = 64ull << 20;
+	uint32_t maxIndices = 16u << 20;
+};
+
+// What the device offers for indirect drawing, filled in by the renderer
+struct GpuSceneFeatures
+{
+	// vkCmdDrawIndexedIndirectCountKHR of VK_KHR_draw_indirect_count, nullptr when the extension is missing
+	PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;
+
+	bool multiDrawIndirect = false;
+	bool drawIndirectFirstInstance = false;
+
+	uint32_t maxDrawIndirectCount = 1;
+};
+
+// GPU driven rendering of many instances. Meshes share one vertex and one index buffer, instances live in a storage
+// buffer, and a compute pass culls them and writes the indirect draws. Recording the frame costs the same no matter
+// how many instances the scene holds, only instances changed since the last frame are copied.
+//
+// Occlusion culling is two-phase: the early phase draws the instances that were visible last frame, a depth pyramid is
+// built from the resulting depth, and the late phase tests every instance against it. Instances that became visible
+// are drawn by the late phase, and the late phase's visible set seeds the next frame's early phase.
+class GpuScene
+{
+public:
+	static constexpr uint32_t CULL_GROUP_SIZE = 64;
+	static constexpr uint32_t PYRAMID_GROUP_SIZE = 8;
+
+	static constexpr const char* CULL_SHADER_PATH = "shaders/gpu_cull.spv";
+	static constexpr const char* PYRAMID_SHADER_PATH = "shaders/hiz_reduce.spv";
+
+	// Draws the scene with instance data from set 0 and the view projection matrix in the push constants
+	static constexpr const char* VERTEX_SHADER_PATH = "shaders/gpu_scene.spv";
+
+public:
+	// The culling uniforms of each frame come from frameArena, whose buffer is bound once as a dynamic uniform buffer.
+	// deferRelease hands over Vulkan objects that frames in flight may still use when the depth source changes.
+	bool Init(VkDevice device, MemoryAllocator* allocator, UploadManager* uploadManager, PipelineCache* pipelineCache, FrameArena& frameArena, const GpuSceneFeatures& features, uint32_t framesInFlight, std::function<void(std::function<void()>)> deferRelease, const GpuSceneLimits& limits = {});
+
+	// The device must be idle
+	void Destroy();
+
+	// Copies the mesh into the shared buffers. Every mesh must use the vertex layout of the first one.
+	// Returns the mesh index, or INVALID_GPU_SCENE_INDEX when the mesh does not fit.
+	uint32_t AddMesh(const CookedMesh& mesh);
+
+	// objectToWorld holds the three rows of an affine transform
+	uint32_t AddInstance(uint32_t mesh, const float* objectToWorld);
+
+	// Follows a transform hierarchy node. Its world matrix comes from the transform buffer the hierarchy writes every
+	// frame, so moving the node never copies the instance.
+	uint32_t AddNodeInstance(uint32_t mesh, uint32_t transformNode);
+
+	// Also detaches the instance from its transform node
+	void SetTransform(uint32_t instance, const float* objectToWorld);
+
+	void RemoveInstance(uint32_t instance);
+
+	// Persistently mapped transform buffer of a frame slot, indexed by transform node. Only written between the slot's
+	// fence wait and its next submission, TransformHierarchy::WriteGpuTransforms fills it.
+	GpuTransform* GetTransformBuffer(uint32_t frameIndex) { return reinterpret_cast<GpuTransform*>(static_cast<uint8_t*>(m_transformAllocation.mapped) + frameIndex * m_transformSegmentSize); }
+
+	uint32_t GetMaxTransforms() { return m_limits.maxTransforms; }
+
+	// Binding 0 of the shared vertex buffer, empty until the first mesh has been added
+	void FillVertexInput(GraphicsPipelineDesc& desc) const;
+
+	// Layout pipelines drawing the scene must be created with
+	VkPipelineLayout GetDrawPipelineLayout() { return m_drawPipelineLayout; }
+
+	// Depth buffer the pyramid is built from, a depth only view in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL when the
+	// pyramid is built. VK_NULL_HANDLE drops the pyramid. Recreates the pyramid, so it is called whenever the depth buffer changes.
+	bool SetDepthSource(VkImageView depthView, VkExtent2D extent);
+
+	bool HasDepthPyramid() { return m_pyramid.sourceView != VK_NULL_HANDLE; }
+
+	// Starts a frame once its slot has retired, which also reads back the slot's culling counts. view holds world space
+	// planes, viewProjection is column-major and pixelsPerUnit is viewport height / (2 tan(fovY / 2)).
+	void BeginFrame(uint32_t frameIndex, FrameArena& frameArena, const CullingView& view, const float* viewProjection, float pixelsPerUnit, bool occlusion, float maxPixelError = 1.0f);
+
+	// Outside of a render pass: copies changed instances, then culls and writes the early phase's indirect draws
+	void RecordEarlyCulling(VkCommandBuffer commandBuffer, FrameArena& frameArena);
+
+	// Outside of a render pass, after the early draws have written depth and the depth source is readable
+	void RecordDepthPyramid(VkCommandBuffer commandBuffer);
+
+	void RecordLateCulling(VkCommandBuffer commandBuffer);
+
+	// Inside a render pass, executed after the culling of the drawn phases. Phases BeginFrame did not set up are skipped.
+	void RecordDraw(VkCommandBuffer commandBuffer, VkPipeline pipeline, uint32_t phases);
+
+	// Counts of the most recent frame whose culling has been read back
+	GpuCullingStats GetCullingStats() { return m_stats; }
+
+	bool IsEmpty() { return m_instanceCount == m_freeInstances.size(); }
+
+	uint32_t GetInstanceCount() { return m_instanceCount - static_cast<uint32_t>(m_freeInstances.size()); }
+
+private:
+	struct MeshEntry
+	{
+		float boundsCenter[3];
+		float boundsRadius;
+
+		// Instances of the mesh are only drawn once its upload has completed
+		uint64_t uploadBatch = 0;
+	};
+
+	// Farthest depth per texel, level 0 is the depth buffer rounded down to a power of two
+	struct DepthPyramid
+	{
+		VkImage image = VK_NULL_HANDLE;
+		MemoryAllocation allocation;
+
+		VkImageView view = VK_NULL_HANDLE;
+		std::vector<VkImageView> levelViews;
+
+		VkImageView sourceView = VK_NULL_HANDLE;
+		VkExtent2D sourceExtent = {};
+		VkExtent2D extent = {};
+		uint32_t levelCount = 0;
+
+		// Owns the sets below, destroying it frees them with the pyramid
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSet cullSet = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> reduceSets;
+
+		// Created in VK_IMAGE_LAYOUT_UNDEFINED, moved to GENERAL by the first command buffer that uses it
+		bool initialized = false;
+	};
+
+	// Culling counts of one frame slot, written by the GPU and read once the slot comes around again
+	struct CountReadback
+	{
+		uint32_t instances = 0;
+		bool pending = false;
+	};
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+
+	MemoryAllocator* m_allocator = nullptr;
+	UploadManager* m_uploadManager = nullptr;
+
+	GpuSceneFeatures m_features;
+	GpuSceneLimits m_limits;
+
+	std::function<void(std::function<void()>)> m_deferRelease;
+
+	// Shared geometry, filled front to back
+	VkBuffer m_vertexBuffer = VK_NULL_HANDLE;
+	VkBuffer m_indexBuffer = VK_NULL_HANDLE;
+	MemoryAllocation m_vertexAllocation;
+	MemoryAllocation m_indexAllocation;
+
+	uint32_t m_vertexCount = 0;
+	uint32_t m_indexCount = 0;
+
+	uint32_t m_vertexStride = 0;
+	std::vector<VkVertexInputBindingDescription> m_vertexBindings;
+	std::vector<VkVertexInputAttributeDescription> m_vertexAttributes;
+
+	VkBuffer m_meshBuffer = VK_NULL_HANDLE;
+	VkBuffer m_instanceBuffer = VK_NULL_HANDLE;
+	VkBuffer m_drawBuffer = VK_NULL_HANDLE;
+	VkBuffer m_countBuffer = VK_NULL_HANDLE;
+	VkBuffer m_visibilityBuffer = VK_NULL_HANDLE;
+	VkBuffer m_readbackBuffer = VK_NULL_HANDLE;
+	MemoryAllocation m_meshAllocation;
+	MemoryAllocation m_instanceAllocation;
+	MemoryAllocation m_drawAllocation;
+	MemoryAllocation m_countAllocation;
+	MemoryAllocation m_visibilityAllocation;
+	MemoryAllocation m_readbackAllocation;
+
+	// One segment per frame in flight, bound with a dynamic offset
+	VkBuffer m_transformBuffer = VK_NULL_HANDLE;
+	MemoryAllocation m_transformAllocation;
+	VkDeviceSize m_transformSegmentSize = 0;
+
+	std::vector<MeshEntry> m_meshes;
+
+	// CPU copy of every instance slot, changed slots are copied to the GPU in the next RecordCulling
+	std::vector<GpuInstance> m_instances;
+	uint32_t m_instanceCount = 0;
+	std::vector<uint32_t> m_freeInstances;
+
+	std::vector<uint32_t> m_dirtyInstances;
+	std::vector<uint8_t> m_dirtyFlags;
+
+	// Scratch for the copy regions of one frame
+	std::vector<VkBufferCopy> m_copyRegions;
+
+	// State of the frame being recorded, m_framePhases holds the culling phases BeginFrame set up
+	uint32_t m_frameIndex = 0;
+	uint32_t m_framePhases = 0;
+	FrameArenaAllocation m_viewAllocation;
+	float m_viewProjection[16] = {};
+
+	std::vector<CountReadback> m_readbacks;
+	GpuCullingStats m_stats;
+
+	DepthPyramid m_pyramid;
+	VkSampler m_pyramidSampler = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout m_cullSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout m_pyramidSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout m_reduceSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout m_drawSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet m_cullSet = VK_NULL_HANDLE;
+	VkDescriptorSet m_drawSet = VK_NULL_HANDLE;
+
+	VkPipelineLayout m_cullPipelineLayout = VK_NULL_HANDLE;
+	VkPipelineLayout m_reducePipelineLayout = VK_NULL_HANDLE;
+	VkPipelineLayout m_drawPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline m_cullPipeline = VK_NULL_HANDLE;
+	VkPipeline m_reducePipeline = VK_NULL_HANDLE;
+
+private:
+	bool CreateBuffers();
+	bool CreateDescriptors(VkBuffer uniformBuffer);
+	bool CreateComputePipeline(PipelineCache* pipelineCache, const char* path, VkPipelineLayout layout, VkPipeline* pipeline);
+
+	// Without a depth source the pyramid is a single texel that the shader never reads, set 1 of the culling layout needs an image
+	bool CreatePyramid(VkImageView depthView, VkExtent2D extent);
+	void ReleasePyramid();
+
+	void RecordCullingPass(VkCommandBuffer commandBuffer, uint32_t phase);
+
+	// Copies this frame's counts into the frame's readback slot
+	void RecordCountReadback(VkCommandBuffer commandBuffer);
+
+	void MarkDirty(uint32_t instance);
+
+	// Stages changed instances in the frame arena and records their copies, instances of pending meshes stay dirty
+	void RecordInstanceUploads(VkCommandBuffer commandBuffer, FrameArena& frameArena);
+};
@@ -0,0 +1,417 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+static constexpr uint32_t NO_THREAD_INDEX = ~0u;
+
+static thread_local uint32_t t_threadIndex = NO_THREAD_INDEX;
+
+// Per thread xorshift state for picking steal victims
+static thread_local uint32_t t_stealSeed = 0x9e3779b9;
+
+bool JobDeque::Push(Job* job)
+{
+	int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+	int64_t top = m_top.load(std::memory_order_acquire);
+
+	if (bottom - top >= static_cast<int64_t>(CAPACITY))
+	{
+		return false;
+	}
+
+	m_buffer[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+
+	// Publishes the job's contents to thieves that acquire the new bottom
+	m_bottom.store(bottom + 1, std::memory_order_release);
+
+	return true;
+}
+
+Job* JobDeque::Pop()
+{
+	int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+
+	m_bottom.store(bottom, std::memory_order_relaxed);
+
+	// Orders the bottom reservation against thieves reading it before they claim the top
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	int64_t top = m_top.load(std::memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		m_bottom.store(bottom + 1, std::memory_order_relaxed);
+
+		return nullptr;
+	}
+
+	Job* job = m_buffer[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+	// Last element, race the thieves for it
+	if (top == bottom)
+	{
+		if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			job = nullptr;
+		}
+
+		m_bottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+Job* JobDeque::Steal()
+{
+	int64_t top = m_top.load(std::memory_order_acquire);
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+	if (top >= bottom)
+	{
+		return nullptr;
+	}
+
+	Job* job = m_buffer[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+	// Lost against the owner or another thief
+	if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+	{
+		return nullptr;
+	}
+
+	return job;
+}
+
+bool JobSystem::Init(uint32_t workerCount)
+{
+	if (workerCount == 0)
+	{
+		workerCount = (std::max)(std::thread::hardware_concurrency(), 1u) - 1;
+	}
+
+	uint32_t threadCount = workerCount + 1;
+
+	m_deques.resize(threadCount);
+	m_pools.resize(threadCount);
+
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		m_deques[i] = std::make_unique<JobDeque>();
+		m_pools[i].jobs = std::make_unique<Job[]>(MAX_JOBS_PER_THREAD);
+	}
+
+	m_sharedPool.jobs = std::make_unique<Job[]>(MAX_JOBS_PER_THREAD);
+
+	t_threadIndex = 0;
+
+	m_running.store(true);
+
+	for (uint32_t i = 1; i < threadCount; i++)
+	{
+		m_workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+
+	Logger::Info("JOB SYSTEM STARTED WITH %u WORKERS", workerCount);
+
+	return true;
+}
+
+void JobSystem::Destroy()
+{
+	m_running.store(false);
+
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+	}
+
+	m_wakeCondition.notify_all();
+
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+
+	m_workers.clear();
+	m_deques.clear();
+	m_pools.clear();
+	m_sharedQueue.clear();
+	m_sharedPool.jobs.reset();
+
+	t_threadIndex = NO_THREAD_INDEX;
+}
+
+void JobSystem::Run(std::function<void()> function, JobCounter* counter)
+{
+	Job* job = AllocateJob();
+
+	job->function = std::move(function);
+	job->counter = counter;
+
+	if (counter != nullptr)
+	{
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	Submit(job);
+}
+
+void JobSystem::Run(std::function<void()> function, JobCounter* counter, JobCounter* dependency)
+{
+	if (dependency == nullptr)
+	{
+		Run(std::move(function), counter);
+
+		return;
+	}
+
+	Job* job = AllocateJob();
+
+	job->function = std::move(function);
+	job->counter = counter;
+
+	if (counter != nullptr)
+	{
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+
+		// The final decrement happens under this lock, so a pending dependency is guaranteed to see the continuation
+		if (!dependency->IsDone())
+		{
+			dependency->continuations.push_back(job);
+
+			return;
+		}
+	}
+
+	Submit(job);
+}
+
+void JobSystem::Wait(JobCounter* counter)
+{
+	uint32_t threadIndex = GetThreadIndex();
+
+	while (!counter->IsDone())
+	{
+		Job* job = FindJob(threadIndex);
+
+		if (job != nullptr)
+		{
+			Execute(job);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// The thread that finished the last job may still hold the lock, the counter must outlive that
+	std::lock_guard<std::mutex> lock(counter->mutex);
+}
+
+uint32_t JobSystem::GetThreadIndex()
+{
+	return t_threadIndex;
+}
+
+Job* JobSystem::AllocateJob()
+{
+	uint32_t threadIndex = GetThreadIndex();
+
+	if (threadIndex == NO_THREAD_INDEX)
+	{
+		Job* job = nullptr;
+
+		{
+			std::lock_guard<std::mutex> lock(m_sharedMutex);
+
+			job = &m_sharedPool.jobs[m_sharedPool.next++ & (MAX_JOBS_PER_THREAD - 1)];
+		}
+
+		// Workers need the shared lock to run queued jobs, so the wait for a slot happens outside of it
+		while (!job->finished.load(std::memory_order_acquire))
+		{
+			std::this_thread::yield();
+		}
+
+		job->finished.store(false, std::memory_order_relaxed);
+
+		return job;
+	}
+
+	JobPool& pool = m_pools[threadIndex];
+
+	Job* job = &pool.jobs[pool.next++ & (MAX_JOBS_PER_THREAD - 1)];
+
+	// The ring wrapped onto a job that has not run yet, help out until it has
+	while (!job->finished.load(std::memory_order_acquire))
+	{
+		Job* other = FindJob(threadIndex);
+
+		if (other != nullptr)
+		{
+			Execute(other);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	job->finished.store(false, std::memory_order_relaxed);
+
+	return job;
+}
+
+void JobSystem::Submit(Job* job)
+{
+	uint32_t threadIndex = GetThreadIndex();
+
+	// Counted before it becomes visible, so a thief never takes the count below zero
+	m_queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+
+	if (threadIndex == NO_THREAD_INDEX)
+	{
+		std::lock_guard<std::mutex> lock(m_sharedMutex);
+
+		m_sharedQueue.push_back(job);
+		m_sharedQueuedJobs.fetch_add(1, std::memory_order_release);
+	}
+	else if (!m_deques[threadIndex]->Push(job))
+	{
+		m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+
+		// Deque full, running inline keeps progress without an unbounded queue
+		Execute(job);
+
+		return;
+	}
+
+	// Pairs with the sleeper count in WorkerLoop, either the worker sees the job or the submitter sees the sleeper
+	if (m_sleepingWorkers.load(std::memory_order_seq_cst) > 0)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+		}
+
+		m_wakeCondition.notify_one();
+	}
+}
+
+Job* JobSystem::FindJob(uint32_t threadIndex)
+{
+	Job* job = nullptr;
+
+	if (threadIndex != NO_THREAD_INDEX)
+	{
+		job = m_deques[threadIndex]->Pop();
+	}
+
+	if (job == nullptr && m_queuedJobs.load(std::memory_order_relaxed) > 0)
+	{
+		// Checked without the lock first, the shared queue is rarely used
+		if (m_sharedQueuedJobs.load(std::memory_order_acquire) > 0)
+		{
+			std::lock_guard<std::mutex> lock(m_sharedMutex);
+
+			if (!m_sharedQueue.empty())
+			{
+				job = m_sharedQueue.front();
+
+				m_sharedQueue.pop_front();
+				m_sharedQueuedJobs.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+
+		uint32_t threadCount = static_cast<uint32_t>(m_deques.size());
+
+		t_stealSeed ^= t_stealSeed << 13;
+		t_stealSeed ^= t_stealSeed >> 17;
+		t_stealSeed ^= t_stealSeed << 5;
+
+		uint32_t start = t_stealSeed % threadCount;
+
+		for (uint32_t i = 0; i < threadCount && job == nullptr; i++)
+		{
+			uint32_t victim = (start + i) % threadCount;
+
+			if (victim != threadIndex)
+			{
+				job = m_deques[victim]->Steal();
+			}
+		}
+	}
+
+	if (job != nullptr)
+	{
+		m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+void JobSystem::Execute(Job* job)
+{
+	job->function();
+
+	// Releases whatever the job captured before the slot is reused
+	job->function = nullptr;
+
+	JobCounter* counter = job->counter;
+
+	job->counter = nullptr;
+	job->finished.store(true, std::memory_order_release);
+
+	if (counter == nullptr)
+	{
+		return;
+	}
+
+	std::vector<Job*> continuations;
+
+	{
+		std::lock_guard<std::mutex> lock(counter->mutex);
+
+		if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			continuations.swap(counter->continuations);
+		}
+	}
+
+	for (Job* continuation : continuations)
+	{
+		Submit(continuation);
+	}
+}
+
+void JobSystem::WorkerLoop(uint32_t threadIndex)
+{
+	t_threadIndex = threadIndex;
+	t_stealSeed = 0x9e3779b9 ^ (threadIndex * 0x85ebca6b);
+
+	while (m_running.load(std::memory_order_relaxed))
+	{
+		Job* job = FindJob(threadIndex);
+
+		if (job != nullptr)
+		{
+			Execute(job);
+
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+
+		m_sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+
+		m_wakeCondition.wait(lock, [this]() { return m_queuedJobs.load(std::memory_order_seq_cst) > 0 || !m_running.load(); });
+
+		m_sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
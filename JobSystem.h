@@ -0,0 +1,144 @@
+#pragma once
+
+struct Job;
+
+// Tracks a group of jobs. Waiting on a counter returns once every job started with it has finished,
+// and jobs started with the counter as their dependency are held back until then.
+struct JobCounter
+{
+	std::atomic<uint32_t> pending = 0;
+
+	std::mutex mutex;
+	std::vector<Job*> continuations;
+
+	bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+struct Job
+{
+	std::function<void()> function;
+
+	JobCounter* counter = nullptr;
+
+	// Cleared when the job is handed out and set once it has run, so the slot can be reused
+	std::atomic<bool> finished = true;
+};
+
+// Chase-Lev work-stealing deque (Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models").
+// The owning thread pushes and pops at the bottom, any thread may steal from the top.
+class JobDeque
+{
+public:
+	static constexpr uint32_t CAPACITY = 4096;
+
+public:
+	// Owner only. Returns false when the deque is full.
+	bool Push(Job* job);
+
+	// Owner only
+	Job* Pop();
+
+	Job* Steal();
+
+private:
+	alignas(64) std::atomic<int64_t> m_top = 0;
+	alignas(64) std::atomic<int64_t> m_bottom = 0;
+
+	std::atomic<Job*> m_buffer[CAPACITY] = {};
+};
+
+// One worker per core besides the thread that calls Init, which takes part whenever it waits.
+// Threads without a deque of their own (the pipeline compiler, the OS) can still start jobs and wait on them.
+class JobSystem
+{
+public:
+	// Jobs a thread may have in flight before starting another one blocks on the oldest
+	static constexpr uint32_t MAX_JOBS_PER_THREAD = JobDeque::CAPACITY;
+
+public:
+	// workerCount 0 uses one worker per hardware thread minus the calling thread
+	bool Init(uint32_t workerCount = 0);
+	void Destroy();
+
+	void Run(std::function<void()> function, JobCounter* counter = nullptr);
+
+	// Starts the job once dependency has reached zero
+	void Run(std::function<void()> function, JobCounter* counter, JobCounter* dependency);
+
+	// Executes other jobs until the counter reaches zero
+	void Wait(JobCounter* counter);
+
+	// Calls function(first, last) for consecutive ranges of at most batchSize items and waits for all of them
+	template<typename Function>
+	void ParallelFor(uint32_t count, uint32_t batchSize, Function&& function)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		batchSize = (std::max)(batchSize, 1u);
+
+		// A single batch gains nothing from a round trip through the deques
+		if (count <= batchSize || m_workers.empty())
+		{
+			function(0u, count);
+
+			return;
+		}
+
+		JobCounter counter;
+
+		for (uint32_t first = 0; first < count; first += batchSize)
+		{
+			uint32_t last = (std::min)(first + batchSize, count);
+
+			Run([&function, first, last]() { function(first, last); }, &counter);
+		}
+
+		Wait(&counter);
+	}
+
+	// Workers plus the thread that called Init
+	uint32_t GetThreadCount() { return static_cast<uint32_t>(m_deques.size()); }
+
+	// 0 for the thread that called Init, 1 to N for workers, ~0u for any other thread
+	static uint32_t GetThreadIndex();
+
+private:
+	struct alignas(64) JobPool
+	{
+		std::unique_ptr<Job[]> jobs;
+		uint32_t next = 0;
+	};
+
+private:
+	std::vector<std::unique_ptr<JobDeque>> m_deques;
+	std::vector<JobPool> m_pools;
+
+	std::vector<std::thread> m_workers;
+
+	// Jobs started from threads without a deque
+	std::deque<Job*> m_sharedQueue;
+	std::atomic<uint32_t> m_sharedQueuedJobs = 0;
+	std::mutex m_sharedMutex;
+
+	// Fallback pool for threads without a deque, guarded by m_sharedMutex
+	JobPool m_sharedPool;
+
+	std::atomic<uint32_t> m_queuedJobs = 0;
+	std::atomic<uint32_t> m_sleepingWorkers = 0;
+	std::atomic<bool> m_running = false;
+
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wakeCondition;
+
+private:
+	Job* AllocateJob();
+	void Submit(Job* job);
+
+	Job* FindJob(uint32_t threadIndex);
+	void Execute(Job* job);
+
+	void WorkerLoop(uint32_t threadIndex);
+};
@@ -0,0 +1,492 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+// One ring entry. Vyukov's bounded queue: a slot whose sequence equals the write position is free, one whose
+// sequence is the position + 1 holds a message for the reader.
+struct alignas(64) LogSlot
+{
+	std::atomic<uint64_t> sequence = 0;
+
+	LogRecord record;
+};
+
+struct LoggerState
+{
+	std::unique_ptr<LogSlot[]> slots;
+
+	alignas(64) std::atomic<uint64_t> writePosition = 0;
+
+	// Only the flush thread advances it
+	alignas(64) std::atomic<uint64_t> readPosition = 0;
+
+	std::atomic<uint64_t> droppedCount = 0;
+	uint64_t reportedDroppedCount = 0;
+
+	std::atomic<bool> running = false;
+	std::thread thread;
+
+	// Wakes the flush thread early, and tells waiting Flush calls how far the sinks got
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable flushed;
+	uint64_t flushedPosition = 0;
+	bool flushRequested = false;
+
+	// Held while the sinks are written
+	std::mutex sinkMutex;
+	std::vector<LogSink*> sinks;
+
+	ConsoleLogSink console;
+};
+
+// The flush thread sleeps at most this long when idle
+static constexpr std::chrono::milliseconds LOG_FLUSH_INTERVAL(5);
+
+// Never destroyed, messages logged by static destructors still find it
+static LoggerState& GetLoggerState()
+{
+	static LoggerState* state = []()
+	{
+		LoggerState* newState = new LoggerState();
+
+		newState->slots = std::make_unique<LogSlot[]>(Logger::RING_CAPACITY);
+
+		for (uint32_t i = 0; i < Logger::RING_CAPACITY; i++)
+		{
+			newState->slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		newState->sinks.push_back(&newState->console);
+
+		return newState;
+	}();
+
+	return *state;
+}
+
+// Caller holds the sink mutex
+static void WriteRecord(LoggerState& state, const LogRecord& record)
+{
+	char text[Logger::MAX_MESSAGE_LENGTH];
+
+	int length = record.format(record, text, sizeof(text));
+
+	if (length < 0)
+	{
+		return;
+	}
+
+	size_t textLength = (std::min)(static_cast<size_t>(length), sizeof(text) - 1);
+
+	for (LogSink* sink : state.sinks)
+	{
+		sink->Write(record.priority, text, textLength);
+	}
+}
+
+static void FlushSinks(LoggerState& state)
+{
+	for (LogSink* sink : state.sinks)
+	{
+		sink->Flush();
+	}
+}
+
+// Writes every published message, returns how many
+static uint32_t DrainRing(LoggerState& state)
+{
+	uint64_t position = state.readPosition.load(std::memory_order_relaxed);
+	uint32_t count = 0;
+
+	std::lock_guard<std::mutex> lock(state.sinkMutex);
+
+	while (true)
+	{
+		LogSlot& slot = state.slots[position & (Logger::RING_CAPACITY - 1)];
+
+		// Not yet published, a writer may still be copying into it
+		if (slot.sequence.load(std::memory_order_acquire) != position + 1)
+		{
+			break;
+		}
+
+		WriteRecord(state, slot.record);
+
+		slot.sequence.store(position + Logger::RING_CAPACITY, std::memory_order_release);
+
+		position++;
+		count++;
+	}
+
+	state.readPosition.store(position, std::memory_order_release);
+
+	uint64_t droppedCount = state.droppedCount.load(std::memory_order_relaxed);
+
+	if (droppedCount != state.reportedDroppedCount)
+	{
+		char text[64];
+		int length = snprintf(text, sizeof(text), "%llu LOG MESSAGES DROPPED", static_cast<unsigned long long>(droppedCount - state.reportedDroppedCount));
+
+		for (LogSink* sink : state.sinks)
+		{
+			sink->Write(WarnPriority, text, static_cast<size_t>(length));
+		}
+
+		state.reportedDroppedCount = droppedCount;
+		count++;
+	}
+
+	if (count > 0)
+	{
+		FlushSinks(state);
+	}
+
+	return count;
+}
+
+static void FlushThread(LoggerState* state)
+{
+	while (true)
+	{
+		uint32_t count = DrainRing(*state);
+
+		{
+			std::lock_guard<std::mutex> lock(state->mutex);
+
+			state->flushedPosition = state->readPosition.load(std::memory_order_relaxed);
+		}
+
+		state->flushed.notify_all();
+
+		if (count > 0)
+		{
+			continue;
+		}
+
+		if (!state->running.load(std::memory_order_acquire))
+		{
+			break;
+		}
+
+		std::unique_lock<std::mutex> lock(state->mutex);
+
+		state->wake.wait_for(lock, LOG_FLUSH_INTERVAL, [state]() { return state->flushRequested || !state->running.load(std::memory_order_relaxed); });
+		state->flushRequested = false;
+	}
+}
+
+void Logger::Init()
+{
+	LoggerState& state = GetLoggerState();
+
+	if (state.running.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+
+	state.running.store(true, std::memory_order_release);
+	state.thread = std::thread(FlushThread, &state);
+
+	static bool exitHandlerRegistered = false;
+
+	if (!exitHandlerRegistered)
+	{
+		std::atexit(Shutdown);
+
+		exitHandlerRegistered = true;
+	}
+}
+
+void Logger::Shutdown()
+{
+	LoggerState& state = GetLoggerState();
+
+	if (!state.running.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+
+		state.running.store(false, std::memory_order_release);
+	}
+
+	state.wake.notify_one();
+	state.thread.join();
+
+	// Messages published while the thread was leaving
+	DrainRing(state);
+}
+
+void Logger::Flush()
+{
+	LoggerState& state = GetLoggerState();
+
+	if (!state.running.load(std::memory_order_acquire))
+	{
+		std::lock_guard<std::mutex> lock(state.sinkMutex);
+
+		FlushSinks(state);
+
+		return;
+	}
+
+	uint64_t target = state.writePosition.load(std::memory_order_acquire);
+
+	std::unique_lock<std::mutex> lock(state.mutex);
+
+	state.flushRequested = true;
+	state.wake.notify_one();
+
+	// Shutdown drains the rest itself
+	state.flushed.wait(lock, [&state, target]() { return state.flushedPosition >= target || !state.running.load(std::memory_order_relaxed); });
+}
+
+void Logger::AddSink(LogSink* sink)
+{
+	LoggerState& state = GetLoggerState();
+
+	std::lock_guard<std::mutex> lock(state.sinkMutex);
+
+	state.sinks.push_back(sink);
+}
+
+void Logger::RemoveSink(LogSink* sink)
+{
+	LoggerState& state = GetLoggerState();
+
+	std::lock_guard<std::mutex> lock(state.sinkMutex);
+
+	state.sinks.erase(std::remove(state.sinks.begin(), state.sinks.end(), sink), state.sinks.end());
+}
+
+LogSink* Logger::GetConsoleSink()
+{
+	return &GetLoggerState().console;
+}
+
+uint64_t Logger::GetDroppedCount()
+{
+	return GetLoggerState().droppedCount.load(std::memory_order_relaxed);
+}
+
+uint32_t Logger::CopyString(LogRecord& record, const char* string)
+{
+	if (string == nullptr)
+	{
+		string = "(null)";
+	}
+
+	// The last byte stays a terminator for strings that find no room at all
+	uint32_t offset = (std::min)(record.stringOffset, LogRecord::PAYLOAD_SIZE - 1);
+	size_t length = strnlen(string, LogRecord::PAYLOAD_SIZE - 1 - offset);
+
+	memcpy(record.payload + offset, string, length);
+	record.payload[offset + length] = 0;
+
+	record.stringOffset = offset + static_cast<uint32_t>(length) + 1;
+
+	return offset;
+}
+
+int Logger::Format(char* text, size_t size, const char* message, ...)
+{
+	va_list arguments;
+	va_start(arguments, message);
+
+	int length = vsnprintf(text, size, message, arguments);
+
+	va_end(arguments);
+
+	return length;
+}
+
+void Logger::Submit(const LogRecord& record)
+{
+	LoggerState& state = GetLoggerState();
+
+	if (!state.running.load(std::memory_order_acquire))
+	{
+		std::lock_guard<std::mutex> lock(state.sinkMutex);
+
+		WriteRecord(state, record);
+		FlushSinks(state);
+
+		return;
+	}
+
+	uint64_t position = state.writePosition.load(std::memory_order_relaxed);
+
+	LogSlot* slot = nullptr;
+
+	while (true)
+	{
+		slot = &state.slots[position & (RING_CAPACITY - 1)];
+
+		int64_t difference = static_cast<int64_t>(slot->sequence.load(std::memory_order_acquire) - position);
+
+		if (difference == 0)
+		{
+			// Claims the slot, another writer may have been faster
+			if (state.writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (difference < 0)
+		{
+			// Full, the reader has not released the slot of the previous round yet
+			if (record.priority < WarnPriority)
+			{
+				state.droppedCount.fetch_add(1, std::memory_order_relaxed);
+
+				return;
+			}
+
+			std::this_thread::yield();
+
+			position = state.writePosition.load(std::memory_order_relaxed);
+		}
+		else
+		{
+			position = state.writePosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->record = record;
+	slot->sequence.store(position + 1, std::memory_order_release);
+
+	if (record.priority >= ErrorPriority)
+	{
+		Flush();
+	}
+}
+
+ConsoleLogSink::ConsoleLogSink()
+{
+#ifndef _WIN32
+	m_colors = isatty(STDOUT_FILENO) != 0;
+#endif // _WIN32
+}
+
+// Tags as the console shows them, also used by the file sink
+static const char* GetPriorityTag(LogPriority priority)
+{
+	switch (priority)
+	{
+	case TracePriority:
+		return "[TRACE]\t";
+	case DebugPriority:
+		return "[DEBUG]\t";
+	case InfoPriority:
+		return "[INFO]\t";
+	case WarnPriority:
+		return "[WARN]\t";
+	case ErrorPriority:
+		return "[ERROR]\t";
+	case CriticalPriority:
+		return "[CRITICAL]\t";
+	default:
+		return "";
+	}
+}
+
+void ConsoleLogSink::Write(LogPriority priority, const char* text, size_t length)
+{
+#ifdef _WIN32
+	static const WORD colors[] =
+	{
+		FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE,
+		FOREGROUND_GREEN | FOREGROUND_BLUE,
+		FOREGROUND_GREEN,
+		FOREGROUND_RED | FOREGROUND_GREEN,
+		FOREGROUND_RED | FOREGROUND_INTENSITY,
+		FOREGROUND_RED
+	};
+
+	HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+
+	SetConsoleTextAttribute(console, colors[priority]);
+	fputs(GetPriorityTag(priority), stdout);
+	fwrite(text, 1, length, stdout);
+	fputc('\n', stdout);
+
+	SetConsoleTextAttribute(console, FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE);
+#else
+	static const char* colors[] = { "\033[0m", "\033[36m", "\033[32m", "\033[33m", "\033[91m", "\033[31m" };
+
+	if (m_colors)
+	{
+		fputs(colors[priority], stdout);
+	}
+
+	fputs(GetPriorityTag(priority), stdout);
+	fwrite(text, 1, length, stdout);
+
+	fputs(m_colors ? "\033[0m\n" : "\n", stdout);
+#endif // _WIN32
+}
+
+void ConsoleLogSink::Flush()
+{
+	fflush(stdout);
+}
+
+FileLogSink::FileLogSink(const std::string& path) : m_file(path, std::ios::binary | std::ios::trunc)
+{
+	if (!m_file.is_open())
+	{
+		Logger::Error("FAILED TO OPEN LOG FILE %s", path.c_str());
+	}
+}
+
+void FileLogSink::Write(LogPriority priority, const char* text, size_t length)
+{
+	if (!m_file.is_open())
+	{
+		return;
+	}
+
+	m_file << GetPriorityTag(priority);
+	m_file.write(text, static_cast<std::streamsize>(length));
+	m_file << '\n';
+}
+
+void FileLogSink::Flush()
+{
+	m_file.flush();
+}
+
+void MemoryLogSink::Write(LogPriority priority, const char* text, size_t length)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_capacity == 0)
+	{
+		return;
+	}
+
+	if (m_lines.size() >= m_capacity)
+	{
+		m_lines.pop_front();
+	}
+
+	m_lines.push_back({ priority, std::string(text, length) });
+}
+
+std::vector<MemoryLogSink::Line> MemoryLogSink::GetLines()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return std::vector<Line>(m_lines.begin(), m_lines.end());
+}
+
+void MemoryLogSink::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_lines.clear();
+}
@@ -0,0 +1,177 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+
+		m_data = std::exchange(other.m_data, nullptr);
+		m_size = std::exchange(other.m_size, 0);
+		m_open = std::exchange(other.m_open, false);
+		m_mapped = std::exchange(other.m_mapped, false);
+
+		// Moving a vector keeps its heap block, so a buffered m_data stays valid
+		m_buffer = std::move(other.m_buffer);
+	}
+
+	return *this;
+}
+
+bool MappedFile::Open(const std::string& path, FileAccess access)
+{
+	Close();
+
+	if (access == FileAccess::Auto && Map(path))
+	{
+		return true;
+	}
+
+	return ReadBuffered(path);
+}
+
+void MappedFile::Close()
+{
+	if (m_mapped)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+#else
+		munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif // _WIN32
+	}
+
+	m_data = nullptr;
+	m_size = 0;
+	m_open = false;
+	m_mapped = false;
+
+	m_buffer.clear();
+	m_buffer.shrink_to_fit();
+}
+
+bool MappedFile::Map(const std::string& path)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+
+	// Zero sized files cannot be mapped, the buffered path handles them
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	CloseHandle(file);
+
+	if (mapping == nullptr)
+	{
+		return false;
+	}
+
+	// The view keeps the mapping object alive, both handles can be closed right away
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	CloseHandle(mapping);
+
+	if (view == nullptr)
+	{
+		return false;
+	}
+
+	m_size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int file = open(path.c_str(), O_RDONLY);
+
+	if (file < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStat;
+
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		close(file);
+
+		return false;
+	}
+
+	void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+
+	close(file);
+
+	if (view == MAP_FAILED)
+	{
+		return false;
+	}
+
+	// Loaders walk the file front to back, let the kernel read ahead aggressively
+	madvise(view, static_cast<size_t>(fileStat.st_size), MADV_SEQUENTIAL);
+
+	m_size = static_cast<size_t>(fileStat.st_size);
+#endif // _WIN32
+
+	m_data = static_cast<const uint8_t*>(view);
+	m_open = true;
+	m_mapped = true;
+
+	return true;
+}
+
+bool MappedFile::ReadBuffered(const std::string& path)
+{
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open())
+	{
+		Logger::Error("FAILED TO OPEN FILE %s", path.c_str());
+
+		return false;
+	}
+
+	size_t fileSize = static_cast<size_t>(file.tellg());
+
+	m_buffer.resize(fileSize);
+
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(m_buffer.data()), fileSize);
+
+	if (!file)
+	{
+		Logger::Error("FAILED TO READ FILE %s", path.c_str());
+
+		m_buffer.clear();
+
+		return false;
+	}
+
+	m_data = m_buffer.data();
+	m_size = fileSize;
+	m_open = true;
+
+	return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+enum class FileAccess
+{
+	// Memory maps the file and falls back to a buffered read if mapping is not possible
+	Auto,
+	// Always reads the file into a heap buffer, for files that may change while open
+	Buffered
+};
+
+// Read-only view of a whole file. Mapped views are page aligned and paged in on demand,
+// so assets and SPIR-V can be handed to their consumers without a heap copy.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+public:
+	bool Open(const std::string& path, FileAccess access = FileAccess::Auto);
+	void Close();
+
+	std::span<const uint8_t> GetData() const { return { m_data, m_size }; }
+
+	size_t GetSize() const { return m_size; }
+
+	bool IsOpen() const { return m_open; }
+
+	// False when the contents live in the buffered fallback
+	bool IsMapped() const { return m_mapped; }
+
+private:
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+
+	bool m_open = false;
+	bool m_mapped = false;
+
+	std::vector<uint8_t> m_buffer;
+
+private:
+	bool Map(const std::string& path);
+	bool ReadBuffered(const std::string& path);
+};
@@ -0,0 +1,1043 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+void TlsfBlockMetadata::Init(VkDeviceSize size)
+{
+	m_size = size;
+	m_usedBytes = 0;
+	m_allocationCount = 0;
+
+	m_nodes.clear();
+	m_unusedNodes.clear();
+
+	m_flBitmap = 0;
+
+	for (uint32_t fl = 0; fl < FL_COUNT; fl++)
+	{
+		m_slBitmap[fl] = 0;
+
+		for (uint32_t sl = 0; sl < SL_COUNT; sl++)
+		{
+			m_freeHeads[fl][sl] = INVALID_NODE;
+		}
+	}
+
+	m_firstNode = CreateNode();
+	m_nodes[m_firstNode].offset = 0;
+	m_nodes[m_firstNode].size = size;
+
+	InsertFree(m_firstNode);
+}
+
+void TlsfBlockMetadata::Mapping(VkDeviceSize size, uint32_t* fl, uint32_t* sl)
+{
+	// Sizes below 2^SMALL_SIZE_BITS share the first level and are split linearly
+	if (size < (VkDeviceSize(1) << SMALL_SIZE_BITS))
+	{
+		*fl = 0;
+		*sl = static_cast<uint32_t>(size >> (SMALL_SIZE_BITS - SL_BITS));
+
+		return;
+	}
+
+	uint32_t msb = 63 - static_cast<uint32_t>(std::countl_zero(size));
+
+	*fl = msb - SMALL_SIZE_BITS + 1;
+	*sl = static_cast<uint32_t>(size >> (msb - SL_BITS)) & (SL_COUNT - 1);
+}
+
+uint32_t TlsfBlockMetadata::CreateNode()
+{
+	uint32_t node;
+
+	if (!m_unusedNodes.empty())
+	{
+		node = m_unusedNodes.back();
+		m_unusedNodes.pop_back();
+
+		m_nodes[node] = Node();
+	}
+	else
+	{
+		node = static_cast<uint32_t>(m_nodes.size());
+		m_nodes.emplace_back();
+	}
+
+	return node;
+}
+
+void TlsfBlockMetadata::ReleaseNode(uint32_t node)
+{
+	m_unusedNodes.push_back(node);
+}
+
+void TlsfBlockMetadata::InsertFree(uint32_t node)
+{
+	uint32_t fl, sl;
+	Mapping(m_nodes[node].size, &fl, &sl);
+
+	uint32_t head = m_freeHeads[fl][sl];
+
+	m_nodes[node].free = true;
+	m_nodes[node].prevFree = INVALID_NODE;
+	m_nodes[node].nextFree = head;
+
+	if (head != INVALID_NODE)
+	{
+		m_nodes[head].prevFree = node;
+	}
+
+	m_freeHeads[fl][sl] = node;
+
+	m_flBitmap |= uint64_t(1) << fl;
+	m_slBitmap[fl] |= 1u << sl;
+}
+
+void TlsfBlockMetadata::RemoveFree(uint32_t node)
+{
+	uint32_t fl, sl;
+	Mapping(m_nodes[node].size, &fl, &sl);
+
+	Node& freeNode = m_nodes[node];
+
+	if (freeNode.prevFree != INVALID_NODE)
+	{
+		m_nodes[freeNode.prevFree].nextFree = freeNode.nextFree;
+	}
+	else
+	{
+		m_freeHeads[fl][sl] = freeNode.nextFree;
+	}
+
+	if (freeNode.nextFree != INVALID_NODE)
+	{
+		m_nodes[freeNode.nextFree].prevFree = freeNode.prevFree;
+	}
+
+	freeNode.prevFree = INVALID_NODE;
+	freeNode.nextFree = INVALID_NODE;
+
+	if (m_freeHeads[fl][sl] == INVALID_NODE)
+	{
+		m_slBitmap[fl] &= ~(1u << sl);
+
+		if (m_slBitmap[fl] == 0)
+		{
+			m_flBitmap &= ~(uint64_t(1) << fl);
+		}
+	}
+}
+
+uint32_t TlsfBlockMetadata::FindFree(VkDeviceSize size)
+{
+	// Round the request up to the next size class so that any block found there is guaranteed to fit
+	VkDeviceSize searchSize;
+
+	if (size < (VkDeviceSize(1) << SMALL_SIZE_BITS))
+	{
+		searchSize = size + (VkDeviceSize(1) << (SMALL_SIZE_BITS - SL_BITS)) - 1;
+	}
+	else
+	{
+		uint32_t msb = 63 - static_cast<uint32_t>(std::countl_zero(size));
+
+		searchSize = size + (VkDeviceSize(1) << (msb - SL_BITS)) - 1;
+	}
+
+	uint32_t fl, sl;
+	Mapping(searchSize, &fl, &sl);
+
+	uint32_t slMap = m_slBitmap[fl] & (~0u << sl);
+
+	if (slMap == 0)
+	{
+		if (fl + 1 >= FL_COUNT)
+		{
+			return INVALID_NODE;
+		}
+
+		uint64_t flMap = m_flBitmap & (~uint64_t(0) << (fl + 1));
+
+		if (flMap == 0)
+		{
+			return INVALID_NODE;
+		}
+
+		fl = static_cast<uint32_t>(std::countr_zero(flMap));
+		slMap = m_slBitmap[fl];
+	}
+
+	sl = static_cast<uint32_t>(std::countr_zero(slMap));
+
+	return m_freeHeads[fl][sl];
+}
+
+bool TlsfBlockMetadata::Allocate(VkDeviceSize size, VkDeviceSize alignment, void* userData, uint32_t* node, VkDeviceSize* offset)
+{
+	alignment = (std::max)(alignment, VkDeviceSize(1));
+
+	uint32_t found = FindFree(size + alignment - 1);
+
+	if (found == INVALID_NODE)
+	{
+		return false;
+	}
+
+	RemoveFree(found);
+
+	VkDeviceSize alignedOffset = AlignUp(m_nodes[found].offset, alignment);
+	VkDeviceSize padding = alignedOffset - m_nodes[found].offset;
+
+	// Alignment padding in front becomes its own free block. The previous physical block is never free because
+	// neighbouring free blocks are always merged, so no merge is needed here.
+	if (padding > 0)
+	{
+		uint32_t front = CreateNode();
+
+		Node& frontNode = m_nodes[front];
+		Node& foundNode = m_nodes[found];
+
+		frontNode.offset = foundNode.offset;
+		frontNode.size = padding;
+		frontNode.prevPhysical = foundNode.prevPhysical;
+		frontNode.nextPhysical = found;
+
+		if (foundNode.prevPhysical != INVALID_NODE)
+		{
+			m_nodes[foundNode.prevPhysical].nextPhysical = front;
+		}
+		else
+		{
+			m_firstNode = front;
+		}
+
+		foundNode.prevPhysical = front;
+		foundNode.offset = alignedOffset;
+		foundNode.size -= padding;
+
+		InsertFree(front);
+	}
+
+	VkDeviceSize remaining = m_nodes[found].size - size;
+
+	if (remaining >= MIN_SPLIT_SIZE)
+	{
+		uint32_t back = CreateNode();
+
+		Node& backNode = m_nodes[back];
+		Node& foundNode = m_nodes[found];
+
+		backNode.offset = foundNode.offset + size;
+		backNode.size = remaining;
+		backNode.prevPhysical = found;
+		backNode.nextPhysical = foundNode.nextPhysical;
+
+		if (foundNode.nextPhysical != INVALID_NODE)
+		{
+			m_nodes[foundNode.nextPhysical].prevPhysical = back;
+		}
+
+		foundNode.nextPhysical = back;
+		foundNode.size = size;
+
+		InsertFree(back);
+	}
+
+	Node& allocated = m_nodes[found];
+
+	allocated.free = false;
+	allocated.alignment = alignment;
+	allocated.userData = userData;
+
+	m_usedBytes += allocated.size;
+	m_allocationCount++;
+
+	*node = found;
+	*offset = allocated.offset;
+
+	return true;
+}
+
+void TlsfBlockMetadata::Free(uint32_t node)
+{
+	Node& freed = m_nodes[node];
+
+	m_usedBytes -= freed.size;
+	m_allocationCount--;
+
+	freed.free = true;
+	freed.userData = nullptr;
+
+	uint32_t next = freed.nextPhysical;
+
+	if (next != INVALID_NODE && m_nodes[next].free)
+	{
+		RemoveFree(next);
+
+		freed.size += m_nodes[next].size;
+		freed.nextPhysical = m_nodes[next].nextPhysical;
+
+		if (freed.nextPhysical != INVALID_NODE)
+		{
+			m_nodes[freed.nextPhysical].prevPhysical = node;
+		}
+
+		ReleaseNode(next);
+	}
+
+	uint32_t prev = freed.prevPhysical;
+
+	if (prev != INVALID_NODE && m_nodes[prev].free)
+	{
+		RemoveFree(prev);
+
+		m_nodes[prev].size += freed.size;
+		m_nodes[prev].nextPhysical = freed.nextPhysical;
+
+		if (freed.nextPhysical != INVALID_NODE)
+		{
+			m_nodes[freed.nextPhysical].prevPhysical = prev;
+		}
+
+		ReleaseNode(node);
+
+		node = prev;
+	}
+
+	InsertFree(node);
+}
+
+MemoryAllocator::MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device) : m_device(device)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+
+	m_bufferImageGranularity = properties.limits.bufferImageGranularity;
+	m_maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+	m_pools.resize(m_memoryProperties.memoryTypeCount * 2);
+
+	for (uint32_t memoryType = 0; memoryType < m_memoryProperties.memoryTypeCount; memoryType++)
+	{
+		VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[memoryType].heapIndex].size;
+
+		// Large blocks keep vkAllocateMemory off the hot path, small heaps (e.g. 256 MB BAR windows) get proportionally smaller blocks
+		VkDeviceSize blockSize = heapSize <= (VkDeviceSize(1) << 30) ? std::bit_floor(heapSize / 8) : (VkDeviceSize(64) << 20);
+
+		for (uint32_t kind = 0; kind < 2; kind++)
+		{
+			m_pools[memoryType * 2 + kind].memoryType = memoryType;
+			m_pools[memoryType * 2 + kind].preferredBlockSize = blockSize;
+		}
+	}
+
+	Logger::Info("MEMORY ALLOCATOR CREATED <%u MEMORY TYPES, GRANULARITY %llu>", m_memoryProperties.memoryTypeCount, (unsigned long long)m_bufferImageGranularity);
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+	for (MemoryPool& pool : m_pools)
+	{
+		for (std::unique_ptr<MemoryBlock>& block : pool.blocks)
+		{
+			if (block == nullptr)
+			{
+				continue;
+			}
+
+			if (!block->metadata.IsEmpty())
+			{
+				Logger::Warn("MEMORY BLOCK DESTROYED WITH %u LIVE ALLOCATIONS", block->metadata.GetAllocationCount());
+			}
+
+			FreeDeviceMemory(block->memory, block->mapped);
+		}
+	}
+
+	if (m_stats.dedicatedAllocationCount != 0)
+	{
+		Logger::Warn("MEMORY ALLOCATOR DESTROYED WITH %u LIVE DEDICATED ALLOCATIONS", m_stats.dedicatedAllocationCount);
+	}
+}
+
+bool MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, AllocationKind kind, MemoryAllocation* allocation, void* userData)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	uint32_t memoryType;
+
+	if (!FindMemoryType(requirements.memoryTypeBits, usage, &memoryType))
+	{
+		Logger::Error("FAILED TO FIND A MEMORY TYPE FOR ALLOCATION");
+
+		return false;
+	}
+
+	// Without a granularity restriction linear and optimal resources can safely share blocks
+	uint32_t poolIndex = memoryType * 2 + (kind == AllocationKind::Optimal && m_bufferImageGranularity > 1 ? 1 : 0);
+
+	bool allocated;
+
+	if (requirements.size > m_pools[poolIndex].preferredBlockSize / 2)
+	{
+		*allocation = {};
+
+		allocated = AllocateDeviceMemory(memoryType, requirements.size, &allocation->memory, &allocation->mapped);
+
+		if (allocated)
+		{
+			allocation->size = requirements.size;
+			allocation->memoryType = memoryType;
+			allocation->pool = poolIndex;
+			allocation->userData = userData;
+
+			m_stats.dedicatedAllocationCount++;
+			m_stats.dedicatedBytes += requirements.size;
+		}
+	}
+	else
+	{
+		allocated = AllocateFromPool(poolIndex, requirements.size, requirements.alignment, userData, UINT32_MAX, true, allocation);
+	}
+
+	m_stats.allocateCalls++;
+	m_stats.allocateNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+	return allocated;
+}
+
+void MemoryAllocator::Free(MemoryAllocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (allocation.IsDedicated())
+	{
+		FreeDeviceMemory(allocation.memory, allocation.mapped);
+
+		m_stats.dedicatedAllocationCount--;
+		m_stats.dedicatedBytes -= allocation.size;
+	}
+	else
+	{
+		FreeFromPool(allocation);
+	}
+
+	allocation = {};
+}
+
+bool MemoryAllocator::CreateBuffer(const VkBufferCreateInfo& createInfo, MemoryUsage usage, VkBuffer* buffer, MemoryAllocation* allocation, void* userData)
+{
+	VkResult result = vkCreateBuffer(m_device, &createInfo, nullptr, buffer);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE BUFFER");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetBufferMemoryRequirements(m_device, *buffer, &memoryRequirements);
+
+	if (!Allocate(memoryRequirements, usage, AllocationKind::Linear, allocation, userData))
+	{
+		vkDestroyBuffer(m_device, *buffer, nullptr);
+		*buffer = VK_NULL_HANDLE;
+
+		return false;
+	}
+
+	result = vkBindBufferMemory(m_device, *buffer, allocation->memory, allocation->offset);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO BIND BUFFER MEMORY");
+		Logger::Error("%s", string_VkResult(result));
+
+		vkDestroyBuffer(m_device, *buffer, nullptr);
+		*buffer = VK_NULL_HANDLE;
+
+		Free(*allocation);
+
+		return false;
+	}
+
+	return true;
+}
+
+void MemoryAllocator::DestroyBuffer(VkBuffer buffer, MemoryAllocation& allocation)
+{
+	vkDestroyBuffer(m_device, buffer, nullptr);
+
+	Free(allocation);
+}
+
+bool MemoryAllocator::CreateImage(const VkImageCreateInfo& createInfo, MemoryUsage usage, VkImage* image, MemoryAllocation* allocation, void* userData)
+{
+	VkResult result = vkCreateImage(m_device, &createInfo, nullptr, image);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE IMAGE");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetImageMemoryRequirements(m_device, *image, &memoryRequirements);
+
+	AllocationKind kind = createInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? AllocationKind::Optimal : AllocationKind::Linear;
+
+	if (!Allocate(memoryRequirements, usage, kind, allocation, userData))
+	{
+		vkDestroyImage(m_device, *image, nullptr);
+		*image = VK_NULL_HANDLE;
+
+		return false;
+	}
+
+	result = vkBindImageMemory(m_device, *image, allocation->memory, allocation->offset);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO BIND IMAGE MEMORY");
+		Logger::Error("%s", string_VkResult(result));
+
+		vkDestroyImage(m_device, *image, nullptr);
+		*image = VK_NULL_HANDLE;
+
+		Free(*allocation);
+
+		return false;
+	}
+
+	return true;
+}
+
+void MemoryAllocator::DestroyImage(VkImage image, MemoryAllocation& allocation)
+{
+	vkDestroyImage(m_device, image, nullptr);
+
+	Free(allocation);
+}
+
+uint32_t MemoryAllocator::Defragment(uint32_t maxMoves, const std::function<bool(const MemoryAllocation& from, const MemoryAllocation& to)>& move)
+{
+	struct Candidate
+	{
+		uint32_t node;
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		VkDeviceSize alignment;
+		void* userData;
+	};
+
+	struct Move
+	{
+		MemoryAllocation from;
+		MemoryAllocation to;
+	};
+
+	std::vector<Move> planned;
+
+	// Destinations are reserved under the lock, the callbacks run without it so they may allocate staging memory
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (uint32_t poolIndex = 0; poolIndex < m_pools.size() && planned.size() < maxMoves; poolIndex++)
+		{
+			MemoryPool& pool = m_pools[poolIndex];
+
+			uint32_t source = UINT32_MAX;
+			uint32_t occupiedBlocks = 0;
+
+			for (uint32_t i = 0; i < pool.blocks.size(); i++)
+			{
+				if (pool.blocks[i] == nullptr || pool.blocks[i]->metadata.IsEmpty())
+				{
+					continue;
+				}
+
+				occupiedBlocks++;
+
+				if (source == UINT32_MAX || pool.blocks[i]->metadata.GetUsedBytes() < pool.blocks[source]->metadata.GetUsedBytes())
+				{
+					source = i;
+				}
+			}
+
+			// Emptying the least used block is the move that most likely lets a whole VkDeviceMemory be released
+			if (occupiedBlocks < 2)
+			{
+				continue;
+			}
+
+			std::vector<Candidate> candidates;
+
+			pool.blocks[source]->metadata.ForEachAllocation([&candidates](uint32_t node, VkDeviceSize offset, VkDeviceSize size, VkDeviceSize alignment, void* userData)
+			{
+				candidates.push_back({ node, offset, size, alignment, userData });
+			});
+
+			for (const Candidate& candidate : candidates)
+			{
+				if (planned.size() >= maxMoves)
+				{
+					break;
+				}
+
+				Move plannedMove;
+
+				if (!AllocateFromPool(poolIndex, candidate.size, candidate.alignment, candidate.userData, source, false, &plannedMove.to))
+				{
+					continue;
+				}
+
+				MemoryAllocation& from = plannedMove.from;
+				from.memory = pool.blocks[source]->memory;
+				from.offset = candidate.offset;
+				from.size = candidate.size;
+				from.mapped = pool.blocks[source]->mapped ? static_cast<char*>(pool.blocks[source]->mapped) + candidate.offset : nullptr;
+				from.userData = candidate.userData;
+				from.memoryType = pool.memoryType;
+				from.pool = poolIndex;
+				from.block = source;
+				from.node = candidate.node;
+
+				planned.push_back(plannedMove);
+			}
+		}
+	}
+
+	uint32_t moves = 0;
+
+	// A cancelled move cancels the ones after it as well
+	while (moves < planned.size() && move(planned[moves].from, planned[moves].to))
+	{
+		moves++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (uint32_t i = 0; i < planned.size(); i++)
+		{
+			FreeFromPool(i < moves ? planned[i].from : planned[i].to);
+		}
+
+		ReleaseEmptyBlocksLocked();
+	}
+
+	if (moves > 0)
+	{
+		Logger::Info("DEFRAGMENTATION MOVED %u ALLOCATIONS", moves);
+	}
+
+	return moves;
+}
+
+void MemoryAllocator::ReleaseEmptyBlocks()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	ReleaseEmptyBlocksLocked();
+}
+
+void MemoryAllocator::ReleaseEmptyBlocksLocked()
+{
+	for (MemoryPool& pool : m_pools)
+	{
+		for (std::unique_ptr<MemoryBlock>& block : pool.blocks)
+		{
+			if (block != nullptr && block->metadata.IsEmpty())
+			{
+				FreeDeviceMemory(block->memory, block->mapped);
+
+				block.reset();
+			}
+		}
+	}
+}
+
+MemoryAllocatorStats MemoryAllocator::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	MemoryAllocatorStats stats = m_stats;
+
+	stats.allocationCount = stats.dedicatedAllocationCount;
+	stats.usedBytes = stats.dedicatedBytes;
+
+	for (const MemoryPool& pool : m_pools)
+	{
+		for (const std::unique_ptr<MemoryBlock>& block : pool.blocks)
+		{
+			if (block == nullptr)
+			{
+				continue;
+			}
+
+			stats.blockCount++;
+			stats.blockBytes += block->metadata.GetSize();
+			stats.usedBytes += block->metadata.GetUsedBytes();
+			stats.allocationCount += block->metadata.GetAllocationCount();
+		}
+	}
+
+	return stats;
+}
+
+void MemoryAllocator::LogStats()
+{
+	MemoryAllocatorStats stats = GetStats();
+
+	Logger::Info("MEMORY: %u ALLOCATIONS IN %u BLOCKS + %u DEDICATED", stats.allocationCount, stats.blockCount, stats.dedicatedAllocationCount);
+	Logger::Info("MEMORY: %.2f MB USED / %.2f MB RESERVED", stats.usedBytes / (1024.0 * 1024.0), (stats.blockBytes + stats.dedicatedBytes) / (1024.0 * 1024.0));
+	Logger::Info("MEMORY: %.0f NS AVERAGE ALLOCATION OVER %llu CALLS", stats.AverageAllocateNanoseconds(), (unsigned long long)stats.allocateCalls);
+}
+
+bool MemoryAllocator::FindMemoryType(uint32_t typeFilter, MemoryUsage usage, uint32_t* memoryType)
+{
+	VkMemoryPropertyFlags required = 0;
+	VkMemoryPropertyFlags preferred = 0;
+
+	switch (usage)
+	{
+	case MemoryUsage::GpuOnly:
+		required = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+		break;
+	case MemoryUsage::CpuToGpu:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+		break;
+	case MemoryUsage::GpuToCpu:
+		required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+		break;
+	default:
+		break;
+	}
+
+	for (VkMemoryPropertyFlags flags : { required | preferred, required })
+	{
+		for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++)
+		{
+			if ((typeFilter & (1u << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+			{
+				*memoryType = i;
+
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+bool MemoryAllocator::AllocateDeviceMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory* memory, void** mapped)
+{
+	if (m_deviceAllocationCount >= m_maxAllocationCount)
+	{
+		Logger::Error("MAX MEMORY ALLOCATION COUNT (%u) REACHED", m_maxAllocationCount);
+
+		return false;
+	}
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	VkResult result = vkAllocateMemory(m_device, &allocInfo, nullptr, memory);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO ALLOCATE DEVICE MEMORY");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	*mapped = nullptr;
+
+	// Host visible memory stays mapped for its whole lifetime, mapping is far too slow to do per upload
+	if (m_memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		result = vkMapMemory(m_device, *memory, 0, VK_WHOLE_SIZE, 0, mapped);
+
+		if (result != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO MAP DEVICE MEMORY");
+			Logger::Error("%s", string_VkResult(result));
+		}
+	}
+
+	m_deviceAllocationCount++;
+
+	return true;
+}
+
+void MemoryAllocator::FreeDeviceMemory(VkDeviceMemory memory, void* mapped)
+{
+	if (mapped != nullptr)
+	{
+		vkUnmapMemory(m_device, memory);
+	}
+
+	vkFreeMemory(m_device, memory, nullptr);
+
+	m_deviceAllocationCount--;
+}
+
+bool MemoryAllocator::AllocateFromPool(uint32_t poolIndex, VkDeviceSize size, VkDeviceSize alignment, void* userData, uint32_t excludedBlock, bool allowNewBlock, MemoryAllocation* allocation)
+{
+	MemoryPool& pool = m_pools[poolIndex];
+
+	uint32_t blockIndex = UINT32_MAX;
+	uint32_t node;
+	VkDeviceSize offset;
+
+	for (uint32_t i = 0; i < pool.blocks.size(); i++)
+	{
+		if (i == excludedBlock || pool.blocks[i] == nullptr)
+		{
+			continue;
+		}
+
+		if (pool.blocks[i]->metadata.Allocate(size, alignment, userData, &node, &offset))
+		{
+			blockIndex = i;
+
+			break;
+		}
+	}
+
+	if (blockIndex == UINT32_MAX)
+	{
+		if (!allowNewBlock)
+		{
+			return false;
+		}
+
+		std::unique_ptr<MemoryBlock> block = std::make_unique<MemoryBlock>();
+
+		if (!AllocateDeviceMemory(pool.memoryType, pool.preferredBlockSize, &block->memory, &block->mapped))
+		{
+			return false;
+		}
+
+		block->metadata.Init(pool.preferredBlockSize);
+
+		if (!block->metadata.Allocate(size, alignment, userData, &node, &offset))
+		{
+			Logger::Error("FAILED TO ALLOCATE FROM A NEW MEMORY BLOCK");
+
+			FreeDeviceMemory(block->memory, block->mapped);
+
+			return false;
+		}
+
+		for (uint32_t i = 0; i < pool.blocks.size() && blockIndex == UINT32_MAX; i++)
+		{
+			if (pool.blocks[i] == nullptr)
+			{
+				blockIndex = i;
+			}
+		}
+
+		if (blockIndex == UINT32_MAX)
+		{
+			blockIndex = static_cast<uint32_t>(pool.blocks.size());
+			pool.blocks.emplace_back();
+		}
+
+		pool.blocks[blockIndex] = std::move(block);
+	}
+
+	MemoryBlock& block = *pool.blocks[blockIndex];
+
+	allocation->memory = block.memory;
+	allocation->offset = offset;
+	allocation->size = size;
+	allocation->mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+	allocation->userData = userData;
+	allocation->memoryType = pool.memoryType;
+	allocation->pool = poolIndex;
+	allocation->block = blockIndex;
+	allocation->node = node;
+
+	return true;
+}
+
+void MemoryAllocator::FreeFromPool(const MemoryAllocation& allocation)
+{
+	m_pools[allocation.pool].blocks[allocation.block]->metadata.Free(allocation.node);
+}
+
+bool FrameArena::Init(MemoryAllocator* allocator, VkDeviceSize segmentSize, uint32_t segmentCount, VkBufferUsageFlags usage)
+{
+	m_allocator = allocator;
+
+	// Keeps every segment start aligned for any uniform, storage or vertex offset the device may require
+	m_segmentSize = AlignUp(segmentSize, 256);
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = m_segmentSize * segmentCount;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (!m_allocator->CreateBuffer(bufferInfo, MemoryUsage::CpuToGpu, &m_buffer, &m_allocation))
+	{
+		Logger::Error("FAILED TO CREATE FRAME ARENA");
+
+		return false;
+	}
+
+	BeginFrame(0);
+
+	return true;
+}
+
+void FrameArena::Destroy()
+{
+	if (m_buffer != VK_NULL_HANDLE)
+	{
+		m_allocator->DestroyBuffer(m_buffer, m_allocation);
+
+		m_buffer = VK_NULL_HANDLE;
+	}
+}
+
+void FrameArena::BeginFrame(uint32_t frameIndex)
+{
+	m_highWaterMark = (std::max)(m_highWaterMark, m_head - m_segmentStart);
+
+	m_segmentStart = m_segmentSize * frameIndex;
+	m_head = m_segmentStart;
+}
+
+bool FrameArena::Allocate(VkDeviceSize size, VkDeviceSize alignment, FrameArenaAllocation* allocation)
+{
+	VkDeviceSize offset = AlignUp(m_head, (std::max)(alignment, VkDeviceSize(1)));
+
+	if (offset + size > m_segmentStart + m_segmentSize)
+	{
+		Logger::Warn("FRAME ARENA EXHAUSTED (%llu BYTES REQUESTED)", (unsigned long long)size);
+
+		return false;
+	}
+
+	allocation->buffer = m_buffer;
+	allocation->offset = offset;
+	allocation->mapped = static_cast<char*>(m_allocation.mapped) + offset;
+
+	m_head = offset + size;
+
+	return true;
+}
+
+void MemoryAllocatorBenchmark::Run(uint32_t operationCount)
+{
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr VkDeviceSize BLOCK_SIZE = 256ull << 20;
+	static constexpr uint32_t MAX_LIVE_ALLOCATIONS = 4096;
+
+	struct Operation
+	{
+		VkDeviceSize size;
+		VkDeviceSize alignment;
+		uint32_t victim;
+		bool allocate;
+	};
+
+	// Generated up front so only the allocator is timed: sizes from 256 bytes to 1 MB spread evenly over the powers
+	// of two, about as many frees as allocations once the live set has filled up
+	std::vector<Operation> operations(operationCount);
+
+	uint32_t seed = 0x9e3779b9u;
+
+	auto next = [&seed]()
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+
+		return seed;
+	};
+
+	for (Operation& operation : operations)
+	{
+		operation.size = (VkDeviceSize(256) << (next() % 13)) + next() % 256;
+		operation.alignment = VkDeviceSize(16) << (next() % 5);
+		operation.victim = next();
+		operation.allocate = (next() & 1) != 0;
+	}
+
+	TlsfBlockMetadata metadata;
+	metadata.Init(BLOCK_SIZE);
+
+	std::vector<uint32_t> live;
+	live.reserve(MAX_LIVE_ALLOCATIONS);
+
+	uint32_t allocations = 0;
+	uint32_t frees = 0;
+	uint32_t failures = 0;
+
+	Clock::time_point start = Clock::now();
+
+	for (const Operation& operation : operations)
+	{
+		if (live.empty() || (operation.allocate && live.size() < MAX_LIVE_ALLOCATIONS))
+		{
+			uint32_t node;
+			VkDeviceSize offset;
+
+			if (metadata.Allocate(operation.size, operation.alignment, nullptr, &node, &offset))
+			{
+				live.push_back(node);
+				allocations++;
+			}
+			else
+			{
+				failures++;
+			}
+		}
+		else
+		{
+			uint32_t index = operation.victim % static_cast<uint32_t>(live.size());
+
+			metadata.Free(live[index]);
+
+			live[index] = live.back();
+			live.pop_back();
+			frees++;
+		}
+	}
+
+	double nanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+	Logger::Info("TLSF BENCHMARK: %u ALLOCATIONS, %u FREES, %u FAILED, %.1f NS PER OPERATION", allocations, frees, failures, nanoseconds / (std::max)(operationCount, 1u));
+	Logger::Info("TLSF BENCHMARK: %u LIVE ALLOCATIONS, %llu KB OF %llu KB USED", metadata.GetAllocationCount(), (unsigned long long)(metadata.GetUsedBytes() >> 10), (unsigned long long)(BLOCK_SIZE >> 10));
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+enum class MemoryUsage
+{
+	// Device local, never touched by the CPU
+	GpuOnly,
+	// Host visible and persistently mapped, written by the CPU and read by the GPU
+	CpuToGpu,
+	// Host visible and preferably cached, written by the GPU and read back by the CPU
+	GpuToCpu
+};
+
+// Linear resources (buffers, linear images) and optimal images live in separate block pools so neighbouring
+// sub-allocations never violate bufferImageGranularity.
+enum class AllocationKind
+{
+	Linear, Optimal
+};
+
+struct MemoryAllocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+
+	// Persistently mapped pointer to the first byte of the allocation, nullptr if the memory is not host visible
+	void* mapped = nullptr;
+
+	// Passed back to the defragmentation callback so the owner can find the resource bound to this memory
+	void* userData = nullptr;
+
+	uint32_t memoryType = 0;
+	uint32_t pool = 0;
+	uint32_t block = UINT32_MAX;
+	uint32_t node = UINT32_MAX;
+
+	bool IsDedicated() const { return block == UINT32_MAX; }
+};
+
+struct MemoryAllocatorStats
+{
+	uint32_t blockCount = 0;
+	uint32_t allocationCount = 0;
+	uint32_t dedicatedAllocationCount = 0;
+
+	VkDeviceSize blockBytes = 0;
+	VkDeviceSize usedBytes = 0;
+	VkDeviceSize dedicatedBytes = 0;
+
+	uint64_t allocateCalls = 0;
+	uint64_t allocateNanoseconds = 0;
+
+	double AverageAllocateNanoseconds() const { return allocateCalls ? double(allocateNanoseconds) / allocateCalls : 0.0; }
+};
+
+// Two level segregated fit (TLSF) bookkeeping for one VkDeviceMemory block. Allocate and Free are O(1).
+class TlsfBlockMetadata
+{
+public:
+	static constexpr uint32_t INVALID_NODE = UINT32_MAX;
+
+public:
+	void Init(VkDeviceSize size);
+
+	bool Allocate(VkDeviceSize size, VkDeviceSize alignment, void* userData, uint32_t* node, VkDeviceSize* offset);
+	void Free(uint32_t node);
+
+	VkDeviceSize GetSize() const { return m_size; }
+	VkDeviceSize GetUsedBytes() const { return m_usedBytes; }
+	uint32_t GetAllocationCount() const { return m_allocationCount; }
+
+	bool IsEmpty() const { return m_allocationCount == 0; }
+
+	// Calls visitor(node, offset, size, alignment, userData) for every live allocation in address order
+	template<typename Visitor>
+	void ForEachAllocation(Visitor visitor) const
+	{
+		for (uint32_t node = m_firstNode; node != INVALID_NODE; node = m_nodes[node].nextPhysical)
+		{
+			if (!m_nodes[node].free)
+			{
+				visitor(node, m_nodes[node].offset, m_nodes[node].size, m_nodes[node].alignment, m_nodes[node].userData);
+			}
+		}
+	}
+
+private:
+	static constexpr uint32_t SL_BITS = 5;
+	static constexpr uint32_t SL_COUNT = 1 << SL_BITS;
+	static constexpr uint32_t SMALL_SIZE_BITS = 8;
+	static constexpr uint32_t FL_COUNT = 64 - SMALL_SIZE_BITS + 1;
+
+	// Free remainders smaller than this stay attached to the allocation instead of becoming their own node
+	static constexpr VkDeviceSize MIN_SPLIT_SIZE = 64;
+
+	struct Node
+	{
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		VkDeviceSize alignment = 1;
+
+		uint32_t prevPhysical = INVALID_NODE;
+		uint32_t nextPhysical = INVALID_NODE;
+		uint32_t prevFree = INVALID_NODE;
+		uint32_t nextFree = INVALID_NODE;
+
+		bool free = true;
+
+		void* userData = nullptr;
+	};
+
+private:
+	VkDeviceSize m_size = 0;
+	VkDeviceSize m_usedBytes = 0;
+	uint32_t m_allocationCount = 0;
+
+	uint32_t m_firstNode = INVALID_NODE;
+
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_unusedNodes;
+
+	uint64_t m_flBitmap = 0;
+	uint32_t m_slBitmap[FL_COUNT] = {};
+	uint32_t m_freeHeads[FL_COUNT][SL_COUNT];
+
+private:
+	static void Mapping(VkDeviceSize size, uint32_t* fl, uint32_t* sl);
+
+	uint32_t CreateNode();
+	void ReleaseNode(uint32_t node);
+
+	void InsertFree(uint32_t node);
+	void RemoveFree(uint32_t node);
+
+	uint32_t FindFree(VkDeviceSize size);
+};
+
+class MemoryAllocator
+{
+public:
+	MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice device);
+	~MemoryAllocator();
+
+public:
+	bool Allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, AllocationKind kind, MemoryAllocation* allocation, void* userData = nullptr);
+	void Free(MemoryAllocation& allocation);
+
+	bool CreateBuffer(const VkBufferCreateInfo& createInfo, MemoryUsage usage, VkBuffer* buffer, MemoryAllocation* allocation, void* userData = nullptr);
+	void DestroyBuffer(VkBuffer buffer, MemoryAllocation& allocation);
+
+	bool CreateImage(const VkImageCreateInfo& createInfo, MemoryUsage usage, VkImage* image, MemoryAllocation* allocation, void* userData = nullptr);
+	void DestroyImage(VkImage image, MemoryAllocation& allocation);
+
+	// Defragmentation hook: moves up to maxMoves allocations out of the emptiest block of each pool.
+	// move(from, to) must copy the contents, rebind the owning resource and return true, or return false to cancel.
+	// The caller is responsible for making sure the GPU no longer uses the source allocations. move runs without the
+	// allocator's lock held, so it may allocate and free other memory, but the allocations being moved must stay alive
+	// until Defragment returns.
+	uint32_t Defragment(uint32_t maxMoves, const std::function<bool(const MemoryAllocation& from, const MemoryAllocation& to)>& move);
+
+	// Returns memory of blocks without live allocations to the driver
+	void ReleaseEmptyBlocks();
+
+	MemoryAllocatorStats GetStats();
+
+	void LogStats();
+
+	VkDevice GetVkDevice() { return m_device; }
+
+private:
+	struct MemoryBlock
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		void* mapped = nullptr;
+
+		TlsfBlockMetadata metadata;
+	};
+
+	struct MemoryPool
+	{
+		uint32_t memoryType = 0;
+
+		VkDeviceSize preferredBlockSize = 0;
+
+		// Slots of released blocks are nulled instead of erased so block indices stay valid
+		std::vector<std::unique_ptr<MemoryBlock>> blocks;
+	};
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+
+	VkPhysicalDeviceMemoryProperties m_memoryProperties = {};
+
+	VkDeviceSize m_bufferImageGranularity = 1;
+	uint32_t m_maxAllocationCount = 0;
+
+	// Indexed by memoryType * 2 + AllocationKind
+	std::vector<MemoryPool> m_pools;
+
+	uint32_t m_deviceAllocationCount = 0;
+
+	MemoryAllocatorStats m_stats;
+
+	std::mutex m_mutex;
+
+private:
+	bool FindMemoryType(uint32_t typeFilter, MemoryUsage usage, uint32_t* memoryType);
+
+	bool AllocateDeviceMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory* memory, void** mapped);
+	void FreeDeviceMemory(VkDeviceMemory memory, void* mapped);
+
+	bool AllocateFromPool(uint32_t poolIndex, VkDeviceSize size, VkDeviceSize alignment, void* userData, uint32_t excludedBlock, bool allowNewBlock, MemoryAllocation* allocation);
+	void FreeFromPool(const MemoryAllocation& allocation);
+
+	void ReleaseEmptyBlocksLocked();
+};
+
+struct FrameArenaAllocation
+{
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+
+	void* mapped = nullptr;
+};
+
+// Linear bump allocator over one persistently mapped buffer, split into a segment per frame in flight.
+// A segment is rewound in BeginFrame, after the frame that last used it has retired.
+class FrameArena
+{
+public:
+	bool Init(MemoryAllocator* allocator, VkDeviceSize segmentSize, uint32_t segmentCount, VkBufferUsageFlags usage);
+	void Destroy();
+
+	void BeginFrame(uint32_t frameIndex);
+
+	bool Allocate(VkDeviceSize size, VkDeviceSize alignment, FrameArenaAllocation* allocation);
+
+	VkBuffer GetBuffer() { return m_buffer; }
+
+	VkDeviceSize GetHighWaterMark() { return m_highWaterMark; }
+
+private:
+	MemoryAllocator* m_allocator = nullptr;
+
+	VkBuffer m_buffer = VK_NULL_HANDLE;
+	MemoryAllocation m_allocation;
+
+	VkDeviceSize m_segmentSize = 0;
+	VkDeviceSize m_segmentStart = 0;
+	VkDeviceSize m_head = 0;
+	VkDeviceSize m_highWaterMark = 0;
+};
+
+// Times mixed Allocate and Free calls on the TLSF bookkeeping of one block and logs the results, needs no device
+class MemoryAllocatorBenchmark
+{
+public:
+	static void Run(uint32_t operationCount = 1000000);
+};
@@ -0,0 +1,366 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+// Offline tool: converts FBX meshes into the GPU ready .cmesh format described in MeshFormat.h.
+// Usage: MeshCooker <input.fbx> <output.cmesh> [--no-quantize] [--index32] [--no-optimize] [--overdraw <threshold>] [--lods <count>] [--no-meshlets]
+
+struct CookOptions
+{
+	bool quantize = true;
+	bool forceIndex32 = false;
+	bool optimize = true;
+
+	// Allowed ACMR loss for the overdraw pass, 0 disables it
+	float overdrawThreshold = 1.05f;
+
+	// Upper bound for the LOD chain including LOD 0, 1 disables simplification
+	uint32_t lodCount = MESH_FILE_MAX_LODS;
+
+	bool meshlets = true;
+};
+
+static uint16_t FloatToHalf(float value)
+{
+	uint32_t bits = std::bit_cast<uint32_t>(value);
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t mantissa = bits & 0x7fffff;
+	int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+
+	// Infinity and NaN keep their class, NaN stays quiet
+	if (((bits >> 23) & 0xff) == 0xff)
+	{
+		return static_cast<uint16_t>(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+	}
+
+	if (exponent >= 31)
+	{
+		return static_cast<uint16_t>(sign | 0x7c00);
+	}
+
+	// Subnormal half, or zero when even that is too small
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+		{
+			return static_cast<uint16_t>(sign);
+		}
+
+		mantissa |= 0x800000;
+
+		uint32_t shift = static_cast<uint32_t>(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+
+		if (remainder > halfway || (remainder == halfway && (half & 1)))
+		{
+			half++;
+		}
+
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1fff;
+
+	// Round to nearest even, a carry into the exponent is the correctly rounded result
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+	{
+		half++;
+	}
+
+	return static_cast<uint16_t>(half);
+}
+
+static int8_t QuantizeSnorm8(float value)
+{
+	return static_cast<int8_t>(std::lround((std::clamp)(value, -1.0f, 1.0f) * 127.0f));
+}
+
+static void WritePadding(std::ofstream& file, uint64_t alignment)
+{
+	static const char zeros[MESH_FILE_ALIGNMENT] = {};
+
+	uint64_t position = static_cast<uint64_t>(file.tellp());
+	uint64_t padding = (alignment - position % alignment) % alignment;
+
+	file.write(zeros, padding);
+}
+
+static void OptimizeMesh(std::vector<FBXVertex>& vertices, std::vector<uint32_t>& indices, const CookOptions& options)
+{
+	uint32_t inputVertexCount = static_cast<uint32_t>(vertices.size());
+
+	VertexCacheStats before = MeshOptimizer::AnalyzeVertexCache(indices, inputVertexCount);
+
+	uint32_t vertexCount = MeshOptimizer::DeduplicateVertices(vertices, indices);
+
+	MeshOptimizer::OptimizeVertexCache(indices, vertexCount);
+
+	if (options.overdrawThreshold > 0.0f)
+	{
+		MeshOptimizer::OptimizeOverdraw(indices, vertices, options.overdrawThreshold);
+	}
+
+	VertexCacheStats after = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount);
+
+	Logger::Info("VERTICES %u -> %u, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", inputVertexCount, vertexCount, before.acmr, after.acmr, before.atvr, after.atvr);
+}
+
+static bool CookMesh(const std::vector<FBXMesh>& meshes, const std::string& outputPath, const CookOptions& options)
+{
+	std::vector<FBXVertex> vertices;
+	std::vector<uint32_t> indices;
+
+	// Every FBX mesh goes into one vertex and index stream, nodes are not transformed
+	for (const FBXMesh& mesh : meshes)
+	{
+		uint32_t baseVertex = static_cast<uint32_t>(vertices.size());
+
+		vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+
+		for (uint32_t index : mesh.indices)
+		{
+			indices.push_back(baseVertex + index);
+		}
+	}
+
+	if (vertices.empty() || indices.empty())
+	{
+		Logger::Error("NO GEOMETRY TO COOK");
+
+		return false;
+	}
+
+	if (options.optimize)
+	{
+		OptimizeMesh(vertices, indices, options);
+	}
+
+	// LODs index the same vertex buffer and are appended after LOD 0
+	MeshFileLod lods[MESH_FILE_MAX_LODS] = {};
+
+	uint32_t lodCount = MeshSimplifier::GenerateLods(vertices, indices, (std::clamp)(options.lodCount, 1u, MESH_FILE_MAX_LODS), lods);
+
+	for (uint32_t lod = 1; lod < lodCount; lod++)
+	{
+		Logger::Info("LOD %u: %u TRIANGLES, ERROR %f", lod, lods[lod].indexCount / 3, lods[lod].error);
+	}
+
+	// Regroups the LOD 0 triangles, so it has to run after the LODs were simplified from them
+	std::vector<MeshFileMeshlet> meshlets;
+
+	if (options.meshlets)
+	{
+		MeshletBuilder::Build(vertices, indices, lods[0].firstIndex, lods[0].indexCount, meshlets);
+
+		Logger::Info("%u MESHLETS, %.1f TRIANGLES EACH ON AVERAGE", static_cast<uint32_t>(meshlets.size()), meshlets.empty() ? 0.0f : lods[0].indexCount / 3.0f / meshlets.size());
+	}
+
+	// Last, so the vertex order follows the final triangle order of every LOD
+	if (options.optimize)
+	{
+		MeshOptimizer::OptimizeVertexFetch(vertices, indices);
+	}
+
+	MeshFileHeader header = {};
+	header.magic = MESH_FILE_MAGIC;
+	header.version = MESH_FILE_VERSION;
+	header.headerSize = sizeof(MeshFileHeader);
+
+	bool index32 = options.forceIndex32 || vertices.size() > 0xffff;
+
+	header.flags = (options.quantize ? MESH_FLAG_QUANTIZED : 0) | (index32 ? MESH_FLAG_INDEX32 : 0);
+
+	header.vertexCount = static_cast<uint32_t>(vertices.size());
+	header.vertexStride = options.quantize ? sizeof(MeshVertexQuantized) : sizeof(MeshVertex);
+	header.indexCount = static_cast<uint32_t>(indices.size());
+
+	header.vertexOffset = sizeof(MeshFileHeader);
+	header.vertexBytes = uint64_t(header.vertexCount) * header.vertexStride;
+	header.indexOffset = (header.vertexOffset + header.vertexBytes + MESH_FILE_ALIGNMENT - 1) & ~uint64_t(MESH_FILE_ALIGNMENT - 1);
+	header.indexBytes = uint64_t(header.indexCount) * (index32 ? 4 : 2);
+
+	header.meshletCount = static_cast<uint32_t>(meshlets.size());
+	header.meshletOffset = (header.indexOffset + header.indexBytes + MESH_FILE_ALIGNMENT - 1) & ~uint64_t(MESH_FILE_ALIGNMENT - 1);
+	header.meshletBytes = meshlets.size() * sizeof(MeshFileMeshlet);
+
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		header.boundsMin[axis] = FLT_MAX;
+		header.boundsMax[axis] = -FLT_MAX;
+	}
+
+	for (const FBXVertex& vertex : vertices)
+	{
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			header.boundsMin[axis] = (std::min)(header.boundsMin[axis], vertex.position[axis]);
+			header.boundsMax[axis] = (std::max)(header.boundsMax[axis], vertex.position[axis]);
+		}
+	}
+
+	// Sphere around the box center, tight enough for culling and cheap to compute
+	float radiusSquared = 0.0f;
+
+	for (const FBXVertex& vertex : vertices)
+	{
+		float distanceSquared = 0.0f;
+
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			float delta = vertex.position[axis] - (header.boundsMin[axis] + header.boundsMax[axis]) * 0.5f;
+
+			distanceSquared += delta * delta;
+		}
+
+		radiusSquared = (std::max)(radiusSquared, distanceSquared);
+	}
+
+	header.boundsRadius = std::sqrt(radiusSquared);
+
+	header.lodCount = lodCount;
+
+	memcpy(header.lods, lods, sizeof(lods));
+
+	std::vector<uint8_t> vertexData(header.vertexBytes);
+
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		const FBXVertex& source = vertices[i];
+
+		if (options.quantize)
+		{
+			MeshVertexQuantized vertex = {};
+
+			memcpy(vertex.position, source.position, sizeof(vertex.position));
+
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				vertex.normal[axis] = QuantizeSnorm8(source.normal[axis]);
+			}
+
+			vertex.uv[0] = FloatToHalf(source.uv[0]);
+			vertex.uv[1] = FloatToHalf(source.uv[1]);
+
+			memcpy(vertexData.data() + i * sizeof(vertex), &vertex, sizeof(vertex));
+		}
+		else
+		{
+			MeshVertex vertex = {};
+
+			memcpy(vertex.position, source.position, sizeof(vertex.position));
+			memcpy(vertex.normal, source.normal, sizeof(vertex.normal));
+			memcpy(vertex.uv, source.uv, sizeof(vertex.uv));
+
+			memcpy(vertexData.data() + i * sizeof(vertex), &vertex, sizeof(vertex));
+		}
+	}
+
+	std::vector<uint8_t> indexData(header.indexBytes);
+
+	if (index32)
+	{
+		memcpy(indexData.data(), indices.data(), indexData.size());
+	}
+	else
+	{
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			uint16_t index = static_cast<uint16_t>(indices[i]);
+
+			memcpy(indexData.data() + i * sizeof(uint16_t), &index, sizeof(uint16_t));
+		}
+	}
+
+	std::ofstream file(outputPath, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open())
+	{
+		Logger::Error("FAILED TO OPEN %s FOR WRITING", outputPath.c_str());
+
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(vertexData.data()), vertexData.size());
+
+	WritePadding(file, MESH_FILE_ALIGNMENT);
+
+	file.write(reinterpret_cast<const char*>(indexData.data()), indexData.size());
+
+	WritePadding(file, MESH_FILE_ALIGNMENT);
+
+	file.write(reinterpret_cast<const char*>(meshlets.data()), header.meshletBytes);
+
+	if (!file)
+	{
+		Logger::Error("FAILED TO WRITE %s", outputPath.c_str());
+
+		return false;
+	}
+
+	Logger::Info("COOKED %s: %u VERTICES (%u BYTES EACH), %u INDICES (%u BIT)", outputPath.c_str(), header.vertexCount, header.vertexStride, header.indexCount, index32 ? 32 : 16);
+
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	CookOptions options;
+
+	std::vector<std::string> paths;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (argument == "--no-quantize")
+		{
+			options.quantize = false;
+		}
+		else if (argument == "--index32")
+		{
+			options.forceIndex32 = true;
+		}
+		else if (argument == "--no-optimize")
+		{
+			options.optimize = false;
+		}
+		else if (argument == "--overdraw" && i + 1 < argc)
+		{
+			options.overdrawThreshold = static_cast<float>(atof(argv[++i]));
+		}
+		else if (argument == "--lods" && i + 1 < argc)
+		{
+			options.lodCount = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (argument == "--no-meshlets")
+		{
+			options.meshlets = false;
+		}
+		else
+		{
+			paths.push_back(argument);
+		}
+	}
+
+	if (paths.size() != 2)
+	{
+		Logger::Error("USAGE: MeshCooker <input.fbx> <output.cmesh> [--no-quantize] [--index32] [--no-optimize] [--overdraw <threshold>] [--lods <count>] [--no-meshlets]");
+
+		return EXIT_FAILURE;
+	}
+
+	FBXLoader loader;
+
+	if (!loader.Load(paths[0]))
+	{
+		return EXIT_FAILURE;
+	}
+
+	return CookMesh(loader.GetMeshes(), paths[1], options) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
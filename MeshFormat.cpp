@@ -0,0 +1,158 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+// Largest index of the section, a plain max loop the compiler vectorizes
+template<typename T>
+static uint32_t FindMaxIndex(const uint8_t* data, uint32_t count)
+{
+	const T* indices = reinterpret_cast<const T*>(data);
+
+	T maxIndex = 0;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		maxIndex = (std::max)(maxIndex, indices[i]);
+	}
+
+	return maxIndex;
+}
+
+bool CookedMesh::Open(const std::string& path)
+{
+	Close();
+
+	if (!m_file.Open(path))
+	{
+		return false;
+	}
+
+	std::span<const uint8_t> data = m_file.GetData();
+
+	if (data.size() < sizeof(MeshFileHeader))
+	{
+		Logger::Error("COOKED MESH %s IS TRUNCATED", path.c_str());
+
+		Close();
+
+		return false;
+	}
+
+	memcpy(&m_header, data.data(), sizeof(MeshFileHeader));
+
+	if (m_header.magic != MESH_FILE_MAGIC || m_header.headerSize != sizeof(MeshFileHeader))
+	{
+		Logger::Error("%s IS NOT A COOKED MESH", path.c_str());
+
+		Close();
+
+		return false;
+	}
+
+	// Older files are re-cooked rather than converted at load time
+	if (m_header.version != MESH_FILE_VERSION)
+	{
+		Logger::Error("COOKED MESH %s HAS VERSION %u, EXPECTED %u", path.c_str(), m_header.version, MESH_FILE_VERSION);
+
+		Close();
+
+		return false;
+	}
+
+	uint32_t expectedStride = (m_header.flags & MESH_FLAG_QUANTIZED) ? sizeof(MeshVertexQuantized) : sizeof(MeshVertex);
+	uint32_t indexSize = (m_header.flags & MESH_FLAG_INDEX32) ? 4 : 2;
+
+	bool valid = m_header.vertexStride == expectedStride
+		&& m_header.vertexBytes == uint64_t(m_header.vertexCount) * m_header.vertexStride
+		&& m_header.indexBytes == uint64_t(m_header.indexCount) * indexSize
+		&& m_header.vertexOffset % MESH_FILE_ALIGNMENT == 0
+		&& m_header.indexOffset % MESH_FILE_ALIGNMENT == 0
+		&& m_header.vertexOffset <= data.size() && m_header.vertexBytes <= data.size() - m_header.vertexOffset
+		&& m_header.indexOffset <= data.size() && m_header.indexBytes <= data.size() - m_header.indexOffset
+		&& m_header.lodCount >= 1 && m_header.lodCount <= MESH_FILE_MAX_LODS
+		&& m_header.meshletBytes == uint64_t(m_header.meshletCount) * sizeof(MeshFileMeshlet)
+		&& m_header.meshletOffset % MESH_FILE_ALIGNMENT == 0
+		&& m_header.meshletOffset <= data.size() && m_header.meshletBytes <= data.size() - m_header.meshletOffset;
+
+	for (uint32_t lod = 0; valid && lod < m_header.lodCount; lod++)
+	{
+		valid = uint64_t(m_header.lods[lod].firstIndex) + m_header.lods[lod].indexCount <= m_header.indexCount;
+	}
+
+	// Meshlets lie within LOD 0, the renderer draws their ranges directly
+	if (valid)
+	{
+		uint64_t lodEnd = uint64_t(m_header.lods[0].firstIndex) + m_header.lods[0].indexCount;
+
+		for (const MeshFileMeshlet& meshlet : GetMeshlets())
+		{
+			valid = valid && meshlet.firstIndex >= m_header.lods[0].firstIndex && uint64_t(meshlet.firstIndex) + meshlet.indexCount <= lodEnd;
+		}
+	}
+
+	// An index past the last vertex would make the GPU read outside the vertex buffer
+	if (valid && m_header.indexCount > 0)
+	{
+		const uint8_t* indices = data.data() + m_header.indexOffset;
+
+		uint32_t maxIndex = (m_header.flags & MESH_FLAG_INDEX32) ? FindMaxIndex<uint32_t>(indices, m_header.indexCount) : FindMaxIndex<uint16_t>(indices, m_header.indexCount);
+
+		valid = maxIndex < m_header.vertexCount;
+	}
+
+	if (!valid)
+	{
+		Logger::Error("COOKED MESH %s IS CORRUPTED", path.c_str());
+
+		Close();
+
+		return false;
+	}
+
+	return true;
+}
+
+std::span<const MeshFileMeshlet> CookedMesh::GetMeshlets() const
+{
+	if (m_header.meshletCount == 0)
+	{
+		return {};
+	}
+
+	// The section is aligned within a page aligned mapping or a heap buffer, both suitably aligned for the records
+	const uint8_t* data = m_file.GetData().data() + m_header.meshletOffset;
+
+	return { reinterpret_cast<const MeshFileMeshlet*>(data), m_header.meshletCount };
+}
+
+void CookedMesh::Close()
+{
+	m_file.Close();
+
+	m_header = {};
+}
+
+void CookedMesh::FillVertexInput(GraphicsPipelineDesc& desc) const
+{
+	bool quantized = (m_header.flags & MESH_FLAG_QUANTIZED) != 0;
+
+	desc.vertexBindings = { { 0, m_header.vertexStride, VK_VERTEX_INPUT_RATE_VERTEX } };
+
+	if (quantized)
+	{
+		desc.vertexAttributes = {
+			{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(MeshVertexQuantized, position) },
+			{ 1, 0, VK_FORMAT_R8G8B8A8_SNORM, offsetof(MeshVertexQuantized, normal) },
+			{ 2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(MeshVertexQuantized, uv) },
+		};
+	}
+	else
+	{
+		desc.vertexAttributes = {
+			{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(MeshVertex, position) },
+			{ 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(MeshVertex, normal) },
+			{ 2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(MeshVertex, uv) },
+		};
+	}
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+// Cooked mesh files (.cmesh), written offline by the MeshCooker tool from FBX sources.
+// Little endian. The vertex and index sections start on MESH_FILE_ALIGNMENT boundaries and are laid out
+// exactly as the GPU consumes them, so loading is a straight copy from the mapped file into staging memory.
+
+static constexpr uint32_t MESH_FILE_MAGIC = 0x48534D43; // "CMSH"
+static constexpr uint32_t MESH_FILE_VERSION = 2;
+static constexpr uint32_t MESH_FILE_ALIGNMENT = 16;
+static constexpr uint32_t MESH_FILE_MAX_LODS = 8;
+
+// Vertices are MeshVertexQuantized instead of MeshVertex
+static constexpr uint32_t MESH_FLAG_QUANTIZED = 1 << 0;
+// Indices are 32 bit, 16 bit otherwise
+static constexpr uint32_t MESH_FLAG_INDEX32 = 1 << 1;
+
+struct MeshVertex
+{
+	float position[3];
+	float normal[3];
+	float uv[2];
+};
+
+// Normal as R8G8B8A8_SNORM, UV as R16G16_SFLOAT
+struct MeshVertexQuantized
+{
+	float position[3];
+	int8_t normal[4];
+	uint16_t uv[2];
+};
+
+struct MeshFileLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+
+	// Object space error of this LOD relative to the full detail mesh, 0 for LOD 0
+	float error;
+
+	uint32_t reserved;
+};
+
+// Cluster of LOD 0 for CPU culling. The cooker groups each meshlet's triangles into one contiguous index range.
+// 16 byte aligned vec4 pairs, so the array can be uploaded as is for GPU side culling.
+struct MeshFileMeshlet
+{
+	float center[3];
+	float radius;
+
+	// All triangles face away from any viewer with dot(center - eye, coneAxis) >= coneCutoff * |center - eye| + radius
+	float coneAxis[3];
+	float coneCutoff;
+
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t vertexCount;
+	uint32_t reserved;
+};
+
+struct MeshFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t flags;
+	uint32_t headerSize;
+
+	uint32_t vertexCount;
+	uint32_t vertexStride;
+	uint32_t indexCount;
+	uint32_t lodCount;
+
+	uint64_t vertexOffset;
+	uint64_t vertexBytes;
+	uint64_t indexOffset;
+	uint64_t indexBytes;
+
+	float boundsMin[3];
+	float boundsRadius;
+	float boundsMax[3];
+	uint32_t reserved;
+
+	uint32_t meshletCount;
+	uint32_t reserved2[3];
+	uint64_t meshletOffset;
+	uint64_t meshletBytes;
+
+	MeshFileLod lods[MESH_FILE_MAX_LODS];
+};
+
+static_assert(sizeof(MeshVertex) == 32, "MeshVertex layout is part of the file format");
+static_assert(sizeof(MeshVertexQuantized) == 20, "MeshVertexQuantized layout is part of the file format");
+static_assert(sizeof(MeshFileMeshlet) == 48, "MeshFileMeshlet layout is part of the file format");
+static_assert(sizeof(MeshFileHeader) % MESH_FILE_ALIGNMENT == 0, "Sections following the header must stay aligned");
+
+// Runtime view of a cooked mesh. The file stays mapped while the object lives, the data spans point into it.
+class CookedMesh
+{
+public:
+	bool Open(const std::string& path);
+	void Close();
+
+	const MeshFileHeader& GetHeader() const { return m_header; }
+
+	std::span<const uint8_t> GetVertexData() const { return m_file.GetData().subspan(m_header.vertexOffset, m_header.vertexBytes); }
+	std::span<const uint8_t> GetIndexData() const { return m_file.GetData().subspan(m_header.indexOffset, m_header.indexBytes); }
+
+	// Empty for meshes cooked without meshlets
+	std::span<const MeshFileMeshlet> GetMeshlets() const;
+
+	VkIndexType GetIndexType() const { return (m_header.flags & MESH_FLAG_INDEX32) ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16; }
+
+	// Binding 0 with position, normal and UV at locations 0, 1 and 2
+	void FillVertexInput(GraphicsPipelineDesc& desc) const;
+
+private:
+	MappedFile m_file;
+
+	MeshFileHeader m_header = {};
+};
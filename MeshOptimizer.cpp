@@ -0,0 +1,460 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+// Forsyth scoring constants, the cache modelled here is larger than VERTEX_CACHE_SIZE on purpose
+// so the order also holds up on hardware with bigger caches
+static constexpr uint32_t FORSYTH_CACHE_SIZE = 32;
+static constexpr float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+static constexpr float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+static constexpr float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+static constexpr float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+static constexpr uint32_t INVALID_INDEX = ~0u;
+
+static uint64_t HashVertex(const FBXVertex& vertex)
+{
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&vertex);
+
+	uint64_t hash = 14695981039346656037ull;
+
+	for (size_t i = 0; i < sizeof(FBXVertex); i++)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+
+	return hash;
+}
+
+static float ForsythVertexScore(int32_t cachePosition, uint32_t remainingValence)
+{
+	// No triangles left to draw, the vertex must not attract anything
+	if (remainingValence == 0)
+	{
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+
+	if (cachePosition >= 0)
+	{
+		// The three vertices of the last triangle get a fixed score so the next pick does not favour
+		// a strip-like order that would leave one of them stranded
+		if (cachePosition < 3)
+		{
+			score = FORSYTH_LAST_TRIANGLE_SCORE;
+		}
+		else
+		{
+			float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+
+			score = std::pow(1.0f - (cachePosition - 3) * scale, FORSYTH_CACHE_DECAY_POWER);
+		}
+	}
+
+	// Vertices with few triangles left are finished off first so they can leave the cache
+	score += FORSYTH_VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remainingValence), -FORSYTH_VALENCE_BOOST_POWER);
+
+	return score;
+}
+
+uint32_t MeshOptimizer::DeduplicateVertices(std::vector<FBXVertex>& vertices, std::vector<uint32_t>& indices)
+{
+	uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+
+	// Open addressing table holding vertex ids, kept at most half full
+	size_t tableSize = 1;
+
+	while (tableSize < size_t(vertexCount) * 2)
+	{
+		tableSize *= 2;
+	}
+
+	std::vector<uint32_t> table(tableSize, INVALID_INDEX);
+	std::vector<uint32_t> remap(vertexCount);
+
+	uint32_t uniqueCount = 0;
+
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		size_t slot = HashVertex(vertices[i]) & (tableSize - 1);
+
+		while (table[slot] != INVALID_INDEX && memcmp(&vertices[table[slot]], &vertices[i], sizeof(FBXVertex)) != 0)
+		{
+			slot = (slot + 1) & (tableSize - 1);
+		}
+
+		if (table[slot] == INVALID_INDEX)
+		{
+			// Unique vertices are compacted in place, a vertex never moves past its own position
+			vertices[uniqueCount] = vertices[i];
+
+			table[slot] = uniqueCount++;
+		}
+
+		remap[i] = table[slot];
+	}
+
+	for (uint32_t& index : indices)
+	{
+		index = remap[index];
+	}
+
+	vertices.resize(uniqueCount);
+
+	return uniqueCount;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+	uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Triangles adjacent to each vertex, the live ones are kept at the front of every range
+	std::vector<uint32_t> valence(vertexCount, 0);
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+
+	for (uint32_t i = 0; i < triangleCount * 3; i++)
+	{
+		valence[indices[i]]++;
+	}
+
+	for (uint32_t vertex = 0; vertex < vertexCount; vertex++)
+	{
+		offsets[vertex + 1] = offsets[vertex] + valence[vertex];
+	}
+
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+
+	for (uint32_t i = 0; i < triangleCount * 3; i++)
+	{
+		adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	std::vector<int32_t> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+
+	for (uint32_t vertex = 0; vertex < vertexCount; vertex++)
+	{
+		vertexScore[vertex] = ForsythVertexScore(-1, valence[vertex]);
+	}
+
+	uint32_t best = 0;
+
+	for (uint32_t triangle = 0; triangle < triangleCount; triangle++)
+	{
+		const uint32_t* corners = &indices[triangle * 3];
+
+		triangleScore[triangle] = vertexScore[corners[0]] + vertexScore[corners[1]] + vertexScore[corners[2]];
+
+		if (triangleScore[triangle] > triangleScore[best])
+		{
+			best = triangle;
+		}
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(triangleCount * 3);
+
+	uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+	uint32_t cacheCount = 0;
+
+	uint32_t cursor = 0;
+
+	while (output.size() < size_t(triangleCount) * 3)
+	{
+		// Nothing adjacent to the cache is left, restart from the next unvisited triangle.
+		// A full rescan for the best score would make the pass quadratic on disconnected meshes.
+		if (best == INVALID_INDEX)
+		{
+			while (emitted[cursor])
+			{
+				cursor++;
+			}
+
+			best = cursor;
+		}
+
+		uint32_t corners[3] = { indices[best * 3 + 0], indices[best * 3 + 1], indices[best * 3 + 2] };
+
+		emitted[best] = true;
+
+		output.insert(output.end(), corners, corners + 3);
+
+		for (uint32_t vertex : corners)
+		{
+			uint32_t* live = &adjacency[offsets[vertex]];
+
+			for (uint32_t i = 0; i < valence[vertex]; i++)
+			{
+				if (live[i] == best)
+				{
+					live[i] = live[valence[vertex] - 1];
+					valence[vertex]--;
+
+					break;
+				}
+			}
+		}
+
+		// The emitted triangle moves to the front, everything past FORSYTH_CACHE_SIZE falls out
+		uint32_t newCache[FORSYTH_CACHE_SIZE + 3] = { corners[0], corners[1], corners[2] };
+		uint32_t newCount = 3;
+
+		for (uint32_t i = 0; i < cacheCount; i++)
+		{
+			uint32_t vertex = cache[i];
+
+			if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+			{
+				newCache[newCount++] = vertex;
+			}
+		}
+
+		for (uint32_t i = 0; i < newCount; i++)
+		{
+			uint32_t vertex = newCache[i];
+
+			cachePosition[vertex] = i < FORSYTH_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+			vertexScore[vertex] = ForsythVertexScore(cachePosition[vertex], valence[vertex]);
+		}
+
+		best = INVALID_INDEX;
+
+		float bestScore = -FLT_MAX;
+
+		for (uint32_t i = 0; i < newCount; i++)
+		{
+			uint32_t vertex = newCache[i];
+
+			for (uint32_t j = 0; j < valence[vertex]; j++)
+			{
+				uint32_t triangle = adjacency[offsets[vertex] + j];
+
+				const uint32_t* triangleCorners = &indices[triangle * 3];
+
+				triangleScore[triangle] = vertexScore[triangleCorners[0]] + vertexScore[triangleCorners[1]] + vertexScore[triangleCorners[2]];
+
+				if (triangleScore[triangle] > bestScore)
+				{
+					bestScore = triangleScore[triangle];
+					best = triangle;
+				}
+			}
+		}
+
+		cacheCount = (std::min)(newCount, FORSYTH_CACHE_SIZE);
+
+		memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+	}
+
+	indices.swap(output);
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<FBXVertex>& vertices, float threshold)
+{
+	uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+
+	VertexCacheStats baseline = AnalyzeVertexCache(indices, vertexCount);
+
+	// Replay the FIFO cache to find triangles that miss on every corner. The cache is effectively cold there,
+	// so starting a cluster on one of them costs almost nothing after the clusters are shuffled.
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	uint32_t time = VERTEX_CACHE_SIZE + 1;
+
+	std::vector<uint32_t> clusterStarts = { 0 };
+
+	uint32_t clusterMisses = 0;
+
+	for (uint32_t triangle = 0; triangle < triangleCount; triangle++)
+	{
+		uint32_t misses = 0;
+
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			uint32_t vertex = indices[triangle * 3 + corner];
+
+			if (time - cacheTime[vertex] > VERTEX_CACHE_SIZE)
+			{
+				cacheTime[vertex] = time++;
+				misses++;
+			}
+		}
+
+		uint32_t clusterTriangles = triangle - clusterStarts.back();
+
+		if (misses == 3 && clusterTriangles > 0 && float(clusterMisses) / clusterTriangles <= baseline.acmr * threshold)
+		{
+			clusterStarts.push_back(triangle);
+			clusterMisses = 0;
+		}
+
+		clusterMisses += misses;
+	}
+
+	uint32_t clusterCount = static_cast<uint32_t>(clusterStarts.size());
+
+	clusterStarts.push_back(triangleCount);
+
+	// Area weighted centroid and normal per cluster
+	std::vector<float> clusterData(clusterCount * 7, 0.0f);
+
+	float meshCentroid[3] = {};
+	float meshArea = 0.0f;
+
+	for (uint32_t cluster = 0; cluster < clusterCount; cluster++)
+	{
+		float* data = &clusterData[cluster * 7];
+
+		for (uint32_t triangle = clusterStarts[cluster]; triangle < clusterStarts[cluster + 1]; triangle++)
+		{
+			const float* a = vertices[indices[triangle * 3 + 0]].position;
+			const float* b = vertices[indices[triangle * 3 + 1]].position;
+			const float* c = vertices[indices[triangle * 3 + 2]].position;
+
+			float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+
+			float normal[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+
+			float area = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				data[axis] += (a[axis] + b[axis] + c[axis]) / 3.0f * area;
+				data[3 + axis] += normal[axis];
+			}
+
+			data[6] += area;
+		}
+
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			meshCentroid[axis] += data[axis];
+		}
+
+		meshArea += data[6];
+	}
+
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		meshCentroid[axis] = meshArea > 0.0f ? meshCentroid[axis] / meshArea : 0.0f;
+	}
+
+	// Clusters that face away from the center are likely to occlude the rest, so they draw first
+	std::vector<float> sortKeys(clusterCount);
+
+	for (uint32_t cluster = 0; cluster < clusterCount; cluster++)
+	{
+		const float* data = &clusterData[cluster * 7];
+
+		float normalLength = std::sqrt(data[3] * data[3] + data[4] * data[4] + data[5] * data[5]);
+
+		if (data[6] <= 0.0f || normalLength <= 0.0f)
+		{
+			sortKeys[cluster] = 0.0f;
+
+			continue;
+		}
+
+		float key = 0.0f;
+
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			key += (data[axis] / data[6] - meshCentroid[axis]) * data[3 + axis] / normalLength;
+		}
+
+		sortKeys[cluster] = key;
+	}
+
+	std::vector<uint32_t> order(clusterCount);
+
+	for (uint32_t cluster = 0; cluster < clusterCount; cluster++)
+	{
+		order[cluster] = cluster;
+	}
+
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+
+	for (uint32_t cluster : order)
+	{
+		output.insert(output.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + clusterStarts[cluster + 1] * 3);
+	}
+
+	indices.swap(output);
+}
+
+uint32_t MeshOptimizer::OptimizeVertexFetch(std::vector<FBXVertex>& vertices, std::vector<uint32_t>& indices)
+{
+	std::vector<uint32_t> remap(vertices.size(), INVALID_INDEX);
+	std::vector<FBXVertex> reordered;
+	reordered.reserve(vertices.size());
+
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == INVALID_INDEX)
+		{
+			remap[index] = static_cast<uint32_t>(reordered.size());
+
+			reordered.push_back(vertices[index]);
+		}
+
+		index = remap[index];
+	}
+
+	vertices.swap(reordered);
+
+	return static_cast<uint32_t>(vertices.size());
+}
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+	VertexCacheStats stats;
+
+	// A vertex is cached while fewer than cacheSize misses happened since it was loaded
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<bool> referenced(vertexCount, false);
+
+	uint32_t time = cacheSize + 1;
+	uint32_t referencedCount = 0;
+
+	for (uint32_t index : indices)
+	{
+		if (time - cacheTime[index] > cacheSize)
+		{
+			cacheTime[index] = time++;
+			stats.vertexTransforms++;
+		}
+
+		if (!referenced[index])
+		{
+			referenced[index] = true;
+			referencedCount++;
+		}
+	}
+
+	size_t triangleCount = indices.size() / 3;
+
+	stats.acmr = triangleCount > 0 ? float(stats.vertexTransforms) / triangleCount : 0.0f;
+	stats.atvr = referencedCount > 0 ? float(stats.vertexTransforms) / referencedCount : 0.0f;
+
+	return stats;
+}
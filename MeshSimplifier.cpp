@@ -0,0 +1,522 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+// Normal (3) and UV (2)
+static constexpr uint32_t SIMPLIFY_ATTRIBUTE_COUNT = 5;
+
+// Simplification stops once a LOD removes less than this share of the previous LOD's triangles
+static constexpr float LOD_MIN_REDUCTION = 0.1f;
+
+namespace
+{
+	// Error of a point p with attributes s: p'Ap + 2b.p + c, plus for every attribute channel
+	// w s^2 - 2 s (g.p + d), where g and d are the weighted sums of the attribute's per triangle gradients
+	struct Quadric
+	{
+		double a00, a11, a22, a01, a02, a12;
+		double b0, b1, b2;
+		double c;
+
+		double w;
+
+		double g[SIMPLIFY_ATTRIBUTE_COUNT][3];
+		double d[SIMPLIFY_ATTRIBUTE_COUNT];
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+
+		float error;
+	};
+
+	void AddQuadric(Quadric& q, const Quadric& other)
+	{
+		const double* source = &other.a00;
+		double* destination = &q.a00;
+
+		for (size_t i = 0; i < sizeof(Quadric) / sizeof(double); i++)
+		{
+			destination[i] += source[i];
+		}
+	}
+
+	void GetAttributes(const FBXVertex& vertex, float* attributes)
+	{
+		attributes[0] = vertex.normal[0] * SIMPLIFY_NORMAL_WEIGHT;
+		attributes[1] = vertex.normal[1] * SIMPLIFY_NORMAL_WEIGHT;
+		attributes[2] = vertex.normal[2] * SIMPLIFY_NORMAL_WEIGHT;
+		attributes[3] = vertex.uv[0] * SIMPLIFY_UV_WEIGHT;
+		attributes[4] = vertex.uv[1] * SIMPLIFY_UV_WEIGHT;
+	}
+
+	double EvaluateQuadric(const Quadric& q, const float* p, const float* attributes)
+	{
+		double x = p[0], y = p[1], z = p[2];
+
+		double error = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+			+ 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+			+ 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z)
+			+ q.c;
+
+		for (uint32_t k = 0; k < SIMPLIFY_ATTRIBUTE_COUNT; k++)
+		{
+			double s = attributes[k];
+
+			error += q.w * s * s - 2.0 * s * (q.g[k][0] * x + q.g[k][1] * y + q.g[k][2] * z + q.d[k]);
+		}
+
+		// Normalized by area so the error reads as a squared distance. Rounding can take a near zero error slightly negative.
+		return error > 0.0 && q.w > 0.0 ? error / q.w : 0.0;
+	}
+
+	void TriangleQuadric(Quadric& q, const float* p0, const float* p1, const float* p2, const float (*attributes)[SIMPLIFY_ATTRIBUTE_COUNT])
+	{
+		q = {};
+
+		double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+
+		double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+
+		double lengthSquared = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+		double length = std::sqrt(lengthSquared);
+
+		if (length <= 0.0)
+		{
+			return;
+		}
+
+		// Area weighting keeps large triangles from being dominated by slivers
+		double weight = length * 0.5;
+
+		double u[3] = { n[0] / length, n[1] / length, n[2] / length };
+		double distance = -(u[0] * p0[0] + u[1] * p0[1] + u[2] * p0[2]);
+
+		q.a00 = weight * u[0] * u[0];
+		q.a11 = weight * u[1] * u[1];
+		q.a22 = weight * u[2] * u[2];
+		q.a01 = weight * u[0] * u[1];
+		q.a02 = weight * u[0] * u[2];
+		q.a12 = weight * u[1] * u[2];
+		q.b0 = weight * u[0] * distance;
+		q.b1 = weight * u[1] * distance;
+		q.b2 = weight * u[2] * distance;
+		q.c = weight * distance * distance;
+		q.w = weight;
+
+		// Gradient of each attribute over the triangle plane, s(p) = g.p + d
+		double e2n[3] = { e2[1] * n[2] - e2[2] * n[1], e2[2] * n[0] - e2[0] * n[2], e2[0] * n[1] - e2[1] * n[0] };
+		double ne1[3] = { n[1] * e1[2] - n[2] * e1[1], n[2] * e1[0] - n[0] * e1[2], n[0] * e1[1] - n[1] * e1[0] };
+
+		for (uint32_t k = 0; k < SIMPLIFY_ATTRIBUTE_COUNT; k++)
+		{
+			double s0 = attributes[0][k];
+			double ds1 = attributes[1][k] - s0;
+			double ds2 = attributes[2][k] - s0;
+
+			double g[3];
+
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				g[axis] = (ds1 * e2n[axis] + ds2 * ne1[axis]) / lengthSquared;
+			}
+
+			double d = s0 - (g[0] * p0[0] + g[1] * p0[1] + g[2] * p0[2]);
+
+			q.a00 += weight * g[0] * g[0];
+			q.a11 += weight * g[1] * g[1];
+			q.a22 += weight * g[2] * g[2];
+			q.a01 += weight * g[0] * g[1];
+			q.a02 += weight * g[0] * g[2];
+			q.a12 += weight * g[1] * g[2];
+			q.b0 += weight * g[0] * d;
+			q.b1 += weight * g[1] * d;
+			q.b2 += weight * g[2] * d;
+			q.c += weight * d * d;
+
+			q.g[k][0] = weight * g[0];
+			q.g[k][1] = weight * g[1];
+			q.g[k][2] = weight * g[2];
+			q.d[k] = weight * d;
+		}
+	}
+
+	void TriangleNormal(const float* p0, const float* p1, const float* p2, double* n)
+	{
+		double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+}
+
+float MeshSimplifier::Simplify(const std::vector<FBXVertex>& vertices, const std::vector<uint32_t>& indices, size_t targetIndexCount, float targetError, std::vector<uint32_t>& result)
+{
+	result = indices;
+
+	uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+
+	if (vertexCount == 0 || indices.size() <= targetIndexCount)
+	{
+		return 0.0f;
+	}
+
+	// Positions are normalized to the unit cube so errors and weights do not depend on the mesh scale
+	float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	for (const FBXVertex& vertex : vertices)
+	{
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			boundsMin[axis] = (std::min)(boundsMin[axis], vertex.position[axis]);
+			boundsMax[axis] = (std::max)(boundsMax[axis], vertex.position[axis]);
+		}
+	}
+
+	float extent = (std::max)({ boundsMax[0] - boundsMin[0], boundsMax[1] - boundsMin[1], boundsMax[2] - boundsMin[2] });
+	float scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+
+	std::vector<float> positions(size_t(vertexCount) * 3);
+	std::vector<float> attributes(size_t(vertexCount) * SIMPLIFY_ATTRIBUTE_COUNT);
+
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			positions[i * 3 + axis] = (vertices[i].position[axis] - boundsMin[axis]) * scale;
+		}
+
+		GetAttributes(vertices[i], &attributes[i * SIMPLIFY_ATTRIBUTE_COUNT]);
+	}
+
+	// Vertices sharing a position (attribute seams) are one vertex for topology and quadrics
+	std::vector<uint32_t> positionRemap(vertexCount);
+	std::vector<uint32_t> wedgeCount(vertexCount, 0);
+
+	{
+		std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			const float* position = vertices[i].position;
+
+			uint64_t hash = 14695981039346656037ull;
+
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				hash = (hash ^ std::bit_cast<uint32_t>(position[axis])) * 1099511628211ull;
+			}
+
+			std::vector<uint32_t>& bucket = buckets[hash];
+
+			positionRemap[i] = i;
+
+			for (uint32_t other : bucket)
+			{
+				if (memcmp(vertices[other].position, position, sizeof(float) * 3) == 0)
+				{
+					positionRemap[i] = other;
+
+					break;
+				}
+			}
+
+			if (positionRemap[i] == i)
+			{
+				bucket.push_back(i);
+			}
+
+			wedgeCount[positionRemap[i]]++;
+		}
+	}
+
+	// Lock seams, and both ends of every edge without a matching opposite edge (open borders, most non-manifold edges)
+	std::vector<bool> locked(vertexCount, false);
+
+	{
+		std::unordered_map<uint64_t, int32_t> edges;
+
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				uint32_t a = positionRemap[result[i + corner]];
+				uint32_t b = positionRemap[result[i + (corner + 1) % 3]];
+
+				// Directed edges cancel against their opposite
+				if (a < b)
+				{
+					edges[(uint64_t(a) << 32) | b] += 1;
+				}
+				else
+				{
+					edges[(uint64_t(b) << 32) | a] -= 1;
+				}
+			}
+		}
+
+		for (const auto& [edge, balance] : edges)
+		{
+			if (balance != 0)
+			{
+				locked[edge >> 32] = true;
+				locked[edge & 0xffffffff] = true;
+			}
+		}
+
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			if (wedgeCount[positionRemap[i]] > 1)
+			{
+				locked[positionRemap[i]] = true;
+			}
+		}
+	}
+
+	std::vector<Quadric> quadrics(vertexCount);
+
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		uint32_t i0 = result[i + 0], i1 = result[i + 1], i2 = result[i + 2];
+
+		float triangleAttributes[3][SIMPLIFY_ATTRIBUTE_COUNT];
+
+		memcpy(triangleAttributes[0], &attributes[i0 * SIMPLIFY_ATTRIBUTE_COUNT], sizeof(triangleAttributes[0]));
+		memcpy(triangleAttributes[1], &attributes[i1 * SIMPLIFY_ATTRIBUTE_COUNT], sizeof(triangleAttributes[1]));
+		memcpy(triangleAttributes[2], &attributes[i2 * SIMPLIFY_ATTRIBUTE_COUNT], sizeof(triangleAttributes[2]));
+
+		Quadric quadric;
+		TriangleQuadric(quadric, &positions[i0 * 3], &positions[i1 * 3], &positions[i2 * 3], triangleAttributes);
+
+		AddQuadric(quadrics[positionRemap[i0]], quadric);
+		AddQuadric(quadrics[positionRemap[i1]], quadric);
+		AddQuadric(quadrics[positionRemap[i2]], quadric);
+	}
+
+	float maxError = targetError * targetError;
+	float resultError = 0.0f;
+
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> collapseRemap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+
+	// Each pass collapses a batch of the cheapest independent edges, then rebuilds the triangle list
+	while (result.size() > targetIndexCount)
+	{
+		uint32_t triangleCount = static_cast<uint32_t>(result.size() / 3);
+
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+
+		for (uint32_t index : result)
+		{
+			adjacencyOffsets[positionRemap[index] + 1]++;
+		}
+
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+		}
+
+		adjacency.resize(result.size());
+
+		{
+			std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+
+			for (uint32_t i = 0; i < triangleCount * 3; i++)
+			{
+				adjacency[fill[positionRemap[result[i]]]++] = i / 3;
+			}
+		}
+
+		collapses.clear();
+
+		for (uint32_t i = 0; i < triangleCount * 3; i++)
+		{
+			uint32_t from = result[i];
+			uint32_t to = result[i - i % 3 + (i + 1) % 3];
+
+			uint32_t fromPosition = positionRemap[from];
+
+			if (locked[fromPosition] || fromPosition == positionRemap[to])
+			{
+				continue;
+			}
+
+			float error = static_cast<float>(EvaluateQuadric(quadrics[fromPosition], &positions[to * 3], &attributes[to * SIMPLIFY_ATTRIBUTE_COUNT]));
+
+			collapses.push_back({ from, to, error });
+		}
+
+		if (collapses.empty())
+		{
+			break;
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			collapseRemap[i] = i;
+		}
+
+		std::fill(touched.begin(), touched.end(), false);
+
+		// Collapsing too much at once lets the error ordering go stale, a fifth of the remaining work per pass keeps it close to greedy
+		size_t triangleBudget = (std::max)(size_t(1), (result.size() - targetIndexCount) / 3 / 5 + 1);
+		size_t trianglesRemoved = 0;
+
+		bool progress = false;
+
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapse.error > maxError || trianglesRemoved >= triangleBudget)
+			{
+				break;
+			}
+
+			uint32_t fromPosition = positionRemap[collapse.from];
+			uint32_t toPosition = positionRemap[collapse.to];
+
+			if (touched[fromPosition] || touched[toPosition])
+			{
+				continue;
+			}
+
+			// Reject collapses that flip or fold any surviving triangle around the removed vertex
+			bool flips = false;
+			uint32_t removed = 0;
+
+			for (uint32_t j = adjacencyOffsets[fromPosition]; j < adjacencyOffsets[fromPosition + 1] && !flips; j++)
+			{
+				const uint32_t* triangle = &result[adjacency[j] * 3];
+
+				uint32_t corners[3] = { positionRemap[triangle[0]], positionRemap[triangle[1]], positionRemap[triangle[2]] };
+
+				if (corners[0] == toPosition || corners[1] == toPosition || corners[2] == toPosition)
+				{
+					removed++;
+
+					continue;
+				}
+
+				double before[3];
+				TriangleNormal(&positions[corners[0] * 3], &positions[corners[1] * 3], &positions[corners[2] * 3], before);
+
+				for (uint32_t& corner : corners)
+				{
+					if (corner == fromPosition)
+					{
+						corner = toPosition;
+					}
+				}
+
+				double after[3];
+				TriangleNormal(&positions[corners[0] * 3], &positions[corners[1] * 3], &positions[corners[2] * 3], after);
+
+				double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+				double lengths = std::sqrt((before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) * (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]));
+
+				flips = dot <= 0.25 * lengths;
+			}
+
+			if (flips)
+			{
+				continue;
+			}
+
+			// The neighbourhood of both ends changes, so neither may take part in another collapse this pass
+			for (uint32_t j = adjacencyOffsets[fromPosition]; j < adjacencyOffsets[fromPosition + 1]; j++)
+			{
+				const uint32_t* triangle = &result[adjacency[j] * 3];
+
+				touched[positionRemap[triangle[0]]] = true;
+				touched[positionRemap[triangle[1]]] = true;
+				touched[positionRemap[triangle[2]]] = true;
+			}
+
+			collapseRemap[collapse.from] = collapse.to;
+
+			AddQuadric(quadrics[toPosition], quadrics[fromPosition]);
+
+			resultError = (std::max)(resultError, collapse.error);
+			trianglesRemoved += removed;
+
+			progress = true;
+		}
+
+		if (!progress)
+		{
+			break;
+		}
+
+		size_t write = 0;
+
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			uint32_t a = collapseRemap[result[i + 0]];
+			uint32_t b = collapseRemap[result[i + 1]];
+			uint32_t c = collapseRemap[result[i + 2]];
+
+			uint32_t pa = positionRemap[a], pb = positionRemap[b], pc = positionRemap[c];
+
+			if (pa == pb || pb == pc || pc == pa)
+			{
+				continue;
+			}
+
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+
+		result.resize(write);
+	}
+
+	return std::sqrt(resultError) * extent;
+}
+
+uint32_t MeshSimplifier::GenerateLods(const std::vector<FBXVertex>& vertices, std::vector<uint32_t>& indices, uint32_t maxLods, MeshFileLod* lods)
+{
+	uint32_t baseIndexCount = static_cast<uint32_t>(indices.size());
+
+	lods[0] = { 0, baseIndexCount, 0.0f, 0 };
+
+	uint32_t lodCount = 1;
+
+	std::vector<uint32_t> lod;
+
+	while (lodCount < maxLods)
+	{
+		const MeshFileLod& previous = lods[lodCount - 1];
+
+		// Each LOD starts from the full mesh so the reported error is measured against LOD 0
+		size_t target = (size_t(previous.indexCount) / 3 / 2) * 3;
+
+		float error = Simplify(vertices, std::vector<uint32_t>(indices.begin(), indices.begin() + baseIndexCount), target, SIMPLIFY_LOD_MAX_ERROR, lod);
+
+		if (lod.empty() || lod.size() > previous.indexCount * (1.0f - LOD_MIN_REDUCTION))
+		{
+			break;
+		}
+
+		MeshOptimizer::OptimizeVertexCache(lod, static_cast<uint32_t>(vertices.size()));
+
+		lods[lodCount] = { static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lod.size()), (std::max)(error, previous.error), 0 };
+
+		indices.insert(indices.end(), lod.begin(), lod.end());
+
+		lodCount++;
+	}
+
+	return lodCount;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// Relative importance of attribute error against geometric error, positions are measured in units of the mesh extent
+static constexpr float SIMPLIFY_NORMAL_WEIGHT = 0.5f;
+static constexpr float SIMPLIFY_UV_WEIGHT = 1.0f;
+
+// Error bound of the LOD chain as a share of the mesh extent, the largest side of its bounding box. A unit sphere's
+// coarsest LOD may thus be 0.1 units off, 10% of its radius.
+static constexpr float SIMPLIFY_LOD_MAX_ERROR = 0.05f;
+
+// Quadric error metric simplification (Garland and Heckbert) with attribute error after Hoppe.
+// Edges collapse onto existing vertices, so every LOD indexes the original vertex buffer and a whole
+// LOD chain shares one vertex buffer. Open borders and attribute seams are locked in place.
+class MeshSimplifier
+{
+public:
+	// Collapses edges until the index count reaches targetIndexCount or the next collapse would exceed
+	// targetError (relative to the mesh extent). Returns the object space error of the result.
+	static float Simplify(const std::vector<FBXVertex>& vertices, const std::vector<uint32_t>& indices, size_t targetIndexCount, float targetError, std::vector<uint32_t>& result);
+
+	// Builds up to maxLods LODs, each targeting half the triangles of the previous one, into indices.
+	// LOD 0 is the input. Stops early once simplification no longer makes progress or would exceed
+	// SIMPLIFY_LOD_MAX_ERROR. The errors stored in lods are in object space, not relative to the extent.
+	static uint32_t GenerateLods(const std::vector<FBXVertex>& vertices, std::vector<uint32_t>& indices, uint32_t maxLods, MeshFileLod* lods);
+};
@@ -0,0 +1,274 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+void MeshletBuilder::Build(const std::vector<FBXVertex>& vertices, std::vector<uint32_t>& indices, uint32_t firstIndex, uint32_t indexCount, std::vector<MeshFileMeshlet>& meshlets)
+{
+	meshlets.clear();
+
+	uint32_t triangleCount = indexCount / 3;
+	uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	const uint32_t* source = &indices[firstIndex];
+
+	// Triangles adjacent to each vertex
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	std::vector<uint32_t> adjacency(size_t(triangleCount) * 3);
+
+	for (uint32_t i = 0; i < triangleCount * 3; i++)
+	{
+		offsets[source[i] + 1]++;
+	}
+
+	for (uint32_t vertex = 0; vertex < vertexCount; vertex++)
+	{
+		offsets[vertex + 1] += offsets[vertex];
+	}
+
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+
+		for (uint32_t i = 0; i < triangleCount * 3; i++)
+		{
+			adjacency[fill[source[i]]++] = i / 3;
+		}
+	}
+
+	std::vector<bool> emitted(triangleCount, false);
+
+	// Meshlet that last referenced each vertex, offset by one so zero means none
+	std::vector<uint32_t> vertexMeshlet(vertexCount, 0);
+
+	std::vector<uint32_t> output;
+	output.reserve(size_t(triangleCount) * 3);
+
+	std::vector<uint32_t> meshletVertices;
+	meshletVertices.reserve(MESHLET_MAX_VERTICES);
+
+	uint32_t cursor = 0;
+	uint32_t emittedCount = 0;
+
+	while (emittedCount < triangleCount)
+	{
+		while (emitted[cursor])
+		{
+			cursor++;
+		}
+
+		uint32_t meshletId = static_cast<uint32_t>(meshlets.size()) + 1;
+
+		MeshFileMeshlet meshlet = {};
+		meshlet.firstIndex = firstIndex + static_cast<uint32_t>(output.size());
+
+		meshletVertices.clear();
+
+		uint32_t meshletTriangles = 0;
+		uint32_t next = cursor;
+
+		// The seed follows the input order, so meshlets inherit the locality of the cache optimized triangle order
+		while (next != ~0u)
+		{
+			const uint32_t* corners = &source[next * 3];
+
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				if (vertexMeshlet[corners[corner]] != meshletId)
+				{
+					vertexMeshlet[corners[corner]] = meshletId;
+
+					meshletVertices.push_back(corners[corner]);
+				}
+			}
+
+			output.insert(output.end(), corners, corners + 3);
+
+			emitted[next] = true;
+			emittedCount++;
+			meshletTriangles++;
+
+			if (meshletTriangles == MESHLET_MAX_TRIANGLES)
+			{
+				break;
+			}
+
+			// Neighbour that adds the fewest vertices, the earliest one on ties
+			next = ~0u;
+
+			uint32_t bestNewVertices = 4;
+
+			for (uint32_t vertex : meshletVertices)
+			{
+				for (uint32_t j = offsets[vertex]; j < offsets[vertex + 1]; j++)
+				{
+					uint32_t triangle = adjacency[j];
+
+					if (emitted[triangle])
+					{
+						continue;
+					}
+
+					const uint32_t* candidate = &source[triangle * 3];
+
+					uint32_t newVertices = (vertexMeshlet[candidate[0]] != meshletId) + (vertexMeshlet[candidate[1]] != meshletId) + (vertexMeshlet[candidate[2]] != meshletId);
+
+					if (meshletVertices.size() + newVertices > MESHLET_MAX_VERTICES)
+					{
+						continue;
+					}
+
+					if (newVertices < bestNewVertices || (newVertices == bestNewVertices && triangle < next))
+					{
+						bestNewVertices = newVertices;
+						next = triangle;
+					}
+				}
+			}
+
+			// Disconnected pieces (hard edges, split UVs) continue with the next triangle in input order instead of
+			// ending in a tiny meshlet, every meshlet costs a draw when it survives culling
+			if (next == ~0u)
+			{
+				while (cursor < triangleCount && emitted[cursor])
+				{
+					cursor++;
+				}
+
+				if (cursor < triangleCount)
+				{
+					const uint32_t* candidate = &source[cursor * 3];
+
+					uint32_t newVertices = (vertexMeshlet[candidate[0]] != meshletId) + (vertexMeshlet[candidate[1]] != meshletId) + (vertexMeshlet[candidate[2]] != meshletId);
+
+					if (meshletVertices.size() + newVertices <= MESHLET_MAX_VERTICES)
+					{
+						next = cursor;
+					}
+				}
+			}
+		}
+
+		meshlet.indexCount = meshletTriangles * 3;
+		meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+
+		meshlets.push_back(meshlet);
+	}
+
+	memcpy(&indices[firstIndex], output.data(), output.size() * sizeof(uint32_t));
+
+	for (MeshFileMeshlet& meshlet : meshlets)
+	{
+		ComputeBounds(vertices, &indices[meshlet.firstIndex], meshlet.indexCount, &meshlet);
+	}
+}
+
+void MeshletBuilder::ComputeBounds(const std::vector<FBXVertex>& vertices, const uint32_t* indices, uint32_t indexCount, MeshFileMeshlet* meshlet)
+{
+	float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		const float* position = vertices[indices[i]].position;
+
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			boundsMin[axis] = (std::min)(boundsMin[axis], position[axis]);
+			boundsMax[axis] = (std::max)(boundsMax[axis], position[axis]);
+		}
+	}
+
+	float radiusSquared = 0.0f;
+
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		meshlet->center[axis] = (boundsMin[axis] + boundsMax[axis]) * 0.5f;
+	}
+
+	for (uint32_t i = 0; i < indexCount; i++)
+	{
+		const float* position = vertices[indices[i]].position;
+
+		float dx = position[0] - meshlet->center[0];
+		float dy = position[1] - meshlet->center[1];
+		float dz = position[2] - meshlet->center[2];
+
+		radiusSquared = (std::max)(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+
+	meshlet->radius = std::sqrt(radiusSquared);
+
+	// Cone axis is the average face normal, the cutoff follows from the normal furthest away from it
+	std::vector<float> normals;
+	normals.reserve(indexCount);
+
+	float axis[3] = {};
+
+	for (uint32_t i = 0; i < indexCount; i += 3)
+	{
+		const float* a = vertices[indices[i + 0]].position;
+		const float* b = vertices[indices[i + 1]].position;
+		const float* c = vertices[indices[i + 2]].position;
+
+		float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+
+		float normal[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+
+		float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+		// Degenerate triangles never rasterize and cannot widen the cone
+		if (length <= 0.0f)
+		{
+			continue;
+		}
+
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			normals.push_back(normal[k] / length);
+
+			axis[k] += normal[k] / length;
+		}
+	}
+
+	float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+	// A cutoff of 1 can never pass the culling test
+	meshlet->coneAxis[0] = 0.0f;
+	meshlet->coneAxis[1] = 0.0f;
+	meshlet->coneAxis[2] = 0.0f;
+	meshlet->coneCutoff = 1.0f;
+
+	if (axisLength <= 0.0f)
+	{
+		return;
+	}
+
+	for (uint32_t k = 0; k < 3; k++)
+	{
+		axis[k] /= axisLength;
+	}
+
+	float minDot = 1.0f;
+
+	for (size_t i = 0; i < normals.size(); i += 3)
+	{
+		minDot = (std::min)(minDot, normals[i] * axis[0] + normals[i + 1] * axis[1] + normals[i + 2] * axis[2]);
+	}
+
+	// Normals spread over a hemisphere or more, some triangle always faces the viewer
+	if (minDot <= 0.0f)
+	{
+		return;
+	}
+
+	memcpy(meshlet->coneAxis, axis, sizeof(axis));
+
+	// Every triangle is back facing once the view direction is within 90 degrees minus the cone angle of the axis
+	meshlet->coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
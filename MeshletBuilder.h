@@ -0,0 +1,17 @@
+#pragma once
+
+// Limits chosen to fit mesh shader workgroups (64 threads, 126 primitive slots rounded down to a multiple of 4)
+static constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+static constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Splits a triangle list into meshlets and computes their culling bounds for the cooker
+class MeshletBuilder
+{
+public:
+	// Greedily grows each meshlet from its neighbourhood, preferring triangles that add the fewest new vertices.
+	// indices[firstIndex, firstIndex + indexCount) is reordered so every meshlet owns one contiguous range.
+	static void Build(const std::vector<FBXVertex>& vertices, std::vector<uint32_t>& indices, uint32_t firstIndex, uint32_t indexCount, std::vector<MeshFileMeshlet>& meshlets);
+
+	// Bounding sphere and normal cone of one range of triangles
+	static void ComputeBounds(const std::vector<FBXVertex>& vertices, const uint32_t* indices, uint32_t indexCount, MeshFileMeshlet* meshlet);
+};
@@ -0,0 +1,236 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+VkResult PipelineCache::Init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path)
+{
+	VkResult result;
+
+	m_device = device;
+	m_path = path;
+
+	vkGetPhysicalDeviceProperties(physicalDevice, &m_properties);
+
+	MappedFile file;
+
+	std::span<const uint8_t> data;
+
+	// A missing cache is the normal cold start, only an existing but unusable one is worth a warning
+	if (std::filesystem::exists(m_path) && file.Open(m_path))
+	{
+		data = file.GetData();
+
+		if (!ValidateHeader(data))
+		{
+			Logger::Warn("DISCARDING PIPELINE CACHE %s", m_path.c_str());
+
+			data = {};
+		}
+	}
+
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	result = vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_cache);
+
+	// The header check cannot catch a corrupted body, let the driver reject it and start cold
+	if (result != VK_SUCCESS && !data.empty())
+	{
+		Logger::Warn("DRIVER REJECTED PIPELINE CACHE %s", m_path.c_str());
+
+		data = {};
+
+		cacheInfo.initialDataSize = 0;
+		cacheInfo.pInitialData = nullptr;
+
+		result = vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_cache);
+	}
+
+	if (result != VK_SUCCESS)
+	{
+		m_cache = VK_NULL_HANDLE;
+
+		return result;
+	}
+
+	m_stats.loaded = !data.empty();
+	m_stats.loadedBytes = data.size();
+
+	Logger::Info("PIPELINE CACHE %s (%llu BYTES)", m_stats.loaded ? "LOADED" : "COLD", (unsigned long long)data.size());
+
+	return VK_SUCCESS;
+}
+
+void PipelineCache::Destroy()
+{
+	if (m_cache == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// Pipelines that were not in the loaded blob grew it
+	if (!m_stats.loaded || GetDataSize() != m_stats.loadedBytes)
+	{
+		Save();
+	}
+
+	vkDestroyPipelineCache(m_device, m_cache, nullptr);
+
+	m_cache = VK_NULL_HANDLE;
+}
+
+VkResult PipelineCache::CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline* pipeline)
+{
+	return CreateTracked([&]() { return vkCreateGraphicsPipelines(m_device, m_cache, 1, &createInfo, nullptr, pipeline); });
+}
+
+VkResult PipelineCache::CreateComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline* pipeline)
+{
+	return CreateTracked([&]() { return vkCreateComputePipelines(m_device, m_cache, 1, &createInfo, nullptr, pipeline); });
+}
+
+VkResult PipelineCache::CreateTracked(const std::function<VkResult()>& create)
+{
+	using Clock = std::chrono::steady_clock;
+
+	Clock::time_point start = Clock::now();
+
+	VkResult result = create();
+
+	uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+	if (result == VK_SUCCESS)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_stats.creations++;
+		m_stats.creationNanoseconds += nanoseconds;
+	}
+
+	return result;
+}
+
+PipelineCacheStats PipelineCache::GetStats()
+{
+	// Vulkan 1.0 has no creation feedback, how much the blob grew since loading tells how much was compiled cold
+	size_t size = GetDataSize();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	PipelineCacheStats stats = m_stats;
+	stats.currentBytes = size;
+
+	return stats;
+}
+
+void PipelineCache::LogStats()
+{
+	PipelineCacheStats stats = GetStats();
+
+	Logger::Info("PIPELINE CACHE %u PIPELINES (%.3f MS), %s START, %llu BYTES LOADED, %llu BYTES NOW",
+		stats.creations, stats.creationNanoseconds / 1e6, stats.loaded ? "WARM" : "COLD",
+		(unsigned long long)stats.loadedBytes, (unsigned long long)stats.currentBytes);
+}
+
+size_t PipelineCache::GetDataSize()
+{
+	size_t size = 0;
+
+	if (m_cache == VK_NULL_HANDLE || vkGetPipelineCacheData(m_device, m_cache, &size, nullptr) != VK_SUCCESS)
+	{
+		return 0;
+	}
+
+	return size;
+}
+
+bool PipelineCache::ValidateHeader(std::span<const uint8_t> data)
+{
+	// Layout of VK_PIPELINE_CACHE_HEADER_VERSION_ONE: length, version, vendorID, deviceID, pipelineCacheUUID
+	struct CacheHeader
+	{
+		uint32_t headerSize;
+		uint32_t headerVersion;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	};
+
+	if (data.size() < sizeof(CacheHeader))
+	{
+		return false;
+	}
+
+	CacheHeader header;
+
+	memcpy(&header, data.data(), sizeof(CacheHeader));
+
+	if (header.headerSize < sizeof(CacheHeader) || header.headerSize > data.size() || header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+	{
+		return false;
+	}
+
+	// A driver update changes the UUID, the old blob would only be rejected or ignored by the driver
+	if (header.vendorID != m_properties.vendorID || header.deviceID != m_properties.deviceID || memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool PipelineCache::Save()
+{
+	VkResult result;
+
+	size_t size = GetDataSize();
+
+	std::vector<char> data(size);
+
+	result = vkGetPipelineCacheData(m_device, m_cache, &size, data.data());
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO GET PIPELINE CACHE DATA");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	// Write next to the destination and rename over it, a crash mid-write never leaves a truncated cache behind
+	std::string temporaryPath = m_path + ".tmp";
+
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+
+		file.write(data.data(), size);
+		file.flush();
+
+		if (!file)
+		{
+			Logger::Error("FAILED TO WRITE PIPELINE CACHE %s", temporaryPath.c_str());
+
+			return false;
+		}
+	}
+
+	std::error_code error;
+
+	std::filesystem::rename(temporaryPath, m_path, error);
+
+	if (error)
+	{
+		Logger::Error("FAILED TO REPLACE PIPELINE CACHE %s", m_path.c_str());
+
+		std::filesystem::remove(temporaryPath, error);
+
+		return false;
+	}
+
+	Logger::Info("PIPELINE CACHE SAVED (%llu BYTES)", (unsigned long long)size);
+
+	return true;
+}
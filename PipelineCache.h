@@ -0,0 +1,61 @@
+#pragma once
+
+struct PipelineCacheStats
+{
+	uint32_t creations = 0;
+	uint64_t creationNanoseconds = 0;
+
+	// False when the run started without a usable blob, every creation was then a cold compile
+	bool loaded = false;
+
+	// Blob size read from disk and the size the driver reports now, a larger blob means pipelines compiled cold
+	uint64_t loadedBytes = 0;
+	uint64_t currentBytes = 0;
+};
+
+// Wraps a VkPipelineCache that survives restarts. The blob is loaded in Init, discarded when its header
+// does not match the current vendor, device and pipelineCacheUUID, and written back atomically in Destroy.
+class PipelineCache
+{
+public:
+	// On failure pipelines are still created, without a cache
+	VkResult Init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path);
+
+	// Saves the cache if it gained any pipelines, then destroys it
+	void Destroy();
+
+	// vkCreateGraphicsPipelines through the cache, timed for the stats
+	VkResult CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline* pipeline);
+
+	VkResult CreateComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline* pipeline);
+
+	VkPipelineCache GetVkPipelineCache() { return m_cache; }
+
+	// Queries the current blob size from the driver, not meant to be called per pipeline
+	PipelineCacheStats GetStats();
+
+	void LogStats();
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	VkPipelineCache m_cache = VK_NULL_HANDLE;
+
+	VkPhysicalDeviceProperties m_properties = {};
+
+	std::string m_path;
+
+	// Creation counts and times, written by every thread creating pipelines
+	PipelineCacheStats m_stats;
+
+	std::mutex m_mutex;
+
+private:
+	// Times one creation
+	VkResult CreateTracked(const std::function<VkResult()>& create);
+
+	bool ValidateHeader(std::span<const uint8_t> data);
+
+	size_t GetDataSize();
+
+	bool Save();
+};
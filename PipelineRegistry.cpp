@@ -0,0 +1,494 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+static constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+static constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+static void HashBytes(uint64_t& hash, const void* data, size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	}
+}
+
+template<typename T>
+static void HashValue(uint64_t& hash, const T& value)
+{
+	HashBytes(hash, &value, sizeof(T));
+}
+
+PipelineKey GraphicsPipelineDesc::Hash() const
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+
+	// Strings and arrays are hashed with their length so adjacent fields cannot alias each other
+	HashValue(hash, vertexShader.size());
+	HashBytes(hash, vertexShader.data(), vertexShader.size());
+	HashValue(hash, fragmentShader.size());
+	HashBytes(hash, fragmentShader.data(), fragmentShader.size());
+
+	HashValue(hash, vertexBindings.size());
+	HashBytes(hash, vertexBindings.data(), vertexBindings.size() * sizeof(VkVertexInputBindingDescription));
+	HashValue(hash, vertexAttributes.size());
+	HashBytes(hash, vertexAttributes.data(), vertexAttributes.size() * sizeof(VkVertexInputAttributeDescription));
+
+	HashValue(hash, topology);
+	HashValue(hash, polygonMode);
+	HashValue(hash, cullMode);
+	HashValue(hash, frontFace);
+
+	HashValue(hash, depthTest);
+	HashValue(hash, depthWrite);
+	HashValue(hash, depthCompareOp);
+
+	HashValue(hash, blendEnable);
+	HashValue(hash, srcColorBlendFactor);
+	HashValue(hash, dstColorBlendFactor);
+	HashValue(hash, colorBlendOp);
+	HashValue(hash, srcAlphaBlendFactor);
+	HashValue(hash, dstAlphaBlendFactor);
+	HashValue(hash, alphaBlendOp);
+	HashValue(hash, colorWriteMask);
+	HashValue(hash, colorAttachmentCount);
+
+	HashValue(hash, layout);
+	HashValue(hash, renderPass);
+	HashValue(hash, subpass);
+
+	return hash;
+}
+
+bool GraphicsPipelineDesc::operator==(const GraphicsPipelineDesc& other) const
+{
+	return vertexShader == other.vertexShader
+		&& fragmentShader == other.fragmentShader
+		&& vertexBindings.size() == other.vertexBindings.size()
+		&& memcmp(vertexBindings.data(), other.vertexBindings.data(), vertexBindings.size() * sizeof(VkVertexInputBindingDescription)) == 0
+		&& vertexAttributes.size() == other.vertexAttributes.size()
+		&& memcmp(vertexAttributes.data(), other.vertexAttributes.data(), vertexAttributes.size() * sizeof(VkVertexInputAttributeDescription)) == 0
+		&& topology == other.topology
+		&& polygonMode == other.polygonMode
+		&& cullMode == other.cullMode
+		&& frontFace == other.frontFace
+		&& depthTest == other.depthTest
+		&& depthWrite == other.depthWrite
+		&& depthCompareOp == other.depthCompareOp
+		&& blendEnable == other.blendEnable
+		&& srcColorBlendFactor == other.srcColorBlendFactor
+		&& dstColorBlendFactor == other.dstColorBlendFactor
+		&& colorBlendOp == other.colorBlendOp
+		&& srcAlphaBlendFactor == other.srcAlphaBlendFactor
+		&& dstAlphaBlendFactor == other.dstAlphaBlendFactor
+		&& alphaBlendOp == other.alphaBlendOp
+		&& colorWriteMask == other.colorWriteMask
+		&& colorAttachmentCount == other.colorAttachmentCount
+		&& layout == other.layout
+		&& renderPass == other.renderPass
+		&& subpass == other.subpass;
+}
+
+void PipelineRegistry::Init(VkDevice device, PipelineCache* pipelineCache)
+{
+	m_device = device;
+	m_pipelineCache = pipelineCache;
+}
+
+void PipelineRegistry::Destroy()
+{
+	SetBackgroundCompile(false);
+
+	for (auto& [key, entry] : m_pipelines)
+	{
+		if (entry.pipeline != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(m_device, entry.pipeline, nullptr);
+		}
+	}
+
+	for (auto& [path, shaderModule] : m_shaderModules)
+	{
+		vkDestroyShaderModule(m_device, shaderModule, nullptr);
+	}
+
+	m_pipelines.clear();
+	m_shaderModules.clear();
+}
+
+PipelineKey PipelineRegistry::Register(const GraphicsPipelineDesc& desc)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	PipelineKey key = desc.Hash();
+
+	// Probe past the rare 64 bit collision so two different descriptions never share a pipeline
+	for (auto it = m_pipelines.find(key); it != m_pipelines.end(); it = m_pipelines.find(++key))
+	{
+		if (it->second.desc == desc)
+		{
+			return key;
+		}
+	}
+
+	m_pipelines[key].desc = desc;
+
+	return key;
+}
+
+VkPipeline PipelineRegistry::GetPipeline(PipelineKey key)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	auto it = m_pipelines.find(key);
+
+	if (it == m_pipelines.end())
+	{
+		Logger::Error("UNKNOWN PIPELINE KEY %016llx", (unsigned long long)key);
+
+		return VK_NULL_HANDLE;
+	}
+
+	PipelineEntry& entry = it->second;
+
+	if (entry.state == PipelineState::Ready || entry.state == PipelineState::Failed)
+	{
+		return entry.pipeline;
+	}
+
+	if (m_backgroundCompile)
+	{
+		if (entry.state == PipelineState::Registered)
+		{
+			entry.state = PipelineState::Queued;
+
+			m_compileQueue.push_back(key);
+			m_compileCondition.notify_one();
+		}
+
+		return VK_NULL_HANDLE;
+	}
+
+	// Synchronous first use, another thread may already be compiling it
+	if (entry.state != PipelineState::Registered)
+	{
+		m_readyCondition.wait(lock, [&entry]() { return entry.state == PipelineState::Ready || entry.state == PipelineState::Failed; });
+
+		return entry.pipeline;
+	}
+
+	entry.state = PipelineState::Compiling;
+
+	GraphicsPipelineDesc desc = entry.desc;
+
+	lock.unlock();
+
+	VkPipeline pipeline = Compile(desc);
+
+	lock.lock();
+
+	// Entries are never erased and unordered_map keeps element references stable across rehashes
+	entry.pipeline = pipeline;
+	entry.state = pipeline != VK_NULL_HANDLE ? PipelineState::Ready : PipelineState::Failed;
+
+	m_readyCondition.notify_all();
+
+	return pipeline;
+}
+
+void PipelineRegistry::Prewarm(PipelineKey key)
+{
+	// With background compilation this only queues the compile and returns right away
+	GetPipeline(key);
+}
+
+void PipelineRegistry::SetBackgroundCompile(bool enabled)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (enabled == m_backgroundCompile)
+	{
+		return;
+	}
+
+	m_backgroundCompile = enabled;
+
+	if (enabled)
+	{
+		m_stopWorker = false;
+		m_worker = std::thread(&PipelineRegistry::WorkerLoop, this);
+
+		return;
+	}
+
+	m_stopWorker = true;
+	m_compileCondition.notify_all();
+
+	lock.unlock();
+
+	m_worker.join();
+
+	lock.lock();
+
+	// Pipelines that never reached the worker go back to compiling on first use
+	for (PipelineKey key : m_compileQueue)
+	{
+		m_pipelines[key].state = PipelineState::Registered;
+	}
+
+	m_compileQueue.clear();
+}
+
+uint32_t PipelineRegistry::GetPipelineCount()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return static_cast<uint32_t>(m_pipelines.size());
+}
+
+void PipelineRegistry::WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (true)
+	{
+		m_compileCondition.wait(lock, [this]() { return m_stopWorker || !m_compileQueue.empty(); });
+
+		if (m_stopWorker)
+		{
+			return;
+		}
+
+		PipelineKey key = m_compileQueue.front();
+		m_compileQueue.pop_front();
+
+		m_pipelines[key].state = PipelineState::Compiling;
+
+		GraphicsPipelineDesc desc = m_pipelines[key].desc;
+
+		lock.unlock();
+
+		VkPipeline pipeline = Compile(desc);
+
+		lock.lock();
+
+		m_pipelines[key].pipeline = pipeline;
+		m_pipelines[key].state = pipeline != VK_NULL_HANDLE ? PipelineState::Ready : PipelineState::Failed;
+
+		m_readyCondition.notify_all();
+	}
+}
+
+VkPipeline PipelineRegistry::Compile(const GraphicsPipelineDesc& desc)
+{
+	VkResult result;
+
+	bool depthOnly = desc.fragmentShader.empty();
+
+	VkShaderModule vertexShaderModule = GetShaderModule(desc.vertexShader);
+	VkShaderModule fragmentShaderModule = depthOnly ? VK_NULL_HANDLE : GetShaderModule(desc.fragmentShader);
+
+	if (vertexShaderModule == VK_NULL_HANDLE || (!depthOnly && fragmentShaderModule == VK_NULL_HANDLE))
+	{
+		return VK_NULL_HANDLE;
+	}
+
+	VkPipelineShaderStageCreateInfo vertexShaderStageInfo{};
+	vertexShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertexShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	vertexShaderStageInfo.module = vertexShaderModule;
+	vertexShaderStageInfo.pName = "main";
+
+	VkPipelineShaderStageCreateInfo fragmentShaderStageInfo{};
+	fragmentShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	fragmentShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	fragmentShaderStageInfo.module = fragmentShaderModule;
+	fragmentShaderStageInfo.pName = "main";
+
+	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderStageInfo, fragmentShaderStageInfo };
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexBindings.size());
+	vertexInputInfo.pVertexBindingDescriptions = desc.vertexBindings.data();
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexAttributes.size());
+	vertexInputInfo.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = desc.topology;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	VkPipelineViewportStateCreateInfo viewportState{};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = desc.polygonMode;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = desc.cullMode;
+	rasterizer.frontFace = desc.frontFace;
+	rasterizer.depthBiasEnable = VK_FALSE;
+	rasterizer.depthBiasConstantFactor = 0.0f;
+	rasterizer.depthBiasClamp = 0.0f;
+	rasterizer.depthBiasSlopeFactor = 0.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	multisampling.minSampleShading = 1.0f;
+	multisampling.pSampleMask = nullptr;
+	multisampling.alphaToCoverageEnable = VK_FALSE;
+	multisampling.alphaToOneEnable = VK_FALSE;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;
+	depthStencil.depthWriteEnable = desc.depthWrite ? VK_TRUE : VK_FALSE;
+	depthStencil.depthCompareOp = desc.depthCompareOp;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.stencilTestEnable = VK_FALSE;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = desc.colorWriteMask;
+	colorBlendAttachment.blendEnable = desc.blendEnable ? VK_TRUE : VK_FALSE;
+	colorBlendAttachment.srcColorBlendFactor = desc.srcColorBlendFactor;
+	colorBlendAttachment.dstColorBlendFactor = desc.dstColorBlendFactor;
+	colorBlendAttachment.colorBlendOp = desc.colorBlendOp;
+	colorBlendAttachment.srcAlphaBlendFactor = desc.srcAlphaBlendFactor;
+	colorBlendAttachment.dstAlphaBlendFactor = desc.dstAlphaBlendFactor;
+	colorBlendAttachment.alphaBlendOp = desc.alphaBlendOp;
+
+	std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments(desc.colorAttachmentCount, colorBlendAttachment);
+
+	VkPipelineColorBlendStateCreateInfo colorBlending{};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY;
+	colorBlending.attachmentCount = desc.colorAttachmentCount;
+	colorBlending.pAttachments = colorBlendAttachments.data();
+	colorBlending.blendConstants[0] = 0.0f;
+	colorBlending.blendConstants[1] = 0.0f;
+	colorBlending.blendConstants[2] = 0.0f;
+	colorBlending.blendConstants[3] = 0.0f;
+
+	std::vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicState.pDynamicStates = dynamicStates.data();
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	// Without a fragment stage only depth is written, which is all a depth pre-pass needs
+	pipelineInfo.stageCount = depthOnly ? 1 : 2;
+	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = desc.layout;
+	pipelineInfo.renderPass = desc.renderPass;
+	pipelineInfo.subpass = desc.subpass;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	result = m_pipelineCache->CreateGraphicsPipeline(pipelineInfo, &pipeline);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE GRAPHICS PIPELINE (%s, %s)", desc.vertexShader.c_str(), desc.fragmentShader.c_str());
+		Logger::Error("%s", string_VkResult(result));
+
+		return VK_NULL_HANDLE;
+	}
+
+	Logger::Info("GRAPHICS PIPELINE CREATED SUCCESSFULLY (%s, %s)", desc.vertexShader.c_str(), desc.fragmentShader.c_str());
+
+	return pipeline;
+}
+
+VkShaderModule PipelineRegistry::GetShaderModule(const std::string& path)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto it = m_shaderModules.find(path);
+
+		if (it != m_shaderModules.end())
+		{
+			return it->second;
+		}
+	}
+
+	MappedFile file;
+
+	// A missing shader only fails the pipelines that use it
+	if (!file.Open(path))
+	{
+		Logger::Error("FAILED TO LOAD SHADER %s", path.c_str());
+
+		return VK_NULL_HANDLE;
+	}
+
+	// The driver copies the SPIR-V straight out of the mapped view
+	VkShaderModule shaderModule = CreateShaderModule(file.GetData());
+
+	if (shaderModule == VK_NULL_HANDLE)
+	{
+		return VK_NULL_HANDLE;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Two threads may have loaded the same module, keep the first one
+	auto [it, inserted] = m_shaderModules.emplace(path, shaderModule);
+
+	if (!inserted)
+	{
+		vkDestroyShaderModule(m_device, shaderModule, nullptr);
+	}
+
+	return it->second;
+}
+
+VkShaderModule PipelineRegistry::CreateShaderModule(std::span<const uint8_t> code)
+{
+	// SPIR-V is a stream of 32 bit words, mapped views and heap buffers are both aligned well enough
+	if (code.empty() || code.size() % sizeof(uint32_t) != 0 || reinterpret_cast<uintptr_t>(code.data()) % alignof(uint32_t) != 0)
+	{
+		Logger::Error("INVALID SPIR-V CODE (%llu BYTES)", (unsigned long long)code.size());
+
+		return VK_NULL_HANDLE;
+	}
+
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = code.size();
+	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+
+	if (vkCreateShaderModule(m_device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE SHADER MODULE");
+
+		return VK_NULL_HANDLE;
+	}
+
+	return shaderModule;
+}
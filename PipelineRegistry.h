@@ -0,0 +1,110 @@
+#pragma once
+
+using PipelineKey = uint64_t;
+
+// Everything that goes into a graphics pipeline except viewport and scissor, which are always dynamic.
+// Two descriptions that compare equal share one VkPipeline.
+struct GraphicsPipelineDesc
+{
+	std::string vertexShader;
+
+	// Empty for depth-only pipelines
+	std::string fragmentShader;
+
+	std::vector<VkVertexInputBindingDescription> vertexBindings;
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+	bool depthTest = false;
+	bool depthWrite = false;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+
+	bool blendEnable = false;
+	VkBlendFactor srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	VkBlendFactor dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+	VkBlendOp colorBlendOp = VK_BLEND_OP_ADD;
+	VkBlendFactor srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	VkBlendFactor dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	VkBlendOp alphaBlendOp = VK_BLEND_OP_ADD;
+	VkColorComponentFlags colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	// Must match the subpass, every color attachment shares the blend state above
+	uint32_t colorAttachmentCount = 1;
+
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+
+	PipelineKey Hash() const;
+
+	bool operator==(const GraphicsPipelineDesc& other) const;
+};
+
+// Deduplicates pipeline descriptions and compiles each unique one on first use, through the persistent pipeline cache.
+// With background compilation enabled, first use queues the compile on a worker thread and draws are skipped until it is ready.
+class PipelineRegistry
+{
+public:
+	void Init(VkDevice device, PipelineCache* pipelineCache);
+	void Destroy();
+
+	// Returns the key of an equal description if one was registered before, nothing is compiled yet
+	PipelineKey Register(const GraphicsPipelineDesc& desc);
+
+	// Compiles the pipeline if needed. Returns VK_NULL_HANDLE while a background compile is still running or if it failed.
+	VkPipeline GetPipeline(PipelineKey key);
+
+	// Starts compiling ahead of the first GetPipeline, on the worker thread when background compilation is enabled
+	void Prewarm(PipelineKey key);
+
+	void SetBackgroundCompile(bool enabled);
+
+	uint32_t GetPipelineCount();
+
+private:
+	enum class PipelineState
+	{
+		Registered, Queued, Compiling, Ready, Failed
+	};
+
+	struct PipelineEntry
+	{
+		GraphicsPipelineDesc desc;
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+
+		PipelineState state = PipelineState::Registered;
+	};
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+
+	PipelineCache* m_pipelineCache = nullptr;
+
+	std::unordered_map<PipelineKey, PipelineEntry> m_pipelines;
+	std::unordered_map<std::string, VkShaderModule> m_shaderModules;
+
+	bool m_backgroundCompile = false;
+	bool m_stopWorker = false;
+
+	std::thread m_worker;
+	std::deque<PipelineKey> m_compileQueue;
+	std::condition_variable m_compileCondition;
+	std::condition_variable m_readyCondition;
+
+	std::mutex m_mutex;
+
+private:
+	void WorkerLoop();
+
+	// Called without the lock held, the desc is a copy so registration can continue meanwhile
+	VkPipeline Compile(const GraphicsPipelineDesc& desc);
+
+	VkShaderModule GetShaderModule(const std::string& path);
+	VkShaderModule CreateShaderModule(std::span<const uint8_t> code);
+};
@@ -0,0 +1,924 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+static constexpr VkAccessFlags WRITE_ACCESS_MASK = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+bool RenderGraph::Init(VkDevice device, MemoryAllocator* allocator, std::function<void(std::function<void()>)> deferRelease)
+{
+	m_device = device;
+	m_allocator = allocator;
+	m_deferRelease = std::move(deferRelease);
+
+	return true;
+}
+
+void RenderGraph::Destroy()
+{
+	ReleaseObjects(true);
+
+	m_resources.clear();
+	m_passes.clear();
+	m_executionOrder.clear();
+}
+
+void RenderGraph::Reset()
+{
+	ReleaseObjects(false);
+
+	m_resources.clear();
+	m_passes.clear();
+	m_executionOrder.clear();
+}
+
+RenderGraphResource RenderGraph::ImportImage(const char* name, VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect, VkImageLayout initialLayout, VkPipelineStageFlags initialStage, VkImageLayout finalLayout)
+{
+	Resource resource;
+	resource.name = name;
+	resource.imported = true;
+	resource.format = format;
+	resource.extent = extent;
+	resource.aspect = aspect;
+	resource.initialLayout = initialLayout;
+	resource.initialStage = initialStage;
+	resource.finalLayout = finalLayout;
+
+	m_resources.push_back(std::move(resource));
+
+	return static_cast<RenderGraphResource>(m_resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::CreateImage(const char* name, const RenderGraphImageDesc& desc)
+{
+	Resource resource;
+	resource.name = name;
+	resource.format = desc.format;
+	resource.extent = desc.extent;
+	resource.aspect = desc.aspect;
+	resource.usage = desc.usage;
+
+	m_resources.push_back(std::move(resource));
+
+	return static_cast<RenderGraphResource>(m_resources.size() - 1);
+}
+
+uint32_t RenderGraph::AddPass(const char* name, std::function<void(const RenderGraphPassContext&)> execute)
+{
+	Pass pass;
+	pass.name = name;
+	pass.execute = std::move(execute);
+
+	m_passes.push_back(std::move(pass));
+
+	return static_cast<uint32_t>(m_passes.size() - 1);
+}
+
+void RenderGraph::UseImage(uint32_t pass, RenderGraphResource resource, RenderGraphAccess access, VkAttachmentLoadOp loadOp, VkClearValue clearValue)
+{
+	ImageUse use;
+	use.resource = resource;
+	use.access = access;
+	use.loadOp = IsAttachment(access) ? loadOp : VK_ATTACHMENT_LOAD_OP_LOAD;
+	use.clearValue = clearValue;
+
+	// A read-only attachment has to keep what an earlier pass wrote
+	if (access == RenderGraphAccess::DepthRead)
+	{
+		use.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	}
+
+	m_passes[pass].uses.push_back(use);
+}
+
+void RenderGraph::SetSideEffects(uint32_t pass)
+{
+	m_passes[pass].sideEffects = true;
+}
+
+bool RenderGraph::Compile()
+{
+	CullPasses();
+
+	for (uint32_t order = 0; order < m_executionOrder.size(); order++)
+	{
+		for (const ImageUse& use : m_passes[m_executionOrder[order]].uses)
+		{
+			Resource& resource = m_resources[use.resource];
+
+			if (resource.firstUse == UINT32_MAX)
+			{
+				resource.firstUse = order;
+			}
+
+			resource.lastUse = order;
+			resource.usage |= GetAccessUsage(use.access);
+		}
+	}
+
+	// Attachment contents only need to reach memory when something after the pass may look at them
+	for (uint32_t order = 0; order < m_executionOrder.size(); order++)
+	{
+		for (ImageUse& use : m_passes[m_executionOrder[order]].uses)
+		{
+			const Resource& resource = m_resources[use.resource];
+
+			use.storeOp = resource.imported || resource.lastUse > order ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		}
+	}
+
+	if (!CreateTransientImages())
+	{
+		return false;
+	}
+
+	for (uint32_t passIndex : m_executionOrder)
+	{
+		if (!CreateRenderPass(m_passes[passIndex]))
+		{
+			return false;
+		}
+	}
+
+	Logger::Info("RENDER GRAPH COMPILED <%u OF %u PASSES, %llu KB TRANSIENT MEMORY>", GetLivePassCount(), static_cast<uint32_t>(m_passes.size()), (unsigned long long)(m_transientBytes >> 10));
+
+	return true;
+}
+
+void RenderGraph::SetImportedImage(RenderGraphResource resource, VkImage image, VkImageView view)
+{
+	m_resources[resource].image = image;
+	m_resources[resource].view = view;
+}
+
+VkImageView RenderGraph::GetSampledView(RenderGraphResource resource)
+{
+	const Resource& image = m_resources[resource];
+
+	return image.sampledView != VK_NULL_HANDLE ? image.sampledView : image.view;
+}
+
+VkRenderPass RenderGraph::GetRenderPass(uint32_t pass)
+{
+	return m_passes[pass].renderPass;
+}
+
+VkFramebuffer RenderGraph::GetFramebuffer(uint32_t pass)
+{
+	return FindFramebuffer(m_passes[pass]);
+}
+
+void RenderGraph::SetSubpassContents(uint32_t pass, VkSubpassContents contents)
+{
+	m_passes[pass].contents = contents;
+}
+
+void RenderGraph::Execute(VkCommandBuffer commandBuffer)
+{
+	for (Resource& resource : m_resources)
+	{
+		// Whatever the image went through last frame, it comes back from outside in its initial layout
+		if (resource.imported)
+		{
+			resource.state.layout = resource.initialLayout;
+			resource.state.stages = resource.initialStage;
+			resource.state.access = 0;
+			resource.state.written = false;
+		}
+	}
+
+	for (uint32_t order = 0; order < m_executionOrder.size(); order++)
+	{
+		Pass& pass = m_passes[m_executionOrder[order]];
+
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+
+		m_barriers.clear();
+
+		for (const ImageUse& use : pass.uses)
+		{
+			const Resource& resource = m_resources[use.resource];
+
+			// Transient contents never survive the frame, and an aliased image may have clobbered the memory since
+			bool discard = !resource.imported && resource.firstUse == order;
+
+			AddBarrier(use.resource, GetAccessState(use.access), discard, &srcStages, &dstStages);
+		}
+
+		if (dstStages != 0)
+		{
+			vkCmdPipelineBarrier(commandBuffer, srcStages != 0 ? srcStages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT), dstStages, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(m_barriers.size()), m_barriers.data());
+		}
+
+		RenderGraphPassContext context;
+		context.commandBuffer = commandBuffer;
+		context.renderPass = pass.renderPass;
+		context.extent = pass.extent;
+
+		if (pass.renderPass == VK_NULL_HANDLE)
+		{
+			pass.execute(context);
+
+			continue;
+		}
+
+		context.framebuffer = FindFramebuffer(pass);
+
+		m_clearValues.clear();
+
+		for (const ImageUse& use : pass.uses)
+		{
+			if (IsAttachment(use.access))
+			{
+				m_clearValues.push_back(use.clearValue);
+			}
+		}
+
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = pass.renderPass;
+		renderPassInfo.framebuffer = context.framebuffer;
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = pass.extent;
+		renderPassInfo.clearValueCount = static_cast<uint32_t>(m_clearValues.size());
+		renderPassInfo.pClearValues = m_clearValues.data();
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, pass.contents);
+
+		pass.execute(context);
+
+		vkCmdEndRenderPass(commandBuffer);
+
+		pass.contents = VK_SUBPASS_CONTENTS_INLINE;
+	}
+
+	// Hands imported images back in the layout their owner expects, e.g. for presentation
+	VkPipelineStageFlags srcStages = 0;
+
+	m_barriers.clear();
+
+	for (Resource& resource : m_resources)
+	{
+		if (!resource.imported || resource.firstUse == UINT32_MAX || resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || resource.finalLayout == resource.state.layout)
+		{
+			continue;
+		}
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = resource.state.access & WRITE_ACCESS_MASK;
+		barrier.dstAccessMask = 0;
+		barrier.oldLayout = resource.state.layout;
+		barrier.newLayout = resource.finalLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = resource.image;
+		barrier.subresourceRange = { resource.aspect, 0, 1, 0, 1 };
+
+		m_barriers.push_back(barrier);
+
+		srcStages |= resource.state.stages;
+
+		resource.state.layout = resource.finalLayout;
+	}
+
+	if (!m_barriers.empty())
+	{
+		vkCmdPipelineBarrier(commandBuffer, srcStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(m_barriers.size()), m_barriers.data());
+	}
+}
+
+bool RenderGraph::IsAttachment(RenderGraphAccess access)
+{
+	return access == RenderGraphAccess::ColorAttachment || access == RenderGraphAccess::DepthAttachment || access == RenderGraphAccess::DepthRead;
+}
+
+bool RenderGraph::IsWrite(RenderGraphAccess access)
+{
+	return GetAccessState(access).written;
+}
+
+bool RenderGraph::ReadsContents(const ImageUse& use)
+{
+	switch (use.access)
+	{
+	case RenderGraphAccess::ColorAttachment:
+	case RenderGraphAccess::DepthAttachment:
+		return use.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+	case RenderGraphAccess::TransferDst:
+		return false;
+	default:
+		// Storage writes may be partial, so what was there before still matters
+		return true;
+	}
+}
+
+RenderGraph::ResourceState RenderGraph::GetAccessState(RenderGraphAccess access)
+{
+	switch (access)
+	{
+	case RenderGraphAccess::ColorAttachment:
+		return { VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, true };
+	case RenderGraphAccess::DepthAttachment:
+		return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, true };
+	case RenderGraphAccess::DepthRead:
+		return { VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, false };
+	case RenderGraphAccess::Sampled:
+		return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, false };
+	case RenderGraphAccess::StorageRead:
+		return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, false };
+	case RenderGraphAccess::StorageWrite:
+		return { VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, true };
+	case RenderGraphAccess::TransferSrc:
+		return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, false };
+	case RenderGraphAccess::TransferDst:
+		return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, true };
+	}
+
+	return {};
+}
+
+VkImageUsageFlags RenderGraph::GetAccessUsage(RenderGraphAccess access)
+{
+	switch (access)
+	{
+	case RenderGraphAccess::ColorAttachment:
+		return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	case RenderGraphAccess::DepthAttachment:
+	case RenderGraphAccess::DepthRead:
+		return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	case RenderGraphAccess::Sampled:
+		return VK_IMAGE_USAGE_SAMPLED_BIT;
+	case RenderGraphAccess::StorageRead:
+	case RenderGraphAccess::StorageWrite:
+		return VK_IMAGE_USAGE_STORAGE_BIT;
+	case RenderGraphAccess::TransferSrc:
+		return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	case RenderGraphAccess::TransferDst:
+		return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	}
+
+	return 0;
+}
+
+void RenderGraph::CullPasses()
+{
+	// Walks the passes backwards: a pass is needed if it writes something a needed pass reads after it
+	std::vector<bool> needed(m_resources.size(), false);
+
+	for (uint32_t i = static_cast<uint32_t>(m_passes.size()); i-- > 0;)
+	{
+		Pass& pass = m_passes[i];
+
+		pass.live = pass.sideEffects;
+
+		for (const ImageUse& use : pass.uses)
+		{
+			if (IsWrite(use.access) && (m_resources[use.resource].imported || needed[use.resource]))
+			{
+				pass.live = true;
+			}
+		}
+
+		if (!pass.live)
+		{
+			continue;
+		}
+
+		// A full overwrite ends the chain, earlier writers of the image are no longer needed for it
+		for (const ImageUse& use : pass.uses)
+		{
+			if (IsWrite(use.access) && !ReadsContents(use))
+			{
+				needed[use.resource] = false;
+			}
+		}
+
+		for (const ImageUse& use : pass.uses)
+		{
+			if (ReadsContents(use))
+			{
+				needed[use.resource] = true;
+			}
+		}
+	}
+
+	m_executionOrder.clear();
+
+	for (uint32_t i = 0; i < m_passes.size(); i++)
+	{
+		if (m_passes[i].live)
+		{
+			m_executionOrder.push_back(i);
+		}
+		else
+		{
+			CDNL_LOG_TRACE("RENDER GRAPH CULLED PASS <%s>", m_passes[i].name.c_str());
+		}
+	}
+}
+
+bool RenderGraph::CreateTransientImages()
+{
+	struct Placement
+	{
+		RenderGraphResource resource;
+		VkMemoryRequirements requirements;
+	};
+
+	std::vector<Placement> placements;
+
+	VkDeviceSize unaliasedBytes = 0;
+
+	for (uint32_t i = 0; i < m_resources.size(); i++)
+	{
+		Resource& resource = m_resources[i];
+
+		// Unused transient images are never created
+		if (resource.imported || resource.firstUse == UINT32_MAX)
+		{
+			continue;
+		}
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = resource.format;
+		imageInfo.extent = { resource.extent.width, resource.extent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = resource.usage;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		VkResult result = vkCreateImage(m_device, &imageInfo, nullptr, &resource.image);
+
+		if (result != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO CREATE RENDER GRAPH IMAGE <%s>", resource.name.c_str());
+			Logger::Error("%s", string_VkResult(result));
+
+			return false;
+		}
+
+		Placement placement;
+		placement.resource = i;
+
+		vkGetImageMemoryRequirements(m_device, resource.image, &placement.requirements);
+
+		resource.size = placement.requirements.size;
+		unaliasedBytes += placement.requirements.size;
+
+		placements.push_back(placement);
+	}
+
+	// Largest first keeps the heap tight, smaller images fill the gaps next to them
+	std::stable_sort(placements.begin(), placements.end(), [](const Placement& a, const Placement& b) { return a.requirements.size > b.requirements.size; });
+
+	// Images that disagree on memory types cannot share an allocation, each distinct set gets its own heap
+	std::vector<uint32_t> heapTypes;
+
+	for (const Placement& placement : placements)
+	{
+		if (std::find(heapTypes.begin(), heapTypes.end(), placement.requirements.memoryTypeBits) == heapTypes.end())
+		{
+			heapTypes.push_back(placement.requirements.memoryTypeBits);
+		}
+	}
+
+	m_transientBytes = 0;
+
+	for (uint32_t memoryTypeBits : heapTypes)
+	{
+		std::vector<const Placement*> placed;
+
+		VkMemoryRequirements heapRequirements{};
+		heapRequirements.alignment = 1;
+		heapRequirements.memoryTypeBits = memoryTypeBits;
+
+		for (const Placement& placement : placements)
+		{
+			if (placement.requirements.memoryTypeBits != memoryTypeBits)
+			{
+				continue;
+			}
+
+			Resource& resource = m_resources[placement.resource];
+
+			VkDeviceSize offset = 0;
+			bool moved = true;
+
+			// Lowest offset that does not collide with an image alive at the same time
+			while (moved)
+			{
+				moved = false;
+
+				for (const Placement* other : placed)
+				{
+					const Resource& otherResource = m_resources[other->resource];
+
+					bool overlapsInTime = resource.firstUse <= otherResource.lastUse && otherResource.firstUse <= resource.lastUse;
+					bool overlapsInMemory = offset < otherResource.offset + otherResource.size && otherResource.offset < offset + resource.size;
+
+					if (overlapsInTime && overlapsInMemory)
+					{
+						offset = AlignUp(otherResource.offset + otherResource.size, placement.requirements.alignment);
+						moved = true;
+					}
+				}
+			}
+
+			resource.offset = offset;
+
+			for (const Placement* other : placed)
+			{
+				Resource& otherResource = m_resources[other->resource];
+
+				if (offset < otherResource.offset + otherResource.size && otherResource.offset < offset + resource.size)
+				{
+					resource.aliases.push_back(other->resource);
+					otherResource.aliases.push_back(placement.resource);
+				}
+			}
+
+			heapRequirements.size = (std::max)(heapRequirements.size, offset + resource.size);
+			heapRequirements.alignment = (std::max)(heapRequirements.alignment, placement.requirements.alignment);
+
+			placed.push_back(&placement);
+		}
+
+		MemoryAllocation allocation;
+
+		if (!m_allocator->Allocate(heapRequirements, MemoryUsage::GpuOnly, AllocationKind::Optimal, &allocation))
+		{
+			Logger::Error("FAILED TO ALLOCATE RENDER GRAPH MEMORY");
+
+			return false;
+		}
+
+		m_transientMemory.push_back(allocation);
+		m_transientBytes += heapRequirements.size;
+
+		for (const Placement* placement : placed)
+		{
+			Resource& resource = m_resources[placement->resource];
+
+			VkResult result = vkBindImageMemory(m_device, resource.image, allocation.memory, allocation.offset + resource.offset);
+
+			if (result != VK_SUCCESS)
+			{
+				Logger::Error("FAILED TO BIND RENDER GRAPH IMAGE MEMORY <%s>", resource.name.c_str());
+				Logger::Error("%s", string_VkResult(result));
+
+				return false;
+			}
+
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = resource.image;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = resource.format;
+			viewInfo.subresourceRange = { resource.aspect, 0, 1, 0, 1 };
+
+			result = vkCreateImageView(m_device, &viewInfo, nullptr, &resource.view);
+
+			if (result != VK_SUCCESS)
+			{
+				Logger::Error("FAILED TO CREATE RENDER GRAPH IMAGE VIEW <%s>", resource.name.c_str());
+				Logger::Error("%s", string_VkResult(result));
+
+				return false;
+			}
+
+			VkImageAspectFlags depthStencil = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+
+			if ((resource.aspect & depthStencil) == depthStencil && (resource.usage & VK_IMAGE_USAGE_SAMPLED_BIT) != 0)
+			{
+				viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+				result = vkCreateImageView(m_device, &viewInfo, nullptr, &resource.sampledView);
+
+				if (result != VK_SUCCESS)
+				{
+					Logger::Error("FAILED TO CREATE RENDER GRAPH SAMPLED VIEW <%s>", resource.name.c_str());
+					Logger::Error("%s", string_VkResult(result));
+
+					return false;
+				}
+			}
+		}
+	}
+
+	if (!placements.empty())
+	{
+		Logger::Info("RENDER GRAPH TRANSIENT IMAGES: %u, %llu KB ALIASED INTO %llu KB", static_cast<uint32_t>(placements.size()), (unsigned long long)(unaliasedBytes >> 10), (unsigned long long)(m_transientBytes >> 10));
+	}
+
+	return true;
+}
+
+bool RenderGraph::CreateRenderPass(Pass& pass)
+{
+	std::vector<VkAttachmentDescription> attachments;
+	std::vector<VkAttachmentReference> colorReferences;
+
+	VkAttachmentReference depthReference{};
+	bool hasDepth = false;
+
+	for (const ImageUse& use : pass.uses)
+	{
+		if (!IsAttachment(use.access))
+		{
+			continue;
+		}
+
+		const Resource& resource = m_resources[use.resource];
+
+		if (attachments.empty())
+		{
+			pass.extent = resource.extent;
+		}
+		else if (resource.extent.width != pass.extent.width || resource.extent.height != pass.extent.height)
+		{
+			Logger::Error("RENDER GRAPH PASS <%s> HAS ATTACHMENTS OF DIFFERENT SIZES", pass.name.c_str());
+
+			return false;
+		}
+
+		VkImageLayout layout = GetAccessState(use.access).layout;
+
+		// Layout transitions happen in the graph's barriers, so the render pass itself never changes layouts
+		VkAttachmentDescription attachment{};
+		attachment.format = resource.format;
+		attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		attachment.loadOp = use.loadOp;
+		attachment.storeOp = use.storeOp;
+		attachment.stencilLoadOp = (resource.aspect & VK_IMAGE_ASPECT_STENCIL_BIT) ? use.loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.stencilStoreOp = (resource.aspect & VK_IMAGE_ASPECT_STENCIL_BIT) ? use.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.initialLayout = layout;
+		attachment.finalLayout = layout;
+
+		VkAttachmentReference reference{};
+		reference.attachment = static_cast<uint32_t>(attachments.size());
+		reference.layout = layout;
+
+		attachments.push_back(attachment);
+
+		if (use.access == RenderGraphAccess::ColorAttachment)
+		{
+			colorReferences.push_back(reference);
+		}
+		else if (!hasDepth)
+		{
+			depthReference = reference;
+			hasDepth = true;
+		}
+		else
+		{
+			Logger::Error("RENDER GRAPH PASS <%s> HAS MORE THAN ONE DEPTH ATTACHMENT", pass.name.c_str());
+
+			return false;
+		}
+	}
+
+	if (attachments.empty())
+	{
+		return true;
+	}
+
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+	subpass.pColorAttachments = colorReferences.data();
+	subpass.pDepthStencilAttachment = hasDepth ? &depthReference : nullptr;
+
+	VkRenderPassCreateInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassInfo.pAttachments = attachments.data();
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+
+	VkResult result = vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &pass.renderPass);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE RENDER GRAPH RENDER PASS <%s>", pass.name.c_str());
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	return true;
+}
+
+VkFramebuffer RenderGraph::FindFramebuffer(Pass& pass)
+{
+	if (pass.renderPass == VK_NULL_HANDLE)
+	{
+		return VK_NULL_HANDLE;
+	}
+
+	std::vector<VkImageView> views;
+
+	for (const ImageUse& use : pass.uses)
+	{
+		if (IsAttachment(use.access))
+		{
+			views.push_back(m_resources[use.resource].view);
+		}
+	}
+
+	// Only as many entries as there are swap chain images, a linear search is enough
+	for (const auto& [cachedViews, framebuffer] : pass.framebuffers)
+	{
+		if (cachedViews == views)
+		{
+			return framebuffer;
+		}
+	}
+
+	VkFramebufferCreateInfo framebufferInfo{};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = pass.renderPass;
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+	framebufferInfo.pAttachments = views.data();
+	framebufferInfo.width = pass.extent.width;
+	framebufferInfo.height = pass.extent.height;
+	framebufferInfo.layers = 1;
+
+	VkFramebuffer framebuffer = VK_NULL_HANDLE;
+
+	VkResult result = vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &framebuffer);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE RENDER GRAPH FRAME BUFFER <%s>", pass.name.c_str());
+		Logger::Error("%s", string_VkResult(result));
+
+		return VK_NULL_HANDLE;
+	}
+
+	pass.framebuffers.emplace_back(std::move(views), framebuffer);
+
+	return framebuffer;
+}
+
+void RenderGraph::ReleaseObjects(bool immediate)
+{
+	std::vector<VkRenderPass> renderPasses;
+	std::vector<VkFramebuffer> framebuffers;
+	std::vector<VkImageView> views;
+	std::vector<VkImage> images;
+	std::vector<MemoryAllocation> memory = std::move(m_transientMemory);
+
+	m_transientMemory.clear();
+	m_transientBytes = 0;
+
+	for (Pass& pass : m_passes)
+	{
+		if (pass.renderPass != VK_NULL_HANDLE)
+		{
+			renderPasses.push_back(pass.renderPass);
+		}
+
+		for (const auto& [cachedViews, framebuffer] : pass.framebuffers)
+		{
+			framebuffers.push_back(framebuffer);
+		}
+
+		pass.renderPass = VK_NULL_HANDLE;
+		pass.framebuffers.clear();
+	}
+
+	for (Resource& resource : m_resources)
+	{
+		if (resource.imported)
+		{
+			continue;
+		}
+
+		if (resource.view != VK_NULL_HANDLE)
+		{
+			views.push_back(resource.view);
+		}
+
+		if (resource.sampledView != VK_NULL_HANDLE)
+		{
+			views.push_back(resource.sampledView);
+		}
+
+		if (resource.image != VK_NULL_HANDLE)
+		{
+			images.push_back(resource.image);
+		}
+
+		resource.view = VK_NULL_HANDLE;
+		resource.sampledView = VK_NULL_HANDLE;
+		resource.image = VK_NULL_HANDLE;
+	}
+
+	VkDevice device = m_device;
+	MemoryAllocator* allocator = m_allocator;
+
+	auto release = [device, allocator, renderPasses, framebuffers, views, images, memory]() mutable
+	{
+		for (VkFramebuffer framebuffer : framebuffers)
+		{
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+		}
+
+		for (VkRenderPass renderPass : renderPasses)
+		{
+			vkDestroyRenderPass(device, renderPass, nullptr);
+		}
+
+		for (VkImageView view : views)
+		{
+			vkDestroyImageView(device, view, nullptr);
+		}
+
+		for (VkImage image : images)
+		{
+			vkDestroyImage(device, image, nullptr);
+		}
+
+		for (MemoryAllocation& allocation : memory)
+		{
+			allocator->Free(allocation);
+		}
+	};
+
+	if (immediate || !m_deferRelease)
+	{
+		release();
+	}
+	else
+	{
+		m_deferRelease(std::move(release));
+	}
+}
+
+void RenderGraph::AddBarrier(RenderGraphResource resource, const ResourceState& next, bool discard, VkPipelineStageFlags* srcStages, VkPipelineStageFlags* dstStages)
+{
+	Resource& image = m_resources[resource];
+	ResourceState& previous = image.state;
+
+	VkPipelineStageFlags waitStages = previous.stages;
+	VkAccessFlags waitAccess = previous.access;
+	bool previousWrite = previous.written;
+
+	// The memory may still be in use by an image it is shared with, from earlier in this frame or from the previous frame
+	if (discard)
+	{
+		for (RenderGraphResource alias : image.aliases)
+		{
+			waitStages |= m_resources[alias].state.stages;
+			waitAccess |= m_resources[alias].state.access;
+			previousWrite = previousWrite || m_resources[alias].state.written;
+		}
+	}
+
+	VkImageLayout oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : previous.layout;
+
+	bool layoutChange = oldLayout != next.layout;
+
+	// Reads after reads in the same layout need no barrier, the stages pile up so the next write waits for all of them
+	if (!layoutChange && !previousWrite && !next.written)
+	{
+		previous.stages |= next.stages;
+		previous.access |= next.access;
+
+		return;
+	}
+
+	*srcStages |= waitStages;
+	*dstStages |= next.stages;
+
+	// Write after read only needs the execution dependency
+	if (layoutChange || previousWrite)
+	{
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = waitAccess & WRITE_ACCESS_MASK;
+		barrier.dstAccessMask = next.access;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = next.layout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image.image;
+		barrier.subresourceRange = { image.aspect, 0, 1, 0, 1 };
+
+		m_barriers.push_back(barrier);
+	}
+
+	previous = next;
+}
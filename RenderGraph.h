@@ -0,0 +1,202 @@
+#pragma once
+
+typedef uint32_t RenderGraphResource;
+
+static constexpr RenderGraphResource INVALID_RENDER_GRAPH_RESOURCE = UINT32_MAX;
+
+// How a pass touches an image. Each access implies the layout, pipeline stages and access mask of the barrier in front of the pass.
+enum class RenderGraphAccess
+{
+	ColorAttachment,
+	DepthAttachment,
+	// Depth test without depth writes, the image stays in the read-only layout
+	DepthRead,
+	Sampled,
+	StorageRead,
+	StorageWrite,
+	TransferSrc,
+	TransferDst
+};
+
+struct RenderGraphImageDesc
+{
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkExtent2D extent = {};
+	VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+
+	// Added to the usage the graph derives from the declared accesses
+	VkImageUsageFlags usage = 0;
+};
+
+struct RenderGraphPassContext
+{
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+
+	// VK_NULL_HANDLE for passes without attachments
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	VkFramebuffer framebuffer = VK_NULL_HANDLE;
+
+	VkExtent2D extent = {};
+};
+
+// Frame graph of passes that declare the images they read and write. Compile culls passes whose results never reach an
+// imported image or a pass with side effects, creates a render pass per raster pass and places transient images with
+// disjoint lifetimes in the same memory. Execute then records the barriers and layout transitions between the passes.
+// The graph is built once and executed every frame, imported images may be swapped per frame.
+class RenderGraph
+{
+public:
+	// deferRelease hands over Vulkan objects that frames in flight may still use when the graph is rebuilt
+	bool Init(VkDevice device, MemoryAllocator* allocator, std::function<void(std::function<void()>)> deferRelease);
+	void Destroy();
+
+	// Drops all passes and resources, the Vulkan objects of the previous build are released through deferRelease
+	void Reset();
+
+	// An image owned outside of the graph. Its contents are kept and passes writing it are never culled.
+	// initialStage is the stage the image becomes available at each frame, e.g. the wait stage of the acquire semaphore.
+	RenderGraphResource ImportImage(const char* name, VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect, VkImageLayout initialLayout, VkPipelineStageFlags initialStage, VkImageLayout finalLayout);
+
+	// An image that only lives within the frame, created by Compile and aliased with other transient images
+	RenderGraphResource CreateImage(const char* name, const RenderGraphImageDesc& desc);
+
+	// Passes execute in the order they are added
+	uint32_t AddPass(const char* name, std::function<void(const RenderGraphPassContext&)> execute);
+
+	// Attachment accesses take part in the pass's render pass. loadOp only applies to attachments.
+	void UseImage(uint32_t pass, RenderGraphResource resource, RenderGraphAccess access, VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_LOAD, VkClearValue clearValue = {});
+
+	// Keeps the pass even though nothing in the graph consumes its results, e.g. readbacks
+	void SetSideEffects(uint32_t pass);
+
+	bool Compile();
+
+	// Must be set for every imported image before a frame that uses it is executed
+	void SetImportedImage(RenderGraphResource resource, VkImage image, VkImageView view);
+
+	// View of a transient image for descriptors, valid until the next Reset. Combined depth stencil images get a depth only view.
+	VkImageView GetSampledView(RenderGraphResource resource);
+
+	// Raster passes only. Lets work for the pass be recorded into secondary command buffers before Execute.
+	VkRenderPass GetRenderPass(uint32_t pass);
+	VkFramebuffer GetFramebuffer(uint32_t pass);
+
+	// Per frame choice between recording the pass inline and executing secondary command buffers
+	void SetSubpassContents(uint32_t pass, VkSubpassContents contents);
+
+	void Execute(VkCommandBuffer commandBuffer);
+
+	uint32_t GetLivePassCount() { return static_cast<uint32_t>(m_executionOrder.size()); }
+
+	VkDeviceSize GetTransientBytes() { return m_transientBytes; }
+
+private:
+	struct ResourceState
+	{
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags stages = 0;
+		VkAccessFlags access = 0;
+		bool written = false;
+	};
+
+	struct Resource
+	{
+		std::string name;
+
+		bool imported = false;
+
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent = {};
+		VkImageAspectFlags aspect = 0;
+		VkImageUsageFlags usage = 0;
+
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+
+		// Only created for sampled depth stencil images, descriptors may not reference both aspects
+		VkImageView sampledView = VK_NULL_HANDLE;
+
+		VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags initialStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		// Transient placement, memory shared with every resource in aliases
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		std::vector<RenderGraphResource> aliases;
+
+		// Live pass indices of the first and last use, UINT32_MAX if no live pass uses the image
+		uint32_t firstUse = UINT32_MAX;
+		uint32_t lastUse = UINT32_MAX;
+
+		// Kept across frames so the first barrier of a frame also waits for the previous frame's last use
+		ResourceState state;
+	};
+
+	struct ImageUse
+	{
+		RenderGraphResource resource = INVALID_RENDER_GRAPH_RESOURCE;
+		RenderGraphAccess access = RenderGraphAccess::Sampled;
+
+		VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		VkAttachmentStoreOp storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		VkClearValue clearValue = {};
+	};
+
+	struct Pass
+	{
+		std::string name;
+
+		std::function<void(const RenderGraphPassContext&)> execute;
+
+		std::vector<ImageUse> uses;
+
+		bool sideEffects = false;
+		bool live = false;
+
+		VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE;
+
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		VkExtent2D extent = {};
+
+		// Imported views change per frame, so framebuffers are cached per combination of attachment views
+		std::vector<std::pair<std::vector<VkImageView>, VkFramebuffer>> framebuffers;
+	};
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	MemoryAllocator* m_allocator = nullptr;
+
+	std::function<void(std::function<void()>)> m_deferRelease;
+
+	std::vector<Resource> m_resources;
+	std::vector<Pass> m_passes;
+
+	std::vector<uint32_t> m_executionOrder;
+
+	// One allocation per memory type the transient images need, images sharing one alias at their own offsets
+	std::vector<MemoryAllocation> m_transientMemory;
+	VkDeviceSize m_transientBytes = 0;
+
+	// Scratch for the barriers in front of one pass
+	std::vector<VkImageMemoryBarrier> m_barriers;
+	std::vector<VkClearValue> m_clearValues;
+
+private:
+	static bool IsAttachment(RenderGraphAccess access);
+	static bool IsWrite(RenderGraphAccess access);
+	static bool ReadsContents(const ImageUse& use);
+
+	static ResourceState GetAccessState(RenderGraphAccess access);
+	static VkImageUsageFlags GetAccessUsage(RenderGraphAccess access);
+
+	void CullPasses();
+	bool CreateTransientImages();
+	bool CreateRenderPass(Pass& pass);
+
+	VkFramebuffer FindFramebuffer(Pass& pass);
+
+	void ReleaseObjects(bool immediate);
+
+	void AddBarrier(RenderGraphResource resource, const ResourceState& next, bool discard, VkPipelineStageFlags* srcStages, VkPipelineStageFlags* dstStages);
+};
@@ -0,0 +1,919 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+// AVX2 code is compiled per function, so the rest of the engine keeps running on CPUs without it.
+// MSVC emits any intrinsic regardless of /arch, GCC and Clang need the target named.
+#if CDNL_MATH_SSE
+	#if defined(__GNUC__) || defined(__clang__)
+		#define CDNL_TARGET_AVX2 __attribute__((target("avx2,fma")))
+	#else
+		#define CDNL_TARGET_AVX2
+	#endif
+#endif // CDNL_MATH_SSE
+
+Mat4 Mat4::Transposed() const
+{
+	Mat4 result;
+
+	for (uint32_t row = 0; row < 4; row++)
+	{
+		for (uint32_t column = 0; column < 4; column++)
+		{
+			result.Data()[row * 4 + column] = Get(row, column);
+		}
+	}
+
+	return result;
+}
+
+Mat4 Mat4::Inverse() const
+{
+	// Cofactor expansion. Inverting the transpose gives the transpose of the inverse, so the layout does not matter.
+	const float* m = Data();
+
+	float inverse[16];
+
+	inverse[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+	inverse[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+	inverse[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+	inverse[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+	inverse[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+	inverse[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+	inverse[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+	inverse[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+	inverse[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+	inverse[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+	inverse[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+	inverse[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+	inverse[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+	inverse[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+	inverse[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+	inverse[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+	float determinant = m[0] * inverse[0] + m[1] * inverse[4] + m[2] * inverse[8] + m[3] * inverse[12];
+
+	Mat4 result;
+
+	if (determinant == 0.0f)
+	{
+		return result;
+	}
+
+	float scale = 1.0f / determinant;
+
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		result.Data()[i] = inverse[i] * scale;
+	}
+
+	return result;
+}
+
+Mat4 Mat4::InverseAffine() const
+{
+	Vec3 c0 = columns[0].Xyz();
+	Vec3 c1 = columns[1].Xyz();
+	Vec3 c2 = columns[2].Xyz();
+
+	// Rows of the inverse 3x3 are the cross products of the columns over the determinant
+	Vec3 r0 = Vec3::Cross(c1, c2);
+	Vec3 r1 = Vec3::Cross(c2, c0);
+	Vec3 r2 = Vec3::Cross(c0, c1);
+
+	float determinant = Vec3::Dot(c0, r0);
+
+	if (determinant == 0.0f)
+	{
+		return Mat4();
+	}
+
+	float scale = 1.0f / determinant;
+
+	r0 *= scale;
+	r1 *= scale;
+	r2 *= scale;
+
+	Vec3 translation = columns[3].Xyz();
+
+	Mat4 result;
+	result.columns[0] = { r0.x, r1.x, r2.x, 0.0f };
+	result.columns[1] = { r0.y, r1.y, r2.y, 0.0f };
+	result.columns[2] = { r0.z, r1.z, r2.z, 0.0f };
+	result.columns[3] = { -Vec3::Dot(r0, translation), -Vec3::Dot(r1, translation), -Vec3::Dot(r2, translation), 1.0f };
+
+	return result;
+}
+
+Mat4 Mat4::Translation(const Vec3& translation)
+{
+	Mat4 result;
+	result.columns[3] = Vec4(translation, 1.0f);
+
+	return result;
+}
+
+Mat4 Mat4::Scale(const Vec3& scale)
+{
+	Mat4 result;
+	result.columns[0].x = scale.x;
+	result.columns[1].y = scale.y;
+	result.columns[2].z = scale.z;
+
+	return result;
+}
+
+Mat4 Mat4::Rotation(const Quat& q)
+{
+	return Compose({ 0.0f, 0.0f, 0.0f }, q, { 1.0f, 1.0f, 1.0f });
+}
+
+Mat4 Mat4::Compose(const Vec3& translation, const Quat& q, const Vec3& scale)
+{
+	float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+	Mat4 result;
+	result.columns[0] = Vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f) * scale.x;
+	result.columns[1] = Vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f) * scale.y;
+	result.columns[2] = Vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f) * scale.z;
+	result.columns[3] = Vec4(translation, 1.0f);
+
+	return result;
+}
+
+Mat4 Mat4::LookAt(const Vec3& eye, const Vec3& target, const Vec3& up)
+{
+	Vec3 forward = (target - eye).Normalized();
+	Vec3 side = Vec3::Cross(forward, up).Normalized();
+	Vec3 cameraUp = Vec3::Cross(side, forward);
+
+	Mat4 result;
+	result.columns[0] = { side.x, cameraUp.x, -forward.x, 0.0f };
+	result.columns[1] = { side.y, cameraUp.y, -forward.y, 0.0f };
+	result.columns[2] = { side.z, cameraUp.z, -forward.z, 0.0f };
+	result.columns[3] = { -Vec3::Dot(side, eye), -Vec3::Dot(cameraUp, eye), Vec3::Dot(forward, eye), 1.0f };
+
+	return result;
+}
+
+Mat4 Mat4::Perspective(float fovY, float aspect, float nearZ, float farZ)
+{
+	float focal = 1.0f / std::tan(fovY * 0.5f);
+
+	// View space -nearZ maps to depth 0 and -farZ to depth 1
+	Mat4 result;
+	result.columns[0] = { focal / aspect, 0.0f, 0.0f, 0.0f };
+	result.columns[1] = { 0.0f, -focal, 0.0f, 0.0f };
+	result.columns[2] = { 0.0f, 0.0f, farZ / (nearZ - farZ), -1.0f };
+	result.columns[3] = { 0.0f, 0.0f, nearZ * farZ / (nearZ - farZ), 0.0f };
+
+	return result;
+}
+
+// Scalar kernels, also used for the elements that do not fill a whole vector
+
+static void ComposeMatricesScalar(const Vec3* positions, const Quat* rotations, const Vec3* scales, Mat4* worlds, uint32_t first, uint32_t count)
+{
+	for (uint32_t i = first; i < count; i++)
+	{
+		const Quat& q = rotations[i];
+
+		float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+		float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+		float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+		float* m = worlds[i].Data();
+
+		m[0] = (1.0f - 2.0f * (yy + zz)) * scales[i].x;
+		m[1] = 2.0f * (xy + wz) * scales[i].x;
+		m[2] = 2.0f * (xz - wy) * scales[i].x;
+		m[3] = 0.0f;
+		m[4] = 2.0f * (xy - wz) * scales[i].y;
+		m[5] = (1.0f - 2.0f * (xx + zz)) * scales[i].y;
+		m[6] = 2.0f * (yz + wx) * scales[i].y;
+		m[7] = 0.0f;
+		m[8] = 2.0f * (xz + wy) * scales[i].z;
+		m[9] = 2.0f * (yz - wx) * scales[i].z;
+		m[10] = (1.0f - 2.0f * (xx + yy)) * scales[i].z;
+		m[11] = 0.0f;
+		m[12] = positions[i].x;
+		m[13] = positions[i].y;
+		m[14] = positions[i].z;
+		m[15] = 1.0f;
+	}
+}
+
+static void MultiplyMatricesScalar(const Mat4* a, const Mat4* b, Mat4* results, uint32_t first, uint32_t count)
+{
+	for (uint32_t i = first; i < count; i++)
+	{
+		const float* left = a[i].Data();
+
+		// Copied first, results may alias b
+		float right[16];
+		memcpy(right, b[i].Data(), sizeof(right));
+
+		float* result = results[i].Data();
+
+		for (uint32_t column = 0; column < 4; column++)
+		{
+			for (uint32_t row = 0; row < 4; row++)
+			{
+				result[column * 4 + row] = left[row] * right[column * 4] + left[4 + row] * right[column * 4 + 1] + left[8 + row] * right[column * 4 + 2] + left[12 + row] * right[column * 4 + 3];
+			}
+		}
+	}
+}
+
+static void TransformAabbsScalar(const Mat4* matrices, const Aabb* local, Aabb* world, uint32_t first, uint32_t count)
+{
+	for (uint32_t i = first; i < count; i++)
+	{
+		const float* m = matrices[i].Data();
+
+		Vec3 c = local[i].center;
+		Vec3 e = local[i].extents;
+
+		Aabb box;
+		box.center = { m[0] * c.x + m[4] * c.y + m[8] * c.z + m[12], m[1] * c.x + m[5] * c.y + m[9] * c.z + m[13], m[2] * c.x + m[6] * c.y + m[10] * c.z + m[14] };
+		box.extents = { std::abs(m[0]) * e.x + std::abs(m[4]) * e.y + std::abs(m[8]) * e.z, std::abs(m[1]) * e.x + std::abs(m[5]) * e.y + std::abs(m[9]) * e.z, std::abs(m[2]) * e.x + std::abs(m[6]) * e.y + std::abs(m[10]) * e.z };
+
+		world[i] = box;
+	}
+}
+
+static uint32_t CullSpheresScalar(const CullingView& view, const BoundingSphere* spheres, uint32_t first, uint32_t count, uint32_t* visibleIndices)
+{
+	uint32_t visibleCount = 0;
+
+	for (uint32_t i = first; i < count; i++)
+	{
+		bool visible = true;
+
+		for (const float* plane : view.planes)
+		{
+			visible &= plane[0] * spheres[i].center.x + plane[1] * spheres[i].center.y + plane[2] * spheres[i].center.z + plane[3] >= -spheres[i].radius;
+		}
+
+		visibleIndices[visibleCount] = i;
+		visibleCount += visible ? 1 : 0;
+	}
+
+	return visibleCount;
+}
+
+static uint32_t CullAabbsScalar(const CullingView& view, const Aabb* boxes, uint32_t first, uint32_t count, uint32_t* visibleIndices)
+{
+	uint32_t visibleCount = 0;
+
+	for (uint32_t i = first; i < count; i++)
+	{
+		const Vec3& c = boxes[i].center;
+		const Vec3& e = boxes[i].extents;
+
+		bool visible = true;
+
+		// The box corner farthest along the plane normal decides
+		for (const float* plane : view.planes)
+		{
+			visible &= plane[0] * c.x + plane[1] * c.y + plane[2] * c.z + plane[3] + std::abs(plane[0]) * e.x + std::abs(plane[1]) * e.y + std::abs(plane[2]) * e.z >= 0.0f;
+		}
+
+		visibleIndices[visibleCount] = i;
+		visibleCount += visible ? 1 : 0;
+	}
+
+	return visibleCount;
+}
+
+static void ComposeMatricesScalar(const Vec3* positions, const Quat* rotations, const Vec3* scales, Mat4* worlds, uint32_t count)
+{
+	ComposeMatricesScalar(positions, rotations, scales, worlds, 0, count);
+}
+
+static void MultiplyMatricesScalar(const Mat4* a, const Mat4* b, Mat4* results, uint32_t count)
+{
+	MultiplyMatricesScalar(a, b, results, 0, count);
+}
+
+static void TransformAabbsScalar(const Mat4* matrices, const Aabb* local, Aabb* world, uint32_t count)
+{
+	TransformAabbsScalar(matrices, local, world, 0, count);
+}
+
+static uint32_t CullSpheresScalar(const CullingView& view, const BoundingSphere* spheres, uint32_t count, uint32_t* visibleIndices)
+{
+	return CullSpheresScalar(view, spheres, 0, count, visibleIndices);
+}
+
+static uint32_t CullAabbsScalar(const CullingView& view, const Aabb* boxes, uint32_t count, uint32_t* visibleIndices)
+{
+	return CullAabbsScalar(view, boxes, 0, count, visibleIndices);
+}
+
+#if CDNL_MATH_SSE
+
+// Appends base + the index of every set bit
+static uint32_t AppendMaskIndices(uint32_t mask, uint32_t base, uint32_t* visibleIndices)
+{
+	uint32_t written = 0;
+
+	while (mask != 0)
+	{
+		visibleIndices[written++] = base + static_cast<uint32_t>(std::countr_zero(mask));
+
+		mask &= mask - 1;
+	}
+
+	return written;
+}
+
+// SSE kernels, four elements per iteration where the data allows it
+
+static void ComposeMatricesSse(const Vec3* positions, const Quat* rotations, const Vec3* scales, Mat4* worlds, uint32_t count)
+{
+	uint32_t i = 0;
+
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 two = _mm_set1_ps(2.0f);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 qx = _mm_load_ps(&rotations[i].x);
+		__m128 qy = _mm_load_ps(&rotations[i + 1].x);
+		__m128 qz = _mm_load_ps(&rotations[i + 2].x);
+		__m128 qw = _mm_load_ps(&rotations[i + 3].x);
+
+		_MM_TRANSPOSE4_PS(qx, qy, qz, qw);
+
+		__m128 sx = _mm_set_ps(scales[i + 3].x, scales[i + 2].x, scales[i + 1].x, scales[i].x);
+		__m128 sy = _mm_set_ps(scales[i + 3].y, scales[i + 2].y, scales[i + 1].y, scales[i].y);
+		__m128 sz = _mm_set_ps(scales[i + 3].z, scales[i + 2].z, scales[i + 1].z, scales[i].z);
+
+		__m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+		__m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+		__m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+		// One vector per matrix element, lane j belongs to matrix i + j
+		__m128 elements[16];
+		elements[0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+		elements[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+		elements[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+		elements[3] = _mm_setzero_ps();
+		elements[4] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+		elements[5] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+		elements[6] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+		elements[7] = _mm_setzero_ps();
+		elements[8] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+		elements[9] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+		elements[10] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+		elements[11] = _mm_setzero_ps();
+		elements[12] = _mm_set_ps(positions[i + 3].x, positions[i + 2].x, positions[i + 1].x, positions[i].x);
+		elements[13] = _mm_set_ps(positions[i + 3].y, positions[i + 2].y, positions[i + 1].y, positions[i].y);
+		elements[14] = _mm_set_ps(positions[i + 3].z, positions[i + 2].z, positions[i + 1].z, positions[i].z);
+		elements[15] = one;
+
+		// Each group of four elements is one column of all four matrices
+		for (uint32_t column = 0; column < 4; column++)
+		{
+			__m128 c0 = elements[column * 4];
+			__m128 c1 = elements[column * 4 + 1];
+			__m128 c2 = elements[column * 4 + 2];
+			__m128 c3 = elements[column * 4 + 3];
+
+			_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+			_mm_store_ps(&worlds[i].columns[column].x, c0);
+			_mm_store_ps(&worlds[i + 1].columns[column].x, c1);
+			_mm_store_ps(&worlds[i + 2].columns[column].x, c2);
+			_mm_store_ps(&worlds[i + 3].columns[column].x, c3);
+		}
+	}
+
+	ComposeMatricesScalar(positions, rotations, scales, worlds, i, count);
+}
+
+static void MultiplyMatricesSse(const Mat4* a, const Mat4* b, Mat4* results, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		__m128 a0 = _mm_load_ps(&a[i].columns[0].x);
+		__m128 a1 = _mm_load_ps(&a[i].columns[1].x);
+		__m128 a2 = _mm_load_ps(&a[i].columns[2].x);
+		__m128 a3 = _mm_load_ps(&a[i].columns[3].x);
+
+		__m128 columns[4];
+
+		for (uint32_t column = 0; column < 4; column++)
+		{
+			__m128 bc = _mm_load_ps(&b[i].columns[column].x);
+
+			__m128 result = _mm_mul_ps(a0, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(0, 0, 0, 0)));
+			result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(1, 1, 1, 1))));
+			result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(2, 2, 2, 2))));
+			result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(3, 3, 3, 3))));
+
+			columns[column] = result;
+		}
+
+		// Stored after all columns are read, results may alias b
+		for (uint32_t column = 0; column < 4; column++)
+		{
+			_mm_store_ps(&results[i].columns[column].x, columns[column]);
+		}
+	}
+}
+
+static void TransformAabbsSse(const Mat4* matrices, const Aabb* local, Aabb* world, uint32_t count)
+{
+	__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 xyzMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		__m128 m0 = _mm_load_ps(&matrices[i].columns[0].x);
+		__m128 m1 = _mm_load_ps(&matrices[i].columns[1].x);
+		__m128 m2 = _mm_load_ps(&matrices[i].columns[2].x);
+		__m128 m3 = _mm_load_ps(&matrices[i].columns[3].x);
+
+		__m128 c = _mm_load_ps(&local[i].center.x);
+		__m128 e = _mm_load_ps(&local[i].extents.x);
+
+		__m128 center = _mm_add_ps(m3, _mm_mul_ps(m0, _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 0, 0, 0))));
+		center = _mm_add_ps(center, _mm_mul_ps(m1, _mm_shuffle_ps(c, c, _MM_SHUFFLE(1, 1, 1, 1))));
+		center = _mm_add_ps(center, _mm_mul_ps(m2, _mm_shuffle_ps(c, c, _MM_SHUFFLE(2, 2, 2, 2))));
+
+		__m128 extents = _mm_mul_ps(_mm_and_ps(m0, absMask), _mm_shuffle_ps(e, e, _MM_SHUFFLE(0, 0, 0, 0)));
+		extents = _mm_add_ps(extents, _mm_mul_ps(_mm_and_ps(m1, absMask), _mm_shuffle_ps(e, e, _MM_SHUFFLE(1, 1, 1, 1))));
+		extents = _mm_add_ps(extents, _mm_mul_ps(_mm_and_ps(m2, absMask), _mm_shuffle_ps(e, e, _MM_SHUFFLE(2, 2, 2, 2))));
+
+		// The w lane of the translation would land in the reserved field
+		_mm_store_ps(&world[i].center.x, _mm_and_ps(center, xyzMask));
+		_mm_store_ps(&world[i].extents.x, extents);
+	}
+}
+
+static uint32_t CullSpheresSse(const CullingView& view, const BoundingSphere* spheres, uint32_t count, uint32_t* visibleIndices)
+{
+	uint32_t visibleCount = 0;
+	uint32_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_load_ps(&spheres[i].center.x);
+		__m128 y = _mm_load_ps(&spheres[i + 1].center.x);
+		__m128 z = _mm_load_ps(&spheres[i + 2].center.x);
+		__m128 r = _mm_load_ps(&spheres[i + 3].center.x);
+
+		_MM_TRANSPOSE4_PS(x, y, z, r);
+
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), r);
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for (const float* plane : view.planes)
+		{
+			__m128 distance = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane[0])), _mm_mul_ps(y, _mm_set1_ps(plane[1])));
+			distance = _mm_add_ps(distance, _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane[2])), _mm_set1_ps(plane[3])));
+
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		visibleCount += AppendMaskIndices(static_cast<uint32_t>(_mm_movemask_ps(inside)), i, visibleIndices + visibleCount);
+	}
+
+	return visibleCount + CullSpheresScalar(view, spheres, i, count, visibleIndices + visibleCount);
+}
+
+static uint32_t CullAabbsSse(const CullingView& view, const Aabb* boxes, uint32_t count, uint32_t* visibleIndices)
+{
+	uint32_t visibleCount = 0;
+	uint32_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 cx = _mm_load_ps(&boxes[i].center.x);
+		__m128 cy = _mm_load_ps(&boxes[i + 1].center.x);
+		__m128 cz = _mm_load_ps(&boxes[i + 2].center.x);
+		__m128 cw = _mm_load_ps(&boxes[i + 3].center.x);
+
+		__m128 ex = _mm_load_ps(&boxes[i].extents.x);
+		__m128 ey = _mm_load_ps(&boxes[i + 1].extents.x);
+		__m128 ez = _mm_load_ps(&boxes[i + 2].extents.x);
+		__m128 ew = _mm_load_ps(&boxes[i + 3].extents.x);
+
+		_MM_TRANSPOSE4_PS(cx, cy, cz, cw);
+		_MM_TRANSPOSE4_PS(ex, ey, ez, ew);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for (const float* plane : view.planes)
+		{
+			__m128 distance = _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane[0])), _mm_mul_ps(cy, _mm_set1_ps(plane[1])));
+			distance = _mm_add_ps(distance, _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane[2])), _mm_set1_ps(plane[3])));
+
+			__m128 reach = _mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::abs(plane[0]))), _mm_mul_ps(ey, _mm_set1_ps(std::abs(plane[1]))));
+			reach = _mm_add_ps(reach, _mm_mul_ps(ez, _mm_set1_ps(std::abs(plane[2]))));
+
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+		}
+
+		visibleCount += AppendMaskIndices(static_cast<uint32_t>(_mm_movemask_ps(inside)), i, visibleIndices + visibleCount);
+	}
+
+	return visibleCount + CullAabbsScalar(view, boxes, i, count, visibleIndices + visibleCount);
+}
+
+// AVX2 kernels, eight elements per iteration. Structure of arrays registers are built by transposing the loaded elements.
+
+// Eight 4-float elements to four registers of eight x, y, z and w values
+CDNL_TARGET_AVX2 static void Transpose8x4(const float* first, size_t stride, __m256* x, __m256* y, __m256* z, __m256* w)
+{
+	__m256 a0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(first)), _mm_load_ps(first + 4 * stride), 1);
+	__m256 a1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(first + stride)), _mm_load_ps(first + 5 * stride), 1);
+	__m256 a2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(first + 2 * stride)), _mm_load_ps(first + 6 * stride), 1);
+	__m256 a3 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(first + 3 * stride)), _mm_load_ps(first + 7 * stride), 1);
+
+	__m256 t0 = _mm256_unpacklo_ps(a0, a1);
+	__m256 t1 = _mm256_unpackhi_ps(a0, a1);
+	__m256 t2 = _mm256_unpacklo_ps(a2, a3);
+	__m256 t3 = _mm256_unpackhi_ps(a2, a3);
+
+	*x = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+	*y = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+	*z = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	*w = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+CDNL_TARGET_AVX2 static void Transpose8x8(__m256* rows)
+{
+	__m256 t[8];
+	__m256 s[8];
+
+	for (uint32_t i = 0; i < 8; i += 2)
+	{
+		t[i] = _mm256_unpacklo_ps(rows[i], rows[i + 1]);
+		t[i + 1] = _mm256_unpackhi_ps(rows[i], rows[i + 1]);
+	}
+
+	for (uint32_t i = 0; i < 8; i += 4)
+	{
+		s[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+		s[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+		s[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+		s[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+	}
+
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		rows[i] = _mm256_permute2f128_ps(s[i], s[i + 4], 0x20);
+		rows[i + 4] = _mm256_permute2f128_ps(s[i], s[i + 4], 0x31);
+	}
+}
+
+CDNL_TARGET_AVX2 static void ComposeMatricesAvx2(const Vec3* positions, const Quat* rotations, const Vec3* scales, Mat4* worlds, uint32_t count)
+{
+	uint32_t i = 0;
+
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256 two = _mm256_set1_ps(2.0f);
+
+	// Vec3 arrays are 12 bytes per element, gathered by float offset
+	__m256i offsets = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 qx, qy, qz, qw;
+		Transpose8x4(&rotations[i].x, 4, &qx, &qy, &qz, &qw);
+
+		__m256 sx = _mm256_i32gather_ps(&scales[i].x, offsets, 4);
+		__m256 sy = _mm256_i32gather_ps(&scales[i].y, offsets, 4);
+		__m256 sz = _mm256_i32gather_ps(&scales[i].z, offsets, 4);
+
+		__m256 xx = _mm256_mul_ps(qx, qx), yy = _mm256_mul_ps(qy, qy), zz = _mm256_mul_ps(qz, qz);
+		__m256 xy = _mm256_mul_ps(qx, qy), xz = _mm256_mul_ps(qx, qz), yz = _mm256_mul_ps(qy, qz);
+		__m256 wx = _mm256_mul_ps(qw, qx), wy = _mm256_mul_ps(qw, qy), wz = _mm256_mul_ps(qw, qz);
+
+		// Rows of the two 8x8 blocks, elements 0 to 7 and 8 to 15 of the eight matrices
+		__m256 low[8];
+		__m256 high[8];
+
+		low[0] = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(yy, zz), one), sx);
+		low[1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx);
+		low[2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx);
+		low[3] = _mm256_setzero_ps();
+		low[4] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy);
+		low[5] = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, zz), one), sy);
+		low[6] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy);
+		low[7] = _mm256_setzero_ps();
+		high[0] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz);
+		high[1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz);
+		high[2] = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, yy), one), sz);
+		high[3] = _mm256_setzero_ps();
+		high[4] = _mm256_i32gather_ps(&positions[i].x, offsets, 4);
+		high[5] = _mm256_i32gather_ps(&positions[i].y, offsets, 4);
+		high[6] = _mm256_i32gather_ps(&positions[i].z, offsets, 4);
+		high[7] = one;
+
+		Transpose8x8(low);
+		Transpose8x8(high);
+
+		for (uint32_t j = 0; j < 8; j++)
+		{
+			_mm256_storeu_ps(worlds[i + j].Data(), low[j]);
+			_mm256_storeu_ps(worlds[i + j].Data() + 8, high[j]);
+		}
+	}
+
+	ComposeMatricesScalar(positions, rotations, scales, worlds, i, count);
+}
+
+CDNL_TARGET_AVX2 static void MultiplyMatricesAvx2(const Mat4* a, const Mat4* b, Mat4* results, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		// Each column of a in both halves, two result columns per register
+		__m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i].columns[0].x));
+		__m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i].columns[1].x));
+		__m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i].columns[2].x));
+		__m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i].columns[3].x));
+
+		__m256 b01 = _mm256_loadu_ps(b[i].Data());
+		__m256 b23 = _mm256_loadu_ps(b[i].Data() + 8);
+
+		__m256 r01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, _MM_SHUFFLE(0, 0, 0, 0)));
+		r01 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b01, _MM_SHUFFLE(1, 1, 1, 1)), r01);
+		r01 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b01, _MM_SHUFFLE(2, 2, 2, 2)), r01);
+		r01 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b01, _MM_SHUFFLE(3, 3, 3, 3)), r01);
+
+		__m256 r23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, _MM_SHUFFLE(0, 0, 0, 0)));
+		r23 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b23, _MM_SHUFFLE(1, 1, 1, 1)), r23);
+		r23 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b23, _MM_SHUFFLE(2, 2, 2, 2)), r23);
+		r23 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b23, _MM_SHUFFLE(3, 3, 3, 3)), r23);
+
+		_mm256_storeu_ps(results[i].Data(), r01);
+		_mm256_storeu_ps(results[i].Data() + 8, r23);
+	}
+}
+
+CDNL_TARGET_AVX2 static void TransformAabbsAvx2(const Mat4* matrices, const Aabb* local, Aabb* world, uint32_t count)
+{
+	uint32_t i = 0;
+
+	__m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+	for (; i + 8 <= count; i += 8)
+	{
+		// Rows of two 8x8 blocks: elements 0 to 7 and 8 to 15 of each matrix, transposed to one register per element
+		__m256 low[8];
+		__m256 high[8];
+
+		for (uint32_t j = 0; j < 8; j++)
+		{
+			low[j] = _mm256_loadu_ps(matrices[i + j].Data());
+			high[j] = _mm256_loadu_ps(matrices[i + j].Data() + 8);
+		}
+
+		Transpose8x8(low);
+		Transpose8x8(high);
+
+		__m256 cx, cy, cz, cw, ex, ey, ez, ew;
+		Transpose8x4(&local[i].center.x, 8, &cx, &cy, &cz, &cw);
+		Transpose8x4(&local[i].extents.x, 8, &ex, &ey, &ez, &ew);
+
+		// Element e of column c is low[c * 4 + e] for the first two columns, high[(c - 2) * 4 + e] for the others
+		__m256 out[8];
+
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			__m256 m0 = low[axis];
+			__m256 m1 = low[4 + axis];
+			__m256 m2 = high[axis];
+			__m256 m3 = high[4 + axis];
+
+			out[axis] = _mm256_fmadd_ps(m0, cx, _mm256_fmadd_ps(m1, cy, _mm256_fmadd_ps(m2, cz, m3)));
+			out[4 + axis] = _mm256_fmadd_ps(_mm256_and_ps(m0, absMask), ex, _mm256_fmadd_ps(_mm256_and_ps(m1, absMask), ey, _mm256_mul_ps(_mm256_and_ps(m2, absMask), ez)));
+		}
+
+		out[3] = _mm256_setzero_ps();
+		out[7] = _mm256_setzero_ps();
+
+		// Back to one 32 byte box per row
+		Transpose8x8(out);
+
+		for (uint32_t j = 0; j < 8; j++)
+		{
+			_mm256_storeu_ps(&world[i + j].center.x, out[j]);
+		}
+	}
+
+	TransformAabbsScalar(matrices, local, world, i, count);
+}
+
+CDNL_TARGET_AVX2 static uint32_t CullSpheresAvx2(const CullingView& view, const BoundingSphere* spheres, uint32_t count, uint32_t* visibleIndices)
+{
+	uint32_t visibleCount = 0;
+	uint32_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 x, y, z, r;
+		Transpose8x4(&spheres[i].center.x, 4, &x, &y, &z, &r);
+
+		__m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), r);
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+		for (const float* plane : view.planes)
+		{
+			__m256 distance = _mm256_fmadd_ps(x, _mm256_set1_ps(plane[0]), _mm256_fmadd_ps(y, _mm256_set1_ps(plane[1]), _mm256_fmadd_ps(z, _mm256_set1_ps(plane[2]), _mm256_set1_ps(plane[3]))));
+
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+		}
+
+		visibleCount += AppendMaskIndices(static_cast<uint32_t>(_mm256_movemask_ps(inside)), i, visibleIndices + visibleCount);
+	}
+
+	return visibleCount + CullSpheresScalar(view, spheres, i, count, visibleIndices + visibleCount);
+}
+
+CDNL_TARGET_AVX2 static uint32_t CullAabbsAvx2(const CullingView& view, const Aabb* boxes, uint32_t count, uint32_t* visibleIndices)
+{
+	uint32_t visibleCount = 0;
+	uint32_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 cx, cy, cz, cw, ex, ey, ez, ew;
+		Transpose8x4(&boxes[i].center.x, 8, &cx, &cy, &cz, &cw);
+		Transpose8x4(&boxes[i].extents.x, 8, &ex, &ey, &ez, &ew);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+		for (const float* plane : view.planes)
+		{
+			__m256 distance = _mm256_fmadd_ps(cx, _mm256_set1_ps(plane[0]), _mm256_fmadd_ps(cy, _mm256_set1_ps(plane[1]), _mm256_fmadd_ps(cz, _mm256_set1_ps(plane[2]), _mm256_set1_ps(plane[3]))));
+
+			distance = _mm256_fmadd_ps(ex, _mm256_set1_ps(std::abs(plane[0])), _mm256_fmadd_ps(ey, _mm256_set1_ps(std::abs(plane[1])), _mm256_fmadd_ps(ez, _mm256_set1_ps(std::abs(plane[2])), distance)));
+
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+
+		visibleCount += AppendMaskIndices(static_cast<uint32_t>(_mm256_movemask_ps(inside)), i, visibleIndices + visibleCount);
+	}
+
+	return visibleCount + CullAabbsScalar(view, boxes, i, count, visibleIndices + visibleCount);
+}
+
+static bool IsAvx2Supported()
+{
+#if defined(__AVX2__) && defined(__FMA__)
+	// Built for AVX2, the compiler already assumes it everywhere
+	return true;
+#elif defined(_MSC_VER)
+	int info[4];
+
+	__cpuid(info, 0);
+
+	if (info[0] < 7)
+	{
+		return false;
+	}
+
+	__cpuid(info, 1);
+
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+
+	// The OS must save the YMM registers on context switches
+	if (!fma || !osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+	{
+		return false;
+	}
+
+	__cpuidex(info, 7, 0);
+
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+#endif // CDNL_MATH_SSE
+
+struct MathKernels
+{
+	SimdIsa isa = SimdIsa::Scalar;
+
+	void (*composeMatrices)(const Vec3*, const Quat*, const Vec3*, Mat4*, uint32_t) = ComposeMatricesScalar;
+	void (*multiplyMatrices)(const Mat4*, const Mat4*, Mat4*, uint32_t) = MultiplyMatricesScalar;
+	void (*transformAabbs)(const Mat4*, const Aabb*, Aabb*, uint32_t) = TransformAabbsScalar;
+	uint32_t (*cullSpheres)(const CullingView&, const BoundingSphere*, uint32_t, uint32_t*) = CullSpheresScalar;
+	uint32_t (*cullAabbs)(const CullingView&, const Aabb*, uint32_t, uint32_t*) = CullAabbsScalar;
+};
+
+static SimdIsa GetBestIsa()
+{
+#if CDNL_MATH_SSE
+	return IsAvx2Supported() ? SimdIsa::Avx2 : SimdIsa::Sse;
+#else
+	return SimdIsa::Scalar;
+#endif // CDNL_MATH_SSE
+}
+
+static MathKernels SelectKernels(SimdIsa isa)
+{
+	MathKernels kernels;
+
+#if CDNL_MATH_SSE
+	if (isa == SimdIsa::Avx2)
+	{
+		kernels.isa = SimdIsa::Avx2;
+		kernels.composeMatrices = ComposeMatricesAvx2;
+		kernels.multiplyMatrices = MultiplyMatricesAvx2;
+		kernels.transformAabbs = TransformAabbsAvx2;
+		kernels.cullSpheres = CullSpheresAvx2;
+		kernels.cullAabbs = CullAabbsAvx2;
+	}
+	else if (isa == SimdIsa::Sse)
+	{
+		kernels.isa = SimdIsa::Sse;
+		kernels.composeMatrices = ComposeMatricesSse;
+		kernels.multiplyMatrices = MultiplyMatricesSse;
+		kernels.transformAabbs = TransformAabbsSse;
+		kernels.cullSpheres = CullSpheresSse;
+		kernels.cullAabbs = CullAabbsSse;
+	}
+#endif // CDNL_MATH_SSE
+
+	return kernels;
+}
+
+static MathKernels& GetKernels()
+{
+	static MathKernels kernels = []()
+	{
+		MathKernels selected = SelectKernels(GetBestIsa());
+
+		Logger::Info("MATH KERNELS USE %s", SimdMath::GetIsaName(selected.isa));
+
+		return selected;
+	}();
+
+	return kernels;
+}
+
+SimdIsa SimdMath::GetIsa()
+{
+	return GetKernels().isa;
+}
+
+void SimdMath::SetIsa(SimdIsa isa)
+{
+	SimdIsa best = GetBestIsa();
+
+	// Not thread safe, meant for startup and benchmarks before any kernel runs concurrently
+	GetKernels() = SelectKernels(static_cast<int>(isa) > static_cast<int>(best) ? best : isa);
+}
+
+const char* SimdMath::GetIsaName(SimdIsa isa)
+{
+	switch (isa)
+	{
+	case SimdIsa::Avx2:
+		return "AVX2";
+	case SimdIsa::Sse:
+		return "SSE";
+	default:
+		return "SCALAR";
+	}
+}
+
+void SimdMath::ComposeMatrices(const Vec3* positions, const Quat* rotations, const Vec3* scales, Mat4* worlds, uint32_t count)
+{
+	GetKernels().composeMatrices(positions, rotations, scales, worlds, count);
+}
+
+void SimdMath::MultiplyMatrices(const Mat4* a, const Mat4* b, Mat4* results, uint32_t count)
+{
+	GetKernels().multiplyMatrices(a, b, results, count);
+}
+
+void SimdMath::TransformAabbs(const Mat4* matrices, const Aabb* local, Aabb* world, uint32_t count)
+{
+	GetKernels().transformAabbs(matrices, local, world, count);
+}
+
+uint32_t SimdMath::CullSpheres(const CullingView& view, const BoundingSphere* spheres, uint32_t count, uint32_t* visibleIndices)
+{
+	return GetKernels().cullSpheres(view, spheres, count, visibleIndices);
+}
+
+uint32_t SimdMath::CullAabbs(const CullingView& view, const Aabb* boxes, uint32_t count, uint32_t* visibleIndices)
+{
+	return GetKernels().cullAabbs(view, boxes, count, visibleIndices);
+}
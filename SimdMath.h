@@ -0,0 +1,257 @@
+#pragma once
+
+// SSE2 is part of every x64 target, so vector types use it unconditionally there. Defining CDNL_MATH_SCALAR before the
+// precompiled header forces the portable code everywhere, e.g. to compare results.
+#if !defined(CDNL_MATH_SCALAR) && (defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__))
+	#define CDNL_MATH_SSE 1
+#else
+	#define CDNL_MATH_SSE 0
+#endif
+
+static constexpr float MATH_PI = 3.14159265358979323846f;
+
+// Instruction sets the batched kernels are compiled for, picked at startup from what the CPU supports
+enum class SimdIsa
+{
+	Scalar,
+	Sse,
+	Avx2
+};
+
+struct Vec3
+{
+	float x = 0.0f;
+	float y = 0.0f;
+	float z = 0.0f;
+
+	Vec3() = default;
+	constexpr Vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+	Vec3 operator+(const Vec3& other) const { return { x + other.x, y + other.y, z + other.z }; }
+	Vec3 operator-(const Vec3& other) const { return { x - other.x, y - other.y, z - other.z }; }
+	Vec3 operator*(const Vec3& other) const { return { x * other.x, y * other.y, z * other.z }; }
+	Vec3 operator*(float scale) const { return { x * scale, y * scale, z * scale }; }
+	Vec3 operator-() const { return { -x, -y, -z }; }
+
+	Vec3& operator+=(const Vec3& other) { return *this = *this + other; }
+	Vec3& operator-=(const Vec3& other) { return *this = *this - other; }
+	Vec3& operator*=(float scale) { return *this = *this * scale; }
+
+	static float Dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	static Vec3 Cross(const Vec3& a, const Vec3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+	static Vec3 Min(const Vec3& a, const Vec3& b) { return { (std::min)(a.x, b.x), (std::min)(a.y, b.y), (std::min)(a.z, b.z) }; }
+	static Vec3 Max(const Vec3& a, const Vec3& b) { return { (std::max)(a.x, b.x), (std::max)(a.y, b.y), (std::max)(a.z, b.z) }; }
+
+	float Length() const { return std::sqrt(Dot(*this, *this)); }
+
+	// Zero vectors stay zero
+	Vec3 Normalized() const
+	{
+		float length = Length();
+
+		return length > 0.0f ? *this * (1.0f / length) : Vec3();
+	}
+};
+
+struct alignas(16) Vec4
+{
+	float x = 0.0f;
+	float y = 0.0f;
+	float z = 0.0f;
+	float w = 0.0f;
+
+	Vec4() = default;
+	constexpr Vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+	constexpr Vec4(const Vec3& xyz, float w) : x(xyz.x), y(xyz.y), z(xyz.z), w(w) {}
+
+#if CDNL_MATH_SSE
+	explicit Vec4(__m128 value) { _mm_store_ps(&x, value); }
+
+	__m128 Load() const { return _mm_load_ps(&x); }
+
+	Vec4 operator+(const Vec4& other) const { return Vec4(_mm_add_ps(Load(), other.Load())); }
+	Vec4 operator-(const Vec4& other) const { return Vec4(_mm_sub_ps(Load(), other.Load())); }
+	Vec4 operator*(const Vec4& other) const { return Vec4(_mm_mul_ps(Load(), other.Load())); }
+	Vec4 operator*(float scale) const { return Vec4(_mm_mul_ps(Load(), _mm_set1_ps(scale))); }
+#else
+	Vec4 operator+(const Vec4& other) const { return { x + other.x, y + other.y, z + other.z, w + other.w }; }
+	Vec4 operator-(const Vec4& other) const { return { x - other.x, y - other.y, z - other.z, w - other.w }; }
+	Vec4 operator*(const Vec4& other) const { return { x * other.x, y * other.y, z * other.z, w * other.w }; }
+	Vec4 operator*(float scale) const { return { x * scale, y * scale, z * scale, w * scale }; }
+#endif // CDNL_MATH_SSE
+
+	Vec3 Xyz() const { return { x, y, z }; }
+
+	static float Dot(const Vec4& a, const Vec4& b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+};
+
+// Unit quaternion, rotating by q is q * v * conjugate(q)
+struct alignas(16) Quat
+{
+	float x = 0.0f;
+	float y = 0.0f;
+	float z = 0.0f;
+	float w = 1.0f;
+
+	Quat() = default;
+	constexpr Quat(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+
+	// Applies other first, then this
+	Quat operator*(const Quat& other) const
+	{
+		return {
+			w * other.x + x * other.w + y * other.z - z * other.y,
+			w * other.y - x * other.z + y * other.w + z * other.x,
+			w * other.z + x * other.y - y * other.x + z * other.w,
+			w * other.w - x * other.x - y * other.y - z * other.z
+		};
+	}
+
+	Quat Conjugate() const { return { -x, -y, -z, w }; }
+
+	Quat Normalized() const
+	{
+		float length = std::sqrt(x * x + y * y + z * z + w * w);
+
+		return length > 0.0f ? Quat(x / length, y / length, z / length, w / length) : Quat();
+	}
+
+	Vec3 Rotate(const Vec3& v) const
+	{
+		// v + 2w (q x v) + 2 q x (q x v), with q the vector part
+		Vec3 q = { x, y, z };
+		Vec3 t = Vec3::Cross(q, v) * 2.0f;
+
+		return v + t * w + Vec3::Cross(q, t);
+	}
+
+	// axis must be normalized, angle in radians
+	static Quat FromAxisAngle(const Vec3& axis, float angle)
+	{
+		float s = std::sin(angle * 0.5f);
+
+		return { axis.x * s, axis.y * s, axis.z * s, std::cos(angle * 0.5f) };
+	}
+
+	// Normalized linear interpolation along the shorter arc, close enough to slerp for animation steps
+	static Quat Nlerp(const Quat& a, const Quat& b, float t)
+	{
+		float sign = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0.0f ? -1.0f : 1.0f;
+
+		return Quat(a.x + (b.x * sign - a.x) * t, a.y + (b.y * sign - a.y) * t, a.z + (b.z * sign - a.z) * t, a.w + (b.w * sign - a.w) * t).Normalized();
+	}
+};
+
+// Column-major like GLSL, so Data() can be handed to push constants and the float pointer APIs as it is.
+// Vectors are columns, a * b applies b first.
+struct alignas(16) Mat4
+{
+	Vec4 columns[4] = { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } };
+
+	const float* Data() const { return &columns[0].x; }
+	float* Data() { return &columns[0].x; }
+
+	// Element of the given row and column
+	float Get(uint32_t row, uint32_t column) const { return Data()[column * 4 + row]; }
+
+	Vec4 operator*(const Vec4& v) const
+	{
+#if CDNL_MATH_SSE
+		__m128 result = _mm_mul_ps(columns[0].Load(), _mm_set1_ps(v.x));
+		result = _mm_add_ps(result, _mm_mul_ps(columns[1].Load(), _mm_set1_ps(v.y)));
+		result = _mm_add_ps(result, _mm_mul_ps(columns[2].Load(), _mm_set1_ps(v.z)));
+		result = _mm_add_ps(result, _mm_mul_ps(columns[3].Load(), _mm_set1_ps(v.w)));
+
+		return Vec4(result);
+#else
+		return columns[0] * v.x + columns[1] * v.y + columns[2] * v.z + columns[3] * v.w;
+#endif // CDNL_MATH_SSE
+	}
+
+	Mat4 operator*(const Mat4& other) const
+	{
+		Mat4 result;
+
+		for (uint32_t column = 0; column < 4; column++)
+		{
+			result.columns[column] = *this * other.columns[column];
+		}
+
+		return result;
+	}
+
+	Vec3 TransformPoint(const Vec3& p) const { return (*this * Vec4(p, 1.0f)).Xyz(); }
+	Vec3 TransformDirection(const Vec3& d) const { return (*this * Vec4(d, 0.0f)).Xyz(); }
+
+	Mat4 Transposed() const;
+
+	// General inverse, the identity if the matrix is singular
+	Mat4 Inverse() const;
+
+	// Inverse of a rotation, scale and translation without projection, cheaper than Inverse
+	Mat4 InverseAffine() const;
+
+	static Mat4 Identity() { return {}; }
+
+	static Mat4 Translation(const Vec3& translation);
+	static Mat4 Scale(const Vec3& scale);
+	static Mat4 Rotation(const Quat& rotation);
+
+	// Scale first, then rotation, then translation
+	static Mat4 Compose(const Vec3& translation, const Quat& rotation, const Vec3& scale);
+
+	// Right-handed view looking down -Z with Y up
+	static Mat4 LookAt(const Vec3& eye, const Vec3& target, const Vec3& up);
+
+	// Vulkan clip space: 0 to 1 depth and Y pointing down, so no flip is needed in the shaders. fovY in radians.
+	static Mat4 Perspective(float fovY, float aspect, float nearZ, float farZ);
+};
+
+// Axis-aligned box as center and half extents, 32 bytes so eight of them load as sixteen aligned vectors
+struct alignas(16) Aabb
+{
+	Vec3 center;
+	float reserved0 = 0.0f;
+
+	Vec3 extents;
+	float reserved1 = 0.0f;
+
+	static Aabb FromMinMax(const Vec3& min, const Vec3& max) { return { (min + max) * 0.5f, 0.0f, (max - min) * 0.5f, 0.0f }; }
+
+	Vec3 GetMin() const { return center - extents; }
+	Vec3 GetMax() const { return center + extents; }
+};
+
+struct alignas(16) BoundingSphere
+{
+	Vec3 center;
+	float radius = 0.0f;
+};
+
+// Batched kernels for the transform and culling hot loops. Each has a scalar, an SSE and an AVX2 version, the widest
+// one the CPU runs is chosen on first use. Arrays are independent per element, any count works.
+class SimdMath
+{
+public:
+	static SimdIsa GetIsa();
+
+	// Forces an instruction set, e.g. to benchmark the versions against each other. Unsupported ones fall back to the best supported.
+	static void SetIsa(SimdIsa isa);
+
+	static const char* GetIsaName(SimdIsa isa);
+
+	// worlds[i] = Compose(positions[i], rotations[i], scales[i])
+	static void ComposeMatrices(const Vec3* positions, const Quat* rotations, const Vec3* scales, Mat4* worlds, uint32_t count);
+
+	// results[i] = a[i] * b[i], results may alias b
+	static void MultiplyMatrices(const Mat4* a, const Mat4* b, Mat4* results, uint32_t count);
+
+	// Smallest world space box around each transformed local box (Arvo's method)
+	static void TransformAabbs(const Mat4* matrices, const Aabb* local, Aabb* world, uint32_t count);
+
+	// Writes the indices of the spheres and boxes inside or intersecting all six planes, returns how many were written.
+	// visibleIndices needs room for count entries.
+	static uint32_t CullSpheres(const CullingView& view, const BoundingSphere* spheres, uint32_t count, uint32_t* visibleIndices);
+	static uint32_t CullAabbs(const CullingView& view, const Aabb* boxes, uint32_t count, uint32_t* visibleIndices);
+};
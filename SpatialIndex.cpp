@@ -0,0 +1,1233 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+// Depth first traversal stack, on the stack frame unless a query walks an unusually deep tree
+template<typename T>
+class TraversalStack
+{
+public:
+	void Push(const T& item)
+	{
+		if (m_count < INLINE_CAPACITY)
+		{
+			m_inline[m_count] = item;
+		}
+		else
+		{
+			m_overflow.push_back(item);
+		}
+
+		m_count++;
+	}
+
+	T Pop()
+	{
+		m_count--;
+
+		if (m_count < INLINE_CAPACITY)
+		{
+			return m_inline[m_count];
+		}
+
+		T item = m_overflow.back();
+		m_overflow.pop_back();
+
+		return item;
+	}
+
+	bool IsEmpty() const { return m_count == 0; }
+
+private:
+	static constexpr uint32_t INLINE_CAPACITY = 256;
+
+	T m_inline[INLINE_CAPACITY];
+	std::vector<T> m_overflow;
+	uint32_t m_count = 0;
+};
+
+// Frustum node visit: planes whose bit is set in mask still have to be tested, the others hold the whole node
+struct FrustumEntry
+{
+	uint32_t node;
+	uint32_t mask;
+};
+
+static constexpr uint32_t ALL_PLANES = 0x3f;
+
+// Ray with the reciprocal direction precomputed for the slab test
+struct RaySlabs
+{
+	Vec3 origin;
+	Vec3 inverseDirection;
+	float maxDistance;
+
+	RaySlabs(const Vec3& origin, const Vec3& direction, float maxDistance) : origin(origin), maxDistance(maxDistance)
+	{
+		// FLT_MAX instead of infinity for axis parallel rays, 0 * FLT_MAX is 0 where 0 * infinity would be NaN
+		inverseDirection.x = direction.x != 0.0f ? 1.0f / direction.x : FLT_MAX;
+		inverseDirection.y = direction.y != 0.0f ? 1.0f / direction.y : FLT_MAX;
+		inverseDirection.z = direction.z != 0.0f ? 1.0f / direction.z : FLT_MAX;
+	}
+
+	// Distance at which the ray enters the box, or a negative value when it misses it within maxDistance
+	float Intersect(const Vec3& min, const Vec3& max) const
+	{
+		Vec3 t0 = (min - origin) * inverseDirection;
+		Vec3 t1 = (max - origin) * inverseDirection;
+
+		Vec3 near = Vec3::Min(t0, t1);
+		Vec3 far = Vec3::Max(t0, t1);
+
+		float entry = (std::max)((std::max)(near.x, near.y), (std::max)(near.z, 0.0f));
+		float exit = (std::min)((std::min)(far.x, far.y), (std::min)(far.z, maxDistance));
+
+		return entry <= exit ? entry : -1.0f;
+	}
+};
+
+static float SurfaceArea(const Vec3& min, const Vec3& max)
+{
+	Vec3 size = max - min;
+
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static float UnionArea(const Vec3& minA, const Vec3& maxA, const Vec3& minB, const Vec3& maxB)
+{
+	return SurfaceArea(Vec3::Min(minA, minB), Vec3::Max(maxA, maxB));
+}
+
+static bool Contains(const Vec3& outerMin, const Vec3& outerMax, const Vec3& min, const Vec3& max)
+{
+	return outerMin.x <= min.x && outerMin.y <= min.y && outerMin.z <= min.z && max.x <= outerMax.x && max.y <= outerMax.y && max.z <= outerMax.z;
+}
+
+static bool Overlaps(const Vec3& minA, const Vec3& maxA, const Vec3& minB, const Vec3& maxB)
+{
+	return minA.x <= maxB.x && minB.x <= maxA.x && minA.y <= maxB.y && minB.y <= maxA.y && minA.z <= maxB.z && minB.z <= maxA.z;
+}
+
+// Tests the box against the planes left in mask. Returns false when it is outside one of them, otherwise clears the
+// bits of the planes the box is entirely inside of.
+static bool ClassifyFrustum(const CullingView& view, const Vec3& min, const Vec3& max, uint32_t* mask)
+{
+	Vec3 center = (min + max) * 0.5f;
+	Vec3 extents = (max - min) * 0.5f;
+
+	for (uint32_t plane = 0; plane < 6; plane++)
+	{
+		if ((*mask & (1u << plane)) == 0)
+		{
+			continue;
+		}
+
+		const float* p = view.planes[plane];
+
+		float distance = p[0] * center.x + p[1] * center.y + p[2] * center.z + p[3];
+		float radius = std::abs(p[0]) * extents.x + std::abs(p[1]) * extents.y + std::abs(p[2]) * extents.z;
+
+		if (distance + radius < 0.0f)
+		{
+			return false;
+		}
+
+		if (distance - radius >= 0.0f)
+		{
+			*mask &= ~(1u << plane);
+		}
+	}
+
+	return true;
+}
+
+// DynamicAabbTree
+
+uint32_t DynamicAabbTree::CreateProxy(const Aabb& bounds, uint32_t userData)
+{
+	uint32_t leaf = AllocateNode();
+
+	Node& node = m_nodes[leaf];
+
+	Vec3 margin(m_margin, m_margin, m_margin);
+
+	node.min = bounds.GetMin() - margin;
+	node.max = bounds.GetMax() + margin;
+	node.height = 0;
+	node.userData = userData;
+
+	InsertLeaf(leaf);
+
+	m_proxyCount++;
+
+	return leaf;
+}
+
+void DynamicAabbTree::DestroyProxy(uint32_t proxy)
+{
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+
+	m_proxyCount--;
+}
+
+bool DynamicAabbTree::MoveProxy(uint32_t proxy, const Aabb& bounds)
+{
+	Vec3 min = bounds.GetMin();
+	Vec3 max = bounds.GetMax();
+
+	Node& leaf = m_nodes[proxy];
+
+	if (Contains(leaf.min, leaf.max, min, max))
+	{
+		return false;
+	}
+
+	Vec3 margin(m_margin, m_margin, m_margin);
+
+	min -= margin;
+	max += margin;
+
+	// A leaf that moved out of its box but still touches it keeps its place, the refit grows or shrinks the ancestors
+	// and the rotations repair the tree where the old place got worse. Reinserting costs a descent from the root.
+	if (Overlaps(leaf.min, leaf.max, min, max) && leaf.parent != INVALID_SPATIAL_PROXY)
+	{
+		leaf.min = min;
+		leaf.max = max;
+
+		RefitAncestors(leaf.parent);
+
+		return true;
+	}
+
+	RemoveLeaf(proxy);
+
+	m_nodes[proxy].min = min;
+	m_nodes[proxy].max = max;
+
+	InsertLeaf(proxy);
+
+	return true;
+}
+
+void DynamicAabbTree::QueryFrustum(const CullingView& view, std::vector<uint32_t>& results) const
+{
+	if (m_root == INVALID_SPATIAL_PROXY)
+	{
+		return;
+	}
+
+	TraversalStack<FrustumEntry> stack;
+	stack.Push({ m_root, ALL_PLANES });
+
+	while (!stack.IsEmpty())
+	{
+		FrustumEntry entry = stack.Pop();
+
+		const Node& node = m_nodes[entry.node];
+
+		// Inside all planes, the subtree is reported without further tests
+		if (entry.mask != 0 && !ClassifyFrustum(view, node.min, node.max, &entry.mask))
+		{
+			continue;
+		}
+
+		if (node.IsLeaf())
+		{
+			results.push_back(node.userData);
+
+			continue;
+		}
+
+		stack.Push({ node.children[0], entry.mask });
+		stack.Push({ node.children[1], entry.mask });
+	}
+}
+
+void DynamicAabbTree::QueryOverlap(const Aabb& bounds, std::vector<uint32_t>& results) const
+{
+	if (m_root == INVALID_SPATIAL_PROXY)
+	{
+		return;
+	}
+
+	Vec3 min = bounds.GetMin();
+	Vec3 max = bounds.GetMax();
+
+	TraversalStack<uint32_t> stack;
+	stack.Push(m_root);
+
+	while (!stack.IsEmpty())
+	{
+		const Node& node = m_nodes[stack.Pop()];
+
+		if (!Overlaps(node.min, node.max, min, max))
+		{
+			continue;
+		}
+
+		if (node.IsLeaf())
+		{
+			results.push_back(node.userData);
+
+			continue;
+		}
+
+		stack.Push(node.children[0]);
+		stack.Push(node.children[1]);
+	}
+}
+
+void DynamicAabbTree::QueryRay(const Vec3& origin, const Vec3& direction, float maxDistance, std::vector<uint32_t>& results) const
+{
+	if (m_root == INVALID_SPATIAL_PROXY)
+	{
+		return;
+	}
+
+	RaySlabs ray(origin, direction, maxDistance);
+
+	TraversalStack<uint32_t> stack;
+	stack.Push(m_root);
+
+	while (!stack.IsEmpty())
+	{
+		const Node& node = m_nodes[stack.Pop()];
+
+		if (ray.Intersect(node.min, node.max) < 0.0f)
+		{
+			continue;
+		}
+
+		if (node.IsLeaf())
+		{
+			results.push_back(node.userData);
+
+			continue;
+		}
+
+		stack.Push(node.children[0]);
+		stack.Push(node.children[1]);
+	}
+}
+
+float DynamicAabbTree::GetAreaRatio() const
+{
+	if (m_root == INVALID_SPATIAL_PROXY)
+	{
+		return 0.0f;
+	}
+
+	float rootArea = SurfaceArea(m_nodes[m_root].min, m_nodes[m_root].max);
+
+	if (rootArea <= 0.0f)
+	{
+		return 0.0f;
+	}
+
+	float innerArea = 0.0f;
+
+	for (const Node& node : m_nodes)
+	{
+		if (node.height > 0)
+		{
+			innerArea += SurfaceArea(node.min, node.max);
+		}
+	}
+
+	return innerArea / rootArea;
+}
+
+uint32_t DynamicAabbTree::AllocateNode()
+{
+	uint32_t node = m_freeList;
+
+	if (node == INVALID_SPATIAL_PROXY)
+	{
+		node = static_cast<uint32_t>(m_nodes.size());
+		m_nodes.emplace_back();
+	}
+	else
+	{
+		m_freeList = m_nodes[node].children[0];
+		m_nodes[node] = Node();
+	}
+
+	return node;
+}
+
+void DynamicAabbTree::FreeNode(uint32_t node)
+{
+	m_nodes[node].children[0] = m_freeList;
+	m_nodes[node].height = -1;
+
+	m_freeList = node;
+}
+
+void DynamicAabbTree::InsertLeaf(uint32_t leaf)
+{
+	if (m_root == INVALID_SPATIAL_PROXY)
+	{
+		m_root = leaf;
+		m_nodes[leaf].parent = INVALID_SPATIAL_PROXY;
+
+		return;
+	}
+
+	Vec3 leafMin = m_nodes[leaf].min;
+	Vec3 leafMax = m_nodes[leaf].max;
+
+	// Greedy descent: pairing the leaf with a node grows every ancestor of that node to the union, so each step
+	// compares stopping here with the cheapest lower bound of going into either child
+	uint32_t sibling = m_root;
+
+	while (!m_nodes[sibling].IsLeaf())
+	{
+		const Node& node = m_nodes[sibling];
+
+		float area = SurfaceArea(node.min, node.max);
+		float combinedArea = UnionArea(node.min, node.max, leafMin, leafMax);
+
+		// A new parent of this node and the leaf
+		float cost = 2.0f * combinedArea;
+
+		// Growth of this node every deeper choice pays as well
+		float inheritedCost = 2.0f * (combinedArea - area);
+
+		float childCosts[2];
+
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			const Node& child = m_nodes[node.children[i]];
+
+			float childCombinedArea = UnionArea(child.min, child.max, leafMin, leafMax);
+
+			childCosts[i] = child.IsLeaf() ? childCombinedArea + inheritedCost : childCombinedArea - SurfaceArea(child.min, child.max) + inheritedCost;
+		}
+
+		if (cost < childCosts[0] && cost < childCosts[1])
+		{
+			break;
+		}
+
+		sibling = childCosts[0] <= childCosts[1] ? node.children[0] : node.children[1];
+	}
+
+	uint32_t oldParent = m_nodes[sibling].parent;
+	uint32_t newParent = AllocateNode();
+
+	Node& parent = m_nodes[newParent];
+	parent.parent = oldParent;
+	parent.children[0] = sibling;
+	parent.children[1] = leaf;
+	parent.min = Vec3::Min(m_nodes[sibling].min, leafMin);
+	parent.max = Vec3::Max(m_nodes[sibling].max, leafMax);
+	parent.height = m_nodes[sibling].height + 1;
+
+	m_nodes[sibling].parent = newParent;
+	m_nodes[leaf].parent = newParent;
+
+	if (oldParent == INVALID_SPATIAL_PROXY)
+	{
+		m_root = newParent;
+
+		return;
+	}
+
+	Node& grandParent = m_nodes[oldParent];
+	grandParent.children[grandParent.children[0] == sibling ? 0 : 1] = newParent;
+
+	RefitAncestors(oldParent);
+}
+
+void DynamicAabbTree::RemoveLeaf(uint32_t leaf)
+{
+	if (leaf == m_root)
+	{
+		m_root = INVALID_SPATIAL_PROXY;
+
+		return;
+	}
+
+	uint32_t parent = m_nodes[leaf].parent;
+	uint32_t grandParent = m_nodes[parent].parent;
+	uint32_t sibling = m_nodes[parent].children[0] == leaf ? m_nodes[parent].children[1] : m_nodes[parent].children[0];
+
+	FreeNode(parent);
+
+	m_nodes[sibling].parent = grandParent;
+	m_nodes[leaf].parent = INVALID_SPATIAL_PROXY;
+
+	if (grandParent == INVALID_SPATIAL_PROXY)
+	{
+		m_root = sibling;
+
+		return;
+	}
+
+	Node& node = m_nodes[grandParent];
+	node.children[node.children[0] == parent ? 0 : 1] = sibling;
+
+	RefitAncestors(grandParent);
+}
+
+void DynamicAabbTree::RefitAncestors(uint32_t node)
+{
+	while (node != INVALID_SPATIAL_PROXY)
+	{
+		Node& current = m_nodes[node];
+
+		const Node& child0 = m_nodes[current.children[0]];
+		const Node& child1 = m_nodes[current.children[1]];
+
+		current.min = Vec3::Min(child0.min, child1.min);
+		current.max = Vec3::Max(child0.max, child1.max);
+		current.height = (std::max)(child0.height, child1.height) + 1;
+
+		Rotate(node);
+
+		node = m_nodes[node].parent;
+	}
+}
+
+void DynamicAabbTree::Rotate(uint32_t a)
+{
+	// Node a has children b and c. Swapping b with a child of c, or c with a child of b, keeps a's box but changes the
+	// box of the child that receives the grandchild. The swap that shrinks that box the most is applied.
+	Node& nodeA = m_nodes[a];
+
+	if (nodeA.height < 2)
+	{
+		return;
+	}
+
+	uint32_t b = nodeA.children[0];
+	uint32_t c = nodeA.children[1];
+
+	const Node& nodeB = m_nodes[b];
+	const Node& nodeC = m_nodes[c];
+
+	// Candidates: the child of a that moves down, and the grandchild that moves up in its place
+	uint32_t bestUp = INVALID_SPATIAL_PROXY;
+	uint32_t bestDown = INVALID_SPATIAL_PROXY;
+	float bestGain = 0.0f;
+
+	auto consider = [&](uint32_t down, const Node& downNode, const Node& other)
+	{
+		if (other.IsLeaf())
+		{
+			return;
+		}
+
+		float otherArea = SurfaceArea(other.min, other.max);
+
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			// The grandchild swapped up leaves its sibling to share the other child with the node moved down
+			const Node& kept = m_nodes[other.children[1 - i]];
+
+			float gain = otherArea - UnionArea(downNode.min, downNode.max, kept.min, kept.max);
+
+			if (gain > bestGain)
+			{
+				bestGain = gain;
+				bestUp = other.children[i];
+				bestDown = down;
+			}
+		}
+	};
+
+	consider(b, nodeB, nodeC);
+	consider(c, nodeC, nodeB);
+
+	if (bestUp == INVALID_SPATIAL_PROXY)
+	{
+		return;
+	}
+
+	uint32_t other = bestDown == b ? c : b;
+
+	Node& otherNode = m_nodes[other];
+
+	nodeA.children[bestDown == b ? 0 : 1] = bestUp;
+	otherNode.children[otherNode.children[0] == bestUp ? 0 : 1] = bestDown;
+
+	m_nodes[bestUp].parent = a;
+	m_nodes[bestDown].parent = other;
+
+	const Node& child0 = m_nodes[otherNode.children[0]];
+	const Node& child1 = m_nodes[otherNode.children[1]];
+
+	otherNode.min = Vec3::Min(child0.min, child1.min);
+	otherNode.max = Vec3::Max(child0.max, child1.max);
+	otherNode.height = (std::max)(child0.height, child1.height) + 1;
+
+	nodeA.height = (std::max)(m_nodes[nodeA.children[0]].height, m_nodes[nodeA.children[1]].height) + 1;
+}
+
+// StaticBvh
+
+void StaticBvh::Build(const Aabb* bounds, uint32_t count, JobSystem* jobSystem)
+{
+	m_nodes.clear();
+	m_boxes.resize(count);
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	m_jobSystem = jobSystem;
+
+	Node root;
+	root.min = Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	root.max = Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	root.first = 0;
+	root.count = count;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Box& box = m_boxes[i];
+		box.min = bounds[i].GetMin();
+		box.max = bounds[i].GetMax();
+		box.index = i;
+
+		root.min = Vec3::Min(root.min, box.min);
+		root.max = Vec3::Max(root.max, box.max);
+	}
+
+	// A binary tree with at least one box per leaf never needs more, so the threads never resize the array
+	m_nodes.resize(2 * static_cast<size_t>(count) - 1);
+	m_nodes[0] = root;
+	m_nodeCount.store(1, std::memory_order_relaxed);
+
+	Subdivide(0);
+
+	m_nodes.resize(m_nodeCount.load(std::memory_order_relaxed));
+	m_nodes.shrink_to_fit();
+
+	m_jobSystem = nullptr;
+}
+
+void StaticBvh::QueryFrustum(const CullingView& view, std::vector<uint32_t>& results) const
+{
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	TraversalStack<FrustumEntry> stack;
+	stack.Push({ 0, ALL_PLANES });
+
+	while (!stack.IsEmpty())
+	{
+		FrustumEntry entry = stack.Pop();
+
+		const Node& node = m_nodes[entry.node];
+
+		if (entry.mask != 0 && !ClassifyFrustum(view, node.min, node.max, &entry.mask))
+		{
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			stack.Push({ node.first, entry.mask });
+			stack.Push({ node.first + 1, entry.mask });
+
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+		{
+			uint32_t mask = entry.mask;
+
+			if (mask == 0 || ClassifyFrustum(view, m_boxes[i].min, m_boxes[i].max, &mask))
+			{
+				results.push_back(m_boxes[i].index);
+			}
+		}
+	}
+}
+
+void StaticBvh::QueryOverlap(const Aabb& bounds, std::vector<uint32_t>& results) const
+{
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	Vec3 min = bounds.GetMin();
+	Vec3 max = bounds.GetMax();
+
+	TraversalStack<uint32_t> stack;
+	stack.Push(0);
+
+	while (!stack.IsEmpty())
+	{
+		const Node& node = m_nodes[stack.Pop()];
+
+		if (!Overlaps(node.min, node.max, min, max))
+		{
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			stack.Push(node.first);
+			stack.Push(node.first + 1);
+
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+		{
+			if (Overlaps(m_boxes[i].min, m_boxes[i].max, min, max))
+			{
+				results.push_back(m_boxes[i].index);
+			}
+		}
+	}
+}
+
+void StaticBvh::QueryRay(const Vec3& origin, const Vec3& direction, float maxDistance, std::vector<uint32_t>& results) const
+{
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	RaySlabs ray(origin, direction, maxDistance);
+
+	TraversalStack<uint32_t> stack;
+	stack.Push(0);
+
+	while (!stack.IsEmpty())
+	{
+		const Node& node = m_nodes[stack.Pop()];
+
+		if (ray.Intersect(node.min, node.max) < 0.0f)
+		{
+			continue;
+		}
+
+		if (node.count == 0)
+		{
+			stack.Push(node.first);
+			stack.Push(node.first + 1);
+
+			continue;
+		}
+
+		for (uint32_t i = node.first; i < node.first + node.count; i++)
+		{
+			if (ray.Intersect(m_boxes[i].min, m_boxes[i].max) >= 0.0f)
+			{
+				results.push_back(m_boxes[i].index);
+			}
+		}
+	}
+}
+
+bool StaticBvh::RayCastClosest(const Vec3& origin, const Vec3& direction, float maxDistance, uint32_t* index, float* distance) const
+{
+	if (m_nodes.empty())
+	{
+		return false;
+	}
+
+	RaySlabs ray(origin, direction, maxDistance);
+
+	struct RayEntry
+	{
+		uint32_t node;
+		float entry;
+	};
+
+	float rootEntry = ray.Intersect(m_nodes[0].min, m_nodes[0].max);
+
+	if (rootEntry < 0.0f)
+	{
+		return false;
+	}
+
+	TraversalStack<RayEntry> stack;
+	stack.Push({ 0, rootEntry });
+
+	bool hit = false;
+
+	while (!stack.IsEmpty())
+	{
+		RayEntry entry = stack.Pop();
+
+		// Every box below starts behind the closest hit so far
+		if (entry.entry > ray.maxDistance)
+		{
+			continue;
+		}
+
+		const Node& node = m_nodes[entry.node];
+
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				float boxEntry = ray.Intersect(m_boxes[i].min, m_boxes[i].max);
+
+				if (boxEntry >= 0.0f && boxEntry <= ray.maxDistance)
+				{
+					ray.maxDistance = boxEntry;
+					*index = m_boxes[i].index;
+
+					hit = true;
+				}
+			}
+
+			continue;
+		}
+
+		float entry0 = ray.Intersect(m_nodes[node.first].min, m_nodes[node.first].max);
+		float entry1 = ray.Intersect(m_nodes[node.first + 1].min, m_nodes[node.first + 1].max);
+
+		// Pushed last, popped first
+		RayEntry near = { node.first, entry0 };
+		RayEntry far = { node.first + 1, entry1 };
+
+		if (entry1 >= 0.0f && (entry0 < 0.0f || entry1 < entry0))
+		{
+			std::swap(near, far);
+		}
+
+		if (far.entry >= 0.0f)
+		{
+			stack.Push(far);
+		}
+
+		if (near.entry >= 0.0f)
+		{
+			stack.Push(near);
+		}
+	}
+
+	if (hit)
+	{
+		*distance = ray.maxDistance;
+	}
+
+	return hit;
+}
+
+void StaticBvh::Subdivide(uint32_t nodeIndex)
+{
+	// Iterative, badly distributed boxes can make the tree as deep as there are boxes
+	std::vector<uint32_t> stack = { nodeIndex };
+
+	JobCounter counter;
+
+	while (!stack.empty())
+	{
+		uint32_t node = stack.back();
+		stack.pop_back();
+
+		uint32_t children;
+
+		if (!Split(node, &children))
+		{
+			continue;
+		}
+
+		// The smaller half goes to another thread, the larger one keeps this thread busy
+		uint32_t smaller = m_nodes[children].count < m_nodes[children + 1].count ? children : children + 1;
+		uint32_t larger = smaller == children ? children + 1 : children;
+
+		if (m_jobSystem != nullptr && m_nodes[smaller].count + m_nodes[larger].count >= PARALLEL_BUILD_THRESHOLD)
+		{
+			m_jobSystem->Run([this, smaller]() { Subdivide(smaller); }, &counter);
+		}
+		else
+		{
+			stack.push_back(smaller);
+		}
+
+		stack.push_back(larger);
+	}
+
+	if (m_jobSystem != nullptr)
+	{
+		m_jobSystem->Wait(&counter);
+	}
+}
+
+bool StaticBvh::Split(uint32_t nodeIndex, uint32_t* children)
+{
+	// Copied, the children are written to the same array
+	Node node = m_nodes[nodeIndex];
+
+	if (node.count <= MAX_LEAF_SIZE)
+	{
+		return false;
+	}
+
+	uint32_t first = node.first;
+	uint32_t last = node.first + node.count;
+
+	// Binning goes by box centers, doubled to save the halving
+	Vec3 centerMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vec3 centerMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	for (uint32_t i = first; i < last; i++)
+	{
+		Vec3 center = m_boxes[i].min + m_boxes[i].max;
+
+		centerMin = Vec3::Min(centerMin, center);
+		centerMax = Vec3::Max(centerMax, center);
+	}
+
+	// Binning along the axis the centers spread the most, the other two rarely split better
+	float centerExtents[3] = { centerMax.x - centerMin.x, centerMax.y - centerMin.y, centerMax.z - centerMin.z };
+	float centerMins[3] = { centerMin.x, centerMin.y, centerMin.z };
+
+	uint32_t axis = centerExtents[0] >= centerExtents[1] ? 0 : 1;
+	axis = centerExtents[axis] >= centerExtents[2] ? axis : 2;
+
+	Node childNodes[2];
+
+	for (Node& childNode : childNodes)
+	{
+		childNode.min = Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+		childNode.max = Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	}
+
+	uint32_t middle = first + node.count / 2;
+
+	// Extents so small that the scale overflows would turn centers into inf or NaN bin positions, binning then treats
+	// them like coinciding centers
+	float scale = centerExtents[axis] > 0.0f ? BIN_COUNT / centerExtents[axis] : 0.0f;
+
+	bool binned = false;
+
+	if (scale > 0.0f && std::isfinite(scale))
+	{
+		struct Bin
+		{
+			Vec3 min = Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+			Vec3 max = Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			uint32_t count = 0;
+		};
+
+		Bin bins[BIN_COUNT];
+
+		float axisMin = centerMins[axis];
+
+		auto binOf = [&](const Box& box)
+		{
+			float center = (&box.min.x)[axis] + (&box.max.x)[axis];
+
+			return (std::min)(static_cast<uint32_t>((center - axisMin) * scale), BIN_COUNT - 1);
+		};
+
+		for (uint32_t i = first; i < last; i++)
+		{
+			Bin& bin = bins[binOf(m_boxes[i])];
+
+			bin.min = Vec3::Min(bin.min, m_boxes[i].min);
+			bin.max = Vec3::Max(bin.max, m_boxes[i].max);
+			bin.count++;
+		}
+
+		// Sweeping from the right stores the bounds and cost of everything after each split
+		Bin rightBins[BIN_COUNT];
+
+		for (uint32_t bin = BIN_COUNT - 1; bin > 0; bin--)
+		{
+			const Bin& previous = bin + 1 < BIN_COUNT ? rightBins[bin + 1] : Bin();
+
+			rightBins[bin].min = Vec3::Min(previous.min, bins[bin].min);
+			rightBins[bin].max = Vec3::Max(previous.max, bins[bin].max);
+			rightBins[bin].count = previous.count + bins[bin].count;
+		}
+
+		Bin left;
+
+		uint32_t bestSplit = 0;
+		float bestCost = FLT_MAX;
+		Bin bestLeft;
+
+		// Split s puts bins [0, s) on the left
+		for (uint32_t split = 1; split < BIN_COUNT; split++)
+		{
+			left.min = Vec3::Min(left.min, bins[split - 1].min);
+			left.max = Vec3::Max(left.max, bins[split - 1].max);
+			left.count += bins[split - 1].count;
+
+			const Bin& right = rightBins[split];
+
+			if (left.count == 0 || right.count == 0)
+			{
+				continue;
+			}
+
+			float cost = SurfaceArea(left.min, left.max) * left.count + SurfaceArea(right.min, right.max) * right.count;
+
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = split;
+				bestLeft = left;
+			}
+		}
+
+		// Centers usually spread over more than one bin, rounding can still drop them all into one
+		if (bestSplit != 0)
+		{
+			Box* split = std::partition(m_boxes.data() + first, m_boxes.data() + last, [&](const Box& box) { return binOf(box) < bestSplit; });
+
+			middle = static_cast<uint32_t>(split - m_boxes.data());
+
+			childNodes[0].min = bestLeft.min;
+			childNodes[0].max = bestLeft.max;
+			childNodes[1].min = rightBins[bestSplit].min;
+			childNodes[1].max = rightBins[bestSplit].max;
+
+			binned = true;
+		}
+	}
+
+	if (!binned)
+	{
+		// All centers coincide, any halving is as good as another
+		for (uint32_t i = first; i < last; i++)
+		{
+			Node& childNode = childNodes[i < middle ? 0 : 1];
+
+			childNode.min = Vec3::Min(childNode.min, m_boxes[i].min);
+			childNode.max = Vec3::Max(childNode.max, m_boxes[i].max);
+		}
+	}
+
+	childNodes[0].first = first;
+	childNodes[0].count = middle - first;
+	childNodes[1].first = middle;
+	childNodes[1].count = last - middle;
+
+	*children = m_nodeCount.fetch_add(2, std::memory_order_relaxed);
+
+	m_nodes[*children] = childNodes[0];
+	m_nodes[*children + 1] = childNodes[1];
+
+	// Turns the node into an inner node only now, queries never run during the build
+	m_nodes[nodeIndex].first = *children;
+	m_nodes[nodeIndex].count = 0;
+
+	return true;
+}
+
+// SpatialIndexBenchmark
+
+// Deterministic so runs compare
+static uint32_t NextRandom(uint32_t* state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return *state;
+}
+
+static float RandomFloat(uint32_t* state, float min, float max)
+{
+	return min + (max - min) * static_cast<float>(NextRandom(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+void SpatialIndexBenchmark::Run(JobSystem* jobSystem, const std::vector<uint32_t>& objectCounts)
+{
+	using Clock = std::chrono::steady_clock;
+
+	auto milliseconds = [](Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); };
+
+	static constexpr uint32_t QUERY_COUNT = 1000;
+
+	Logger::Info("SPATIAL INDEX BENCHMARK, %s KERNELS", SimdMath::GetIsaName(SimdMath::GetIsa()));
+
+	for (uint32_t objectCount : objectCounts)
+	{
+		uint32_t seed = 0x9e3779b9u;
+
+		// Constant density: the world grows with the object count, the frustum and query sizes stay the same
+		float worldSize = 20.0f * std::cbrt(static_cast<float>(objectCount));
+
+		std::vector<Aabb> boxes(objectCount);
+
+		for (Aabb& box : boxes)
+		{
+			box.center = Vec3(RandomFloat(&seed, 0.0f, worldSize), RandomFloat(&seed, 0.0f, worldSize), RandomFloat(&seed, 0.0f, worldSize));
+			box.extents = Vec3(RandomFloat(&seed, 0.25f, 2.0f), RandomFloat(&seed, 0.25f, 2.0f), RandomFloat(&seed, 0.25f, 2.0f));
+		}
+
+		Vec3 middle = Vec3(worldSize, worldSize, worldSize) * 0.5f;
+		Vec3 eye = middle - Vec3(0.0f, 0.0f, 150.0f);
+
+		Mat4 view = Mat4::LookAt(eye, middle, Vec3(0.0f, 1.0f, 0.0f));
+		Mat4 projection = Mat4::Perspective(1.0f, 16.0f / 9.0f, 0.1f, 300.0f);
+		Mat4 viewProjection = projection * view;
+
+		CullingView cullingView = ClusterCulling::ExtractView(viewProjection.Data(), &eye.x);
+
+		std::vector<uint32_t> visibleIndices(objectCount);
+		std::vector<uint32_t> results;
+		results.reserve(objectCount);
+
+		Clock::time_point start = Clock::now();
+		uint32_t bruteVisible = SimdMath::CullAabbs(cullingView, boxes.data(), objectCount, visibleIndices.data());
+		double bruteTime = milliseconds(start);
+
+		StaticBvh bvh;
+
+		start = Clock::now();
+		bvh.Build(boxes.data(), objectCount, jobSystem);
+		double bvhBuildTime = milliseconds(start);
+
+		start = Clock::now();
+		bvh.QueryFrustum(cullingView, results);
+		double bvhCullTime = milliseconds(start);
+
+		uint32_t bvhVisible = static_cast<uint32_t>(results.size());
+
+		DynamicAabbTree tree;
+
+		// Fat boxes would report more than brute force, the move pass below sets the margin back
+		tree.SetMargin(0.0f);
+
+		std::vector<uint32_t> proxies(objectCount);
+
+		start = Clock::now();
+
+		for (uint32_t i = 0; i < objectCount; i++)
+		{
+			proxies[i] = tree.CreateProxy(boxes[i], i);
+		}
+
+		double treeBuildTime = milliseconds(start);
+
+		results.clear();
+
+		start = Clock::now();
+		tree.QueryFrustum(cullingView, results);
+		double treeCullTime = milliseconds(start);
+
+		uint32_t treeVisible = static_cast<uint32_t>(results.size());
+
+		Logger::Info("%u OBJECTS", objectCount);
+		Logger::Info("  FRUSTUM: BRUTE FORCE %.3f ms, STATIC BVH %.3f ms, DYNAMIC TREE %.3f ms, %u VISIBLE", bruteTime, bvhCullTime, treeCullTime, bruteVisible);
+
+		if (bvhVisible != bruteVisible || treeVisible != bruteVisible)
+		{
+			Logger::Warn("SPATIAL INDEX VISIBLE COUNTS DIFFER: BRUTE FORCE %u, STATIC BVH %u, DYNAMIC TREE %u", bruteVisible, bvhVisible, treeVisible);
+		}
+
+		Logger::Info("  BUILD: STATIC BVH %.3f ms (%u NODES), DYNAMIC TREE %.3f ms (HEIGHT %u, AREA RATIO %.1f)", bvhBuildTime, bvh.GetNodeCount(), treeBuildTime, tree.GetHeight(), tree.GetAreaRatio());
+
+		// Overlap queries with boxes a few objects wide, brute force tests every object
+		std::vector<Aabb> queries(QUERY_COUNT);
+
+		for (Aabb& query : queries)
+		{
+			query.center = Vec3(RandomFloat(&seed, 0.0f, worldSize), RandomFloat(&seed, 0.0f, worldSize), RandomFloat(&seed, 0.0f, worldSize));
+			query.extents = Vec3(5.0f, 5.0f, 5.0f);
+		}
+
+		size_t bruteHits = 0;
+
+		start = Clock::now();
+
+		for (const Aabb& query : queries)
+		{
+			for (const Aabb& box : boxes)
+			{
+				Vec3 distance = query.center - box.center;
+
+				bruteHits += std::abs(distance.x) <= query.extents.x + box.extents.x && std::abs(distance.y) <= query.extents.y + box.extents.y && std::abs(distance.z) <= query.extents.z + box.extents.z ? 1 : 0;
+			}
+		}
+
+		double bruteOverlapTime = milliseconds(start);
+
+		results.clear();
+
+		start = Clock::now();
+
+		for (const Aabb& query : queries)
+		{
+			bvh.QueryOverlap(query, results);
+		}
+
+		double bvhOverlapTime = milliseconds(start);
+
+		size_t bvhHits = results.size();
+		results.clear();
+
+		start = Clock::now();
+
+		for (const Aabb& query : queries)
+		{
+			tree.QueryOverlap(query, results);
+		}
+
+		double treeOverlapTime = milliseconds(start);
+
+		Logger::Info("  %u OVERLAPS: BRUTE FORCE %.3f ms, STATIC BVH %.3f ms, DYNAMIC TREE %.3f ms, %zu HITS", QUERY_COUNT, bruteOverlapTime, bvhOverlapTime, treeOverlapTime, bruteHits);
+
+		if (bvhHits != bruteHits || results.size() != bruteHits)
+		{
+			Logger::Warn("SPATIAL INDEX OVERLAP HITS DIFFER: BRUTE FORCE %zu, STATIC BVH %zu, DYNAMIC TREE %zu", bruteHits, bvhHits, results.size());
+		}
+
+		// Rays across the world from random points towards random points, all hits and the closest
+		start = Clock::now();
+
+		results.clear();
+
+		size_t closestHits = 0;
+
+		for (uint32_t i = 0; i < QUERY_COUNT; i++)
+		{
+			Vec3 origin(RandomFloat(&seed, 0.0f, worldSize), RandomFloat(&seed, 0.0f, worldSize), RandomFloat(&seed, 0.0f, worldSize));
+			Vec3 target(RandomFloat(&seed, 0.0f, worldSize), RandomFloat(&seed, 0.0f, worldSize), RandomFloat(&seed, 0.0f, worldSize));
+
+			Vec3 direction = (target - origin).Normalized();
+
+			bvh.QueryRay(origin, direction, worldSize, results);
+
+			uint32_t index = 0;
+			float distance = 0.0f;
+
+			closestHits += bvh.RayCastClosest(origin, direction, worldSize, &index, &distance) ? 1 : 0;
+		}
+
+		double rayTime = milliseconds(start);
+
+		Logger::Info("  %u RAYS: STATIC BVH %.3f ms, %zu HITS, %zu RAYS HIT SOMETHING", QUERY_COUNT, rayTime, results.size(), closestHits);
+
+		// Every tenth object drifts a little each step, the margin absorbs most of it
+		tree.SetMargin(DynamicAabbTree::DEFAULT_MARGIN);
+
+		uint32_t movedCount = 0;
+
+		start = Clock::now();
+
+		for (uint32_t step = 0; step < 10; step++)
+		{
+			for (uint32_t i = 0; i < objectCount; i += 10)
+			{
+				boxes[i].center += Vec3(RandomFloat(&seed, -0.05f, 0.05f), RandomFloat(&seed, -0.05f, 0.05f), RandomFloat(&seed, -0.05f, 0.05f));
+
+				movedCount += tree.MoveProxy(proxies[i], boxes[i]) ? 1 : 0;
+			}
+		}
+
+		double moveTime = milliseconds(start);
+
+		Logger::Info("  10 STEPS MOVING 10%%: DYNAMIC TREE %.3f ms, %u LEAVES UPDATED, HEIGHT %u, AREA RATIO %.1f", moveTime, movedCount, tree.GetHeight(), tree.GetAreaRatio());
+	}
+}
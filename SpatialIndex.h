@@ -0,0 +1,154 @@
+#pragma once
+
+static constexpr uint32_t INVALID_SPATIAL_PROXY = UINT32_MAX;
+
+// Incrementally updated bounding volume tree for objects that come, go and move. Every object is a leaf whose box is
+// enlarged by a margin, so small moves leave the tree alone. Inserting descends towards the sibling that grows the
+// surface area the least, and every node on the way back up is refitted and rotated when swapping a child with a
+// grandchild makes its children's boxes smaller (SAH guided rotations), which keeps the tree balanced without rebuilds.
+//
+// Queries report the userData given to CreateProxy and test the enlarged boxes, so they may report objects just
+// outside the tested volume.
+class DynamicAabbTree
+{
+public:
+	static constexpr float DEFAULT_MARGIN = 0.1f;
+
+public:
+	// Margin added on every side of the leaves created or moved from now on
+	void SetMargin(float margin) { m_margin = margin; }
+
+	uint32_t CreateProxy(const Aabb& bounds, uint32_t userData);
+	void DestroyProxy(uint32_t proxy);
+
+	// False when the enlarged box still holds bounds and nothing changed. A leaf that moved a little is refitted in
+	// place together with its ancestors, one that jumped away from its old box is removed and inserted again.
+	bool MoveProxy(uint32_t proxy, const Aabb& bounds);
+
+	uint32_t GetUserData(uint32_t proxy) const { return m_nodes[proxy].userData; }
+
+	// The enlarged box the tree holds for the proxy
+	Aabb GetFatBounds(uint32_t proxy) const { return Aabb::FromMinMax(m_nodes[proxy].min, m_nodes[proxy].max); }
+
+	// Append the userData of every proxy whose box intersects the frustum, the box or the ray segment. Ray distances
+	// are in multiples of direction, which need not be normalized.
+	void QueryFrustum(const CullingView& view, std::vector<uint32_t>& results) const;
+	void QueryOverlap(const Aabb& bounds, std::vector<uint32_t>& results) const;
+	void QueryRay(const Vec3& origin, const Vec3& direction, float maxDistance, std::vector<uint32_t>& results) const;
+
+	uint32_t GetProxyCount() const { return m_proxyCount; }
+
+	// Longest path from the root to a leaf, 0 for a single leaf
+	uint32_t GetHeight() const { return m_root == INVALID_SPATIAL_PROXY ? 0 : static_cast<uint32_t>(m_nodes[m_root].height); }
+
+	// Summed surface area of the inner nodes over the root's, lower means cheaper queries
+	float GetAreaRatio() const;
+
+private:
+	struct Node
+	{
+		Vec3 min;
+		uint32_t parent = INVALID_SPATIAL_PROXY;
+
+		Vec3 max;
+
+		// 0 for leaves, -1 for free nodes
+		int32_t height = 0;
+
+		// Free nodes chain through children[0]
+		uint32_t children[2] = { INVALID_SPATIAL_PROXY, INVALID_SPATIAL_PROXY };
+		uint32_t userData = 0;
+
+		bool IsLeaf() const { return children[0] == INVALID_SPATIAL_PROXY; }
+	};
+
+private:
+	std::vector<Node> m_nodes;
+	uint32_t m_root = INVALID_SPATIAL_PROXY;
+	uint32_t m_freeList = INVALID_SPATIAL_PROXY;
+
+	uint32_t m_proxyCount = 0;
+
+	float m_margin = DEFAULT_MARGIN;
+
+private:
+	uint32_t AllocateNode();
+	void FreeNode(uint32_t node);
+
+	void InsertLeaf(uint32_t leaf);
+	void RemoveLeaf(uint32_t leaf);
+
+	// Recomputes box and height from node up to the root, rotating where it pays off
+	void RefitAncestors(uint32_t node);
+	void Rotate(uint32_t node);
+};
+
+// Bounding volume hierarchy over a fixed set of boxes, built once with binned SAH. Nodes are 32 bytes in one array
+// with the two children of a node side by side, and the boxes are reordered so every leaf reads a contiguous run.
+// Large ranges are split off as job system jobs during the build.
+class StaticBvh
+{
+public:
+	static constexpr uint32_t MAX_LEAF_SIZE = 4;
+	static constexpr uint32_t BIN_COUNT = 16;
+
+	// Ranges with at least this many boxes build one of their halves on another thread
+	static constexpr uint32_t PARALLEL_BUILD_THRESHOLD = 8192;
+
+public:
+	// Queries report indices into bounds. jobSystem may be nullptr to build on the calling thread.
+	void Build(const Aabb* bounds, uint32_t count, JobSystem* jobSystem);
+
+	void QueryFrustum(const CullingView& view, std::vector<uint32_t>& results) const;
+	void QueryOverlap(const Aabb& bounds, std::vector<uint32_t>& results) const;
+	void QueryRay(const Vec3& origin, const Vec3& direction, float maxDistance, std::vector<uint32_t>& results) const;
+
+	// Nearest box the ray enters within maxDistance, visiting the nearer child first and skipping farther ones
+	bool RayCastClosest(const Vec3& origin, const Vec3& direction, float maxDistance, uint32_t* index, float* distance) const;
+
+	uint32_t GetNodeCount() const { return static_cast<uint32_t>(m_nodes.size()); }
+	uint32_t GetBoxCount() const { return static_cast<uint32_t>(m_boxes.size()); }
+
+private:
+	// Leaves have count > 0 and own boxes [first, first + count), inner nodes have their children at first and first + 1
+	struct Node
+	{
+		Vec3 min;
+		uint32_t first = 0;
+
+		Vec3 max;
+		uint32_t count = 0;
+	};
+
+	struct Box
+	{
+		Vec3 min;
+		uint32_t index = 0;
+
+		Vec3 max;
+		float reserved = 0.0f;
+	};
+
+private:
+	std::vector<Node> m_nodes;
+	std::vector<Box> m_boxes;
+
+	// Children are claimed in pairs by the build threads
+	std::atomic<uint32_t> m_nodeCount = 0;
+
+	JobSystem* m_jobSystem = nullptr;
+
+private:
+	// Splits node and every node below it, large halves are handed to the job system
+	void Subdivide(uint32_t node);
+
+	// Splits one node with binned SAH, false when it stays a leaf
+	bool Split(uint32_t node, uint32_t* children);
+};
+
+// Times brute force culling against both trees with random boxes and logs the results
+class SpatialIndexBenchmark
+{
+public:
+	static void Run(JobSystem* jobSystem, const std::vector<uint32_t>& objectCounts = { 10000, 100000, 1000000 });
+};
@@ -0,0 +1,86 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+void SystemScheduler::AddSystem(SystemDesc desc)
+{
+	m_systems.push_back({ std::move(desc), {} });
+
+	m_batchesDirty = true;
+}
+
+void SystemScheduler::Run(EntityWorld& world, JobSystem& jobSystem, float deltaTime)
+{
+	if (m_batchesDirty)
+	{
+		BuildBatches();
+	}
+
+	for (uint32_t batch = 0; batch < m_batches.size(); batch++)
+	{
+		uint32_t first = m_batches[batch];
+		uint32_t last = batch + 1 < m_batches.size() ? m_batches[batch + 1] : static_cast<uint32_t>(m_systems.size());
+
+		// Systems of a batch run at the same time, a structural change made directly by one of them would move the
+		// components under the others, so the world refuses them until the batch is done
+		world.BeginIteration();
+
+		// The calling thread takes the first system itself instead of idling in Wait
+		JobCounter counter;
+
+		for (uint32_t system = first + 1; system < last; system++)
+		{
+			jobSystem.Run([this, &world, system, deltaTime]()
+			{
+				m_systems[system].desc.update(world, m_systems[system].commands, deltaTime);
+			}, &counter);
+		}
+
+		m_systems[first].desc.update(world, m_systems[first].commands, deltaTime);
+
+		jobSystem.Wait(&counter);
+
+		world.EndIteration();
+	}
+
+	// Structural changes only happen here, after every system is done iterating
+	for (System& system : m_systems)
+	{
+		if (!system.commands.IsEmpty())
+		{
+			world.Playback(system.commands);
+		}
+	}
+}
+
+void SystemScheduler::BuildBatches()
+{
+	m_batches.clear();
+
+	ComponentMask batchReads = 0;
+	ComponentMask batchWrites = 0;
+
+	for (uint32_t system = 0; system < m_systems.size(); system++)
+	{
+		const SystemDesc& desc = m_systems[system].desc;
+
+		// Read after write, write after read and write after write all need the earlier system to finish first
+		bool conflict = (desc.reads & batchWrites) != 0 || (desc.writes & (batchReads | batchWrites)) != 0;
+
+		if (m_batches.empty() || conflict)
+		{
+			m_batches.push_back(system);
+
+			batchReads = 0;
+			batchWrites = 0;
+		}
+
+		batchReads |= desc.reads;
+		batchWrites |= desc.writes;
+	}
+
+	m_batchesDirty = false;
+
+	Logger::Info("%u SYSTEMS IN %u BATCHES", static_cast<uint32_t>(m_systems.size()), static_cast<uint32_t>(m_batches.size()));
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+struct SystemDesc
+{
+	const char* name = "";
+
+	// Component types the system reads and writes, decides which systems may run side by side
+	ComponentMask reads = 0;
+	ComponentMask writes = 0;
+
+	// Runs on a job system thread. Structural changes go into commands, played back once every system has run, the world
+	// refuses them while the systems run.
+	std::function<void(EntityWorld& world, EntityCommandBuffer& commands, float deltaTime)> update;
+};
+
+// Runs systems in the order they were added. Consecutive systems whose component accesses do not conflict form a batch
+// that runs in parallel, a system writing what an earlier system of the batch reads or writes starts the next batch.
+// Systems are free to split their own work further with EntityWorld::ParallelForEachChunk.
+class SystemScheduler
+{
+public:
+	void AddSystem(SystemDesc desc);
+
+	void Run(EntityWorld& world, JobSystem& jobSystem, float deltaTime);
+
+	uint32_t GetSystemCount() { return static_cast<uint32_t>(m_systems.size()); }
+
+	// Batches of the last Run, 1 when every system conflicts with the one before it
+	uint32_t GetBatchCount() { return static_cast<uint32_t>(m_batches.size()); }
+
+private:
+	struct System
+	{
+		SystemDesc desc;
+
+		// Played back in system order, so the outcome does not depend on which system finished first
+		EntityCommandBuffer commands;
+	};
+
+private:
+	std::vector<System> m_systems;
+
+	// First system of each batch, rebuilt when a system is added
+	std::vector<uint32_t> m_batches;
+	bool m_batchesDirty = false;
+
+private:
+	void BuildBatches();
+};
@@ -0,0 +1,515 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+uint32_t TransformHierarchy::CreateNode(uint32_t parent)
+{
+	if (parent != INVALID_TRANSFORM_NODE && !IsValid(parent))
+	{
+		Logger::Error("TRANSFORM PARENT %u DOES NOT EXIST", parent);
+
+		return INVALID_TRANSFORM_NODE;
+	}
+
+	uint32_t node;
+
+	if (!m_freeNodes.empty())
+	{
+		node = m_freeNodes.back();
+
+		m_freeNodes.pop_back();
+	}
+	else
+	{
+		node = static_cast<uint32_t>(m_nodeSlots.size());
+
+		m_nodeSlots.push_back(INVALID_TRANSFORM_NODE);
+		m_parents.push_back(INVALID_TRANSFORM_NODE);
+		m_firstChildren.push_back(INVALID_TRANSFORM_NODE);
+		m_nextSiblings.push_back(INVALID_TRANSFORM_NODE);
+		m_pendingWrites.push_back(0);
+	}
+
+	// Appended for now, the next Update moves it to its level
+	uint32_t slot = static_cast<uint32_t>(m_slotNodes.size());
+
+	m_slotNodes.push_back(node);
+	m_slotParents.push_back(INVALID_TRANSFORM_NODE);
+	m_positions.emplace_back();
+	m_rotations.emplace_back();
+	m_scales.push_back({ 1.0f, 1.0f, 1.0f });
+	m_worlds.emplace_back();
+	m_dirty.push_back(1);
+	m_changed.push_back(0);
+
+	m_nodeSlots[node] = slot;
+	m_parents[node] = parent;
+	m_firstChildren[node] = INVALID_TRANSFORM_NODE;
+	m_nextSiblings[node] = INVALID_TRANSFORM_NODE;
+	m_pendingWrites[node] = 0;
+
+	if (parent != INVALID_TRANSFORM_NODE)
+	{
+		m_nextSiblings[node] = m_firstChildren[parent];
+		m_firstChildren[parent] = node;
+	}
+
+	m_layoutDirty = true;
+
+	return node;
+}
+
+void TransformHierarchy::DestroyNode(uint32_t node)
+{
+	if (!IsValid(node))
+	{
+		return;
+	}
+
+	Unlink(node);
+
+	// The subtree is walked before its links are cleared, the slots drop out of the storage in the next Update
+	m_order.clear();
+	m_order.push_back(node);
+
+	while (!m_order.empty())
+	{
+		uint32_t current = m_order.back();
+
+		m_order.pop_back();
+
+		for (uint32_t child = m_firstChildren[current]; child != INVALID_TRANSFORM_NODE; child = m_nextSiblings[child])
+		{
+			m_order.push_back(child);
+		}
+
+		m_slotNodes[m_nodeSlots[current]] = INVALID_TRANSFORM_NODE;
+
+		m_nodeSlots[current] = INVALID_TRANSFORM_NODE;
+		m_parents[current] = INVALID_TRANSFORM_NODE;
+		m_firstChildren[current] = INVALID_TRANSFORM_NODE;
+		m_nextSiblings[current] = INVALID_TRANSFORM_NODE;
+		m_pendingWrites[current] = 0;
+
+		m_freeNodes.push_back(current);
+	}
+
+	m_layoutDirty = true;
+}
+
+bool TransformHierarchy::SetParent(uint32_t node, uint32_t parent)
+{
+	if (!IsValid(node) || (parent != INVALID_TRANSFORM_NODE && !IsValid(parent)))
+	{
+		Logger::Error("TRANSFORM NODE %u OR PARENT %u DOES NOT EXIST", node, parent);
+
+		return false;
+	}
+
+	for (uint32_t ancestor = parent; ancestor != INVALID_TRANSFORM_NODE; ancestor = m_parents[ancestor])
+	{
+		if (ancestor == node)
+		{
+			Logger::Error("TRANSFORM NODE %u CANNOT BE PARENTED INTO ITS OWN SUBTREE", node);
+
+			return false;
+		}
+	}
+
+	if (m_parents[node] == parent)
+	{
+		return true;
+	}
+
+	Unlink(node);
+
+	m_parents[node] = parent;
+
+	if (parent != INVALID_TRANSFORM_NODE)
+	{
+		m_nextSiblings[node] = m_firstChildren[parent];
+		m_firstChildren[parent] = node;
+	}
+
+	// The world matrix changes with the parent, the subtree follows through the changed flags
+	m_dirty[m_nodeSlots[node]] = 1;
+
+	m_layoutDirty = true;
+
+	return true;
+}
+
+void TransformHierarchy::SetLocalTransform(uint32_t node, const Vec3& position, const Quat& rotation, const Vec3& scale)
+{
+	uint32_t slot = m_nodeSlots[node];
+
+	m_positions[slot] = position;
+	m_rotations[slot] = rotation;
+	m_scales[slot] = scale;
+
+	MarkDirty(slot);
+}
+
+void TransformHierarchy::SetLocalPosition(uint32_t node, const Vec3& position)
+{
+	uint32_t slot = m_nodeSlots[node];
+
+	m_positions[slot] = position;
+
+	MarkDirty(slot);
+}
+
+void TransformHierarchy::SetLocalRotation(uint32_t node, const Quat& rotation)
+{
+	uint32_t slot = m_nodeSlots[node];
+
+	m_rotations[slot] = rotation;
+
+	MarkDirty(slot);
+}
+
+void TransformHierarchy::SetLocalScale(uint32_t node, const Vec3& scale)
+{
+	uint32_t slot = m_nodeSlots[node];
+
+	m_scales[slot] = scale;
+
+	MarkDirty(slot);
+}
+
+void TransformHierarchy::Update(JobSystem* jobSystem)
+{
+	if (m_layoutDirty)
+	{
+		RebuildLayout();
+	}
+
+	m_updatedCount = 0;
+
+	// A level only needs a pass when one of its nodes is dirty or the level above changed
+	bool parentsChanged = false;
+
+	for (uint32_t level = 0; level < GetLevelCount(); level++)
+	{
+		uint32_t first = m_levelStarts[level];
+		uint32_t last = m_levelStarts[level + 1];
+
+		if (m_levelDirty[level] == 0 && !parentsChanged)
+		{
+			// The next level must not see the flags of an older Update
+			if (m_levelChanged[level] != 0)
+			{
+				memset(&m_changed[first], 0, last - first);
+
+				m_levelChanged[level] = 0;
+			}
+
+			continue;
+		}
+
+		std::atomic<uint32_t> updated = 0;
+
+		auto updateBatch = [&](uint32_t batchFirst, uint32_t batchLast)
+		{
+			updated.fetch_add(UpdateRange(first + batchFirst, first + batchLast, level == 0), std::memory_order_relaxed);
+		};
+
+		if (jobSystem != nullptr)
+		{
+			jobSystem->ParallelFor(last - first, UPDATE_BATCH_SIZE, updateBatch);
+		}
+		else
+		{
+			updateBatch(0, last - first);
+		}
+
+		uint32_t levelUpdated = updated.load(std::memory_order_relaxed);
+
+		m_levelDirty[level] = 0;
+		m_levelChanged[level] = levelUpdated > 0 ? 1 : 0;
+
+		parentsChanged = levelUpdated > 0;
+
+		m_updatedCount += levelUpdated;
+	}
+
+	if (m_updatedCount > 0)
+	{
+		m_hasPendingWrites = true;
+	}
+}
+
+void TransformHierarchy::WriteGpuTransforms(JobSystem* jobSystem, GpuTransform* destination, uint32_t capacity, uint32_t framesInFlight)
+{
+	if (!m_hasPendingWrites || destination == nullptr)
+	{
+		return;
+	}
+
+	uint32_t count = (std::min)(static_cast<uint32_t>(m_nodeSlots.size()), capacity);
+
+	std::atomic<bool> remaining = false;
+
+	// Sequential rows per node, the mapped memory is usually write-combined and is never read here
+	auto writeBatch = [&](uint32_t first, uint32_t last)
+	{
+		bool batchRemaining = false;
+
+		for (uint32_t node = first; node < last; node++)
+		{
+			uint32_t pending = m_pendingWrites[node];
+
+			if (pending == 0)
+			{
+				continue;
+			}
+
+			const float* world = m_worlds[m_nodeSlots[node]].Data();
+
+			GpuTransform& transform = destination[node];
+
+			for (uint32_t row = 0; row < 3; row++)
+			{
+				transform.rows[row * 4] = world[row];
+				transform.rows[row * 4 + 1] = world[4 + row];
+				transform.rows[row * 4 + 2] = world[8 + row];
+				transform.rows[row * 4 + 3] = world[12 + row];
+			}
+
+			// The other frame slots still hold the old matrix, each gets it when its turn comes
+			pending = (pending == WRITE_ALL_FRAMES ? framesInFlight : pending) - 1;
+
+			m_pendingWrites[node] = static_cast<uint8_t>(pending);
+
+			batchRemaining |= pending != 0;
+		}
+
+		if (batchRemaining)
+		{
+			remaining.store(true, std::memory_order_relaxed);
+		}
+	};
+
+	if (jobSystem != nullptr)
+	{
+		jobSystem->ParallelFor(count, WRITE_BATCH_SIZE, writeBatch);
+	}
+	else
+	{
+		writeBatch(0, count);
+	}
+
+	m_hasPendingWrites = remaining.load(std::memory_order_relaxed);
+}
+
+void TransformHierarchy::MarkDirty(uint32_t slot)
+{
+	m_dirty[slot] = 1;
+
+	// Recomputed with the layout otherwise
+	if (!m_layoutDirty)
+	{
+		size_t level = std::upper_bound(m_levelStarts.begin(), m_levelStarts.end(), slot) - m_levelStarts.begin() - 1;
+
+		m_levelDirty[level] = 1;
+	}
+}
+
+void TransformHierarchy::Unlink(uint32_t node)
+{
+	uint32_t parent = m_parents[node];
+
+	if (parent == INVALID_TRANSFORM_NODE)
+	{
+		return;
+	}
+
+	if (m_firstChildren[parent] == node)
+	{
+		m_firstChildren[parent] = m_nextSiblings[node];
+	}
+	else
+	{
+		uint32_t sibling = m_firstChildren[parent];
+
+		while (m_nextSiblings[sibling] != node)
+		{
+			sibling = m_nextSiblings[sibling];
+		}
+
+		m_nextSiblings[sibling] = m_nextSiblings[node];
+	}
+
+	m_parents[node] = INVALID_TRANSFORM_NODE;
+	m_nextSiblings[node] = INVALID_TRANSFORM_NODE;
+}
+
+void TransformHierarchy::RebuildLayout()
+{
+	m_order.clear();
+
+	// Roots keep their relative order, the levels below follow their parents
+	for (uint32_t node : m_slotNodes)
+	{
+		if (node != INVALID_TRANSFORM_NODE && m_parents[node] == INVALID_TRANSFORM_NODE)
+		{
+			m_order.push_back(node);
+		}
+	}
+
+	m_levelStarts.assign(1, 0);
+
+	size_t levelFirst = 0;
+
+	while (levelFirst < m_order.size())
+	{
+		size_t levelLast = m_order.size();
+
+		for (size_t i = levelFirst; i < levelLast; i++)
+		{
+			for (uint32_t child = m_firstChildren[m_order[i]]; child != INVALID_TRANSFORM_NODE; child = m_nextSiblings[child])
+			{
+				m_order.push_back(child);
+			}
+		}
+
+		m_levelStarts.push_back(static_cast<uint32_t>(levelLast));
+
+		levelFirst = levelLast;
+	}
+
+	uint32_t count = static_cast<uint32_t>(m_order.size());
+
+	auto permute = [&](auto& values)
+	{
+		std::remove_reference_t<decltype(values)> sorted(count);
+
+		for (uint32_t slot = 0; slot < count; slot++)
+		{
+			sorted[slot] = values[m_nodeSlots[m_order[slot]]];
+		}
+
+		values.swap(sorted);
+	};
+
+	permute(m_positions);
+	permute(m_rotations);
+	permute(m_scales);
+	permute(m_worlds);
+	permute(m_dirty);
+	permute(m_changed);
+
+	m_slotNodes = m_order;
+
+	for (uint32_t slot = 0; slot < count; slot++)
+	{
+		m_nodeSlots[m_order[slot]] = slot;
+	}
+
+	// Parents come first, so their slots are final by now
+	m_slotParents.resize(count);
+
+	for (uint32_t slot = 0; slot < count; slot++)
+	{
+		uint32_t parent = m_parents[m_order[slot]];
+
+		m_slotParents[slot] = parent == INVALID_TRANSFORM_NODE ? INVALID_TRANSFORM_NODE : m_nodeSlots[parent];
+	}
+
+	uint32_t levelCount = GetLevelCount();
+
+	m_levelDirty.assign(levelCount, 0);
+
+	// The changed flags moved with their nodes, a level without a pass clears them
+	m_levelChanged.assign(levelCount, 1);
+
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		for (uint32_t slot = m_levelStarts[level]; slot < m_levelStarts[level + 1] && m_levelDirty[level] == 0; slot++)
+		{
+			m_levelDirty[level] = m_dirty[slot];
+		}
+	}
+
+	m_layoutDirty = false;
+}
+
+uint32_t TransformHierarchy::UpdateRange(uint32_t first, uint32_t last, bool roots)
+{
+	uint32_t updated = 0;
+
+	Mat4 parents[MAX_RUN_LENGTH];
+
+	uint32_t slot = first;
+	uint32_t checkedUntil = first;
+
+	while (slot < last)
+	{
+		// Parents of neighbouring slots are neighbours too, so a block without dirty nodes and changed parents is
+		// found with two scans. A block that fails is walked node by node before the next one is tried.
+		if (slot >= checkedUntil && slot + SKIP_BLOCK_SIZE <= last)
+		{
+			bool idle = memchr(&m_dirty[slot], 1, SKIP_BLOCK_SIZE) == nullptr;
+
+			if (idle && !roots)
+			{
+				uint32_t firstParent = m_slotParents[slot];
+				uint32_t lastParent = m_slotParents[slot + SKIP_BLOCK_SIZE - 1];
+
+				idle = memchr(&m_changed[firstParent], 1, lastParent - firstParent + 1) == nullptr;
+			}
+
+			if (idle)
+			{
+				memset(&m_changed[slot], 0, SKIP_BLOCK_SIZE);
+
+				slot += SKIP_BLOCK_SIZE;
+
+				continue;
+			}
+
+			checkedUntil = slot + SKIP_BLOCK_SIZE;
+		}
+
+		uint32_t runFirst = slot;
+
+		while (slot < last && slot - runFirst < MAX_RUN_LENGTH && (m_dirty[slot] != 0 || (!roots && m_changed[m_slotParents[slot]] != 0)))
+		{
+			m_dirty[slot] = 0;
+			m_changed[slot] = 1;
+
+			m_pendingWrites[m_slotNodes[slot]] = WRITE_ALL_FRAMES;
+
+			slot++;
+		}
+
+		uint32_t runLength = slot - runFirst;
+
+		if (runLength == 0)
+		{
+			m_changed[slot] = 0;
+
+			slot++;
+
+			continue;
+		}
+
+		// Siblings share a parent and sit side by side, so runs are long wherever a subtree moved
+		SimdMath::ComposeMatrices(&m_positions[runFirst], &m_rotations[runFirst], &m_scales[runFirst], &m_worlds[runFirst], runLength);
+
+		if (!roots)
+		{
+			for (uint32_t i = 0; i < runLength; i++)
+			{
+				parents[i] = m_worlds[m_slotParents[runFirst + i]];
+			}
+
+			SimdMath::MultiplyMatrices(parents, &m_worlds[runFirst], &m_worlds[runFirst], runLength);
+		}
+
+		updated += runLength;
+	}
+
+	return updated;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+static constexpr uint32_t INVALID_TRANSFORM_NODE = UINT32_MAX;
+
+// Rows of an affine object to world matrix as the shaders read them, std430 layout
+struct GpuTransform
+{
+	float rows[12];
+};
+
+static_assert(sizeof(GpuTransform) == 48, "GpuTransform must match the Transform struct of the shaders");
+
+// Scene graph of local transforms. Nodes are kept breadth-first in flat arrays, so every depth level is one contiguous
+// range whose parents all sit in the level before it. Update walks the levels in order and spreads each level over
+// the job system, and only nodes whose local transform changed, or whose parent's world matrix did, are recomputed.
+//
+// Node ids stay stable while the storage order changes, they also index the GPU transform buffer.
+class TransformHierarchy
+{
+public:
+	// Nodes of one level a job updates, and node ids a job writes to the GPU buffer
+	static constexpr uint32_t UPDATE_BATCH_SIZE = 512;
+	static constexpr uint32_t WRITE_BATCH_SIZE = 4096;
+
+public:
+	// A node without parent is a root. The local transform starts as the identity.
+	uint32_t CreateNode(uint32_t parent = INVALID_TRANSFORM_NODE);
+
+	// Destroys the node together with its descendants
+	void DestroyNode(uint32_t node);
+
+	// The local transform is kept, so the node follows its new parent. Fails when parent is the node or one of its descendants.
+	bool SetParent(uint32_t node, uint32_t parent);
+
+	uint32_t GetParent(uint32_t node) const { return m_parents[node]; }
+
+	bool IsValid(uint32_t node) const { return node < m_nodeSlots.size() && m_nodeSlots[node] != INVALID_TRANSFORM_NODE; }
+
+	void SetLocalTransform(uint32_t node, const Vec3& position, const Quat& rotation, const Vec3& scale);
+	void SetLocalPosition(uint32_t node, const Vec3& position);
+	void SetLocalRotation(uint32_t node, const Quat& rotation);
+	void SetLocalScale(uint32_t node, const Vec3& scale);
+
+	const Vec3& GetLocalPosition(uint32_t node) const { return m_positions[m_nodeSlots[node]]; }
+	const Quat& GetLocalRotation(uint32_t node) const { return m_rotations[m_nodeSlots[node]]; }
+	const Vec3& GetLocalScale(uint32_t node) const { return m_scales[m_nodeSlots[node]]; }
+
+	// As of the last Update
+	const Mat4& GetWorldMatrix(uint32_t node) const { return m_worlds[m_nodeSlots[node]]; }
+
+	// Recomputes the world matrices of changed nodes and their descendants. Levels run one after another, the nodes of
+	// a level in parallel on jobSystem, or on the calling thread when it is nullptr.
+	void Update(JobSystem* jobSystem);
+
+	// Writes the world matrices a frame slot has not seen yet into destination, indexed by node id. destination is the
+	// persistently mapped transform buffer of the frame being recorded, whose previous frame has retired. Every change
+	// is written once per frame slot, nodes at or beyond capacity are skipped.
+	void WriteGpuTransforms(JobSystem* jobSystem, GpuTransform* destination, uint32_t capacity, uint32_t framesInFlight);
+
+	uint32_t GetNodeCount() const { return static_cast<uint32_t>(m_nodeSlots.size() - m_freeNodes.size()); }
+
+	uint32_t GetLevelCount() const { return m_levelStarts.empty() ? 0 : static_cast<uint32_t>(m_levelStarts.size() - 1); }
+
+	// World matrices the last Update recomputed
+	uint32_t GetUpdatedCount() const { return m_updatedCount; }
+
+private:
+	// Pending write count of a node changed since the last WriteGpuTransforms, replaced by framesInFlight there
+	static constexpr uint8_t WRITE_ALL_FRAMES = UINT8_MAX;
+
+	// Changed nodes that are neighbours in storage are composed and multiplied as one batch of at most this many
+	static constexpr uint32_t MAX_RUN_LENGTH = 64;
+
+	// Slots whose flags are scanned at once to skip unchanged parts of a level
+	static constexpr uint32_t SKIP_BLOCK_SIZE = 64;
+
+private:
+	// Indexed by node id
+	std::vector<uint32_t> m_nodeSlots;
+	std::vector<uint32_t> m_parents;
+	std::vector<uint32_t> m_firstChildren;
+	std::vector<uint32_t> m_nextSiblings;
+	std::vector<uint8_t> m_pendingWrites;
+	std::vector<uint32_t> m_freeNodes;
+
+	// Indexed by storage slot, breadth-first once the layout is current. New nodes are appended until the next Update.
+	std::vector<uint32_t> m_slotNodes;
+	std::vector<uint32_t> m_slotParents;
+	std::vector<Vec3> m_positions;
+	std::vector<Quat> m_rotations;
+	std::vector<Vec3> m_scales;
+	std::vector<Mat4> m_worlds;
+
+	// m_dirty marks changed local transforms, m_changed the world matrices the last Update recomputed
+	std::vector<uint8_t> m_dirty;
+	std::vector<uint8_t> m_changed;
+
+	// First slot of each level followed by the slot count. Per level: whether a node is dirty, whether the last Update changed any.
+	std::vector<uint32_t> m_levelStarts;
+	std::vector<uint8_t> m_levelDirty;
+	std::vector<uint8_t> m_levelChanged;
+
+	// Creation, destruction and reparenting reorder the storage in the next Update
+	bool m_layoutDirty = false;
+
+	bool m_hasPendingWrites = false;
+
+	uint32_t m_updatedCount = 0;
+
+	// Scratch of the layout rebuild
+	std::vector<uint32_t> m_order;
+
+private:
+	void MarkDirty(uint32_t slot);
+
+	void Unlink(uint32_t node);
+
+	// Sorts the storage breadth-first, dropping destroyed slots
+	void RebuildLayout();
+
+	// Recomputes the changed slots of [first, last) within one level, returns how many changed
+	uint32_t UpdateRange(uint32_t first, uint32_t last, bool roots);
+};
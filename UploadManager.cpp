@@ -0,0 +1,530 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+bool UploadManager::Init(MemoryAllocator* allocator, VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily, std::mutex* queueMutex, VkDeviceSize ringSize)
+{
+	VkResult result;
+
+	m_allocator = allocator;
+	m_device = allocator->GetVkDevice();
+
+	m_transferQueue = transferQueue;
+	m_queueMutex = queueMutex;
+	m_transferFamily = transferFamily;
+	m_graphicsFamily = graphicsFamily;
+
+	m_ringSize = AlignUp(ringSize, STAGING_ALIGNMENT);
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = m_ringSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (!m_allocator->CreateBuffer(bufferInfo, MemoryUsage::CpuToGpu, &m_stagingBuffer, &m_stagingAllocation))
+	{
+		Logger::Error("FAILED TO CREATE STAGING RING");
+
+		return false;
+	}
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = m_transferFamily;
+
+	result = vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO CREATE UPLOAD COMMAND POOL");
+		Logger::Error("%s", string_VkResult(result));
+
+		return false;
+	}
+
+	m_batches.resize(MAX_BATCHES_IN_FLIGHT);
+
+	for (UploadBatch& batch : m_batches)
+	{
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = m_commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		result = vkAllocateCommandBuffers(m_device, &allocInfo, &batch.commandBuffer);
+
+		if (result != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO ALLOCATE UPLOAD COMMAND BUFFER");
+			Logger::Error("%s", string_VkResult(result));
+
+			return false;
+		}
+
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		result = vkCreateFence(m_device, &fenceInfo, nullptr, &batch.fence);
+
+		if (result != VK_SUCCESS)
+		{
+			Logger::Error("FAILED TO CREATE UPLOAD FENCE");
+			Logger::Error("%s", string_VkResult(result));
+
+			return false;
+		}
+	}
+
+	Logger::Info("UPLOAD MANAGER INITIALIZED (%llu MB STAGING RING, %s)", (unsigned long long)(m_ringSize >> 20), HasDedicatedTransferQueue() ? "DEDICATED TRANSFER QUEUE" : "GRAPHICS QUEUE");
+
+	return true;
+}
+
+void UploadManager::Destroy()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_recording)
+	{
+		FlushLocked();
+	}
+
+	WaitForBatchLocked(m_submittedBatch);
+
+	for (UploadBatch& batch : m_batches)
+	{
+		vkDestroyFence(m_device, batch.fence, nullptr);
+	}
+
+	m_batches.clear();
+
+	vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+
+	if (m_stagingBuffer != VK_NULL_HANDLE)
+	{
+		m_allocator->DestroyBuffer(m_stagingBuffer, m_stagingAllocation);
+
+		m_stagingBuffer = VK_NULL_HANDLE;
+	}
+}
+
+uint64_t UploadManager::UploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	VkBuffer srcBuffer;
+	VkDeviceSize srcOffset;
+	void* mapped;
+
+	if (!AllocateStaging(size, &srcBuffer, &srcOffset, &mapped))
+	{
+		return 0;
+	}
+
+	memcpy(mapped, data, size);
+
+	UploadBatch& batch = BeginBatch();
+
+	VkBufferCopy region{};
+	region.srcOffset = srcOffset;
+	region.dstOffset = dstOffset;
+	region.size = size;
+
+	vkCmdCopyBuffer(batch.commandBuffer, srcBuffer, dstBuffer, 1, &region);
+
+	if (HasDedicatedTransferQueue())
+	{
+		// Release half of the ownership transfer, the graphics queue records the matching acquire once the batch is done
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = m_transferFamily;
+		barrier.dstQueueFamilyIndex = m_graphicsFamily;
+		barrier.buffer = dstBuffer;
+		barrier.offset = dstOffset;
+		barrier.size = size;
+
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+		batch.bufferAcquires.push_back(barrier);
+	}
+
+	return m_submittedBatch + 1;
+}
+
+uint64_t UploadManager::UploadImage(VkImage image, VkExtent3D extent, VkImageAspectFlags aspectMask, const void* data, VkDeviceSize size, VkImageLayout finalLayout)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	VkBuffer srcBuffer;
+	VkDeviceSize srcOffset;
+	void* mapped;
+
+	if (!AllocateStaging(size, &srcBuffer, &srcOffset, &mapped))
+	{
+		return 0;
+	}
+
+	memcpy(mapped, data, size);
+
+	UploadBatch& batch = BeginBatch();
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = aspectMask;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	VkBufferImageCopy region{};
+	region.bufferOffset = srcOffset;
+	region.imageSubresource.aspectMask = aspectMask;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = extent;
+
+	vkCmdCopyBufferToImage(batch.commandBuffer, srcBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = finalLayout;
+
+	if (HasDedicatedTransferQueue())
+	{
+		// The layout transition is part of the ownership transfer and is executed once, between release and acquire
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = m_transferFamily;
+		barrier.dstQueueFamilyIndex = m_graphicsFamily;
+
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+		batch.imageAcquires.push_back(barrier);
+	}
+	else
+	{
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	return m_submittedBatch + 1;
+}
+
+uint64_t UploadManager::Flush()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return FlushLocked();
+}
+
+void UploadManager::Update()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	UpdateLocked();
+}
+
+void UploadManager::WaitForBatch(uint64_t batch)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Waiting on the batch that is still being recorded would never return
+	if (m_recording && batch > m_submittedBatch)
+	{
+		FlushLocked();
+	}
+
+	WaitForBatchLocked(batch);
+}
+
+void UploadManager::RecordAcquireBarriers(VkCommandBuffer commandBuffer)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_pendingBufferAcquires.empty() && m_pendingImageAcquires.empty())
+	{
+		return;
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+		0, nullptr,
+		static_cast<uint32_t>(m_pendingBufferAcquires.size()), m_pendingBufferAcquires.data(),
+		static_cast<uint32_t>(m_pendingImageAcquires.size()), m_pendingImageAcquires.data());
+
+	m_pendingBufferAcquires.clear();
+	m_pendingImageAcquires.clear();
+}
+
+bool UploadManager::AllocateStaging(VkDeviceSize size, VkBuffer* buffer, VkDeviceSize* offset, void** mapped)
+{
+	// Large one-off uploads get their own staging buffer instead of draining the ring, it is freed with the batch
+	if (size > m_ringSize / 2)
+	{
+		TemporaryBuffer temporary;
+
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (!m_allocator->CreateBuffer(bufferInfo, MemoryUsage::CpuToGpu, &temporary.buffer, &temporary.allocation))
+		{
+			Logger::Error("FAILED TO CREATE STAGING BUFFER (%llu BYTES)", (unsigned long long)size);
+
+			return false;
+		}
+
+		BeginBatch().temporaryBuffers.push_back(temporary);
+
+		*buffer = temporary.buffer;
+		*offset = 0;
+		*mapped = temporary.allocation.mapped;
+
+		return true;
+	}
+
+	UpdateLocked();
+
+	while (!TryAllocateRing(size, offset))
+	{
+		// The ring is full of staged copies, submit them and wait for the oldest batch to give its space back
+		if (m_recording)
+		{
+			FlushLocked();
+		}
+
+		if (m_completedBatch == m_submittedBatch)
+		{
+			Logger::Error("STAGING RING EXHAUSTED (%llu BYTES REQUESTED)", (unsigned long long)size);
+
+			return false;
+		}
+
+		WaitForBatchLocked(m_completedBatch + 1);
+	}
+
+	*buffer = m_stagingBuffer;
+	*mapped = static_cast<char*>(m_stagingAllocation.mapped) + *offset;
+
+	return true;
+}
+
+bool UploadManager::TryAllocateRing(VkDeviceSize size, VkDeviceSize* offset)
+{
+	VkDeviceSize aligned = AlignUp(size, STAGING_ALIGNMENT);
+
+	// Rewind an idle ring so the next uploads start from a contiguous region
+	if (m_completedBatch == m_submittedBatch && !m_recording)
+	{
+		m_head = 0;
+		m_tail = 0;
+	}
+
+	// The head never catches up with the tail from behind, so head == tail always means the ring is empty
+	if (m_head >= m_tail)
+	{
+		if (m_head + aligned <= m_ringSize)
+		{
+			*offset = m_head;
+			m_head += aligned;
+
+			return true;
+		}
+
+		if (aligned < m_tail)
+		{
+			*offset = 0;
+			m_head = aligned;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	if (m_head + aligned < m_tail)
+	{
+		*offset = m_head;
+		m_head += aligned;
+
+		return true;
+	}
+
+	return false;
+}
+
+UploadManager::UploadBatch& UploadManager::BeginBatch()
+{
+	if (m_recording)
+	{
+		return m_batches[(m_submittedBatch + 1) % MAX_BATCHES_IN_FLIGHT];
+	}
+
+	// Reuse the slot of the oldest batch, which has to be finished first when all slots are in flight
+	if (m_submittedBatch - m_completedBatch >= MAX_BATCHES_IN_FLIGHT)
+	{
+		WaitForBatchLocked(m_submittedBatch + 1 - MAX_BATCHES_IN_FLIGHT);
+	}
+
+	UploadBatch& batch = m_batches[(m_submittedBatch + 1) % MAX_BATCHES_IN_FLIGHT];
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkResult result = vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO BEGIN RECORDING UPLOAD COMMAND BUFFER");
+		Logger::Error("%s", string_VkResult(result));
+	}
+
+	m_recording = true;
+
+	return batch;
+}
+
+uint64_t UploadManager::FlushLocked()
+{
+	if (!m_recording)
+	{
+		return m_submittedBatch;
+	}
+
+	VkResult result;
+
+	UploadBatch& batch = m_batches[(m_submittedBatch + 1) % MAX_BATCHES_IN_FLIGHT];
+
+	if (!HasDedicatedTransferQueue())
+	{
+		// Same queue family, a single barrier makes every copy of the batch visible to later graphics work
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	result = vkEndCommandBuffer(batch.commandBuffer);
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO RECORD UPLOAD COMMAND BUFFER");
+		Logger::Error("%s", string_VkResult(result));
+	}
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+	if (m_queueMutex != nullptr)
+	{
+		std::lock_guard<std::mutex> queueLock(*m_queueMutex);
+
+		result = vkQueueSubmit(m_transferQueue, 1, &submitInfo, batch.fence);
+	}
+	else
+	{
+		result = vkQueueSubmit(m_transferQueue, 1, &submitInfo, batch.fence);
+	}
+
+	if (result != VK_SUCCESS)
+	{
+		Logger::Error("FAILED TO SUBMIT UPLOAD COMMAND BUFFER");
+		Logger::Error("%s", string_VkResult(result));
+	}
+
+	batch.ringEnd = m_head;
+
+	m_recording = false;
+
+	return ++m_submittedBatch;
+}
+
+void UploadManager::UpdateLocked()
+{
+	while (m_completedBatch < m_submittedBatch)
+	{
+		UploadBatch& batch = m_batches[(m_completedBatch + 1) % MAX_BATCHES_IN_FLIGHT];
+
+		if (vkGetFenceStatus(m_device, batch.fence) != VK_SUCCESS)
+		{
+			break;
+		}
+
+		RetireBatch(batch);
+	}
+}
+
+void UploadManager::WaitForBatchLocked(uint64_t batch)
+{
+	while (m_completedBatch < (std::min)(batch, m_submittedBatch))
+	{
+		UploadBatch& oldest = m_batches[(m_completedBatch + 1) % MAX_BATCHES_IN_FLIGHT];
+
+		VkResult result = vkWaitForFences(m_device, 1, &oldest.fence, VK_TRUE, UINT64_MAX);
+
+		if (result != VK_SUCCESS)
+		{
+			Logger::Error("WAIT FOR UPLOAD FENCE TIMED OUT");
+			Logger::Error("%s", string_VkResult(result));
+
+			return;
+		}
+
+		RetireBatch(oldest);
+	}
+}
+
+void UploadManager::RetireBatch(UploadBatch& batch)
+{
+	vkResetFences(m_device, 1, &batch.fence);
+
+	m_tail = batch.ringEnd;
+
+	m_pendingBufferAcquires.insert(m_pendingBufferAcquires.end(), batch.bufferAcquires.begin(), batch.bufferAcquires.end());
+	m_pendingImageAcquires.insert(m_pendingImageAcquires.end(), batch.imageAcquires.begin(), batch.imageAcquires.end());
+
+	batch.bufferAcquires.clear();
+	batch.imageAcquires.clear();
+
+	for (TemporaryBuffer& temporary : batch.temporaryBuffers)
+	{
+		m_allocator->DestroyBuffer(temporary.buffer, temporary.allocation);
+	}
+
+	batch.temporaryBuffers.clear();
+
+	m_completedBatch.fetch_add(1, std::memory_order_release);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+// Streams buffer and image contents into device local memory through a persistently mapped staging ring.
+// Copies are batched into one submission per Flush, on the dedicated transfer queue when the device has one,
+// so uploads overlap with rendering instead of stalling the graphics queue.
+class UploadManager
+{
+public:
+	static constexpr VkDeviceSize STAGING_RING_SIZE = 64ull << 20;
+	static constexpr uint32_t MAX_BATCHES_IN_FLIGHT = 4;
+
+	// Keeps every staging offset valid for buffer copies and for image copies of any texel or block size
+	static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+public:
+	// queueMutex is held around every submission when the transfer queue is also submitted to by others, e.g. the
+	// graphics queue standing in for a missing transfer queue. nullptr for a queue the upload manager owns alone.
+	bool Init(MemoryAllocator* allocator, VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily, std::mutex* queueMutex, VkDeviceSize ringSize = STAGING_RING_SIZE);
+	void Destroy();
+
+	// The data is copied into staging memory before returning, so the caller may free it right away.
+	// Returns the id of the batch the copy belongs to, or 0 if it could not be staged.
+	uint64_t UploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+
+	// Fills mip 0, layer 0 of an image from tightly packed texels and leaves it in finalLayout.
+	// Previous contents are discarded.
+	uint64_t UploadImage(VkImage image, VkExtent3D extent, VkImageAspectFlags aspectMask, const void* data, VkDeviceSize size, VkImageLayout finalLayout);
+
+	// Submits every copy staged since the last flush in one submission and returns its batch id
+	uint64_t Flush();
+
+	// Retires finished batches without blocking and hands their ownership transfers over to the graphics queue
+	void Update();
+
+	void WaitForBatch(uint64_t batch);
+
+	// A resource is safe to use in any command buffer recorded after the batch has completed
+	bool IsBatchComplete(uint64_t batch) { return batch <= m_completedBatch.load(std::memory_order_acquire); }
+
+	// Records the graphics side of the queue family ownership transfers of completed batches.
+	// Must be called at the start of the next graphics command buffer, before the resources are used.
+	void RecordAcquireBarriers(VkCommandBuffer commandBuffer);
+
+	bool HasDedicatedTransferQueue() { return m_transferFamily != m_graphicsFamily; }
+
+private:
+	struct TemporaryBuffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		MemoryAllocation allocation;
+	};
+
+	struct UploadBatch
+	{
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+
+		// Head of the staging ring when the batch was submitted, everything before it is free once the batch retires
+		VkDeviceSize ringEnd = 0;
+
+		std::vector<VkBufferMemoryBarrier> bufferAcquires;
+		std::vector<VkImageMemoryBarrier> imageAcquires;
+
+		// Staging buffers of uploads too large for the ring
+		std::vector<TemporaryBuffer> temporaryBuffers;
+	};
+
+private:
+	MemoryAllocator* m_allocator = nullptr;
+
+	VkDevice m_device = VK_NULL_HANDLE;
+	VkQueue m_transferQueue = VK_NULL_HANDLE;
+	std::mutex* m_queueMutex = nullptr;
+
+	uint32_t m_transferFamily = 0;
+	uint32_t m_graphicsFamily = 0;
+
+	VkCommandPool m_commandPool = VK_NULL_HANDLE;
+
+	VkBuffer m_stagingBuffer = VK_NULL_HANDLE;
+	MemoryAllocation m_stagingAllocation;
+
+	VkDeviceSize m_ringSize = 0;
+	VkDeviceSize m_head = 0;
+	VkDeviceSize m_tail = 0;
+
+	// Batch ids start at 1, batch n lives in slot n % MAX_BATCHES_IN_FLIGHT
+	std::vector<UploadBatch> m_batches;
+
+	uint64_t m_submittedBatch = 0;
+	// Advanced under m_mutex, read without it by IsBatchComplete
+	std::atomic<uint64_t> m_completedBatch = 0;
+
+	bool m_recording = false;
+
+	std::vector<VkBufferMemoryBarrier> m_pendingBufferAcquires;
+	std::vector<VkImageMemoryBarrier> m_pendingImageAcquires;
+
+	std::mutex m_mutex;
+
+private:
+	bool AllocateStaging(VkDeviceSize size, VkBuffer* buffer, VkDeviceSize* offset, void** mapped);
+	bool TryAllocateRing(VkDeviceSize size, VkDeviceSize* offset);
+
+	UploadBatch& BeginBatch();
+
+	uint64_t FlushLocked();
+	void UpdateLocked();
+	void WaitForBatchLocked(uint64_t batch);
+
+	void RetireBatch(UploadBatch& batch);
+};
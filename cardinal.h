@@ -5,114 +5,273 @@ enum LogPriority
 	TracePriority, DebugPriority, InfoPriority, WarnPriority, ErrorPriority, CriticalPriority
 };
 
+// Messages below this priority compile to nothing, the arguments of Logger calls are still evaluated while those of the
+// CDNL_LOG macros are not. Release builds keep Info and above unless the build defines it.
+#ifndef CDNL_MIN_LOG_PRIORITY
+	#ifdef NDEBUG
+		#define CDNL_MIN_LOG_PRIORITY InfoPriority
+	#else
+		#define CDNL_MIN_LOG_PRIORITY TracePriority
+	#endif // NDEBUG
+#endif // CDNL_MIN_LOG_PRIORITY
+
+// Receives formatted messages on the logger's flush thread, or on the logging thread while the logger is not running.
+// Sinks must not log themselves.
+class LogSink
+{
+public:
+	virtual ~LogSink() = default;
+
+	// text is one message without priority tag and line break
+	virtual void Write(LogPriority priority, const char* text, size_t length) = 0;
+
+	// Called after every batch of messages
+	virtual void Flush() {}
+};
+
+// stdout with a colored priority tag, console attributes on Windows and ANSI escapes on terminals elsewhere
+class ConsoleLogSink : public LogSink
+{
+public:
+	ConsoleLogSink();
+
+	void Write(LogPriority priority, const char* text, size_t length) override;
+	void Flush() override;
+
+private:
+	bool m_colors = true;
+};
+
+class FileLogSink : public LogSink
+{
+public:
+	// Truncates the file
+	explicit FileLogSink(const std::string& path);
+
+	bool IsOpen() { return m_file.is_open(); }
+
+	void Write(LogPriority priority, const char* text, size_t length) override;
+	void Flush() override;
+
+private:
+	std::ofstream m_file;
+};
+
+// Keeps the most recent messages, e.g. for an in-game console or to check output without a terminal
+class MemoryLogSink : public LogSink
+{
+public:
+	struct Line
+	{
+		LogPriority priority;
+		std::string text;
+	};
+
+public:
+	explicit MemoryLogSink(uint32_t capacity = 1024) : m_capacity(capacity) {}
+
+	void Write(LogPriority priority, const char* text, size_t length) override;
+
+	// Oldest first
+	std::vector<Line> GetLines();
+
+	void Clear();
+
+private:
+	std::mutex m_mutex;
+	std::deque<Line> m_lines;
+	uint32_t m_capacity;
+};
+
+// A message with its arguments captured, formatted later on the flush thread. Strings are copied behind the
+// arguments, so the message may reference temporaries. The format string itself must be a literal.
+struct LogRecord
+{
+	static constexpr uint32_t PAYLOAD_SIZE = 224;
+
+	// Eight bytes per argument, the rest holds the copied strings
+	static constexpr uint32_t ARGUMENT_SIZE = 8;
+
+	// Instantiated for the argument types of each call, writes at most size bytes including the terminator
+	int (*format)(const LogRecord& record, char* text, size_t size) = nullptr;
+	const char* message = nullptr;
+
+	LogPriority priority = InfoPriority;
+	uint32_t stringOffset = 0;
+
+	alignas(8) unsigned char payload[PAYLOAD_SIZE];
+};
+
+// printf style logging that costs the calling thread a copy of the arguments into a lock-free ring. A flush thread
+// formats the messages and hands them to the sinks, so console and file I/O stay off the hot paths. Errors and
+// critical messages wait until they are written, they usually precede a throw.
+//
+// Before Init and after Shutdown messages are written on the calling thread. Without AddSink they go to the console.
 class Logger
 {
 public:
+	// Messages the ring holds, a full ring drops messages below Warn and makes the others wait
+	static constexpr uint32_t RING_CAPACITY = 4096;
+
+	// Longest formatted message, longer ones are cut
+	static constexpr uint32_t MAX_MESSAGE_LENGTH = 1024;
+
+public:
+	// Starts the flush thread. Shutdown runs at exit when it was not called before.
+	static void Init();
+
+	// Writes what is queued and stops the flush thread. Other threads should have stopped logging.
+	static void Shutdown();
+
+	// Blocks until every message logged so far has been written to the sinks
+	static void Flush();
+
+	// The sink is used until RemoveSink returns, the caller keeps ownership
+	static void AddSink(LogSink* sink);
+	static void RemoveSink(LogSink* sink);
+
+	// Added by default, remove it for file or memory output only
+	static LogSink* GetConsoleSink();
+
+	// Messages lost to a full ring
+	static uint64_t GetDroppedCount();
+
 	template<typename... Args>
 	static void Trace(const char* message, Args... args)
 	{
-		log("[Trace]\t", TracePriority, message, args...);
+		if constexpr (TracePriority >= CDNL_MIN_LOG_PRIORITY)
+		{
+			Log(TracePriority, message, args...);
+		}
 	}
 
 	template<typename... Args>
 	static void Debug(const char* message, Args... args)
 	{
-		log("[Debug]\t", DebugPriority, message, args...);
+		if constexpr (DebugPriority >= CDNL_MIN_LOG_PRIORITY)
+		{
+			Log(DebugPriority, message, args...);
+		}
 	}
 
 	template<typename... Args>
 	static void Info(const char* message, Args... args)
 	{
-		log("[Info]\t", InfoPriority, message, args...);
+		if constexpr (InfoPriority >= CDNL_MIN_LOG_PRIORITY)
+		{
+			Log(InfoPriority, message, args...);
+		}
 	}
 
 	template<typename... Args>
 	static void Warn(const char* message, Args... args)
 	{
-		log("[Warn]\t", WarnPriority, message, args...);
+		if constexpr (WarnPriority >= CDNL_MIN_LOG_PRIORITY)
+		{
+			Log(WarnPriority, message, args...);
+		}
 	}
 
 	template<typename... Args>
 	static void Error(const char* message, Args... args)
 	{
-		log("[Error]\t", ErrorPriority, message, args...);
+		if constexpr (ErrorPriority >= CDNL_MIN_LOG_PRIORITY)
+		{
+			Log(ErrorPriority, message, args...);
+		}
 	}
 
 	template<typename... Args>
 	static void Critical(const char* message, Args... args)
 	{
-		log("[Critical]\t", CriticalPriority, message, args...);
+		if constexpr (CriticalPriority >= CDNL_MIN_LOG_PRIORITY)
+		{
+			Log(CriticalPriority, message, args...);
+		}
 	}
 
 private:
+	template<typename T>
+	static constexpr bool IsString = std::is_same_v<T, const char*> || std::is_same_v<T, char*>;
+
 	template<typename... Args>
-	static void log(const char* message_priority_str, LogPriority message_priority, const char* message, Args... args)
+	static void Log(LogPriority priority, const char* message, Args... args)
 	{
-		switch (message_priority)
-		{
-		case TracePriority:
-			printf("[TRACE]\t");
-
-			break;
-		case DebugPriority:
-			SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), FOREGROUND_GREEN | FOREGROUND_BLUE);
-			printf("[DEBUG]\t");
-
-			break;
-		case InfoPriority:
-			SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), FOREGROUND_GREEN);
-			printf("[INFO]\t");
-
-			break;
-		case WarnPriority:
-			SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), FOREGROUND_RED | FOREGROUND_GREEN);
-			printf("[WARN]\t");
-
-			break;
-		case ErrorPriority:
-			SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_RED);
-			printf("[ERROR]\t");
-
-			break;
-		case CriticalPriority:
-			SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), FOREGROUND_RED);
-			printf("[CRITICAL]\t");
-
-			break;
-		default:
-			break;
-		}
+		static_assert(sizeof...(Args) * LogRecord::ARGUMENT_SIZE <= LogRecord::PAYLOAD_SIZE, "Too many log arguments");
+
+		LogRecord record;
+		record.format = &FormatRecord<Args...>;
+		record.message = message;
+		record.priority = priority;
+		record.stringOffset = static_cast<uint32_t>(sizeof...(Args)) * LogRecord::ARGUMENT_SIZE;
 
-		printf(message, args...);
-		printf("\n");
+		uint32_t index = 0;
 
-		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE);
+		(CaptureArgument(record, index++, args), ...);
+
+		Submit(record);
 	}
-};
 
-class Directory {
-public:
-	static std::vector<char> ReadFile(const std::string& fileName)
+	template<typename T>
+	static void CaptureArgument(LogRecord& record, uint32_t index, T value)
 	{
-		std::ifstream file(fileName, std::ios::ate | std::ios::binary);
-
-		if (!file.is_open())
+		if constexpr (IsString<T>)
 		{
+			uint32_t offset = CopyString(record, value);
 
-			//Logger::Failed(CDNL_WIN32_SYSTEM, "FAILED TO OPEN FILE");
+			memcpy(record.payload + index * LogRecord::ARGUMENT_SIZE, &offset, sizeof(offset));
+		}
+		else
+		{
+			static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= LogRecord::ARGUMENT_SIZE, "Log arguments must be printf arguments");
 
-			throw std::runtime_error("[WIN32] : FAILED TO OPEN FILE");
+			memcpy(record.payload + index * LogRecord::ARGUMENT_SIZE, &value, sizeof(T));
 		}
+	}
 
-		size_t fileSize = (size_t)file.tellg();
+	template<typename T>
+	static auto ReadArgument(const LogRecord& record, uint32_t index)
+	{
+		if constexpr (IsString<T>)
+		{
+			uint32_t offset;
+			memcpy(&offset, record.payload + index * LogRecord::ARGUMENT_SIZE, sizeof(offset));
 
-		std::vector<char> buffer(fileSize);
+			return reinterpret_cast<const char*>(record.payload + offset);
+		}
+		else
+		{
+			T value;
+			memcpy(&value, record.payload + index * LogRecord::ARGUMENT_SIZE, sizeof(T));
 
-		file.seekg(0);
-		file.read(buffer.data(), fileSize);
+			return value;
+		}
+	}
 
-		file.close();
+	template<typename... Args>
+	static int FormatRecord(const LogRecord& record, char* text, size_t size)
+	{
+		return FormatArguments<Args...>(record, text, size, std::index_sequence_for<Args...>());
+	}
 
-		return buffer;
+	template<typename... Args, size_t... Indices>
+	static int FormatArguments(const LogRecord& record, char* text, size_t size, std::index_sequence<Indices...>)
+	{
+		return Format(text, size, record.message, ReadArgument<Args>(record, static_cast<uint32_t>(Indices))...);
 	}
-};
\ No newline at end of file
+
+	// Copies a string argument behind the others, cut to the room left. Returns its payload offset.
+	static uint32_t CopyString(LogRecord& record, const char* string);
+
+	// vsnprintf, kept out of the templates
+	static int Format(char* text, size_t size, const char* message, ...);
+
+	static void Submit(const LogRecord& record);
+};
+
+// Logger calls whose arguments are dropped along with the message when the priority is filtered out, for hot paths and
+// arguments that cost something to compute
+#define CDNL_LOG_TRACE(...) do { if constexpr (TracePriority >= CDNL_MIN_LOG_PRIORITY) { Logger::Trace(__VA_ARGS__); } } while (0)
+#define CDNL_LOG_DEBUG(...) do { if constexpr (DebugPriority >= CDNL_MIN_LOG_PRIORITY) { Logger::Debug(__VA_ARGS__); } } while (0)
+#define CDNL_LOG_INFO(...) do { if constexpr (InfoPriority >= CDNL_MIN_LOG_PRIORITY) { Logger::Info(__VA_ARGS__); } } while (0)
+#define CDNL_LOG_WARN(...) do { if constexpr (WarnPriority >= CDNL_MIN_LOG_PRIORITY) { Logger::Warn(__VA_ARGS__); } } while (0)
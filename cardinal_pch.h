@@ -1,19 +1,54 @@
 #pragma once
 
 #include <map>
+#include <array>
+#include <bit>
+#include <span>
 #include <set>
+#include <deque>
 #include <ctime>
+#include <cstdio>
+#include <cstdarg>
+#include <cfloat>
+#include <cmath>
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
 #include <chrono>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include <fstream>
+#include <cstring>
 #include <iostream>
 #include <optional>
+#include <unordered_map>
+#include <condition_variable>
 #include <exception>
+#include <filesystem>
 #include <algorithm>
+#include <type_traits>
+#include <functional>
+
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif // _WIN32
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
 
 #include <vulkan/vulkan.h>
 #include <vulkan/vk_enum_string_helper.h>
-#include <fbxsdk.h>
 
@@ -1,16 +1,35 @@
 #pragma once
 
+#include "JobSystem.h"
+#include "MappedFile.h"
+#include "FBXLoader.h"
+#include "MeshOptimizer.h"
 #include "InputManager.h"
 #include "EventSystem.h"
+#include "EntityWorld.h"
+#include "SystemScheduler.h"
 
 #include "EngineWindow.h"
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+#include "PipelineCache.h"
+#include "PipelineRegistry.h"
+#include "RenderGraph.h"
+#include "MeshFormat.h"
+#include "MeshletBuilder.h"
+#include "ClusterCulling.h"
+#include "SimdMath.h"
+#include "TransformHierarchy.h"
+#include "SpatialIndex.h"
+#include "MeshSimplifier.h"
+#include "GpuScene.h"
 #include "EngineRenderer.h"
 #include "EngineApplication.h"
 
 #ifdef _DEBUG
-	CONST BOOL ENABLE_VALIDATION_LAYERS = TRUE;
+	const bool ENABLE_VALIDATION_LAYERS = true;
 #else
-	CONST BOOL ENABLE_VALIDATION_LAYERS = FALSE;
+	const bool ENABLE_VALIDATION_LAYERS = false;
 #endif // NDEBUG
 
 	
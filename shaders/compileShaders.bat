@@ -1,2 +1,10 @@
-C:\VulkanSDK\1.3.250.1\Bin\glslangValidator.exe -V vertex_shader.vert -o vertex_shader.spv
-C:\VulkanSDK\1.3.250.1\Bin\glslangValidator.exe -V fragment_shader.frag -o fragment_shader.spv
\ No newline at end of file
+@echo off
+rem Compiles every shader next to its source with the validator of the installed Vulkan SDK, also run before each Visual Studio build
+set VALIDATOR="%VULKAN_SDK%\Bin\glslangValidator.exe"
+set SHADERS=%~dp0
+
+%VALIDATOR% -V "%SHADERS%vertex_shader.vert" -o "%SHADERS%vertex_shader.spv" || exit /b 1
+%VALIDATOR% -V "%SHADERS%fragment_shader.frag" -o "%SHADERS%fragment_shader.spv" || exit /b 1
+%VALIDATOR% -V "%SHADERS%gpu_scene.vert" -o "%SHADERS%gpu_scene.spv" || exit /b 1
+%VALIDATOR% -V "%SHADERS%gpu_cull.comp" -o "%SHADERS%gpu_cull.spv" || exit /b 1
+%VALIDATOR% -V "%SHADERS%hiz_reduce.comp" -o "%SHADERS%hiz_reduce.spv" || exit /b 1
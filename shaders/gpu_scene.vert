@@ -0,0 +1,57 @@
+#version 450
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inUV;
+
+layout(location = 0) out vec3 fragColor;
+
+struct Instance
+{
+    vec4 rows[3];
+    vec4 bounds;
+
+    uint mesh;
+    float scale;
+    uint transform;
+    uint reserved;
+};
+
+struct Transform
+{
+    vec4 rows[3];
+};
+
+const uint INVALID_TRANSFORM = 0xffffffffu;
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances { Instance instances[]; };
+
+// This frame's world matrices of the transform hierarchy, used by instances that follow a node
+layout(std430, set = 0, binding = 1) readonly buffer Transforms { Transform transforms[]; };
+
+layout(push_constant) uniform Constants
+{
+    mat4 viewProjection;
+} constants;
+
+// Depth pre-pass and shading pass must produce bit-identical depth for the equal test
+invariant gl_Position;
+
+void main() {
+    // The culling shader stores the instance index in firstInstance
+    Instance instance = instances[gl_InstanceIndex];
+
+    if (instance.transform != INVALID_TRANSFORM)
+    {
+        instance.rows = transforms[instance.transform].rows;
+    }
+
+    vec4 position = vec4(inPosition, 1.0);
+    vec3 world = vec3(dot(instance.rows[0], position), dot(instance.rows[1], position), dot(instance.rows[2], position));
+
+    gl_Position = constants.viewProjection * vec4(world, 1.0);
+
+    vec3 normal = vec3(dot(instance.rows[0].xyz, inNormal), dot(instance.rows[1].xyz, inNormal), dot(instance.rows[2].xyz, inNormal));
+
+    fragColor = normalize(normal) * 0.5 + 0.5;
+}
@@ -2,6 +2,9 @@
 
 layout(location = 0) out vec3 fragColor;
 
+// Depth pre-pass and shading pass must produce bit-identical depth for the equal test
+invariant gl_Position;
+
 vec2 positions[3] = vec2[]( vec2(0.0, -0.5), vec2(0.5, 0.5), vec2(-0.5, 0.5));
 
 vec3 colors[3] = vec3[](vec3(1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 0.0, 1.0));
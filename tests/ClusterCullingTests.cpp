@@ -0,0 +1,142 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+#include "TestCommon.h"
+
+// A culled meshlet must not hold a triangle the rasterizer would draw: each triangle either faces away from the eye or
+// lies entirely outside one of the frustum planes
+static bool IsTriangleHidden(const CullingView& view, const std::vector<FBXVertex>& vertices, const uint32_t* triangle)
+{
+	Vec3 corners[3];
+
+	for (uint32_t corner = 0; corner < 3; corner++)
+	{
+		const float* position = vertices[triangle[corner]].position;
+
+		corners[corner] = Vec3(position[0], position[1], position[2]);
+	}
+
+	Vec3 normal = Vec3::Cross(corners[1] - corners[0], corners[2] - corners[0]);
+	Vec3 eye(view.eye[0], view.eye[1], view.eye[2]);
+
+	if (Vec3::Dot(normal, eye - corners[0]) <= 0.0f)
+	{
+		return true;
+	}
+
+	for (const float* plane : view.planes)
+	{
+		bool outside = true;
+
+		for (const Vec3& corner : corners)
+		{
+			outside = outside && plane[0] * corner.x + plane[1] * corner.y + plane[2] * corner.z + plane[3] < 0.0f;
+		}
+
+		if (outside)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// The cooker's meshlets of a unit sphere, culled for a camera at eye looking at target. Returns the culled count.
+static uint32_t CullSphere(const std::vector<FBXVertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<MeshFileMeshlet>& meshlets, const Vec3& eye, const Vec3& target)
+{
+	Mat4 objectToClip = Mat4::Perspective(1.0f, 1.0f, 0.1f, 100.0f) * Mat4::LookAt(eye, target, Vec3(0.0f, 1.0f, 0.0f));
+
+	CullingView view = ClusterCulling::ExtractView(objectToClip.Data(), &eye.x);
+
+	std::vector<IndexRange> ranges;
+
+	uint32_t visibleCount = ClusterCulling::CullMeshlets(view, meshlets, ranges);
+
+	uint32_t rangeIndices = 0;
+	uint32_t visibleIndices = 0;
+
+	for (const IndexRange& range : ranges)
+	{
+		rangeIndices += range.indexCount;
+	}
+
+	for (const MeshFileMeshlet& meshlet : meshlets)
+	{
+		if (ClusterCulling::IsMeshletVisible(view, meshlet))
+		{
+			visibleIndices += meshlet.indexCount;
+
+			continue;
+		}
+
+		bool hidden = true;
+
+		for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3)
+		{
+			hidden = hidden && IsTriangleHidden(view, vertices, &indices[i]);
+		}
+
+		CDNL_TEST_CHECK(hidden);
+	}
+
+	// Merged ranges cover exactly the visible meshlets
+	CDNL_TEST_CHECK(rangeIndices == visibleIndices);
+
+	return static_cast<uint32_t>(meshlets.size()) - visibleCount;
+}
+
+static void TestSphere()
+{
+	std::vector<FBXVertex> vertices;
+	std::vector<uint32_t> indices;
+
+	MakeSphere(100, 101, 1.0f, vertices, indices);
+
+	MeshOptimizer::OptimizeVertexCache(indices, static_cast<uint32_t>(vertices.size()));
+
+	std::vector<MeshFileMeshlet> meshlets;
+
+	MeshletBuilder::Build(vertices, indices, 0, static_cast<uint32_t>(indices.size()), meshlets);
+
+	uint32_t meshletIndices = 0;
+
+	for (const MeshFileMeshlet& meshlet : meshlets)
+	{
+		CDNL_TEST_CHECK(meshlet.firstIndex == meshletIndices);
+		CDNL_TEST_CHECK(meshlet.indexCount <= MESHLET_MAX_TRIANGLES * 3 && meshlet.vertexCount <= MESHLET_MAX_VERTICES);
+
+		meshletIndices += meshlet.indexCount;
+	}
+
+	CDNL_TEST_CHECK(meshletIndices == indices.size());
+
+	// Whole sphere on screen, everything culled is cone culled. Roughly the far half of the sphere faces away.
+	uint32_t coneCulled = CullSphere(vertices, indices, meshlets, Vec3(0.0f, 0.0f, 5.0f), Vec3(0.0f, 0.0f, 0.0f));
+
+	Logger::Info("SPHERE OF %zu TRIANGLES SEEN FROM OUTSIDE: %u OF %zu MESHLETS CONE CULLED", indices.size() / 3, coneCulled, meshlets.size());
+
+	CDNL_TEST_CHECK(coneCulled > meshlets.size() / 4 && coneCulled < meshlets.size() / 2 + 1);
+
+	// Looking away, every meshlet is outside the frustum
+	uint32_t frustumCulled = CullSphere(vertices, indices, meshlets, Vec3(0.0f, 0.0f, 5.0f), Vec3(0.0f, 0.0f, 10.0f));
+
+	CDNL_TEST_CHECK(frustumCulled == meshlets.size());
+
+	// From inside every triangle faces away, which stresses the cone bounds of meshlets seen edge on. The frustum removes at least
+	// the half behind the camera, the cones must remove a good part of the rest.
+	uint32_t insideCulled = CullSphere(vertices, indices, meshlets, Vec3(0.0f, 0.0f, 0.0f), Vec3(0.0f, 0.0f, -1.0f));
+
+	Logger::Info("SPHERE SEEN FROM INSIDE: %u OF %zu MESHLETS CULLED", insideCulled, meshlets.size());
+
+	CDNL_TEST_CHECK(insideCulled > meshlets.size() * 2 / 3);
+}
+
+int main()
+{
+	TestSphere();
+
+	return FinishTests("CLUSTER CULLING TESTS");
+}
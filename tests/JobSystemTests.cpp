@@ -0,0 +1,201 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+#include "TestCommon.h"
+
+// The owner pushes and pops while thieves steal. Every job must come out exactly once, and what the owner wrote into a
+// job before pushing it must be visible to whoever takes it. Build with CARDINAL_SANITIZE_THREAD to have the accesses
+// checked as well.
+static void TestDequeStress()
+{
+	constexpr uint32_t JOB_COUNT = 200000;
+	constexpr uint32_t THIEF_COUNT = 3;
+
+	JobDeque deque;
+
+	std::unique_ptr<Job[]> jobs = std::make_unique<Job[]>(JOB_COUNT);
+	std::unique_ptr<std::atomic<uint32_t>[]> taken = std::make_unique<std::atomic<uint32_t>[]>(JOB_COUNT);
+
+	std::atomic<uint32_t> takenCount = 0;
+	std::atomic<uint32_t> wrongPayloads = 0;
+	std::atomic<bool> ownerDone = false;
+
+	// The payload is a plain field, written before Push and read after the job was taken
+	auto take = [&](Job* job)
+	{
+		uint32_t index = static_cast<uint32_t>(job - jobs.get());
+
+		if (job->counter != reinterpret_cast<JobCounter*>(static_cast<uintptr_t>(index) + 1))
+		{
+			wrongPayloads.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		taken[index].fetch_add(1, std::memory_order_relaxed);
+		takenCount.fetch_add(1, std::memory_order_relaxed);
+	};
+
+	std::vector<std::thread> thieves;
+
+	for (uint32_t thief = 0; thief < THIEF_COUNT; thief++)
+	{
+		thieves.emplace_back([&]()
+		{
+			while (!ownerDone.load(std::memory_order_acquire) || takenCount.load(std::memory_order_relaxed) < JOB_COUNT)
+			{
+				if (Job* job = deque.Steal())
+				{
+					take(job);
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	TestRandom random;
+
+	for (uint32_t next = 0; next < JOB_COUNT;)
+	{
+		// Bursts of pushes, then a few pops, so the deque keeps running nearly empty where owner and thieves race
+		uint32_t burst = random.Next() % 8 + 1;
+
+		for (uint32_t i = 0; i < burst && next < JOB_COUNT; i++)
+		{
+			Job* job = &jobs[next];
+			job->counter = reinterpret_cast<JobCounter*>(static_cast<uintptr_t>(next) + 1);
+
+			if (!deque.Push(job))
+			{
+				break;
+			}
+
+			next++;
+		}
+
+		uint32_t pops = random.Next() % 8;
+
+		for (uint32_t i = 0; i < pops; i++)
+		{
+			if (Job* job = deque.Pop())
+			{
+				take(job);
+			}
+		}
+	}
+
+	while (Job* job = deque.Pop())
+	{
+		take(job);
+	}
+
+	ownerDone.store(true, std::memory_order_release);
+
+	for (std::thread& thief : thieves)
+	{
+		thief.join();
+	}
+
+	uint32_t duplicates = 0;
+	uint32_t missing = 0;
+
+	for (uint32_t i = 0; i < JOB_COUNT; i++)
+	{
+		uint32_t count = taken[i].load(std::memory_order_relaxed);
+
+		duplicates += count > 1 ? 1 : 0;
+		missing += count == 0 ? 1 : 0;
+	}
+
+	Logger::Info("DEQUE STRESS: %u JOBS, %u DUPLICATES, %u MISSING", JOB_COUNT, duplicates, missing);
+
+	CDNL_TEST_CHECK(duplicates == 0);
+	CDNL_TEST_CHECK(missing == 0);
+	CDNL_TEST_CHECK(wrongPayloads.load() == 0);
+}
+
+// Nested parallel loops, dependencies and jobs started from a thread without a deque, on more workers than cores
+static void TestJobSystemStress()
+{
+	JobSystem jobSystem;
+	jobSystem.Init(4);
+
+	for (uint32_t round = 0; round < 20; round++)
+	{
+		std::atomic<uint64_t> sum = 0;
+
+		jobSystem.ParallelFor(256, 4, [&](uint32_t first, uint32_t last)
+		{
+			for (uint32_t i = first; i < last; i++)
+			{
+				jobSystem.ParallelFor(64, 8, [&, i](uint32_t innerFirst, uint32_t innerLast)
+				{
+					for (uint32_t j = innerFirst; j < innerLast; j++)
+					{
+						sum.fetch_add(i * 64 + j, std::memory_order_relaxed);
+					}
+				});
+			}
+		});
+
+		CDNL_TEST_CHECK(sum.load() == 16384ull * 16383 / 2);
+
+		// The dependent jobs may only run once every first stage job has finished
+		JobCounter firstStage;
+		JobCounter secondStage;
+
+		std::atomic<uint32_t> firstDone = 0;
+		std::atomic<uint32_t> orderViolations = 0;
+
+		for (uint32_t i = 0; i < 64; i++)
+		{
+			jobSystem.Run([&]() { firstDone.fetch_add(1, std::memory_order_relaxed); }, &firstStage);
+		}
+
+		for (uint32_t i = 0; i < 64; i++)
+		{
+			jobSystem.Run([&]()
+			{
+				if (firstDone.load(std::memory_order_relaxed) != 64)
+				{
+					orderViolations.fetch_add(1, std::memory_order_relaxed);
+				}
+			}, &secondStage, &firstStage);
+		}
+
+		jobSystem.Wait(&secondStage);
+
+		CDNL_TEST_CHECK(orderViolations.load() == 0);
+
+		std::atomic<uint32_t> foreignDone = 0;
+
+		std::thread foreign([&]()
+		{
+			JobCounter counter;
+
+			for (uint32_t i = 0; i < 32; i++)
+			{
+				jobSystem.Run([&]() { foreignDone.fetch_add(1, std::memory_order_relaxed); }, &counter);
+			}
+
+			jobSystem.Wait(&counter);
+		});
+
+		foreign.join();
+
+		CDNL_TEST_CHECK(foreignDone.load() == 32);
+	}
+
+	jobSystem.Destroy();
+}
+
+int main()
+{
+	TestDequeStress();
+	TestJobSystemStress();
+
+	return FinishTests("JOB SYSTEM TESTS");
+}
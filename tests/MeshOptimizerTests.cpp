@@ -0,0 +1,151 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+#include "TestCommon.h"
+
+// Triangles by corner positions, each rotated to start at its smallest corner and then sorted, so two index buffers
+// compare equal when they draw the same triangles with the same winding in any order
+static std::vector<std::array<float, 9>> CanonicalTriangles(const std::vector<FBXVertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	std::vector<std::array<float, 9>> triangles;
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		std::array<float, 9> triangle;
+
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			memcpy(&triangle[corner * 3], vertices[indices[i + corner]].position, sizeof(float) * 3);
+		}
+
+		uint32_t first = 0;
+
+		for (uint32_t corner = 1; corner < 3; corner++)
+		{
+			if (std::lexicographical_compare(&triangle[corner * 3], &triangle[corner * 3 + 3], &triangle[first * 3], &triangle[first * 3 + 3]))
+			{
+				first = corner;
+			}
+		}
+
+		std::rotate(triangle.begin(), triangle.begin() + first * 3, triangle.end());
+
+		triangles.push_back(triangle);
+	}
+
+	std::sort(triangles.begin(), triangles.end());
+
+	return triangles;
+}
+
+// The cooker's order of passes on a shuffled grid, every pass keeps the triangles and never raises the ACMR it started from
+static void TestShuffledGrid()
+{
+	std::vector<FBXVertex> vertices;
+	std::vector<uint32_t> indices;
+
+	MakeShuffledGridSoup(100, vertices, indices);
+
+	std::vector<std::array<float, 9>> triangles = CanonicalTriangles(vertices, indices);
+
+	uint32_t vertexCount = MeshOptimizer::DeduplicateVertices(vertices, indices);
+
+	CDNL_TEST_CHECK(vertexCount == 101 * 101);
+	CDNL_TEST_CHECK(CanonicalTriangles(vertices, indices) == triangles);
+
+	VertexCacheStats before = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount);
+
+	MeshOptimizer::OptimizeVertexCache(indices, vertexCount);
+
+	VertexCacheStats optimized = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount);
+
+	Logger::Info("SHUFFLED GRID ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", before.acmr, optimized.acmr, before.atvr, optimized.atvr);
+
+	CDNL_TEST_CHECK(optimized.acmr <= before.acmr);
+	CDNL_TEST_CHECK(CanonicalTriangles(vertices, indices) == triangles);
+
+	// Forsyth lands around 0.7 on large grids, shuffled input sits near the worst case of 3
+	CDNL_TEST_CHECK(optimized.acmr < 0.75f);
+
+	MeshOptimizer::OptimizeOverdraw(indices, vertices, 1.05f);
+
+	VertexCacheStats overdraw = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount);
+
+	CDNL_TEST_CHECK(overdraw.acmr <= optimized.acmr * 1.05f + 1e-4f);
+	CDNL_TEST_CHECK(CanonicalTriangles(vertices, indices) == triangles);
+
+	vertexCount = MeshOptimizer::OptimizeVertexFetch(vertices, indices);
+
+	VertexCacheStats fetch = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount);
+
+	// Renumbering changes no cache hit
+	CDNL_TEST_CHECK(vertexCount == 101 * 101);
+	CDNL_TEST_CHECK(fetch.vertexTransforms == overdraw.vertexTransforms);
+	CDNL_TEST_CHECK(CanonicalTriangles(vertices, indices) == triangles);
+
+	// First use order: every index is either seen before or the next new vertex
+	uint32_t nextVertex = 0;
+	bool firstUseOrder = true;
+
+	for (uint32_t index : indices)
+	{
+		firstUseOrder = firstUseOrder && index <= nextVertex;
+		nextVertex = (std::max)(nextVertex, index + 1);
+	}
+
+	CDNL_TEST_CHECK(firstUseOrder);
+}
+
+// Input that is already cache friendly must not come out worse
+static void TestOptimizedInput()
+{
+	std::vector<FBXVertex> vertices;
+	std::vector<uint32_t> indices;
+
+	MakeShuffledGridSoup(64, vertices, indices);
+
+	uint32_t vertexCount = MeshOptimizer::DeduplicateVertices(vertices, indices);
+
+	MeshOptimizer::OptimizeVertexCache(indices, vertexCount);
+
+	VertexCacheStats once = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount);
+
+	MeshOptimizer::OptimizeVertexCache(indices, vertexCount);
+
+	VertexCacheStats twice = MeshOptimizer::AnalyzeVertexCache(indices, vertexCount);
+
+	CDNL_TEST_CHECK(twice.acmr <= once.acmr);
+
+	// Row by row order, which a FIFO cache of 16 already handles well on narrow grids
+	std::vector<uint32_t> rows;
+
+	for (uint32_t y = 0; y < 8; y++)
+	{
+		for (uint32_t x = 0; x < 8; x++)
+		{
+			uint32_t a = y * 9 + x;
+
+			rows.insert(rows.end(), { a, a + 1, a + 10, a, a + 10, a + 9 });
+		}
+	}
+
+	VertexCacheStats rowsBefore = MeshOptimizer::AnalyzeVertexCache(rows, 81);
+
+	MeshOptimizer::OptimizeVertexCache(rows, 81);
+
+	VertexCacheStats rowsAfter = MeshOptimizer::AnalyzeVertexCache(rows, 81);
+
+	Logger::Info("ROW ORDER GRID ACMR %.3f -> %.3f", rowsBefore.acmr, rowsAfter.acmr);
+
+	CDNL_TEST_CHECK(rowsAfter.acmr <= rowsBefore.acmr);
+}
+
+int main()
+{
+	TestShuffledGrid();
+	TestOptimizedInput();
+
+	return FinishTests("MESH OPTIMIZER TESTS");
+}
@@ -0,0 +1,105 @@
+#include "cardinal_pch.h"
+#include "cardinal.h"
+
+#include "core.h"
+
+#include "TestCommon.h"
+
+// Largest distance of a triangle centroid from the sphere's surface, how far the LOD strays from the shape it stands for
+static float MaxSphereDeviation(const std::vector<FBXVertex>& vertices, const uint32_t* indices, uint32_t indexCount, float radius)
+{
+	float deviation = 0.0f;
+
+	for (uint32_t i = 0; i < indexCount; i += 3)
+	{
+		Vec3 centroid;
+
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			const float* position = vertices[indices[i + corner]].position;
+
+			centroid += Vec3(position[0], position[1], position[2]) * (1.0f / 3.0f);
+		}
+
+		deviation = (std::max)(deviation, std::fabs(radius - centroid.Length()));
+	}
+
+	return deviation;
+}
+
+// A 20k triangle unit sphere, whose extent is 2: every LOD stays within SIMPLIFY_LOD_MAX_ERROR of the extent
+static void TestSphereLods()
+{
+	constexpr float RADIUS = 1.0f;
+	constexpr float EXTENT = 2.0f * RADIUS;
+
+	std::vector<FBXVertex> vertices;
+	std::vector<uint32_t> indices;
+
+	MakeSphere(100, 101, RADIUS, vertices, indices);
+
+	CDNL_TEST_CHECK(indices.size() == 20000 * 3);
+
+	MeshFileLod lods[MESH_FILE_MAX_LODS];
+
+	uint32_t lodCount = MeshSimplifier::GenerateLods(vertices, indices, MESH_FILE_MAX_LODS, lods);
+
+	CDNL_TEST_CHECK(lodCount > 1);
+
+	float tessellationDeviation = MaxSphereDeviation(vertices, indices.data(), lods[0].indexCount, RADIUS);
+
+	for (uint32_t lod = 0; lod < lodCount; lod++)
+	{
+		float deviation = MaxSphereDeviation(vertices, indices.data() + lods[lod].firstIndex, lods[lod].indexCount, RADIUS);
+
+		Logger::Info("SPHERE LOD %u: %u TRIANGLES, ERROR %.4f (%.2f%% OF THE EXTENT), CENTROID DEVIATION %.4f", lod, lods[lod].indexCount / 3, lods[lod].error, lods[lod].error / EXTENT * 100.0f, deviation);
+
+		// Reported errors are object space and bounded by the chain's limit
+		CDNL_TEST_CHECK(lods[lod].error <= SIMPLIFY_LOD_MAX_ERROR * EXTENT);
+		CDNL_TEST_CHECK(lod == 0 || lods[lod].error >= lods[lod - 1].error);
+		CDNL_TEST_CHECK(lod == 0 || lods[lod].indexCount < lods[lod - 1].indexCount);
+
+		// The quadric error is not an exact distance, but the surface must not stray past the chain's limit either,
+		// and the reported error has to track the actual deviation for LOD selection to be meaningful
+		CDNL_TEST_CHECK(deviation <= SIMPLIFY_LOD_MAX_ERROR * EXTENT);
+		CDNL_TEST_CHECK(deviation <= lods[lod].error * 1.5f + tessellationDeviation);
+	}
+}
+
+// Simplify stops at the error it is given even when the triangle target asks for more. The surface ends up within
+// about 15% of that error, the quadric measures distance to the original planes rather than to the surface.
+static void TestErrorLimit()
+{
+	constexpr float RADIUS = 3.0f;
+	constexpr float EXTENT = 2.0f * RADIUS;
+
+	std::vector<FBXVertex> vertices;
+	std::vector<uint32_t> indices;
+
+	MakeSphere(64, 65, RADIUS, vertices, indices);
+
+	float tessellationDeviation = MaxSphereDeviation(vertices, indices.data(), static_cast<uint32_t>(indices.size()), RADIUS);
+
+	for (float targetError : { 0.005f, 0.01f, 0.02f })
+	{
+		std::vector<uint32_t> result;
+
+		float error = MeshSimplifier::Simplify(vertices, indices, 0, targetError, result);
+
+		float deviation = MaxSphereDeviation(vertices, result.data(), static_cast<uint32_t>(result.size()), RADIUS);
+
+		Logger::Info("SPHERE SIMPLIFIED TO %zu TRIANGLES AT ERROR %.4f FOR A LIMIT OF %.4f, CENTROID DEVIATION %.4f", result.size() / 3, error, targetError * EXTENT, deviation);
+
+		CDNL_TEST_CHECK(!result.empty() && result.size() < indices.size());
+		CDNL_TEST_CHECK(error <= targetError * EXTENT);
+		CDNL_TEST_CHECK(deviation <= error * 1.5f + tessellationDeviation);
+	}
+}
+
+int main()
+{
+	TestSphereLods();
+	TestErrorLimit();
+
+	return FinishTests("MESH SIMPLIFIER TESTS");
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+// Minimal checks for the test executables: a failed check logs its location and the test's main returns nonzero
+inline uint32_t g_testFailures = 0;
+
+#define CDNL_TEST_CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			Logger::Error("CHECK FAILED %s:%d: %s", __FILE__, __LINE__, #condition); \
+			g_testFailures++; \
+		} \
+	} while (0)
+
+// Flushes the log and turns the failures into the exit code
+inline int FinishTests(const char* name)
+{
+	if (g_testFailures == 0)
+	{
+		Logger::Info("%s PASSED", name);
+	}
+	else
+	{
+		Logger::Error("%s FAILED WITH %u FAILED CHECKS", name, g_testFailures);
+	}
+
+	Logger::Flush();
+
+	return g_testFailures == 0 ? 0 : 1;
+}
+
+// Deterministic generator for shuffling fixtures, so failures reproduce
+struct TestRandom
+{
+	uint32_t state = 0x9E3779B9u;
+
+	uint32_t Next()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+
+		return state;
+	}
+};
+
+// size x size quads in the XY plane as triangle soup, one vertex per corner, triangles in random order
+inline void MakeShuffledGridSoup(uint32_t size, std::vector<FBXVertex>& vertices, std::vector<uint32_t>& indices)
+{
+	// Corners as grid point ids, three per triangle
+	std::vector<uint32_t> corners;
+
+	auto gridIndex = [size](uint32_t x, uint32_t y) { return y * (size + 1) + x; };
+
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+		{
+			corners.insert(corners.end(), { gridIndex(x, y), gridIndex(x + 1, y), gridIndex(x + 1, y + 1) });
+			corners.insert(corners.end(), { gridIndex(x, y), gridIndex(x + 1, y + 1), gridIndex(x, y + 1) });
+		}
+	}
+
+	TestRandom random;
+
+	for (size_t i = corners.size() / 3 - 1; i > 0; i--)
+	{
+		std::swap_ranges(corners.begin() + i * 3, corners.begin() + i * 3 + 3, corners.begin() + (random.Next() % (i + 1)) * 3);
+	}
+
+	vertices.clear();
+	indices.clear();
+
+	for (uint32_t corner : corners)
+	{
+		FBXVertex vertex{};
+		vertex.position[0] = static_cast<float>(corner % (size + 1));
+		vertex.position[1] = static_cast<float>(corner / (size + 1));
+		vertex.normal[2] = 1.0f;
+		vertex.uv[0] = vertex.position[0] / size;
+		vertex.uv[1] = vertex.position[1] / size;
+
+		indices.push_back(static_cast<uint32_t>(vertices.size()));
+		vertices.push_back(vertex);
+	}
+}
+// Indexed UV sphere of the given radius, closed at the poles, counter-clockwise seen from outside
+inline void MakeSphere(uint32_t segments, uint32_t rings, float radius, std::vector<FBXVertex>& vertices, std::vector<uint32_t>& indices)
+{
+	constexpr float PI = 3.14159265358979f;
+
+	vertices.clear();
+	indices.clear();
+
+	// One vertex per pole, so the sphere has no open border or seam at the poles
+	auto addVertex = [&](float theta, float phi)
+	{
+		FBXVertex vertex{};
+		vertex.normal[0] = std::sin(theta) * std::cos(phi);
+		vertex.normal[1] = std::cos(theta);
+		vertex.normal[2] = std::sin(theta) * std::sin(phi);
+
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			vertex.position[axis] = vertex.normal[axis] * radius;
+		}
+
+		vertices.push_back(vertex);
+	};
+
+	addVertex(0.0f, 0.0f);
+
+	for (uint32_t ring = 1; ring < rings; ring++)
+	{
+		for (uint32_t segment = 0; segment < segments; segment++)
+		{
+			addVertex(PI * ring / rings, 2.0f * PI * segment / segments);
+		}
+	}
+
+	addVertex(PI, 0.0f);
+
+	uint32_t bottom = static_cast<uint32_t>(vertices.size() - 1);
+
+	auto ringVertex = [segments](uint32_t ring, uint32_t segment) { return 1 + (ring - 1) * segments + segment % segments; };
+
+	for (uint32_t segment = 0; segment < segments; segment++)
+	{
+		indices.insert(indices.end(), { 0, ringVertex(1, segment + 1), ringVertex(1, segment) });
+		indices.insert(indices.end(), { bottom, ringVertex(rings - 1, segment), ringVertex(rings - 1, segment + 1) });
+	}
+
+	for (uint32_t ring = 1; ring + 1 < rings; ring++)
+	{
+		for (uint32_t segment = 0; segment < segments; segment++)
+		{
+			uint32_t a = ringVertex(ring, segment), b = ringVertex(ring, segment + 1);
+			uint32_t c = ringVertex(ring + 1, segment), d = ringVertex(ring + 1, segment + 1);
+
+			indices.insert(indices.end(), { a, b, d });
+			indices.insert(indices.end(), { a, d, c });
+		}
+	}
+}